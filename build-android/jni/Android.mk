@@ -57,6 +57,11 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := VkLayer_screenshot
 LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot.cpp
 LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot_parsing.cpp
+LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot_bands.cpp
+LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot_convert.cpp
+LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot_encode.cpp
+LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot_hash.cpp
+LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/screenshot_shm.cpp
 LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/vk_layer_table.cpp
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(THIRD_PARTY)/Vulkan-Headers/include \
                     $(LOCAL_PATH)/$(LVL_DIR)/layers \
@@ -66,16 +71,16 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(THIRD_PARTY)/Vulkan-Headers/include \
 LOCAL_STATIC_LIBRARIES += layer_utils
 LOCAL_CPPFLAGS += -std=c++11 -Wall -Werror -Wno-unused-function -Wno-unused-const-variable -mxgot
 LOCAL_CPPFLAGS += -DVK_ENABLE_BETA_EXTENSIONS -DVK_USE_PLATFORM_ANDROID_KHR -DVK_PROTOTYPES -fvisibility=hidden
-LOCAL_LDLIBS    := -llog
+LOCAL_CPPFLAGS += -DSCREENSHOT_USE_ZLIB
+LOCAL_LDLIBS    := -llog -lz
 include $(BUILD_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
 LOCAL_MODULE := VkLayer_device_simulation
 LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/device_simulation.cpp
+LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/device_simulation_json.cpp
 LOCAL_SRC_FILES += $(SRC_DIR)/layersvt/vk_layer_table.cpp
-LOCAL_SRC_FILES += $(ANDROID_DIR)/third_party/jsoncpp/dist/jsoncpp.cpp
-LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(ANDROID_DIR)/third_party/jsoncpp/dist \
-                    $(LOCAL_PATH)/$(THIRD_PARTY)/Vulkan-Headers/include \
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(THIRD_PARTY)/Vulkan-Headers/include \
                     $(LOCAL_PATH)/$(LVL_DIR)/layers \
                     $(LOCAL_PATH)/$(LVL_DIR)/layers/generated \
                     $(LOCAL_PATH)/$(SRC_DIR)/layersvt \
@@ -34,11 +34,13 @@
 #include "vk_layer_utils.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <fstream>
 #include <mutex>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <ostream>
 #include <sstream>
 #include <string.h>
@@ -679,6 +681,193 @@ const char *const ApiDumpSettings::SPACES =
     "                  ";
 const char *const ApiDumpSettings::TABS = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
 
+// Hash map striped over a fixed number of independently locked shards. Used for state keyed by Vulkan
+// handles that is read and written from many threads, where a single lock would serialize every call.
+template <typename Key, typename Value, typename Hash = std::hash<Key> >
+class ShardedMap {
+   public:
+    // Returns true if the key was not present before.
+    bool insertOrAssign(const Key &key, const Value &value) {
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> lg(shard.mutex);
+        auto inserted = shard.map.insert(std::make_pair(key, value));
+        if (!inserted.second) inserted.first->second = value;
+        return inserted.second;
+    }
+
+    // Returns true if the key was present.
+    bool erase(const Key &key) {
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> lg(shard.mutex);
+        return shard.map.erase(key) > 0;
+    }
+
+    // Removes the key and hands its value back to the caller. Returns false if the key was not present.
+    bool extract(const Key &key, Value &value) {
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> lg(shard.mutex);
+        const auto it = shard.map.find(key);
+        if (it == shard.map.end()) return false;
+        value = std::move(it->second);
+        shard.map.erase(it);
+        return true;
+    }
+
+    bool find(const Key &key, Value &value) const {
+        const Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> lg(shard.mutex);
+        const auto it = shard.map.find(key);
+        if (it == shard.map.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+   private:
+    static const size_t SHARD_COUNT_LOG2 = 6;
+    static const size_t SHARD_COUNT = 1 << SHARD_COUNT_LOG2;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+
+    // Handles are frequently aligned pointers, so mix all the bits before picking a shard.
+    inline static size_t shardIndex(const Key &key) {
+        return static_cast<size_t>((static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull) >> (64 - SHARD_COUNT_LOG2));
+    }
+    inline Shard &shardFor(const Key &key) { return shards[shardIndex(key)]; }
+    inline const Shard &shardFor(const Key &key) const { return shards[shardIndex(key)]; }
+
+    Shard shards[SHARD_COUNT];
+};
+
+// The names of the handles that the current call of this thread destroys or frees. They are taken out of
+// the name map before the call goes down the chain, because the driver may hand the same handle values out
+// again, to another thread, as soon as it returns. The call is still dumped with the names kept here.
+class ObjectNameMap;
+class ReleasedObjectNames {
+   public:
+    explicit ReleasedObjectNames(ObjectNameMap &map) : map(map), previous(current) { current = this; }
+    ~ReleasedObjectNames() { current = previous; }
+
+    void release(uint64_t handle);
+
+    static std::shared_ptr<const std::string> find(uint64_t handle) {
+        for (const ReleasedObjectNames *released = current; released != NULL; released = released->previous) {
+            for (const auto &entry : released->names) {
+                if (entry.first == handle) return entry.second;
+            }
+        }
+        return std::shared_ptr<const std::string>();
+    }
+
+   private:
+    ReleasedObjectNames(const ReleasedObjectNames &) = delete;
+    ReleasedObjectNames &operator=(const ReleasedObjectNames &) = delete;
+
+    ObjectNameMap &map;
+    ReleasedObjectNames *previous;
+    std::vector<std::pair<uint64_t, std::shared_ptr<const std::string> > > names;
+
+    static thread_local ReleasedObjectNames *current;
+};
+
+thread_local ReleasedObjectNames *ReleasedObjectNames::current = NULL;
+
+// Maps object handles to the names given by vkSetDebugUtilsObjectNameEXT/vkDebugMarkerSetObjectNameEXT.
+// Names are interned, so objects sharing a name share one string, and the lookup is skipped entirely
+// until the application names its first object.
+class ObjectNameMap {
+   public:
+    // A NULL or empty name removes the name, as vkSetDebugUtilsObjectNameEXT specifies.
+    void set(uint64_t handle, const char *name) {
+        if (name == NULL || name[0] == '\0') {
+            erase(handle);
+            return;
+        }
+        if (names.insertOrAssign(handle, intern(name))) name_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void erase(uint64_t handle) {
+        if (name_count.load(std::memory_order_relaxed) == 0) return;
+        if (names.erase(handle)) name_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Removes the name of a handle and returns it, or NULL if the handle has no name.
+    std::shared_ptr<const std::string> extract(uint64_t handle) {
+        std::shared_ptr<const std::string> name;
+        if (name_count.load(std::memory_order_relaxed) == 0) return name;
+        if (names.extract(handle, name)) name_count.fetch_sub(1, std::memory_order_relaxed);
+        return name;
+    }
+
+    // Returns NULL if the handle has no name. The returned string stays valid even if the handle is
+    // renamed or destroyed concurrently. Handles the current call of this thread is destroying keep their
+    // names until it returns.
+    std::shared_ptr<const std::string> find(uint64_t handle) const {
+        std::shared_ptr<const std::string> name = ReleasedObjectNames::find(handle);
+        if (!name && name_count.load(std::memory_order_relaxed) != 0) names.find(handle, name);
+        return name;
+    }
+
+   private:
+    std::shared_ptr<const std::string> intern(const char *name) {
+        std::lock_guard<std::mutex> lg(intern_mutex);
+        std::weak_ptr<const std::string> &entry = interned_names[name];
+        std::shared_ptr<const std::string> interned_name = entry.lock();
+        if (!interned_name) {
+            interned_name = std::make_shared<const std::string>(name);
+            entry = interned_name;
+        }
+
+        // Names whose objects were all destroyed only leave an expired entry behind. Sweep those once
+        // the table has doubled in size since the last sweep, so the amortized cost stays constant.
+        if (interned_names.size() >= 2 * intern_sweep_size) {
+            for (auto it = interned_names.begin(); it != interned_names.end();) {
+                if (it->second.expired())
+                    it = interned_names.erase(it);
+                else
+                    ++it;
+            }
+            intern_sweep_size = std::max(interned_names.size(), static_cast<size_t>(INTERN_SWEEP_MIN));
+        }
+        return interned_name;
+    }
+
+    static const size_t INTERN_SWEEP_MIN = 1024;
+
+    ShardedMap<uint64_t, std::shared_ptr<const std::string> > names;
+    std::atomic<size_t> name_count{0};
+
+    std::mutex intern_mutex;
+    std::unordered_map<std::string, std::weak_ptr<const std::string> > interned_names;
+    size_t intern_sweep_size = INTERN_SWEEP_MIN;
+};
+
+inline void ReleasedObjectNames::release(uint64_t handle) {
+    std::shared_ptr<const std::string> name = map.extract(handle);
+    if (name) names.emplace_back(handle, std::move(name));
+}
+
+// Command buffers allocated from one pool. Command pools are externally synchronized, so the
+// contents are only touched by the thread that currently owns the pool.
+struct CmdPoolState {
+    std::unordered_set<VkCommandBuffer> cmd_buffers;
+};
+
+// Descriptor sets allocated from one pool, whose names are dropped when the pool is reset or destroyed.
+// Descriptor pools are externally synchronized too.
+struct DescriptorPoolState {
+    std::unordered_set<VkDescriptorSet> descriptor_sets;
+};
+
+template <typename Pool>
+struct PoolKeyHash {
+    size_t operator()(const std::pair<VkDevice, Pool> &key) const {
+        return std::hash<uint64_t>()((uint64_t)key.first ^ ((uint64_t)key.second * 0x9E3779B97F4A7C15ull));
+    }
+};
+
 class ApiDumpInstance {
    public:
     inline ApiDumpInstance() : dump_settings(NULL), frame_count(0), thread_count(0) {
@@ -750,53 +939,97 @@ class ApiDumpInstance {
     }
 
     inline VkCommandBufferLevel getCmdBufferLevel(VkCommandBuffer cmd_buffer) {
-        std::lock_guard<std::recursive_mutex> lg(cmd_buffer_state_mutex);
-        const auto level_iter = cmd_buffer_level.find(cmd_buffer);
-        assert(level_iter != cmd_buffer_level.end());
-        const auto level = level_iter->second;
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        const bool found = cmd_buffer_levels.find(cmd_buffer, level);
+        assert(found);
+        (void)found;
         return level;
     }
 
-    inline void eraseCmdBuffers(VkDevice device, VkCommandPool cmd_pool, std::vector<VkCommandBuffer> cmd_buffers) {
-        cmd_buffers.erase(std::remove(cmd_buffers.begin(), cmd_buffers.end(), nullptr), cmd_buffers.end());
-        if (!cmd_buffers.empty()) {
-            std::lock_guard<std::recursive_mutex> lg(cmd_buffer_state_mutex);
+    inline void eraseCmdBuffers(VkDevice device, VkCommandPool cmd_pool, const VkCommandBuffer *cmd_buffers,
+                                uint32_t cmd_buffer_count) {
+        if (cmd_buffers == nullptr || cmd_buffer_count == 0) return;
 
-            const auto pool_cmd_buffers_iter = cmd_buffer_pools.find(std::make_pair(device, cmd_pool));
-            assert(pool_cmd_buffers_iter != cmd_buffer_pools.end());
+        std::shared_ptr<CmdPoolState> pool_state;
+        const bool found = cmd_pools.find(std::make_pair(device, cmd_pool), pool_state);
+        assert(found);
+        (void)found;
 
-            for (const auto cmd_buffer : cmd_buffers) {
-                pool_cmd_buffers_iter->second.erase(cmd_buffer);
+        for (uint32_t i = 0; i < cmd_buffer_count; ++i) {
+            if (cmd_buffers[i] == nullptr) continue;
+            if (pool_state) pool_state->cmd_buffers.erase(cmd_buffers[i]);
 
-                assert(cmd_buffer_level.count(cmd_buffer) > 0);
-                cmd_buffer_level.erase(cmd_buffer);
-            }
+            const bool erased = cmd_buffer_levels.erase(cmd_buffers[i]);
+            assert(erased);
+            (void)erased;
         }
     }
 
-    inline void addCmdBuffers(VkDevice device, VkCommandPool cmd_pool, std::vector<VkCommandBuffer> cmd_buffers,
-                              VkCommandBufferLevel level) {
-        std::lock_guard<std::recursive_mutex> lg(cmd_buffer_state_mutex);
-        auto &pool_cmd_buffers = cmd_buffer_pools[std::make_pair(device, cmd_pool)];
-        pool_cmd_buffers.insert(cmd_buffers.begin(), cmd_buffers.end());
+    inline void addCmdBuffers(VkDevice device, VkCommandPool cmd_pool, const VkCommandBuffer *cmd_buffers,
+                              uint32_t cmd_buffer_count, VkCommandBufferLevel level) {
+        const auto key = std::make_pair(device, cmd_pool);
+        std::shared_ptr<CmdPoolState> pool_state;
+        if (!cmd_pools.find(key, pool_state)) {
+            pool_state = std::make_shared<CmdPoolState>();
+            cmd_pools.insertOrAssign(key, pool_state);
+        }
+        pool_state->cmd_buffers.insert(cmd_buffers, cmd_buffers + cmd_buffer_count);
 
-        for (const auto cmd_buffer : cmd_buffers) {
-            assert(cmd_buffer_level.count(cmd_buffer) == 0);
-            cmd_buffer_level[cmd_buffer] = level;
+        for (uint32_t i = 0; i < cmd_buffer_count; ++i) {
+            const bool inserted = cmd_buffer_levels.insertOrAssign(cmd_buffers[i], level);
+            assert(inserted);
+            (void)inserted;
         }
     }
 
-    inline void eraseCmdBufferPool(VkDevice device, VkCommandPool cmd_pool) {
+    inline void eraseCmdBufferPool(VkDevice device, VkCommandPool cmd_pool, ReleasedObjectNames &released_names) {
         if (cmd_pool != VK_NULL_HANDLE) {
-            std::lock_guard<std::recursive_mutex> lg(cmd_buffer_state_mutex);
-
-            const auto cmd_buffers_iter = cmd_buffer_pools.find(std::make_pair(device, cmd_pool));
-            if (cmd_buffers_iter != cmd_buffer_pools.end()) {
-                for (const auto cmd_buffer : cmd_buffers_iter->second) {
-                    assert(cmd_buffer_level.count(cmd_buffer) > 0);
-                    cmd_buffer_level.erase(cmd_buffer);
+            std::shared_ptr<CmdPoolState> pool_state;
+            if (cmd_pools.extract(std::make_pair(device, cmd_pool), pool_state)) {
+                for (const auto cmd_buffer : pool_state->cmd_buffers) {
+                    const bool erased = cmd_buffer_levels.erase(cmd_buffer);
+                    assert(erased);
+                    (void)erased;
+                    released_names.release((uint64_t)cmd_buffer);
                 }
-                cmd_buffers_iter->second.clear();
+            }
+        }
+    }
+
+    inline void addDescriptorSets(VkDevice device, VkDescriptorPool descriptor_pool, const VkDescriptorSet *descriptor_sets,
+                                  uint32_t descriptor_set_count) {
+        const auto key = std::make_pair(device, descriptor_pool);
+        std::shared_ptr<DescriptorPoolState> pool_state;
+        if (!descriptor_pools.find(key, pool_state)) {
+            pool_state = std::make_shared<DescriptorPoolState>();
+            descriptor_pools.insertOrAssign(key, pool_state);
+        }
+        pool_state->descriptor_sets.insert(descriptor_sets, descriptor_sets + descriptor_set_count);
+    }
+
+    inline void eraseDescriptorSets(VkDevice device, VkDescriptorPool descriptor_pool, const VkDescriptorSet *descriptor_sets,
+                                    uint32_t descriptor_set_count) {
+        if (descriptor_sets == nullptr || descriptor_set_count == 0) return;
+
+        std::shared_ptr<DescriptorPoolState> pool_state;
+        if (!descriptor_pools.find(std::make_pair(device, descriptor_pool), pool_state)) return;
+        for (uint32_t i = 0; i < descriptor_set_count; ++i) pool_state->descriptor_sets.erase(descriptor_sets[i]);
+    }
+
+    // Resetting or destroying a pool frees all of its descriptor sets.
+    inline void resetDescriptorPool(VkDevice device, VkDescriptorPool descriptor_pool, ReleasedObjectNames &released_names) {
+        std::shared_ptr<DescriptorPoolState> pool_state;
+        if (descriptor_pools.find(std::make_pair(device, descriptor_pool), pool_state)) {
+            for (const auto descriptor_set : pool_state->descriptor_sets) released_names.release((uint64_t)descriptor_set);
+            pool_state->descriptor_sets.clear();
+        }
+    }
+
+    inline void eraseDescriptorPool(VkDevice device, VkDescriptorPool descriptor_pool, ReleasedObjectNames &released_names) {
+        if (descriptor_pool != VK_NULL_HANDLE) {
+            std::shared_ptr<DescriptorPoolState> pool_state;
+            if (descriptor_pools.extract(std::make_pair(device, descriptor_pool), pool_state)) {
+                for (const auto descriptor_set : pool_state->descriptor_sets) released_names.release((uint64_t)descriptor_set);
             }
         }
     }
@@ -808,7 +1041,7 @@ class ApiDumpInstance {
 
     static inline ApiDumpInstance &current() { return current_instance; }
 
-    std::unordered_map<uint64_t, std::string> object_name_map;
+    ObjectNameMap object_name_map;
 
    private:
     static ApiDumpInstance current_instance;
@@ -824,9 +1057,10 @@ class ApiDumpInstance {
     uint32_t thread_count;
     uint64_t thread_id = UINT64_MAX;
 
-    std::recursive_mutex cmd_buffer_state_mutex;
-    std::map<std::pair<VkDevice, VkCommandPool>, std::unordered_set<VkCommandBuffer> > cmd_buffer_pools;
-    std::unordered_map<VkCommandBuffer, VkCommandBufferLevel> cmd_buffer_level;
+    ShardedMap<std::pair<VkDevice, VkCommandPool>, std::shared_ptr<CmdPoolState>, PoolKeyHash<VkCommandPool> > cmd_pools;
+    ShardedMap<VkCommandBuffer, VkCommandBufferLevel> cmd_buffer_levels;
+    ShardedMap<std::pair<VkDevice, VkDescriptorPool>, std::shared_ptr<DescriptorPoolState>, PoolKeyHash<VkDescriptorPool> >
+        descriptor_pools;
 
     bool conditional_initialized = false;
     bool should_dump_output = true;
@@ -42,21 +42,38 @@
 #include <stdlib.h>
 #include <cinttypes>
 #include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <fstream>
+#include <iterator>
 #include <mutex>
 #include <sstream>
-
-#include <json/json.h>  // https://github.com/open-source-parsers/jsoncpp
+#include <thread>
 
 #include "vulkan/vk_layer.h"
 #include "vulkan/vulkan_beta.h"
 #include "vk_layer_config.h"
 #include "vk_layer_table.h"
+#include "device_simulation_json.h"
 
 namespace {
 
@@ -298,6 +315,14 @@ const char *const kEnvarDevsimModifyExtensionList =
     "debug.vulkan.devsim.modifyextensionlist";  // a non-zero integer will enable modifying device extensions list.
 const char *const kEnvarDevsimModifyMemoryFlags =
     "debug.vulkan.devsim.modifymemoryflags";  // a non-zero integer will enable modifying device memory flags.
+const char *const kEnvarDevsimProfileCache =
+    "debug.vulkan.devsim.profilecache";  // zero will disable the cache of simulated device configurations.
+const char *const kEnvarDevsimFilenameMap =
+    "debug.vulkan.devsim.filenamemap";  // configuration file(s) to load for selected physical devices.
+const char *const kEnvarDevsimMemoryBudget =
+    "debug.vulkan.devsim.memorybudget";  // a non-zero integer will enable simulated memory heap budgets.
+const char *const kEnvarDevsimHotReload =
+    "debug.vulkan.devsim.hotreload";  // a non-zero integer will enable reloading the configuration files when they change.
 #else
 const char *const kEnvarDevsimFilename = "VK_DEVSIM_FILENAME";          // path of the configuration file(s) to load.
 const char *const kEnvarDevsimDebugEnable = "VK_DEVSIM_DEBUG_ENABLE";   // a non-zero integer will enable debugging output.
@@ -309,6 +334,14 @@ const char *const kEnvarDevsimModifyExtensionList =
     "VK_DEVSIM_MODIFY_EXTENSION_LIST";  // a non-zero integer will enable modifying device extensions list.
 const char *const kEnvarDevsimModifyMemoryFlags =
     "VK_DEVSIM_MODIFY_MEMORY_FLAGS";  // a non-zero integer will enable modifying device memory flags.
+const char *const kEnvarDevsimProfileCache =
+    "VK_DEVSIM_PROFILE_CACHE";  // zero will disable the cache of simulated device configurations.
+const char *const kEnvarDevsimFilenameMap =
+    "VK_DEVSIM_FILENAME_MAP";  // configuration file(s) to load for selected physical devices.
+const char *const kEnvarDevsimMemoryBudget =
+    "VK_DEVSIM_MEMORY_BUDGET";  // a non-zero integer will enable simulated memory heap budgets.
+const char *const kEnvarDevsimHotReload =
+    "VK_DEVSIM_HOT_RELOAD";  // a non-zero integer will enable reloading the configuration files when they change.
 #endif
 
 const char *const kLayerSettingsDevsimFilename =
@@ -326,6 +359,18 @@ const char *const kLayerSettingsDevsimModifyExtensionList =
 const char *const kLayerSettingsDevsimModifyMemoryFlags =
     "lunarg_device_simulation.modify_memory_flags";  // vk_layer_settings.txt equivalent for kEnvarDevsimModifyMemoryFlags
 
+const char *const kLayerSettingsDevsimProfileCache =
+    "lunarg_device_simulation.profile_cache";  // vk_layer_settings.txt equivalent for kEnvarDevsimProfileCache
+
+const char *const kLayerSettingsDevsimFilenameMap =
+    "lunarg_device_simulation.filename_map";  // vk_layer_settings.txt equivalent for kEnvarDevsimFilenameMap
+
+const char *const kLayerSettingsDevsimMemoryBudget =
+    "lunarg_device_simulation.memory_budget";  // vk_layer_settings.txt equivalent for kEnvarDevsimMemoryBudget
+
+const char *const kLayerSettingsDevsimHotReload =
+    "lunarg_device_simulation.hot_reload";  // vk_layer_settings.txt equivalent for kEnvarDevsimHotReload
+
 struct IntSetting {
     int num;
     bool fromEnvVar;
@@ -342,6 +387,10 @@ struct IntSetting errorLevel;
 struct IntSetting emulatePortability;
 struct IntSetting modifyExtensionList;
 struct IntSetting modifyMemoryFlags;
+struct IntSetting profileCache;
+struct StringSetting filenameMap;
+struct IntSetting memoryBudget;
+struct IntSetting hotReload;
 
 // Various small utility functions ///////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -438,7 +487,10 @@ void DebugPrintf(const char *fmt, ...) {
     }
 }
 
+std::atomic<uint32_t> errorCount(0);  // Number of errors reported by ErrorPrintf().
+
 void ErrorPrintf(const char *fmt, ...) {
+    ++errorCount;
 #if !defined(__ANDROID__)
     fprintf(stderr, "\tERROR devsim ");
 #endif
@@ -474,6 +526,82 @@ VkResult EnumerateAll(std::vector<T> *vect, std::function<VkResult(uint32_t *, T
     return result;
 }
 
+// Split a list of configuration files, as found in kEnvarDevsimFilename, into the names of the files.
+std::vector<std::string> SplitFilenameList(const char *filename_list) {
+#if defined(_WIN32)
+    const char delimiter = ';';
+#else
+    const char delimiter = ':';
+#endif
+    std::stringstream ss_list(filename_list);
+    std::string filename;
+
+    std::vector<std::string> filenames;
+    while (std::getline(ss_list, filename, delimiter)) {
+        if (!filename.empty()) {
+            filenames.push_back(filename);
+        }
+    }
+    return filenames;
+}
+
+// A file mapped read-only into memory.  On Windows it is read into memory instead.  data() is nullptr if the file could not be
+// opened or is empty.
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string &path) {
+#if defined(_WIN32)
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            opened_ = true;
+            buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            if (!buffer_.empty()) {
+                data_ = buffer_.data();
+                size_ = buffer_.size();
+            }
+        }
+#else
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        opened_ = true;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data_ = static_cast<const char *>(mapping);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (data_) {
+            munmap(const_cast<char *>(data_), size_);
+        }
+#endif
+    }
+
+    bool opened() const { return opened_; }
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+   private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool opened_ = false;
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    std::vector<char> buffer_;
+#endif
+};
+
 // Global variables //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 std::mutex global_lock;  // Enforce thread-safety for this layer.
@@ -481,20 +609,12 @@ std::mutex global_lock;  // Enforce thread-safety for this layer.
 uint32_t loader_layer_iface_version = CURRENT_LOADER_LAYER_INTERFACE_VERSION;
 
 typedef std::vector<VkQueueFamilyProperties> ArrayOfVkQueueFamilyProperties;
-typedef std::unordered_map<uint32_t /*VkFormat*/, VkFormatProperties> ArrayOfVkFormatProperties;
 typedef std::vector<VkLayerProperties> ArrayOfVkLayerProperties;
 typedef std::vector<VkExtensionProperties> ArrayOfVkExtensionProperties;
 
 // FormatProperties utilities ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// This is the JSON representation of VkFormat property data, as defined by the Devsim schema.
-// It will be split to create a VkFormat value and a VkFormatProperties structure after loading from JSON.
-struct DevsimFormatProperties {
-    VkFormat formatID;
-    VkFormatFeatureFlags linearTilingFeatures;
-    VkFormatFeatureFlags optimalTilingFeatures;
-    VkFormatFeatureFlags bufferFeatures;
-};
+using devsim::DevsimFormatProperties;
 
 bool IsFormatSupported(const VkFormatProperties &props) {
     // Per [SPEC] section 30.3.2 "Format Properties":
@@ -502,8 +622,163 @@ bool IsFormatSupported(const VkFormatProperties &props) {
     return !(!props.linearTilingFeatures && !props.optimalTilingFeatures && !props.bufferFeatures);
 }
 
+// The VkFormatProperties of the supported formats, in a dense table indexed by VkFormat.
+// Core formats have values below 1000, and the formats of extension n have the values 1000000000 + 1000 * (n - 1) + offset,
+// so the table is split in blocks of up to 1000 formats: block 0 for the core formats and block n for those of extension n.
+// Each block only spans up to its last supported format, and unsupported formats have all their feature flags cleared.
+class FormatPropertiesTable {
+   public:
+    // Replace the contents of the table with the supported formats of the list.  Only the first entry of a format is kept.
+    void Assign(const std::vector<std::pair<VkFormat, VkFormatProperties>> &formats) {
+        blocks_.clear();
+        entries_.clear();
+        size_ = 0;
+        for (const auto &format : formats) {
+            const uint32_t block = BlockOf(format.first);
+            if (IsFormatSupported(format.second) && block < kMaxBlockCount) {
+                if (block >= blocks_.size()) {
+                    blocks_.resize(block + 1, Block{0, 0});
+                }
+                blocks_[block].count = std::max(blocks_[block].count, OffsetOf(format.first) + 1);
+            }
+        }
+        uint32_t entry_count = 0;
+        for (auto &block : blocks_) {
+            block.first = entry_count;
+            entry_count += block.count;
+        }
+
+        entries_.resize(entry_count, VkFormatProperties{});
+        for (const auto &format : formats) {
+            const uint32_t block = BlockOf(format.first);
+            if (IsFormatSupported(format.second) && block < kMaxBlockCount) {
+                VkFormatProperties &entry = entries_[blocks_[block].first + OffsetOf(format.first)];
+                if (!IsFormatSupported(entry)) {
+                    entry = format.second;
+                    ++size_;
+                }
+            }
+        }
+    }
+
+    // The properties of format, with no feature flags if it is not supported.
+    VkFormatProperties Get(VkFormat format) const {
+        const uint32_t block = BlockOf(format);
+        const uint32_t offset = OffsetOf(format);
+        if (block < blocks_.size() && offset < blocks_[block].count) {
+            return entries_[blocks_[block].first + offset];
+        }
+        return VkFormatProperties{};
+    }
+
+    // Number of supported formats.
+    size_t size() const { return size_; }
+
+    // Whether format can be stored in the table.  Other values are not valid VkFormat values.
+    static bool IsInRange(VkFormat format) { return BlockOf(format) < kMaxBlockCount; }
+
+   private:
+    friend class ProfileCache;
+
+    static const uint32_t kBlockSize = 1000;
+    static const uint32_t kExtensionFormatBase = 1000000000;
+    static const uint32_t kMaxBlockCount = 1024;
+
+    static uint32_t BlockOf(VkFormat format) {
+        const uint32_t value = static_cast<uint32_t>(format);
+        if (value < kExtensionFormatBase) {
+            return (value < kBlockSize) ? 0 : UINT32_MAX;
+        }
+        return (value - kExtensionFormatBase) / kBlockSize + 1;
+    }
+
+    static uint32_t OffsetOf(VkFormat format) { return static_cast<uint32_t>(format) % kBlockSize; }
+
+    struct Block {
+        uint32_t first;  // index in entries_ of the first format of the block
+        uint32_t count;
+    };
+
+    std::vector<Block> blocks_;
+    std::vector<VkFormatProperties> entries_;
+    size_t size_ = 0;
+};
+
+typedef FormatPropertiesTable ArrayOfVkFormatProperties;
+
 // PhysicalDeviceData : creates and manages the simulated device configurations //////////////////////////////////////////////////
 
+// The memory allocated from each heap of a physical device by all of its logical devices, when heap budgets are simulated.
+struct MemoryHeapUsage {
+    MemoryHeapUsage() {
+        for (auto &heap : heaps) {
+            heap.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<VkDeviceSize> heaps[VK_MAX_MEMORY_HEAPS];
+};
+
+// Frees the data that the lock-free readers of PhysicalDeviceData and DeviceData may still be using, once no reader can be.
+// A reader registers with the epoch current when it starts.  Retire() starts a new epoch whenever the readers of the previous
+// one are gone: the readers left then started after the data retired before the current epoch had been replaced, so that data
+// is freed.  Retire() is called with global_lock held, and never waits for the readers.
+class Reclaimer {
+   public:
+    Reclaimer() {
+        epoch_.store(0, std::memory_order_relaxed);
+        for (auto &readers : readers_) {
+            readers.store(0, std::memory_order_relaxed);
+        }
+    }
+    Reclaimer(const Reclaimer &) = delete;
+    Reclaimer &operator=(const Reclaimer &) = delete;
+
+    // Registers a reader for as long as it is in scope.  The epoch is checked again once the reader is counted, so that it is
+    // never counted with an epoch that Retire() has already left.
+    class Reader {
+       public:
+        explicit Reader(Reclaimer &reclaimer) {
+            for (;;) {
+                const uint32_t epoch = reclaimer.epoch_.load();
+                readers_ = &reclaimer.readers_[epoch & 1];
+                readers_->fetch_add(1);
+                if (reclaimer.epoch_.load() == epoch) {
+                    break;
+                }
+                readers_->fetch_sub(1, std::memory_order_release);
+            }
+        }
+        ~Reader() { readers_->fetch_sub(1, std::memory_order_release); }
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+       private:
+        std::atomic<uint32_t> *readers_;
+    };
+
+    // Take data that new readers can no longer reach, and free what no reader can still be using.
+    void Retire(std::shared_ptr<const void> data) {
+        const uint32_t epoch = epoch_.load();
+        if (data) {
+            retired_.emplace_back(epoch, std::move(data));
+        }
+        if (readers_[(epoch + 1) & 1].load() == 0) {
+            retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                          [epoch](const std::pair<uint32_t, std::shared_ptr<const void>> &entry) {
+                                              return entry.first != epoch;
+                                          }),
+                           retired_.end());
+            epoch_.store(epoch + 1);
+        }
+    }
+
+   private:
+    std::atomic<uint32_t> epoch_;
+    std::atomic<uint32_t> readers_[2];
+    std::vector<std::pair<uint32_t, std::shared_ptr<const void>>> retired_;
+};
+
 class PhysicalDeviceData {
    public:
     // Create a new PDD element during vkCreateInstance(), and preserve in map, indexed by physical_device.
@@ -525,18 +800,55 @@ class PhysicalDeviceData {
         assert(Find(pd));
         assert(global_lock.try_lock() == false);  // Verify mutex is already locked before modifying map_
         map_.erase(pd);
+        replacements_.erase(pd);
         DebugPrintf("PhysicalDeviceData::Destroy()\n");
     }
 
+    // Publish pdd in place of the PDD of pd, for the queries that follow, once its configuration files have been reloaded.  The
+    // PDD it replaces is freed once no query can still be reading it.
+    static void Replace(VkPhysicalDevice pd, std::unique_ptr<const PhysicalDeviceData> pdd) {
+        assert(global_lock.try_lock() == false);  // Verify mutex is already locked before modifying replacements_
+        if (Find(pd)) {
+            replacements_[pd].swap(pdd);
+            Publish();
+            reclaimer_.Retire(std::move(pdd));
+        }
+    }
+
     // Find a PDD from our map, or nullptr if doesn't exist.
     static PhysicalDeviceData *Find(VkPhysicalDevice pd) {
         const auto iter = map_.find(pd);
         return (iter != map_.end()) ? &iter->second : nullptr;
     }
 
+    // Make the current PDDs visible to FindPublished(), once they have been populated or some of them destroyed.
+    static void Publish();
+
+    // Keeps the published PDDs from being freed while in scope.  The vkGetPhysicalDevice*() queries hold one for as long as
+    // they use the PDD that FindPublished() returns, as a reload may replace it meanwhile.
+    class Reader : public Reclaimer::Reader {
+       public:
+        Reader() : Reclaimer::Reader(reclaimer_) {}
+    };
+
+    // Find a published PDD without locking, or nullptr if doesn't exist.  Published PDDs are not modified, so that the
+    // vkGetPhysicalDevice*() queries can read them from any thread without taking global_lock.  Must be called with a Reader in
+    // scope.
+    static const PhysicalDeviceData *FindPublished(VkPhysicalDevice pd) {
+        const PublishedArray *published = published_.load(std::memory_order_acquire);
+        if (published) {
+            for (const auto &entry : *published) {
+                if (entry.first == pd) {
+                    return entry.second;
+                }
+            }
+        }
+        return nullptr;
+    }
+
     static bool HasExtension(VkPhysicalDevice pd, const char *extension_name) { return HasExtension(Find(pd), extension_name); }
 
-    static bool HasExtension(PhysicalDeviceData *pdd, const char *extension_name) {
+    static bool HasExtension(const PhysicalDeviceData *pdd, const char *extension_name) {
         for (const auto &ext_prop : pdd->device_extensions) {
             if (strncmp(extension_name, ext_prop.extensionName, VK_MAX_EXTENSION_NAME_SIZE) == 0) {
                 return true;
@@ -549,7 +861,7 @@ class PhysicalDeviceData {
         return HasSimulatedExtension(Find(pd), extension_name);
     }
 
-    static bool HasSimulatedExtension(PhysicalDeviceData *pdd, const char *extension_name) {
+    static bool HasSimulatedExtension(const PhysicalDeviceData *pdd, const char *extension_name) {
         for (const auto &ext_prop : pdd->arrayof_extension_properties_) {
             if (strncmp(extension_name, ext_prop.extensionName, VK_MAX_EXTENSION_NAME_SIZE) == 0) {
                 return true;
@@ -562,11 +874,12 @@ class PhysicalDeviceData {
         return HasSimulatedOrRealExtension(Find(pd), extension_name);
     }
 
-    static bool HasSimulatedOrRealExtension(PhysicalDeviceData *pdd, const char *extension_name) {
+    static bool HasSimulatedOrRealExtension(const PhysicalDeviceData *pdd, const char *extension_name) {
         return HasSimulatedExtension(pdd, extension_name) || HasExtension(pdd, extension_name);
     }
 
     VkInstance instance() const { return instance_; }
+    VkLayerInstanceDispatchTable *dispatch_table() const { return dispatch_table_; }
 
     std::vector<VkExtensionProperties> device_extensions;
 
@@ -582,10 +895,13 @@ class PhysicalDeviceData {
     VkPhysicalDevicePortabilitySubsetPropertiesKHR physical_device_portability_subset_properties_;
     VkPhysicalDevicePortabilitySubsetFeaturesKHR physical_device_portability_subset_features_;
 
+    // Shared with the logical devices of the physical device, and nullptr unless heap budgets are simulated.
+    std::shared_ptr<MemoryHeapUsage> heap_usage_;
+
    private:
     PhysicalDeviceData() = delete;
     PhysicalDeviceData &operator=(const PhysicalDeviceData &) = delete;
-    PhysicalDeviceData(VkInstance instance) : instance_(instance) {
+    PhysicalDeviceData(VkInstance instance) : instance_(instance), dispatch_table_(instance_dispatch_table(instance)) {
         physical_device_properties_ = {};
         physical_device_features_ = {};
         physical_device_memory_properties_ = {};
@@ -594,296 +910,333 @@ class PhysicalDeviceData {
     }
 
     const VkInstance instance_;
+    VkLayerInstanceDispatchTable *const dispatch_table_;
 
     typedef std::unordered_map<VkPhysicalDevice, PhysicalDeviceData> Map;
     static Map map_;
+
+    // The PDDs published in place of those of map_ by Replace().
+    static std::unordered_map<VkPhysicalDevice, std::unique_ptr<const PhysicalDeviceData>> replacements_;
+
+    // The PDDs of map_ as of the last Publish().  The arrays it replaces, and the PDDs that Replace() replaces, are freed by
+    // reclaimer_.
+    typedef std::vector<std::pair<VkPhysicalDevice, const PhysicalDeviceData *>> PublishedArray;
+    static std::atomic<const PublishedArray *> published_;
+    static Reclaimer reclaimer_;
 };
 
 PhysicalDeviceData::Map PhysicalDeviceData::map_;
+std::unordered_map<VkPhysicalDevice, std::unique_ptr<const PhysicalDeviceData>> PhysicalDeviceData::replacements_;
+std::atomic<const PhysicalDeviceData::PublishedArray *> PhysicalDeviceData::published_(nullptr);
+Reclaimer PhysicalDeviceData::reclaimer_;
+
+void PhysicalDeviceData::Publish() {
+    assert(global_lock.try_lock() == false);  // Verify mutex is already locked before reading map_
+    std::unique_ptr<PublishedArray> published;
+    if (!map_.empty()) {
+        published.reset(new PublishedArray);
+        for (const auto &entry : map_) {
+            const auto replacement = replacements_.find(entry.first);
+            published->emplace_back(entry.first,
+                                    (replacement != replacements_.end()) ? replacement->second.get() : &entry.second);
+        }
+    }
+    std::unique_ptr<const PublishedArray> superseded(published_.exchange(published.release(), std::memory_order_acq_rel));
+    reclaimer_.Retire(std::move(superseded));
+}
 
-// Loader for DevSim JSON configuration files ////////////////////////////////////////////////////////////////////////////////////
+// Get the dispatch table for a physical device.  A PDD keeps the table of its instance, which is otherwise looked up with
+// global_lock held.
+VkLayerInstanceDispatchTable *DispatchTable(const PhysicalDeviceData *pdd, VkPhysicalDevice physical_device) {
+    if (pdd) {
+        return pdd->dispatch_table();
+    }
+    std::lock_guard<std::mutex> lock(global_lock);
+    return instance_dispatch_table(physical_device);
+}
 
-class JsonLoader {
+// DeviceData : the logical devices, and the memory they allocate when heap budgets are simulated /////////////////////////////////
+
+class DeviceData {
    public:
-    JsonLoader(PhysicalDeviceData &pdd) : pdd_(pdd) {}
-    JsonLoader() = delete;
-    JsonLoader(const JsonLoader &) = delete;
-    JsonLoader &operator=(const JsonLoader &) = delete;
+    // Create a new DD during vkCreateDevice(), and preserve in map, indexed by device.
+    static DeviceData &Create(VkDevice device, VkLayerDispatchTable *dispatch_table) {
+        assert(device != VK_NULL_HANDLE);
+        assert(!map_.count(device));              // Verify this instance does not already exist.
+        assert(global_lock.try_lock() == false);  // Verify mutex is already locked before modifying map_
+        DeviceData *dd = new DeviceData(dispatch_table);
+        map_[device].reset(dd);
+        DebugPrintf("DeviceData::Create()\n");
+        return *dd;
+    }
 
-    bool LoadFiles();
-    bool LoadFiles(const char *filename_list);
-    bool LoadFile(const char *filename);
+    static void Destroy(VkDevice device) {
+        assert(map_.count(device));
+        assert(global_lock.try_lock() == false);  // Verify mutex is already locked before modifying map_
+        map_.erase(device);
+        DebugPrintf("DeviceData::Destroy()\n");
+    }
+
+    // Make the current DDs visible to FindPublished(), once one has been created or destroyed.
+    static void Publish();
+
+    // Find a published DD without locking, or nullptr if doesn't exist.  The memory allocations of a DD are the only part of it
+    // that changes, and they are accounted without global_lock.
+    static DeviceData *FindPublished(VkDevice device) {
+        const Reclaimer::Reader reader(reclaimer_);
+        const PublishedArray *published = published_.load(std::memory_order_acquire);
+        if (published) {
+            for (const auto &entry : *published) {
+                if (entry.first == device) {
+                    return entry.second;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // Release the memory that the device still has allocated.
+    ~DeviceData();
+
+    VkLayerDispatchTable *dispatch_table() const { return dispatch_table_; }
+
+    // Limit the memory allocated from each heap to its size in memory_properties, the memory properties of the physical device
+    // that the application sees.  heap_usage is the memory allocated by all the logical devices of the physical device.
+    void SimulateHeapBudgets(const std::shared_ptr<MemoryHeapUsage> &heap_usage,
+                             const VkPhysicalDeviceMemoryProperties &memory_properties);
+
+    // Add size bytes to the usage of the heap of a memory type before they are allocated, or return false if they do not fit in
+    // the budget of the heap.  Succeeds without accounting for anything unless heap budgets are simulated.
+    bool ReserveMemory(uint32_t memory_type_index, VkDeviceSize size);
+
+    // Give back the bytes reserved for an allocation that failed.
+    void UnreserveMemory(uint32_t memory_type_index, VkDeviceSize size);
+
+    // Record the allocation that the bytes were reserved for, so that ReleaseMemory() can give them back.
+    void AddMemory(VkDeviceMemory memory, uint32_t memory_type_index, VkDeviceSize size);
+
+    // Give back the bytes of a freed allocation.
+    void ReleaseMemory(VkDeviceMemory memory);
 
    private:
-    enum class SchemaId {
-        kUnknown = 0,
-        kDevsim100,
-        kDevsimPortabilitySubsetKHR,
+    struct Allocation {
+        uint32_t heap_index;
+        VkDeviceSize size;
     };
 
-    SchemaId IdentifySchema(const Json::Value &value);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceProperties *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDevicePortabilitySubsetPropertiesKHR *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceLimits *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceSparseProperties *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceFeatures *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDevicePortabilitySubsetFeaturesKHR *dest);
-    void GetValue(const Json::Value &parent, int index, VkMemoryType *dest);
-    void GetValue(const Json::Value &parent, int index, VkMemoryHeap *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceMemoryProperties *dest);
-    void GetValue(const Json::Value &parent, const char *name, VkExtent3D *dest);
-    void GetValue(const Json::Value &parent, int index, VkQueueFamilyProperties *dest);
-    void GetValue(const Json::Value &parent, int index, DevsimFormatProperties *dest);
-    void GetValue(const Json::Value &parent, int index, VkLayerProperties *dest);
-    void GetValue(const Json::Value &parent, int index, VkExtensionProperties *dest);
-
-    // For use as warn_func in GET_VALUE_WARN().  Return true if warning occurred.
-    static bool WarnIfGreater(const char *name, const uint64_t new_value, const uint64_t old_value) {
-        if (new_value > old_value) {
-            DebugPrintf("WARN \"%s\" JSON value (%" PRIu64 ") is greater than existing value (%" PRIu64 ")\n", name, new_value,
-                        old_value);
-            return true;
-        }
-        return false;
-    }
+    DeviceData() = delete;
+    DeviceData(const DeviceData &) = delete;
+    DeviceData &operator=(const DeviceData &) = delete;
+    explicit DeviceData(VkLayerDispatchTable *dispatch_table) : dispatch_table_(dispatch_table) {}
 
-    static bool WarnIfLesser(const char *name, const uint64_t new_value, const uint64_t old_value) {
-        if (new_value < old_value) {
-            DebugPrintf("WARN \"%s\" JSON value (%" PRIu64 ") is lesser than existing value (%" PRIu64 ")\n", name, new_value,
-                        old_value);
-            return true;
-        }
-        return false;
+    // The heap of a memory type, or VK_MAX_MEMORY_HEAPS if its allocations are not accounted.
+    uint32_t HeapIndex(uint32_t memory_type_index) const {
+        return (heap_usage_ && memory_type_index < memory_type_count_) ? heap_indices_[memory_type_index] : VK_MAX_MEMORY_HEAPS;
     }
 
-    void GetValue(const Json::Value &parent, const char *name, float *dest,
-                  std::function<bool(const char *, float, float)> warn_func = nullptr) {
-        const Json::Value value = parent[name];
-        if (!value.isDouble()) {
-            return;
-        }
-        const float new_value = value.asFloat();
-        if (warn_func) {
-            warn_func(name, new_value, *dest);
-        }
-        *dest = new_value;
-    }
+    VkLayerDispatchTable *const dispatch_table_;
 
-    void GetValue(const Json::Value &parent, const char *name, int32_t *dest,
-                  std::function<bool(const char *, int32_t, int32_t)> warn_func = nullptr) {
-        const Json::Value value = parent[name];
-        if (!value.isInt()) {
-            return;
-        }
-        const uint32_t new_value = value.asInt();
-        if (warn_func) {
-            warn_func(name, new_value, *dest);
-        }
-        *dest = new_value;
-    }
+    std::shared_ptr<MemoryHeapUsage> heap_usage_;
+    uint32_t memory_type_count_ = 0;
+    uint32_t heap_indices_[VK_MAX_MEMORY_TYPES] = {};
+    VkDeviceSize heap_budgets_[VK_MAX_MEMORY_HEAPS] = {};
 
-    void GetValue(const Json::Value &parent, const char *name, uint32_t *dest,
-                  std::function<bool(const char *, uint32_t, uint32_t)> warn_func = nullptr) {
-        const Json::Value value = parent[name];
-        if (!value.isUInt()) {
-            return;
-        }
-        const uint32_t new_value = value.asUInt();
-        if (warn_func) {
-            warn_func(name, new_value, *dest);
-        }
-        *dest = new_value;
-    }
+    std::mutex allocations_lock_;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations_;
 
-    void GetValue(const Json::Value &parent, const char *name, uint64_t *dest,
-                  std::function<bool(const char *, uint64_t, uint64_t)> warn_func = nullptr) {
-        const Json::Value value = parent[name];
-        if (!value.isUInt64()) {
-            return;
-        }
-        const uint64_t new_value = value.asUInt64();
-        if (warn_func) {
-            warn_func(name, new_value, *dest);
-        }
-        *dest = new_value;
-    }
+    typedef std::unordered_map<VkDevice, std::unique_ptr<DeviceData>> Map;
+    static Map map_;
 
-    template <typename T>  // for Vulkan enum types
-    void GetValue(const Json::Value &parent, const char *name, T *dest,
-                  std::function<bool(const char *, T, T)> warn_func = nullptr) {
-        const Json::Value value = parent[name];
-        if (!value.isInt()) {
-            return;
-        }
-        const T new_value = static_cast<T>(value.asInt());
-        if (warn_func) {
-            warn_func(name, new_value, *dest);
+    // The DDs of map_ as of the last Publish(), with the arrays it replaces freed like those of the published PDDs.
+    typedef std::vector<std::pair<VkDevice, DeviceData *>> PublishedArray;
+    static std::atomic<const PublishedArray *> published_;
+    static Reclaimer reclaimer_;
+};
+
+DeviceData::Map DeviceData::map_;
+std::atomic<const DeviceData::PublishedArray *> DeviceData::published_(nullptr);
+Reclaimer DeviceData::reclaimer_;
+
+void DeviceData::Publish() {
+    assert(global_lock.try_lock() == false);  // Verify mutex is already locked before reading map_
+    std::unique_ptr<PublishedArray> published;
+    if (!map_.empty()) {
+        published.reset(new PublishedArray);
+        for (const auto &entry : map_) {
+            published->emplace_back(entry.first, entry.second.get());
         }
-        *dest = new_value;
     }
+    std::unique_ptr<const PublishedArray> superseded(published_.exchange(published.release(), std::memory_order_acq_rel));
+    reclaimer_.Retire(std::move(superseded));
+}
 
-    int GetArray(const Json::Value &parent, const char *name, uint8_t *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            dest[i] = value[i].asUInt();
-        }
-        return count;
+DeviceData::~DeviceData() {
+    for (const auto &entry : allocations_) {
+        heap_usage_->heaps[entry.second.heap_index].fetch_sub(entry.second.size, std::memory_order_relaxed);
     }
+}
 
-    int GetArray(const Json::Value &parent, const char *name, uint32_t *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            dest[i] = value[i].asUInt();
-        }
-        return count;
+void DeviceData::SimulateHeapBudgets(const std::shared_ptr<MemoryHeapUsage> &heap_usage,
+                                     const VkPhysicalDeviceMemoryProperties &memory_properties) {
+    heap_usage_ = heap_usage;
+    memory_type_count_ = std::min<uint32_t>(memory_properties.memoryTypeCount, VK_MAX_MEMORY_TYPES);
+    const uint32_t heap_count = std::min<uint32_t>(memory_properties.memoryHeapCount, VK_MAX_MEMORY_HEAPS);
+    for (uint32_t i = 0; i < memory_type_count_; ++i) {
+        const uint32_t heap_index = memory_properties.memoryTypes[i].heapIndex;
+        heap_indices_[i] = (heap_index < heap_count) ? heap_index : VK_MAX_MEMORY_HEAPS;
+    }
+    for (uint32_t i = 0; i < heap_count; ++i) {
+        heap_budgets_[i] = memory_properties.memoryHeaps[i].size;
     }
+}
 
-    int GetArray(const Json::Value &parent, const char *name, float *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            dest[i] = value[i].asFloat();
-        }
-        return count;
+bool DeviceData::ReserveMemory(uint32_t memory_type_index, VkDeviceSize size) {
+    const uint32_t heap_index = HeapIndex(memory_type_index);
+    if (heap_index == VK_MAX_MEMORY_HEAPS) {
+        return true;
     }
 
-    int GetArray(const Json::Value &parent, const char *name, char *dest) {
-        const Json::Value value = parent[name];
-        if (!value.isString()) {
-            return -1;
-        }
-        const char *new_value = value.asCString();
-        int count = 0;
-        dest[0] = '\0';
-        if (new_value) {
-            count = static_cast<int>(strlen(new_value));
-            strcpy(dest, new_value);
+    // Other threads may allocate from the same heap, so the usage is only increased if it stays within the budget.
+    std::atomic<VkDeviceSize> &usage = heap_usage_->heaps[heap_index];
+    const VkDeviceSize budget = heap_budgets_[heap_index];
+    VkDeviceSize current = usage.load(std::memory_order_relaxed);
+    do {
+        if (current > budget || size > budget - current) {
+            return false;
         }
-        return count;
+    } while (!usage.compare_exchange_weak(current, current + size, std::memory_order_relaxed));
+    return true;
+}
+
+void DeviceData::UnreserveMemory(uint32_t memory_type_index, VkDeviceSize size) {
+    const uint32_t heap_index = HeapIndex(memory_type_index);
+    if (heap_index != VK_MAX_MEMORY_HEAPS) {
+        heap_usage_->heaps[heap_index].fetch_sub(size, std::memory_order_relaxed);
     }
+}
 
-    int GetArray(const Json::Value &parent, const char *name, VkMemoryType *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            GetValue(value, i, &dest[i]);
-        }
-        return count;
+void DeviceData::AddMemory(VkDeviceMemory memory, uint32_t memory_type_index, VkDeviceSize size) {
+    const uint32_t heap_index = HeapIndex(memory_type_index);
+    if (heap_index != VK_MAX_MEMORY_HEAPS) {
+        std::lock_guard<std::mutex> lock(allocations_lock_);
+        allocations_[memory] = {heap_index, size};
     }
+}
 
-    int GetArray(const Json::Value &parent, const char *name, VkMemoryHeap *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            GetValue(value, i, &dest[i]);
-        }
-        return count;
+void DeviceData::ReleaseMemory(VkDeviceMemory memory) {
+    if (!heap_usage_ || memory == VK_NULL_HANDLE) {
+        return;
     }
 
-    int GetArray(const Json::Value &parent, const char *name, ArrayOfVkQueueFamilyProperties *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        DebugPrintf("\t\tJsonLoader::GetArray(ArrayOfVkQueueFamilyProperties)\n");
-        dest->clear();
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            VkQueueFamilyProperties queue_family_properties = {};
-            GetValue(value, i, &queue_family_properties);
-            dest->push_back(queue_family_properties);
+    Allocation allocation = {};
+    {
+        std::lock_guard<std::mutex> lock(allocations_lock_);
+        const auto iter = allocations_.find(memory);
+        if (iter == allocations_.end()) {
+            return;
         }
-        return static_cast<int>(dest->size());
+        allocation = iter->second;
+        allocations_.erase(iter);
     }
+    heap_usage_->heaps[allocation.heap_index].fetch_sub(allocation.size, std::memory_order_relaxed);
+}
 
-    int GetArray(const Json::Value &parent, const char *name, ArrayOfVkFormatProperties *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        DebugPrintf("\t\tJsonLoader::GetArray(ArrayOfVkFormatProperties)\n");
-        dest->clear();
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            // Get a format structure from JSON.
-            DevsimFormatProperties devsim_format_properties = {};
-            GetValue(value, i, &devsim_format_properties);
-            // Split the JSON-acquired data into VkFormat and VkFormatProperties.
-            const VkFormat format = devsim_format_properties.formatID;
-            VkFormatProperties vk_format_properties = {};
-            vk_format_properties.linearTilingFeatures = devsim_format_properties.linearTilingFeatures;
-            vk_format_properties.optimalTilingFeatures = devsim_format_properties.optimalTilingFeatures;
-            vk_format_properties.bufferFeatures = devsim_format_properties.bufferFeatures;
-            if (IsFormatSupported(vk_format_properties)) {
-                dest->insert({format, vk_format_properties});
-            }
+// Loader for DevSim JSON configuration files ////////////////////////////////////////////////////////////////////////////////////
+
+enum class SchemaId {
+    kUnknown = 0,
+    kDevsim100,
+    kDevsimPortabilitySubsetKHR,
+};
+
+// The configuration files, read and parsed once by JsonLoader::ParseFiles() and then applied to each physical device in turn.
+// A profile is never modified once parsed, so a single one is shared by all physical devices.
+class DevsimProfile {
+   public:
+    struct Document {
+        std::string filename;
+        SchemaId schema_id;
+        devsim::Document values;
+        // The ArrayOfVkFormatProperties of the document, converted once when it is parsed, as it replaces the whole table.
+        ArrayOfVkFormatProperties format_properties;
+    };
+
+    const std::vector<Document> &documents() const { return documents_; }
+
+   private:
+    friend class JsonLoader;
+    std::vector<Document> documents_;
+};
+
+class JsonLoader {
+   public:
+    JsonLoader(PhysicalDeviceData &pdd) : pdd_(pdd) {}
+    JsonLoader() = delete;
+    JsonLoader(const JsonLoader &) = delete;
+    JsonLoader &operator=(const JsonLoader &) = delete;
+
+    // Parse the files of the list, stopping at the first one that cannot be parsed.
+    static std::shared_ptr<const DevsimProfile> ParseFiles();
+    static std::shared_ptr<const DevsimProfile> ParseFiles(const char *filename_list);
+
+    // Override PDD members with the values of each document of the profile, in order.
+    void ApplyProfile(const DevsimProfile &profile);
+
+   private:
+    static bool ParseFile(const char *filename, DevsimProfile *profile);
+    static SchemaId IdentifySchema(const devsim::Document &values);
+    static void GetArray(const std::vector<DevsimFormatProperties> &values, ArrayOfVkFormatProperties *dest);
+    void ApplyDocument(const DevsimProfile::Document &document);
+
+    // Copy the fields that a document sets over those of dest.
+    template <typename T>
+    static void GetValue(const char *name, const devsim::PartialStruct<T> &src, T *dest);
+
+    template <typename T>
+    static void GetArray(const char *name, bool has_src, const std::vector<T> &src, std::vector<T> *dest) {
+        if (has_src) {
+            DebugPrintf("\t\tJsonLoader::GetArray(%s)\n", name);
+            *dest = src;
         }
-        return static_cast<int>(dest->size());
     }
 
-    int GetArray(const Json::Value &parent, const char *name, ArrayOfVkLayerProperties *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        DebugPrintf("\t\tJsonLoader::GetArray(ArrayOfVkLayerProperties)\n");
-        dest->clear();
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            VkLayerProperties layer_properties = {};
-            GetValue(value, i, &layer_properties);
-            dest->push_back(layer_properties);
+    static bool WarnIfGreater(const char *name, const uint64_t new_value, const uint64_t old_value) {
+        if (new_value > old_value) {
+            DebugPrintf("WARN \"%s\" JSON value (%" PRIu64 ") is greater than existing value (%" PRIu64 ")\n", name, new_value,
+                        old_value);
+            return true;
         }
-        return static_cast<int>(dest->size());
+        return false;
     }
 
-    int GetArray(const Json::Value &parent, const char *name, ArrayOfVkExtensionProperties *dest) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::arrayValue) {
-            return -1;
-        }
-        DebugPrintf("\t\tJsonLoader::GetArray(ArrayOfVkExtensionProperties)\n");
-        dest->clear();
-        const int count = static_cast<int>(value.size());
-        for (int i = 0; i < count; ++i) {
-            VkExtensionProperties extension_properties = {};
-            GetValue(value, i, &extension_properties);
-            dest->push_back(extension_properties);
+    static bool WarnIfLesser(const char *name, const uint64_t new_value, const uint64_t old_value) {
+        if (new_value < old_value) {
+            DebugPrintf("WARN \"%s\" JSON value (%" PRIu64 ") is lesser than existing value (%" PRIu64 ")\n", name, new_value,
+                        old_value);
+            return true;
         }
-        return static_cast<int>(dest->size());
+        return false;
     }
 
-    void WarnDeprecated(const Json::Value &parent, const char *name) {
-        const Json::Value value = parent[name];
-        if (value.type() != Json::nullValue) {
-            DebugPrintf("WARN JSON section %s is deprecated and ignored.\n", name);
+    // Read an unsigned field of 4 or 8 bytes, for the warnings.
+    static uint64_t ReadUnsigned(const char *bytes, uint32_t size) {
+        if (size == sizeof(uint64_t)) {
+            uint64_t value = 0;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
         }
+        uint32_t value = 0;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
     }
 
     PhysicalDeviceData &pdd_;
 };
 
-bool JsonLoader::LoadFiles() {
+std::shared_ptr<const DevsimProfile> JsonLoader::ParseFiles() {
     if (inputFilename.str.empty()) {
         ErrorPrintf("envar %s and %s in vk_layer_settings.txt are unset\n", kEnvarDevsimFilename, kLayerSettingsDevsimFilename);
-        return false;
+        return std::make_shared<const DevsimProfile>();
     }
 
     const char *filename_list = inputFilename.str.c_str();
@@ -892,65 +1245,89 @@ bool JsonLoader::LoadFiles() {
     } else {
         DebugPrintf("vk_layer_settings.txt setting %s = \"%s\"\n", kLayerSettingsDevsimFilename, filename_list);
     }
-    return LoadFiles(filename_list);
+    return ParseFiles(filename_list);
 }
 
-bool JsonLoader::LoadFiles(const char *filename_list) {
-#if defined(_WIN32)
-    const char delimiter = ';';
-#else
-    const char delimiter = ':';
-#endif
-    std::stringstream ss_list(filename_list);
-    std::string filename;
-
-    while (std::getline(ss_list, filename, delimiter)) {
-        if (!filename.empty()) {
-            if (!LoadFile(filename.c_str())) {
-                return false;
-            }
+std::shared_ptr<const DevsimProfile> JsonLoader::ParseFiles(const char *filename_list) {
+    auto profile = std::make_shared<DevsimProfile>();
+    for (const auto &filename : SplitFilenameList(filename_list)) {
+        if (!ParseFile(filename.c_str(), profile.get())) {
+            break;
         }
     }
-    return true;
+    return profile;
 }
 
-bool JsonLoader::LoadFile(const char *filename) {
-    std::ifstream json_file(filename);
-    if (!json_file) {
+bool JsonLoader::ParseFile(const char *filename, DevsimProfile *profile) {
+    const MappedFile json_file(filename);
+    if (!json_file.opened()) {
         ErrorPrintf("JsonLoader failed to open file \"%s\"\n", filename);
         return false;
     }
 
-    DebugPrintf("JsonLoader::LoadFile(\"%s\")\n", filename);
-    Json::Reader reader;
-    Json::Value root = Json::nullValue;
-    bool success = reader.parse(json_file, root, false);
-    if (!success) {
-        ErrorPrintf("Json::Reader failed {\n%s}\n", reader.getFormattedErrorMessages().c_str());
+    DebugPrintf("JsonLoader::ParseFile(\"%s\")\n", filename);
+    devsim::Document values;
+    std::string error;
+    if (!devsim::ReadDocument(json_file.data(), json_file.size(), &values, &error)) {
+        ErrorPrintf("JsonLoader failed to parse file \"%s\" at %s\n", filename, error.c_str());
         return false;
     }
-    json_file.close();
 
-    if (root.type() != Json::objectValue) {
-        ErrorPrintf("Json document root is not an object\n");
+    const SchemaId schema_id = IdentifySchema(values);
+    if (schema_id == SchemaId::kUnknown) {
         return false;
     }
 
-    DebugPrintf("{\n");
-    bool result = false;
-    const Json::Value schema_value = root["$schema"];
-    const SchemaId schema_id = IdentifySchema(schema_value);
-    switch (schema_id) {
-        case SchemaId::kDevsim100:
-            GetValue(root, "VkPhysicalDeviceProperties", &pdd_.physical_device_properties_);
-            GetValue(root, "VkPhysicalDeviceFeatures", &pdd_.physical_device_features_);
-            GetValue(root, "VkPhysicalDeviceMemoryProperties", &pdd_.physical_device_memory_properties_);
-            GetArray(root, "ArrayOfVkQueueFamilyProperties", &pdd_.arrayof_queue_family_properties_);
-            GetArray(root, "ArrayOfVkFormatProperties", &pdd_.arrayof_format_properties_);
-            GetArray(root, "ArrayOfVkLayerProperties", &pdd_.arrayof_layer_properties_);
-            GetArray(root, "ArrayOfVkExtensionProperties", &pdd_.arrayof_extension_properties_);
-            result = true;
-            break;
+    profile->documents_.push_back({filename, schema_id, devsim::Document(), ArrayOfVkFormatProperties()});
+    DevsimProfile::Document &document = profile->documents_.back();
+    document.values = std::move(values);
+    if (schema_id == SchemaId::kDevsim100 && document.values.has_format_properties) {
+        GetArray(document.values.format_properties, &document.format_properties);
+    }
+    return true;
+}
+
+void JsonLoader::ApplyProfile(const DevsimProfile &profile) {
+    for (const auto &document : profile.documents()) {
+        ApplyDocument(document);
+    }
+}
+
+void JsonLoader::ApplyDocument(const DevsimProfile::Document &document) {
+    DebugPrintf("JsonLoader::ApplyDocument(\"%s\")\n", document.filename.c_str());
+    DebugPrintf("{\n");
+    const devsim::Document &values = document.values;
+    switch (document.schema_id) {
+        case SchemaId::kDevsim100: {
+            GetValue("VkPhysicalDeviceProperties", values.properties, &pdd_.physical_device_properties_);
+            GetValue("VkPhysicalDeviceFeatures", values.features, &pdd_.physical_device_features_);
+
+            VkPhysicalDeviceMemoryProperties *memory_properties = &pdd_.physical_device_memory_properties_;
+            GetValue("VkPhysicalDeviceMemoryProperties", values.memory_properties, memory_properties);
+            for (const auto &assignment : values.memory_properties.assignments) {
+                if (assignment.offset != offsetof(VkPhysicalDeviceMemoryProperties, memoryTypeCount)) {
+                    continue;
+                }
+                for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i) {
+                    if (memory_properties->memoryTypes[i].heapIndex >= memory_properties->memoryHeapCount) {
+                        DebugPrintf("WARN \"memoryType[%" PRIu32 "].heapIndex\" (%" PRIu32 ") exceeds memoryHeapCount (%" PRIu32
+                                    ")\n",
+                                    i, memory_properties->memoryTypes[i].heapIndex, memory_properties->memoryHeapCount);
+                    }
+                }
+            }
+
+            GetArray("ArrayOfVkQueueFamilyProperties", values.has_queue_family_properties, values.queue_family_properties,
+                     &pdd_.arrayof_queue_family_properties_);
+            if (values.has_format_properties) {
+                pdd_.arrayof_format_properties_ = document.format_properties;
+            }
+            GetArray("ArrayOfVkLayerProperties", values.has_layer_properties, values.layer_properties,
+                     &pdd_.arrayof_layer_properties_);
+            GetArray("ArrayOfVkExtensionProperties", values.has_extension_properties, values.extension_properties,
+                     &pdd_.arrayof_extension_properties_);
+            break;
+        }
 
         case SchemaId::kDevsimPortabilitySubsetKHR:
             if (!PhysicalDeviceData::HasExtension(&pdd_, VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME) && emulatePortability.num <= 0) {
@@ -960,9 +1337,10 @@ bool JsonLoader::LoadFile(const char *filename) {
                     "VK_KHR_portability_subset, please set environment variable %s to 1.\n",
                     kEnvarDevsimEmulatePortability);
             }
-            GetValue(root, "VkPhysicalDevicePortabilitySubsetPropertiesKHR", &pdd_.physical_device_portability_subset_properties_);
-            GetValue(root, "VkPhysicalDevicePortabilitySubsetFeaturesKHR", &pdd_.physical_device_portability_subset_features_);
-            result = true;
+            GetValue("VkPhysicalDevicePortabilitySubsetPropertiesKHR", values.portability_subset_properties,
+                     &pdd_.physical_device_portability_subset_properties_);
+            GetValue("VkPhysicalDevicePortabilitySubsetFeaturesKHR", values.portability_subset_features,
+                     &pdd_.physical_device_portability_subset_features_);
             break;
 
         case SchemaId::kUnknown:
@@ -970,18 +1348,16 @@ bool JsonLoader::LoadFile(const char *filename) {
             break;
     }
     DebugPrintf("}\n");
-
-    return result;
 }
 
-JsonLoader::SchemaId JsonLoader::IdentifySchema(const Json::Value &value) {
-    if (!value.isString()) {
+SchemaId JsonLoader::IdentifySchema(const devsim::Document &values) {
+    if (!values.has_schema) {
         ErrorPrintf("JSON element \"$schema\" is not a string\n");
         return SchemaId::kUnknown;
     }
 
     SchemaId schema_id = SchemaId::kUnknown;
-    const char *schema_string = value.asCString();
+    const char *schema_string = values.schema.c_str();
     if (strcmp(schema_string, "https://schema.khronos.org/vulkan/devsim_1_0_0.json#") == 0) {
         schema_id = SchemaId::kDevsim100;
     } else if (strcmp(schema_string, "https://schema.khronos.org/vulkan/devsim_VK_KHR_portability_subset-provisional-1.json#") ==
@@ -997,343 +1373,712 @@ JsonLoader::SchemaId JsonLoader::IdentifySchema(const Json::Value &value) {
     return schema_id;
 }
 
-// Apply the DRY principle, see https://en.wikipedia.org/wiki/Don%27t_repeat_yourself
-#define GET_VALUE(name) GetValue(value, #name, &dest->name)
-#define GET_ARRAY(name) GetArray(value, #name, dest->name)
-#define GET_VALUE_WARN(name, warn_func) GetValue(value, #name, &dest->name, warn_func)
-
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceProperties *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
+template <typename T>
+void JsonLoader::GetValue(const char *name, const devsim::PartialStruct<T> &src, T *dest) {
+    if (!src.present) {
         return;
     }
-    DebugPrintf("\t\tJsonLoader::GetValue(VkPhysicalDeviceProperties)\n");
-    GET_VALUE(apiVersion);
-    GET_VALUE(driverVersion);
-    GET_VALUE(vendorID);
-    GET_VALUE(deviceID);
-    GET_VALUE(deviceType);
-    GET_ARRAY(deviceName);         // size < VK_MAX_PHYSICAL_DEVICE_NAME_SIZE
-    GET_ARRAY(pipelineCacheUUID);  // size == VK_UUID_SIZE
-    GET_VALUE(limits);
-    GET_VALUE(sparseProperties);
-}
-
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDevicePortabilitySubsetPropertiesKHR *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
+    DebugPrintf("\t\tJsonLoader::GetValue(%s)\n", name);
+    const char *new_values = reinterpret_cast<const char *>(&src.values);
+    char *old_values = reinterpret_cast<char *>(dest);
+    for (const auto &assignment : src.assignments) {
+        const char *new_value = new_values + assignment.offset;
+        char *old_value = old_values + assignment.offset;
+        if (assignment.warn == devsim::Warn::kIfGreater) {
+            WarnIfGreater(assignment.name, ReadUnsigned(new_value, assignment.size), ReadUnsigned(old_value, assignment.size));
+        } else if (assignment.warn == devsim::Warn::kIfLesser) {
+            WarnIfLesser(assignment.name, ReadUnsigned(new_value, assignment.size), ReadUnsigned(old_value, assignment.size));
+        }
+        memcpy(old_value, new_value, assignment.size);
+    }
+}
+
+void JsonLoader::GetArray(const std::vector<DevsimFormatProperties> &values, ArrayOfVkFormatProperties *dest) {
+    DebugPrintf("\t\tJsonLoader::GetArray(ArrayOfVkFormatProperties)\n");
+    std::vector<std::pair<VkFormat, VkFormatProperties>> formats;
+    formats.reserve(values.size());
+    for (const auto &devsim_format_properties : values) {
+        // Split the JSON-acquired data into VkFormat and VkFormatProperties.
+        const VkFormat format = devsim_format_properties.formatID;
+        if (!ArrayOfVkFormatProperties::IsInRange(format)) {
+            DebugPrintf("WARN \"formatID\" (%" PRIu32 ") is not a valid VkFormat value\n", static_cast<uint32_t>(format));
+            continue;
+        }
+        VkFormatProperties vk_format_properties = {};
+        vk_format_properties.linearTilingFeatures = devsim_format_properties.linearTilingFeatures;
+        vk_format_properties.optimalTilingFeatures = devsim_format_properties.optimalTilingFeatures;
+        vk_format_properties.bufferFeatures = devsim_format_properties.bufferFeatures;
+        formats.emplace_back(format, vk_format_properties);
+    }
+    dest->Assign(formats);
+}
+
+// Which configuration files simulate each physical device.  The entries of kEnvarDevsimFilenameMap, separated by commas, are
+// "<selector>:<files>", where <files> is a list of configuration files as in kEnvarDevsimFilename.  <selector> is either the
+// index of the physical device, in the order the Vulkan implementation enumerates them, or one of "vendorID=<id>",
+// "deviceID=<id>" and "deviceName=<text>", which match the properties of the physical device before simulation.  IDs are
+// decimal, or hexadecimal with a 0x prefix, and a deviceName matches if it contains the text.
+// The first entry that matches a physical device selects its files.  Physical devices that no entry matches use the files of
+// kEnvarDevsimFilename, or are passed through if it is unset.
+class ProfileMap {
+   public:
+    ProfileMap();
+
+    // Return the list of configuration files of a physical device, or nullptr to pass it through.
+    const std::string *Select(uint32_t index, const VkPhysicalDeviceProperties &properties) const;
+
+   private:
+    enum class Selector {
+        kIndex,
+        kVendorID,
+        kDeviceID,
+        kDeviceName,
+    };
+
+    struct Entry {
+        std::string text;
+        Selector selector;
+        uint32_t id;
+        std::string device_name;
+        std::string filename_list;
+    };
+
+    static bool ParseId(const char *text, uint32_t *id);
+
+    std::vector<Entry> entries_;
+};
+
+ProfileMap::ProfileMap() {
+    if (filenameMap.str.empty()) {
         return;
     }
-    DebugPrintf("\t\tJsonLoader::GetValue(VkPhysicalDevicePortabilitySubsetPropertiesKHR)\n");
-    GET_VALUE_WARN(minVertexInputBindingStrideAlignment, WarnIfLesser);
+    if (filenameMap.fromEnvVar) {
+        DebugPrintf("envar %s = \"%s\"\n", kEnvarDevsimFilenameMap, filenameMap.str.c_str());
+    } else {
+        DebugPrintf("vk_layer_settings.txt setting %s = \"%s\"\n", kLayerSettingsDevsimFilenameMap, filenameMap.str.c_str());
+    }
+
+    std::stringstream stream(filenameMap.str);
+    std::string text;
+    while (std::getline(stream, text, ',')) {
+        if (text.empty()) {
+            continue;
+        }
+        Entry entry = {text, Selector::kIndex, 0, std::string(), std::string()};
+        const size_t colon = text.find(':');
+        bool valid = colon != std::string::npos && colon + 1 < text.size();
+        if (valid) {
+            const std::string selector = text.substr(0, colon);
+            entry.filename_list = text.substr(colon + 1);
+            if (selector.compare(0, 11, "deviceName=") == 0) {
+                entry.selector = Selector::kDeviceName;
+                entry.device_name = selector.substr(11);
+            } else if (selector.compare(0, 9, "vendorID=") == 0) {
+                entry.selector = Selector::kVendorID;
+                valid = ParseId(selector.c_str() + 9, &entry.id);
+            } else if (selector.compare(0, 9, "deviceID=") == 0) {
+                entry.selector = Selector::kDeviceID;
+                valid = ParseId(selector.c_str() + 9, &entry.id);
+            } else {
+                valid = ParseId(selector.c_str(), &entry.id);
+            }
+        }
+        if (!valid) {
+            ErrorPrintf("%s entry \"%s\" is not <index>:<files>, vendorID=<id>:<files>, deviceID=<id>:<files> or "
+                        "deviceName=<text>:<files>\n",
+                        kEnvarDevsimFilenameMap, text.c_str());
+            continue;
+        }
+        entries_.push_back(entry);
+    }
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceLimits *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
+bool ProfileMap::ParseId(const char *text, uint32_t *id) {
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    // IDs are decimal or hexadecimal with a 0x prefix.  A leading 0 does not make them octal.
+    const int base = text[0] == '0' && (text[1] == 'x' || text[1] == 'X') ? 16 : 10;
+    char *end = nullptr;
+    const unsigned long long value = strtoull(text, &end, base);
+    if (*end != '\0' || value > UINT32_MAX) {
+        return false;
+    }
+    *id = static_cast<uint32_t>(value);
+    return true;
+}
+
+const std::string *ProfileMap::Select(uint32_t index, const VkPhysicalDeviceProperties &properties) const {
+    for (const auto &entry : entries_) {
+        bool match = false;
+        switch (entry.selector) {
+            case Selector::kIndex:
+                match = entry.id == index;
+                break;
+            case Selector::kVendorID:
+                match = entry.id == properties.vendorID;
+                break;
+            case Selector::kDeviceID:
+                match = entry.id == properties.deviceID;
+                break;
+            case Selector::kDeviceName:
+                match = strstr(properties.deviceName, entry.device_name.c_str()) != nullptr;
+                break;
+        }
+        if (match) {
+            DebugPrintf("\t%s entry \"%s\" selects \"%s\"\n", kEnvarDevsimFilenameMap, entry.text.c_str(),
+                        entry.filename_list.c_str());
+            return &entry.filename_list;
+        }
+    }
+
+    // Without a map, the files of kEnvarDevsimFilename simulate every physical device, and JsonLoader reports them unset.
+    if (filenameMap.str.empty() || !inputFilename.str.empty()) {
+        return &inputFilename.str;
+    }
+    return nullptr;
+}
+
+
+// Cache of simulated device configurations //////////////////////////////////////////////////////////////////////////////////////
+
+// Appends the bytes of trivially copyable values to a buffer.
+class BinaryWriter {
+   public:
+    void Write(const void *data, size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+    }
+
+    template <typename T>
+    void Write(const T &value) {
+        Write(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const std::vector<T> &array) {
+        Write(static_cast<uint32_t>(array.size()));
+        Write(array.data(), array.size() * sizeof(T));
+    }
+
+    const std::vector<char> &buffer() const { return buffer_; }
+
+   private:
+    std::vector<char> buffer_;
+};
+
+// Reads back what a BinaryWriter wrote, failing rather than reading past the end of the data.
+class BinaryReader {
+   public:
+    BinaryReader(const char *data, size_t size) : data_(data), end_(data + size) {}
+
+    bool Read(void *data, size_t size) {
+        if (size > static_cast<size_t>(end_ - data_)) {
+            return false;
+        }
+        if (size > 0) {
+            memcpy(data, data_, size);
+            data_ += size;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool Read(T *value) {
+        return Read(value, sizeof(T));
+    }
+
+    template <typename T>
+    bool ReadArray(std::vector<T> *array) {
+        uint32_t count = 0;
+        if (!Read(&count) || count > static_cast<size_t>(end_ - data_) / sizeof(T)) {
+            return false;
+        }
+        array->resize(count);
+        return Read(array->data(), count * sizeof(T));
+    }
+
+    const char *position() const { return data_; }
+    bool AtEnd() const { return data_ == end_; }
+
+   private:
+    const char *data_;
+    const char *const end_;
+};
+
+// 64-bit FNV-1a hash of data.
+uint64_t HashBytes(const char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct FileStatus {
+    bool exists;
+    bool is_directory;
+    uint64_t size;
+    int64_t modification_time;
+};
+
+FileStatus GetFileStatus(const std::string &path) {
+#if defined(_WIN32)
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) {
+        return FileStatus{false, false, 0, 0};
+    }
+    return FileStatus{true, (st.st_mode & _S_IFDIR) != 0, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime)};
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return FileStatus{false, false, 0, 0};
+    }
+    return FileStatus{true, S_ISDIR(st.st_mode), static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime)};
+#endif
+}
+
+// Create a directory and its missing parents.
+bool CreateDirectories(const std::string &path) {
+#if defined(_WIN32)
+    const char *const separators = "\\/";
+#else
+    const char *const separators = "/";
+#endif
+    size_t position = path.find_first_of(separators, 1);
+    while (true) {
+        const std::string directory = path.substr(0, position);
+#if defined(_WIN32)
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        if (position == std::string::npos) {
+            break;
+        }
+        position = path.find_first_of(separators, position + 1);
+    }
+    return GetFileStatus(path).is_directory;
+}
+
+// Rename a file, replacing the destination if it exists.  Readers of the destination see either the old or the new file.
+bool RenameFile(const std::string &from, const std::string &to) {
+#if defined(_WIN32)
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// The directory of the cache, or an empty string if there is none on this platform.
+std::string GetProfileCacheDirectory() {
+#if defined(__ANDROID__)
+    return "";
+#elif defined(_WIN32)
+    const std::string local_app_data = GetEnvarValue("LOCALAPPDATA");
+    return local_app_data.empty() ? "" : local_app_data + "\\vulkan\\devsim";
+#else
+    std::string cache_home = GetEnvarValue("XDG_CACHE_HOME");
+    if (cache_home.empty()) {
+        const std::string home = GetEnvarValue("HOME");
+        if (home.empty()) {
+            return "";
+        }
+        cache_home = home + "/.cache";
+    }
+    return cache_home + "/vulkan/devsim";
+#endif
+}
+
+// Caches the PDD members that the configuration files override, as they are after applying the files to a physical device, so
+// that later runs with the same files and the same physical device do not read any JSON.
+// An entry is named after the layer version, the names of the files and the PDD members as the Vulkan implementation filled
+// them, so that it is replaced when the files change.  It is only used if the size, modification time and contents hash of
+// every file match those it was written for, and otherwise rewritten once the files have been parsed again.
+class ProfileCache {
+   public:
+    // Everything the simulated configuration of a physical device depends on.
+    struct Key {
+        std::string path;  // of the cache entry
+        std::vector<char> source;
+    };
+
+    // Stamp the configuration files of the list, unless the cache is disabled or not available on this platform.
+    explicit ProfileCache(const std::string &filename_list);
+
+    Key MakeKey(const PhysicalDeviceData &pdd) const;
+
+    // Fill the PDD members from the cache entry of key and return true, or return false if there is no valid entry.
+    bool Load(const Key &key, PhysicalDeviceData *pdd) const;
+
+    // Write the PDD members to the cache entry of key, unless an error was reported since the cache was created, as an entry
+    // must not hide errors of the configuration files.
+    void Store(const Key &key, const PhysicalDeviceData &pdd) const;
+
+   private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_size;
+        uint64_t payload_size;
+        uint64_t payload_hash;
+    };
+
+    static const uint32_t kMagic = 0x43534456;  // "VDSC"
+    static const uint32_t kVersion = 1;         // Increment when the layout of the entries changes.
+
+    static void WritePayload(const PhysicalDeviceData &pdd, BinaryWriter *writer);
+    static bool ReadPayload(BinaryReader *reader, PhysicalDeviceData *pdd);
+
+    bool enabled_ = false;
+    std::string directory_;
+    std::vector<char> files_;   // the names of the files
+    std::vector<char> stamps_;  // the size, modification time and contents hash of the files
+    const uint32_t error_count_;
+};
+
+ProfileCache::ProfileCache(const std::string &filename_list) : error_count_(errorCount) {
+    if (profileCache.num <= 0 || filename_list.empty()) {
         return;
     }
-    GET_VALUE(maxImageDimension1D);
-    GET_VALUE(maxImageDimension2D);
-    GET_VALUE(maxImageDimension3D);
-    GET_VALUE(maxImageDimensionCube);
-    GET_VALUE(maxImageArrayLayers);
-    GET_VALUE(maxTexelBufferElements);
-    GET_VALUE(maxUniformBufferRange);
-    GET_VALUE(maxStorageBufferRange);
-    GET_VALUE(maxPushConstantsSize);
-    GET_VALUE(maxMemoryAllocationCount);
-    GET_VALUE(maxSamplerAllocationCount);
-    GET_VALUE(bufferImageGranularity);
-    GET_VALUE(sparseAddressSpaceSize);
-    GET_VALUE_WARN(maxBoundDescriptorSets, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageDescriptorSamplers, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageDescriptorUniformBuffers, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageDescriptorStorageBuffers, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageDescriptorSampledImages, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageDescriptorStorageImages, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageDescriptorInputAttachments, WarnIfGreater);
-    GET_VALUE_WARN(maxPerStageResources, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetSamplers, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetUniformBuffers, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetUniformBuffersDynamic, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetStorageBuffers, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetStorageBuffersDynamic, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetSampledImages, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetStorageImages, WarnIfGreater);
-    GET_VALUE_WARN(maxDescriptorSetInputAttachments, WarnIfGreater);
-    GET_VALUE(maxVertexInputAttributes);
-    GET_VALUE(maxVertexInputBindings);
-    GET_VALUE(maxVertexInputAttributeOffset);
-    GET_VALUE(maxVertexInputBindingStride);
-    GET_VALUE(maxVertexOutputComponents);
-    GET_VALUE(maxTessellationGenerationLevel);
-    GET_VALUE(maxTessellationPatchSize);
-    GET_VALUE(maxTessellationControlPerVertexInputComponents);
-    GET_VALUE(maxTessellationControlPerVertexOutputComponents);
-    GET_VALUE(maxTessellationControlPerPatchOutputComponents);
-    GET_VALUE(maxTessellationControlTotalOutputComponents);
-    GET_VALUE(maxTessellationEvaluationInputComponents);
-    GET_VALUE(maxTessellationEvaluationOutputComponents);
-    GET_VALUE(maxGeometryShaderInvocations);
-    GET_VALUE(maxGeometryInputComponents);
-    GET_VALUE(maxGeometryOutputComponents);
-    GET_VALUE(maxGeometryOutputVertices);
-    GET_VALUE(maxGeometryTotalOutputComponents);
-    GET_VALUE(maxFragmentInputComponents);
-    GET_VALUE(maxFragmentOutputAttachments);
-    GET_VALUE(maxFragmentDualSrcAttachments);
-    GET_VALUE(maxFragmentCombinedOutputResources);
-    GET_VALUE(maxComputeSharedMemorySize);
-    GET_ARRAY(maxComputeWorkGroupCount);  // size == 3
-    GET_VALUE(maxComputeWorkGroupInvocations);
-    GET_ARRAY(maxComputeWorkGroupSize);  // size == 3
-    GET_VALUE(subPixelPrecisionBits);
-    GET_VALUE(subTexelPrecisionBits);
-    GET_VALUE(mipmapPrecisionBits);
-    GET_VALUE(maxDrawIndexedIndexValue);
-    GET_VALUE(maxDrawIndirectCount);
-    GET_VALUE(maxSamplerLodBias);
-    GET_VALUE(maxSamplerAnisotropy);
-    GET_VALUE(maxViewports);
-    GET_ARRAY(maxViewportDimensions);  // size == 2
-    GET_ARRAY(viewportBoundsRange);    // size == 2
-    GET_VALUE(viewportSubPixelBits);
-    GET_VALUE(minMemoryMapAlignment);
-    GET_VALUE(minTexelBufferOffsetAlignment);
-    GET_VALUE(minUniformBufferOffsetAlignment);
-    GET_VALUE(minStorageBufferOffsetAlignment);
-    GET_VALUE(minTexelOffset);
-    GET_VALUE(maxTexelOffset);
-    GET_VALUE(minTexelGatherOffset);
-    GET_VALUE(maxTexelGatherOffset);
-    GET_VALUE(minInterpolationOffset);
-    GET_VALUE(maxInterpolationOffset);
-    GET_VALUE(subPixelInterpolationOffsetBits);
-    GET_VALUE(maxFramebufferWidth);
-    GET_VALUE(maxFramebufferHeight);
-    GET_VALUE(maxFramebufferLayers);
-    GET_VALUE(framebufferColorSampleCounts);
-    GET_VALUE(framebufferDepthSampleCounts);
-    GET_VALUE(framebufferStencilSampleCounts);
-    GET_VALUE(framebufferNoAttachmentsSampleCounts);
-    GET_VALUE(maxColorAttachments);
-    GET_VALUE(sampledImageColorSampleCounts);
-    GET_VALUE(sampledImageIntegerSampleCounts);
-    GET_VALUE(sampledImageDepthSampleCounts);
-    GET_VALUE(sampledImageStencilSampleCounts);
-    GET_VALUE(storageImageSampleCounts);
-    GET_VALUE(maxSampleMaskWords);
-    GET_VALUE(timestampComputeAndGraphics);
-    GET_VALUE(timestampPeriod);
-    GET_VALUE(maxClipDistances);
-    GET_VALUE(maxCullDistances);
-    GET_VALUE(maxCombinedClipAndCullDistances);
-    GET_VALUE(discreteQueuePriorities);
-    GET_ARRAY(pointSizeRange);  // size == 2
-    GET_ARRAY(lineWidthRange);  // size == 2
-    GET_VALUE(pointSizeGranularity);
-    GET_VALUE(lineWidthGranularity);
-    GET_VALUE(strictLines);
-    GET_VALUE(standardSampleLocations);
-    GET_VALUE(optimalBufferCopyOffsetAlignment);
-    GET_VALUE(optimalBufferCopyRowPitchAlignment);
-    GET_VALUE(nonCoherentAtomSize);
-}
-
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceSparseProperties *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
+    directory_ = GetProfileCacheDirectory();
+    if (directory_.empty()) {
         return;
     }
-    GET_VALUE(residencyStandard2DBlockShape);
-    GET_VALUE(residencyStandard2DMultisampleBlockShape);
-    GET_VALUE(residencyStandard3DBlockShape);
-    GET_VALUE(residencyAlignedMipSize);
-    GET_VALUE(residencyNonResidentStrict);
+
+    BinaryWriter files;
+    BinaryWriter stamps;
+    for (const auto &filename : SplitFilenameList(filename_list.c_str())) {
+        const FileStatus status = GetFileStatus(filename);
+        const MappedFile file(filename);
+        if (!status.exists || !file.data()) {
+            return;  // JsonLoader reports it.
+        }
+        files.Write(static_cast<uint32_t>(filename.size()));
+        files.Write(filename.data(), filename.size());
+        stamps.Write(status.size);
+        stamps.Write(status.modification_time);
+        stamps.Write(HashBytes(file.data(), file.size()));
+    }
+    files_ = files.buffer();
+    stamps_ = stamps.buffer();
+    enabled_ = true;
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceFeatures *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
-        return;
+ProfileCache::Key ProfileCache::MakeKey(const PhysicalDeviceData &pdd) const {
+    Key key;
+    if (!enabled_) {
+        return key;
+    }
+
+    VkPhysicalDevicePortabilitySubsetPropertiesKHR portability_properties = pdd.physical_device_portability_subset_properties_;
+    VkPhysicalDevicePortabilitySubsetFeaturesKHR portability_features = pdd.physical_device_portability_subset_features_;
+    portability_properties.pNext = nullptr;
+    portability_features.pNext = nullptr;
+
+    BinaryWriter identity;
+    identity.Write(kVersionDevsimImplementation);
+    identity.Write(static_cast<uint32_t>(sizeof(void *)));
+    identity.Write(emulatePortability.num > 0);
+    identity.Write(files_.data(), files_.size());
+    identity.Write(pdd.physical_device_properties_);
+    identity.Write(pdd.physical_device_features_);
+    identity.Write(pdd.physical_device_memory_properties_);
+    identity.Write(portability_properties);
+    identity.Write(portability_features);
+    identity.WriteArray(pdd.device_extensions);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".bin", HashBytes(identity.buffer().data(), identity.buffer().size()));
+#if defined(_WIN32)
+    key.path = directory_ + "\\" + name;
+#else
+    key.path = directory_ + "/" + name;
+#endif
+    key.source = identity.buffer();
+    key.source.insert(key.source.end(), stamps_.begin(), stamps_.end());
+    return key;
+}
+
+bool ProfileCache::Load(const Key &key, PhysicalDeviceData *pdd) const {
+    if (!enabled_) {
+        return false;
+    }
+
+    const MappedFile file(key.path);
+    BinaryReader reader(file.data(), file.size());
+    Header header;
+    if (!reader.Read(&header) || header.magic != kMagic || header.version != kVersion ||
+        header.source_size != key.source.size() || file.size() - sizeof(Header) < key.source.size() ||
+        header.payload_size != file.size() - sizeof(Header) - key.source.size() ||
+        memcmp(reader.position(), key.source.data(), key.source.size()) != 0) {
+        return false;
+    }
+
+    const char *payload = reader.position() + key.source.size();
+    BinaryReader payload_reader(payload, static_cast<size_t>(header.payload_size));
+    if (HashBytes(payload, static_cast<size_t>(header.payload_size)) != header.payload_hash ||
+        !ReadPayload(&payload_reader, pdd)) {
+        DebugPrintf("profile cache entry \"%s\" is corrupt\n", key.path.c_str());
+        return false;
     }
-    DebugPrintf("\t\tJsonLoader::GetValue(VkPhysicalDeviceFeatures)\n");
-    GET_VALUE(robustBufferAccess);
-    GET_VALUE(fullDrawIndexUint32);
-    GET_VALUE(imageCubeArray);
-    GET_VALUE(independentBlend);
-    GET_VALUE(geometryShader);
-    GET_VALUE(tessellationShader);
-    GET_VALUE(sampleRateShading);
-    GET_VALUE(dualSrcBlend);
-    GET_VALUE(logicOp);
-    GET_VALUE(multiDrawIndirect);
-    GET_VALUE(drawIndirectFirstInstance);
-    GET_VALUE(depthClamp);
-    GET_VALUE(depthBiasClamp);
-    GET_VALUE(fillModeNonSolid);
-    GET_VALUE(depthBounds);
-    GET_VALUE(wideLines);
-    GET_VALUE(largePoints);
-    GET_VALUE(alphaToOne);
-    GET_VALUE(multiViewport);
-    GET_VALUE(samplerAnisotropy);
-    GET_VALUE(textureCompressionETC2);
-    GET_VALUE(textureCompressionASTC_LDR);
-    GET_VALUE(textureCompressionBC);
-    GET_VALUE(occlusionQueryPrecise);
-    GET_VALUE(pipelineStatisticsQuery);
-    GET_VALUE(vertexPipelineStoresAndAtomics);
-    GET_VALUE(fragmentStoresAndAtomics);
-    GET_VALUE(shaderTessellationAndGeometryPointSize);
-    GET_VALUE(shaderImageGatherExtended);
-    GET_VALUE(shaderStorageImageExtendedFormats);
-    GET_VALUE(shaderStorageImageMultisample);
-    GET_VALUE(shaderStorageImageReadWithoutFormat);
-    GET_VALUE(shaderStorageImageWriteWithoutFormat);
-    GET_VALUE(shaderUniformBufferArrayDynamicIndexing);
-    GET_VALUE(shaderSampledImageArrayDynamicIndexing);
-    GET_VALUE(shaderStorageBufferArrayDynamicIndexing);
-    GET_VALUE(shaderStorageImageArrayDynamicIndexing);
-    GET_VALUE(shaderClipDistance);
-    GET_VALUE(shaderCullDistance);
-    GET_VALUE(shaderFloat64);
-    GET_VALUE(shaderInt64);
-    GET_VALUE(shaderInt16);
-    GET_VALUE(shaderResourceResidency);
-    GET_VALUE(shaderResourceMinLod);
-    GET_VALUE(sparseBinding);
-    GET_VALUE(sparseResidencyBuffer);
-    GET_VALUE(sparseResidencyImage2D);
-    GET_VALUE(sparseResidencyImage3D);
-    GET_VALUE(sparseResidency2Samples);
-    GET_VALUE(sparseResidency4Samples);
-    GET_VALUE(sparseResidency8Samples);
-    GET_VALUE(sparseResidency16Samples);
-    GET_VALUE(sparseResidencyAliased);
-    GET_VALUE(variableMultisampleRate);
-    GET_VALUE(inheritedQueries);
-}
-
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDevicePortabilitySubsetFeaturesKHR *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
+    DebugPrintf("loaded profile cache entry \"%s\"\n", key.path.c_str());
+    return true;
+}
+
+void ProfileCache::Store(const Key &key, const PhysicalDeviceData &pdd) const {
+    if (!enabled_ || errorCount != error_count_) {
         return;
     }
-    DebugPrintf("\t\tJsonLoader::GetValue(VkPhysicalDevicePortabilitySubsetFeaturesKHR)\n");
-    GET_VALUE_WARN(constantAlphaColorBlendFactors, WarnIfGreater);
-    GET_VALUE_WARN(events, WarnIfGreater);
-    GET_VALUE_WARN(imageViewFormatReinterpretation, WarnIfGreater);
-    GET_VALUE_WARN(imageViewFormatSwizzle, WarnIfGreater);
-    GET_VALUE_WARN(imageView2DOn3DImage, WarnIfGreater);
-    GET_VALUE_WARN(multisampleArrayImage, WarnIfGreater);
-    GET_VALUE_WARN(mutableComparisonSamplers, WarnIfGreater);
-    GET_VALUE_WARN(pointPolygons, WarnIfGreater);
-    GET_VALUE_WARN(samplerMipLodBias, WarnIfGreater);
-    GET_VALUE_WARN(separateStencilMaskRef, WarnIfGreater);
-    GET_VALUE_WARN(shaderSampleRateInterpolationFunctions, WarnIfGreater);
-    GET_VALUE_WARN(tessellationIsolines, WarnIfGreater);
-    GET_VALUE_WARN(tessellationPointMode, WarnIfGreater);
-    GET_VALUE_WARN(triangleFans, WarnIfGreater);
-    GET_VALUE_WARN(vertexAttributeAccessBeyondStride, WarnIfGreater);
-}
-
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkExtent3D *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
+
+    BinaryWriter payload;
+    WritePayload(pdd, &payload);
+    const Header header = {kMagic, kVersion, key.source.size(), payload.buffer().size(),
+                           HashBytes(payload.buffer().data(), payload.buffer().size())};
+
+    // Write a temporary file and rename it, so that other processes never see a partial entry.
+#if defined(_WIN32)
+    const std::string temp_path = key.path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+    const std::string temp_path = key.path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    bool written = false;
+    if (CreateDirectories(directory_)) {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(key.source.data(), key.source.size());
+        file.write(payload.buffer().data(), payload.buffer().size());
+        file.close();
+        written = !file.fail();
+    }
+    if (!written || !RenameFile(temp_path, key.path)) {
+        remove(temp_path.c_str());
+        DebugPrintf("could not write profile cache entry \"%s\"\n", key.path.c_str());
         return;
     }
-    GET_VALUE(width);
-    GET_VALUE(height);
-    GET_VALUE(depth);
+    DebugPrintf("wrote profile cache entry \"%s\"\n", key.path.c_str());
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, int index, VkQueueFamilyProperties *dest) {
-    const Json::Value value = parent[index];
-    if (value.type() != Json::objectValue) {
-        return;
+void ProfileCache::WritePayload(const PhysicalDeviceData &pdd, BinaryWriter *writer) {
+    VkPhysicalDevicePortabilitySubsetPropertiesKHR portability_properties = pdd.physical_device_portability_subset_properties_;
+    VkPhysicalDevicePortabilitySubsetFeaturesKHR portability_features = pdd.physical_device_portability_subset_features_;
+    portability_properties.pNext = nullptr;
+    portability_features.pNext = nullptr;
+
+    writer->Write(pdd.physical_device_properties_);
+    writer->Write(pdd.physical_device_features_);
+    writer->Write(pdd.physical_device_memory_properties_);
+    writer->Write(portability_properties);
+    writer->Write(portability_features);
+    writer->WriteArray(pdd.arrayof_queue_family_properties_);
+    writer->WriteArray(pdd.arrayof_format_properties_.blocks_);
+    writer->WriteArray(pdd.arrayof_format_properties_.entries_);
+    writer->Write(static_cast<uint64_t>(pdd.arrayof_format_properties_.size_));
+    writer->WriteArray(pdd.arrayof_layer_properties_);
+    writer->WriteArray(pdd.arrayof_extension_properties_);
+}
+
+bool ProfileCache::ReadPayload(BinaryReader *reader, PhysicalDeviceData *pdd) {
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkPhysicalDevicePortabilitySubsetPropertiesKHR portability_properties;
+    VkPhysicalDevicePortabilitySubsetFeaturesKHR portability_features;
+    ArrayOfVkQueueFamilyProperties queue_family_properties;
+    ArrayOfVkFormatProperties format_properties;
+    uint64_t format_count = 0;
+    ArrayOfVkLayerProperties layer_properties;
+    ArrayOfVkExtensionProperties extension_properties;
+    if (!reader->Read(&properties) || !reader->Read(&features) || !reader->Read(&memory_properties) ||
+        !reader->Read(&portability_properties) || !reader->Read(&portability_features) ||
+        !reader->ReadArray(&queue_family_properties) || !reader->ReadArray(&format_properties.blocks_) ||
+        !reader->ReadArray(&format_properties.entries_) || !reader->Read(&format_count) || !reader->ReadArray(&layer_properties) ||
+        !reader->ReadArray(&extension_properties) || !reader->AtEnd()) {
+        return false;
+    }
+    for (const auto &block : format_properties.blocks_) {
+        if (block.count > FormatPropertiesTable::kBlockSize || block.first > format_properties.entries_.size() ||
+            block.count > format_properties.entries_.size() - block.first) {
+            return false;
+        }
     }
-    GET_VALUE(queueFlags);
-    GET_VALUE(queueCount);
-    GET_VALUE(timestampValidBits);
-    GET_VALUE(minImageTransferGranularity);
+    format_properties.size_ = static_cast<size_t>(format_count);
+
+    portability_properties.pNext = pdd->physical_device_portability_subset_properties_.pNext;
+    portability_features.pNext = pdd->physical_device_portability_subset_features_.pNext;
+    pdd->physical_device_properties_ = properties;
+    pdd->physical_device_features_ = features;
+    pdd->physical_device_memory_properties_ = memory_properties;
+    pdd->physical_device_portability_subset_properties_ = portability_properties;
+    pdd->physical_device_portability_subset_features_ = portability_features;
+    pdd->arrayof_queue_family_properties_.swap(queue_family_properties);
+    pdd->arrayof_format_properties_ = std::move(format_properties);
+    pdd->arrayof_layer_properties_.swap(layer_properties);
+    pdd->arrayof_extension_properties_.swap(extension_properties);
+    return true;
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, int index, VkMemoryType *dest) {
-    const Json::Value value = parent[index];
-    if (value.type() != Json::objectValue) {
-        return;
+// Hot reload of the configuration files /////////////////////////////////////////////////////////////////////////////////////////
+
+// Watches the configuration files of the physical devices with inotify, and applies them again when they change.  A background
+// thread parses the changed files, applies them to the values of the Vulkan implementation, and publishes the resulting PDDs in
+// place of the current ones with PhysicalDeviceData::Replace().  The vkGetPhysicalDevice*() queries never wait for a reload:
+// they keep reading the PDDs published before until the new ones are.
+class ProfileWatcher {
+   public:
+    explicit ProfileWatcher(VkInstance instance) : instance_(instance) {}
+    ProfileWatcher(const ProfileWatcher &) = delete;
+    ProfileWatcher &operator=(const ProfileWatcher &) = delete;
+
+    // Stop the thread.  The watcher must be deleted without global_lock held, as the thread takes it to publish the PDDs.
+    ~ProfileWatcher();
+
+    VkInstance instance() const { return instance_; }
+
+    // Apply filename_list again to the values of pdd when one of its files changes.  pdd must not have been configured yet.
+    void Watch(VkPhysicalDevice physical_device, const std::string &filename_list, const PhysicalDeviceData &pdd);
+
+    // Start watching the files, or return false if they cannot be watched.
+    bool Start();
+
+   private:
+    // A list of configuration files and the physical devices that it configures.
+    struct Binding {
+        std::string filename_list;
+        std::vector<std::pair<VkPhysicalDevice, PhysicalDeviceData>> devices;  // with the values of the Vulkan implementation
+        std::vector<std::pair<int, std::string>> files;  // the inotify watch descriptor of the directory, and the file name
+        bool changed;
+    };
+
+    // How long the files must stay unchanged before they are reloaded, as editors often write them in several steps.
+    static const int kSettleMilliseconds = 100;
+
+    void Run();
+    void Reload(const Binding &binding);
+
+    const VkInstance instance_;
+    std::vector<Binding> bindings_;
+    int inotify_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+ProfileWatcher *profileWatcher = nullptr;  // The watcher of the configuration files while hot reload is enabled.
+
+ProfileWatcher::~ProfileWatcher() {
+    stop_.store(true);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+#if defined(__linux__)
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
     }
-    GET_VALUE(propertyFlags);
-    GET_VALUE(heapIndex);
+#endif
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, int index, VkMemoryHeap *dest) {
-    const Json::Value value = parent[index];
-    if (value.type() != Json::objectValue) {
-        return;
+void ProfileWatcher::Watch(VkPhysicalDevice physical_device, const std::string &filename_list, const PhysicalDeviceData &pdd) {
+    auto binding = std::find_if(bindings_.begin(), bindings_.end(),
+                                [&](const Binding &existing) { return existing.filename_list == filename_list; });
+    if (binding == bindings_.end()) {
+        bindings_.push_back({filename_list, {}, {}, false});
+        binding = bindings_.end() - 1;
     }
-    GET_VALUE_WARN(size, WarnIfGreater);
-    GET_VALUE(flags);
+    binding->devices.emplace_back(physical_device, pdd);
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, const char *name, VkPhysicalDeviceMemoryProperties *dest) {
-    const Json::Value value = parent[name];
-    if (value.type() != Json::objectValue) {
-        return;
+bool ProfileWatcher::Start() {
+#if defined(__linux__)
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        ErrorPrintf("ProfileWatcher failed to initialize inotify\n");
+        return false;
     }
-    DebugPrintf("\t\tJsonLoader::GetValue(VkPhysicalDeviceMemoryProperties)\n");
-    const int heap_count = GET_ARRAY(memoryHeaps);  // size <= VK_MAX_MEMORY_HEAPS
-    if (heap_count >= 0) {
-        dest->memoryHeapCount = heap_count;
-    }
-    const int type_count = GET_ARRAY(memoryTypes);  // size <= VK_MAX_MEMORY_TYPES
-    if (type_count >= 0) {
-        dest->memoryTypeCount = type_count;
-        for (int i = 0; i < type_count; ++i) {
-            if (dest->memoryTypes[i].heapIndex >= dest->memoryHeapCount) {
-                DebugPrintf("WARN \"memoryType[%" PRIu32 "].heapIndex\" (%" PRIu32 ") exceeds memoryHeapCount (%" PRIu32 ")\n", i,
-                            dest->memoryTypes[i].heapIndex, dest->memoryHeapCount);
+
+    // Directories are watched rather than files, as editors often replace a file by renaming a new one over it.
+    for (auto &binding : bindings_) {
+        for (const auto &filename : SplitFilenameList(binding.filename_list.c_str())) {
+            const size_t separator = filename.find_last_of('/');
+            const std::string directory = (separator == std::string::npos) ? "." : filename.substr(0, separator + 1);
+            const int wd = inotify_add_watch(inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd < 0) {
+                ErrorPrintf("ProfileWatcher failed to watch directory \"%s\"\n", directory.c_str());
+                continue;
             }
+            binding.files.emplace_back(wd, filename.substr(separator + 1));
+            DebugPrintf("ProfileWatcher watching \"%s\"\n", filename.c_str());
         }
     }
+
+    thread_ = std::thread(&ProfileWatcher::Run, this);
+    return true;
+#else
+    DebugPrintf("ProfileWatcher: hot reload is only available on Linux and Android\n");
+    return false;
+#endif
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, int index, DevsimFormatProperties *dest) {
-    const Json::Value value = parent[index];
-    if (value.type() != Json::objectValue) {
-        return;
+void ProfileWatcher::Run() {
+#if defined(__linux__)
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    while (!stop_.load()) {
+        pollfd poll_fd = {inotify_fd_, POLLIN, 0};
+        const int ready = poll(&poll_fd, 1, kSettleMilliseconds);
+        if (ready < 0 && errno != EINTR) {
+            ErrorPrintf("ProfileWatcher stopped watching, poll() failed\n");
+            return;
+        }
+
+        if (ready > 0) {
+            const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < length;) {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                for (auto &binding : bindings_) {
+                    for (const auto &file : binding.files) {
+                        if (event->len > 0 && file.first == event->wd && file.second == event->name) {
+                            binding.changed = true;
+                            changed = true;
+                        }
+                    }
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+        } else if (ready == 0 && changed) {
+            for (auto &binding : bindings_) {
+                if (binding.changed) {
+                    binding.changed = false;
+                    Reload(binding);
+                }
+            }
+            changed = false;
+        }
     }
-    GET_VALUE(formatID);
-    GET_VALUE(linearTilingFeatures);
-    GET_VALUE(optimalTilingFeatures);
-    GET_VALUE(bufferFeatures);
+#endif
 }
 
-void JsonLoader::GetValue(const Json::Value &parent, int index, VkLayerProperties *dest) {
-    const Json::Value value = parent[index];
-    if (value.type() != Json::objectValue) {
+void ProfileWatcher::Reload(const Binding &binding) {
+    DebugPrintf("ProfileWatcher reloading \"%s\"\n", binding.filename_list.c_str());
+
+    // Files that cannot be parsed, for instance while they are being edited, leave the physical devices as they are.
+    const uint32_t error_count = errorCount;
+    const std::shared_ptr<const DevsimProfile> profile = JsonLoader::ParseFiles(binding.filename_list.c_str());
+    if (errorCount != error_count) {
+        DebugPrintf("ProfileWatcher keeping the previous configuration\n");
         return;
     }
-    GET_ARRAY(layerName);  // size < VK_MAX_EXTENSION_NAME_SIZE
-    GET_VALUE(specVersion);
-    GET_VALUE(implementationVersion);
-    GET_ARRAY(description);  // size < VK_MAX_DESCRIPTION_SIZE
-}
 
-void JsonLoader::GetValue(const Json::Value &parent, int index, VkExtensionProperties *dest) {
-    const Json::Value value = parent[index];
-    if (value.type() != Json::objectValue) {
-        return;
+    for (const auto &device : binding.devices) {
+        std::unique_ptr<PhysicalDeviceData> pdd(new PhysicalDeviceData(device.second));
+        JsonLoader json_loader(*pdd);
+        json_loader.ApplyProfile(*profile);
+
+        std::lock_guard<std::mutex> lock(global_lock);
+        PhysicalDeviceData::Replace(device.first, std::move(pdd));
     }
-    GET_ARRAY(extensionName);  // size < VK_MAX_EXTENSION_NAME_SIZE
-    GET_VALUE(specVersion);
 }
 
-#undef GET_VALUE
-#undef GET_ARRAY
-
 // Layer-specific wrappers for Vulkan functions, accessed via vkGet*ProcAddr() ///////////////////////////////////////////////////
 
 // Fill the inputFilename variable with a value from either vk_layer_settings.txt or environment variables.
@@ -1431,6 +2176,57 @@ static void GetDevSimModifyMemoryFlags() {
     modifyMemoryFlags.num = GetBooleanValue(modify_memory_flags);
 }
 
+// Fill the profileCache variable with a value from either vk_layer_settings.txt or environment variables.
+// Environment variables get priority.  The cache is enabled unless it is set to zero.
+static void GetDevSimProfileCache() {
+    std::string profile_cache = getLayerOption(kLayerSettingsDevsimProfileCache);
+    profileCache.fromEnvVar = false;
+    std::string env_var = GetEnvarValue(kEnvarDevsimProfileCache);
+    if (!env_var.empty()) {
+        profile_cache = env_var;
+        profileCache.fromEnvVar = true;
+    }
+    profileCache.num = profile_cache.empty() ? 1 : GetBooleanValue(profile_cache);
+}
+
+// Fill the filenameMap variable with a value from either vk_layer_settings.txt or environment variables.
+// Environment variables get priority.
+static void GetDevSimFilenameMap() {
+    filenameMap.str = getLayerOption(kLayerSettingsDevsimFilenameMap);
+    filenameMap.fromEnvVar = false;
+    std::string env_var = GetEnvarValue(kEnvarDevsimFilenameMap);
+    if (!env_var.empty()) {
+        filenameMap.str = env_var;
+        filenameMap.fromEnvVar = true;
+    }
+}
+
+// Fill the memoryBudget variable with a value from either vk_layer_settings.txt or environment variables.
+// Environment variables get priority.
+static void GetDevSimMemoryBudget() {
+    std::string memory_budget = getLayerOption(kLayerSettingsDevsimMemoryBudget);
+    memoryBudget.fromEnvVar = false;
+    std::string env_var = GetEnvarValue(kEnvarDevsimMemoryBudget);
+    if (!env_var.empty()) {
+        memory_budget = env_var;
+        memoryBudget.fromEnvVar = true;
+    }
+    memoryBudget.num = GetBooleanValue(memory_budget);
+}
+
+// Fill the hotReload variable with a value from either vk_layer_settings.txt or environment variables.
+// Environment variables get priority.
+static void GetDevSimHotReload() {
+    std::string hot_reload = getLayerOption(kLayerSettingsDevsimHotReload);
+    hotReload.fromEnvVar = false;
+    std::string env_var = GetEnvarValue(kEnvarDevsimHotReload);
+    if (!env_var.empty()) {
+        hot_reload = env_var;
+        hotReload.fromEnvVar = true;
+    }
+    hotReload.num = GetBooleanValue(hot_reload);
+}
+
 // Generic layer dispatch table setup, see [LALI].
 static VkResult LayerSetupCreateInstance(const VkInstanceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator,
                                          VkInstance *pInstance) {
@@ -1440,6 +2236,10 @@ static VkResult LayerSetupCreateInstance(const VkInstanceCreateInfo *pCreateInfo
     GetDevSimErrorLevel();
     GetDevSimModifyExtensionList();
     GetDevSimModifyMemoryFlags();
+    GetDevSimProfileCache();
+    GetDevSimFilenameMap();
+    GetDevSimMemoryBudget();
+    GetDevSimHotReload();
 
     VkLayerInstanceCreateInfo *chain_info = get_chain_info(pCreateInfo, VK_LAYER_LINK_INFO);
     assert(chain_info->u.pLayerInfo);
@@ -1462,7 +2262,6 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreat
                                               VkInstance *pInstance) {
     DebugPrintf("CreateInstance ========================================\n");
     DebugPrintf("%s version %d.%d.%d\n", kOurLayerName, kVersionDevsimMajor, kVersionDevsimMinor, kVersionDevsimPatch);
-    DebugPrintf("JsonCpp version %s\n", JSONCPP_VERSION_STRING);
 
     const VkApplicationInfo *app_info = pCreateInfo->pApplicationInfo;
     const uint32_t requested_version = (app_info && app_info->apiVersion) ? app_info->apiVersion : VK_API_VERSION_1_0;
@@ -1491,6 +2290,17 @@ VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance, const VkAllocati
     DebugPrintf("DestroyInstance\n");
 
     if (instance) {
+        // The watcher is stopped before global_lock is taken, which its thread may be waiting for.
+        std::unique_ptr<ProfileWatcher> watcher;
+        {
+            std::lock_guard<std::mutex> lock(global_lock);
+            if (profileWatcher && profileWatcher->instance() == instance) {
+                watcher.reset(profileWatcher);
+                profileWatcher = nullptr;
+            }
+        }
+        watcher.reset();
+
         std::lock_guard<std::mutex> lock(global_lock);
 
         {
@@ -1501,8 +2311,10 @@ VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance, const VkAllocati
                 return dt->EnumeratePhysicalDevices(instance, count, results);
             });
             assert(!err);
-            if (!err)
+            if (!err) {
                 for (const auto pd : physical_devices) PhysicalDeviceData::Destroy(pd);
+                PhysicalDeviceData::Publish();
+            }
 
             dt->DestroyInstance(instance, pAllocator);
         }
@@ -1511,19 +2323,17 @@ VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance, const VkAllocati
 }
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceProperties *pProperties) {
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
-
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
     if (pdd) {
         *pProperties = pdd->physical_device_properties_;
     } else {
-        dt->GetPhysicalDeviceProperties(physicalDevice, pProperties);
+        DispatchTable(pdd, physicalDevice)->GetPhysicalDeviceProperties(physicalDevice, pProperties);
     }
 }
 
 // Utility function for iterating through the pNext chain of certain Vulkan structs.
-void FillPNextChain(PhysicalDeviceData *physicalDeviceData, void *place) {
+void FillPNextChain(const PhysicalDeviceData *physicalDeviceData, void *place) {
     while (place) {
         VkBaseOutStructure *structure = (VkBaseOutStructure *)place;
 
@@ -1553,14 +2363,13 @@ void FillPNextChain(PhysicalDeviceData *physicalDeviceData, void *place) {
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceProperties2(VkPhysicalDevice physicalDevice,
                                                         VkPhysicalDeviceProperties2KHR *pProperties) {
-    {
-        std::lock_guard<std::mutex> lock(global_lock);
-        const auto dt = instance_dispatch_table(physicalDevice);
-        dt->GetPhysicalDeviceProperties2(physicalDevice, pProperties);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    DispatchTable(pdd, physicalDevice)->GetPhysicalDeviceProperties2(physicalDevice, pProperties);
+    if (pdd) {
+        pProperties->properties = pdd->physical_device_properties_;
+        FillPNextChain(pdd, pProperties->pNext);
     }
-    GetPhysicalDeviceProperties(physicalDevice, &pProperties->properties);
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
-    FillPNextChain(pdd, pProperties->pNext);
 }
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceProperties2KHR(VkPhysicalDevice physicalDevice,
@@ -1569,26 +2378,23 @@ VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceProperties2KHR(VkPhysicalDevice phys
 }
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceFeatures(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures *pFeatures) {
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
-
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
     if (pdd) {
         *pFeatures = pdd->physical_device_features_;
     } else {
-        dt->GetPhysicalDeviceFeatures(physicalDevice, pFeatures);
+        DispatchTable(pdd, physicalDevice)->GetPhysicalDeviceFeatures(physicalDevice, pFeatures);
     }
 }
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceFeatures2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures2KHR *pFeatures) {
-    {
-        std::lock_guard<std::mutex> lock(global_lock);
-        const auto dt = instance_dispatch_table(physicalDevice);
-        dt->GetPhysicalDeviceFeatures2(physicalDevice, pFeatures);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    DispatchTable(pdd, physicalDevice)->GetPhysicalDeviceFeatures2(physicalDevice, pFeatures);
+    if (pdd) {
+        pFeatures->features = pdd->physical_device_features_;
+        FillPNextChain(pdd, pFeatures->pNext);
     }
-    GetPhysicalDeviceFeatures(physicalDevice, &pFeatures->features);
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
-    FillPNextChain(pdd, pFeatures->pNext);
 }
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceFeatures2KHR(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures2KHR *pFeatures) {
@@ -1629,10 +2435,10 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumerateInstanceExtensionProperties(const char *
 VKAPI_ATTR VkResult VKAPI_CALL EnumerateDeviceExtensionProperties(VkPhysicalDevice physicalDevice, const char *pLayerName,
                                                                   uint32_t *pCount, VkExtensionProperties *pProperties) {
     VkResult result = VK_SUCCESS;
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    const auto dt = DispatchTable(pdd, physicalDevice);
 
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
     const uint32_t src_count = (pdd) ? static_cast<uint32_t>(pdd->arrayof_extension_properties_.size()) : 0;
     if (pLayerName && !strcmp(pLayerName, kOurLayerName)) {
         result = EnumerateProperties(kDeviceExtensionPropertiesCount, kDeviceExtensionProperties.data(), pCount, pProperties);
@@ -1642,8 +2448,8 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumerateDeviceExtensionProperties(VkPhysicalDevi
         result = EnumerateProperties(src_count, pdd->arrayof_extension_properties_.data(), pCount, pProperties);
     }
 
-    if (result == VK_SUCCESS && !pLayerName && emulatePortability.num > 0 &&
-        !PhysicalDeviceData::HasSimulatedOrRealExtension(physicalDevice, VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME)) {
+    if (result == VK_SUCCESS && !pLayerName && emulatePortability.num > 0 && pdd &&
+        !PhysicalDeviceData::HasSimulatedOrRealExtension(pdd, VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME)) {
         if (pProperties) {
             strncpy(pProperties[(*pCount) - 1].extensionName, VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME, VK_MAX_EXTENSION_NAME_SIZE);
             pProperties[(*pCount) - 1].specVersion = VK_KHR_PORTABILITY_SUBSET_SPEC_VERSION;
@@ -1657,11 +2463,10 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumerateDeviceExtensionProperties(VkPhysicalDevi
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice,
                                                              VkPhysicalDeviceMemoryProperties *pMemoryProperties) {
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
-
     // Are there JSON overrides, or should we call down to return the original values?
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    const auto dt = DispatchTable(pdd, physicalDevice);
     if (pdd) {
         if (modifyMemoryFlags.num > 0) {
             *pMemoryProperties = pdd->physical_device_memory_properties_;
@@ -1681,19 +2486,48 @@ VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceMemoryProperties(VkPhysicalDevice ph
     }
 }
 
+// Report the memory allocated from each heap of a physical device when heap budgets are simulated, with the size of the heap as
+// its budget.
+void FillMemoryBudget(const PhysicalDeviceData *pdd, const VkPhysicalDeviceMemoryProperties &memory_properties, void *place) {
+    while (place) {
+        VkBaseOutStructure *structure = (VkBaseOutStructure *)place;
+        if (structure->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT) {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT *budget = (VkPhysicalDeviceMemoryBudgetPropertiesEXT *)place;
+            for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i) {
+                const bool valid = i < memory_properties.memoryHeapCount;
+                budget->heapBudget[i] = valid ? memory_properties.memoryHeaps[i].size : 0;
+                budget->heapUsage[i] = valid ? pdd->heap_usage_->heaps[i].load(std::memory_order_relaxed) : 0;
+            }
+        }
+        place = structure->pNext;
+    }
+}
+
+VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceMemoryProperties2(VkPhysicalDevice physicalDevice,
+                                                              VkPhysicalDeviceMemoryProperties2KHR *pMemoryProperties) {
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    DispatchTable(pdd, physicalDevice)->GetPhysicalDeviceMemoryProperties2(physicalDevice, pMemoryProperties);
+    if (pdd) {
+        GetPhysicalDeviceMemoryProperties(physicalDevice, &pMemoryProperties->memoryProperties);
+        if (pdd->heap_usage_) {
+            FillMemoryBudget(pdd, pMemoryProperties->memoryProperties, pMemoryProperties->pNext);
+        }
+    }
+}
+
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceMemoryProperties2KHR(VkPhysicalDevice physicalDevice,
                                                                  VkPhysicalDeviceMemoryProperties2KHR *pMemoryProperties) {
-    GetPhysicalDeviceMemoryProperties(physicalDevice, &pMemoryProperties->memoryProperties);
+    GetPhysicalDeviceMemoryProperties2(physicalDevice, pMemoryProperties);
 }
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice physicalDevice,
                                                                   uint32_t *pQueueFamilyPropertyCount,
                                                                   VkQueueFamilyProperties *pQueueFamilyProperties) {
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
-
     // Are there JSON overrides, or should we call down to return the original values?
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    const auto dt = DispatchTable(pdd, physicalDevice);
     const uint32_t src_count = (pdd) ? static_cast<uint32_t>(pdd->arrayof_queue_family_properties_.size()) : 0;
     if (src_count == 0) {
         dt->GetPhysicalDeviceQueueFamilyProperties(physicalDevice, pQueueFamilyPropertyCount, pQueueFamilyProperties);
@@ -1706,11 +2540,10 @@ VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevi
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceQueueFamilyProperties2KHR(VkPhysicalDevice physicalDevice,
                                                                       uint32_t *pQueueFamilyPropertyCount,
                                                                       VkQueueFamilyProperties2KHR *pQueueFamilyProperties2) {
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
-
     // Are there JSON overrides, or should we call down to return the original values?
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    const auto dt = DispatchTable(pdd, physicalDevice);
     const uint32_t src_count = (pdd) ? static_cast<uint32_t>(pdd->arrayof_queue_family_properties_.size()) : 0;
     if (src_count == 0) {
         dt->GetPhysicalDeviceQueueFamilyProperties2KHR(physicalDevice, pQueueFamilyPropertyCount, pQueueFamilyProperties2);
@@ -1733,17 +2566,14 @@ VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceQueueFamilyProperties2KHR(VkPhysical
 
 VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceFormatProperties(VkPhysicalDevice physicalDevice, VkFormat format,
                                                              VkFormatProperties *pFormatProperties) {
-    std::lock_guard<std::mutex> lock(global_lock);
-    const auto dt = instance_dispatch_table(physicalDevice);
-
     // Are there JSON overrides, or should we call down to return the original values?
-    PhysicalDeviceData *pdd = PhysicalDeviceData::Find(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
     const uint32_t src_count = (pdd) ? static_cast<uint32_t>(pdd->arrayof_format_properties_.size()) : 0;
     if (src_count == 0) {
-        dt->GetPhysicalDeviceFormatProperties(physicalDevice, format, pFormatProperties);
+        DispatchTable(pdd, physicalDevice)->GetPhysicalDeviceFormatProperties(physicalDevice, format, pFormatProperties);
     } else {
-        const auto iter = pdd->arrayof_format_properties_.find(format);
-        *pFormatProperties = (iter != pdd->arrayof_format_properties_.end()) ? iter->second : VkFormatProperties{};
+        *pFormatProperties = pdd->arrayof_format_properties_.Get(format);
     }
 }
 
@@ -1774,7 +2604,8 @@ VKAPI_ATTR VkResult VKAPI_CALL GetPhysicalDeviceToolPropertiesEXT(VkPhysicalDevi
         (*pToolCount)--;
     }
 
-    VkLayerInstanceDispatchTable *pInstanceTable = instance_dispatch_table(physicalDevice);
+    const PhysicalDeviceData::Reader reader;
+    VkLayerInstanceDispatchTable *pInstanceTable = DispatchTable(PhysicalDeviceData::FindPublished(physicalDevice), physicalDevice);
     VkResult result = pInstanceTable->GetPhysicalDeviceToolPropertiesEXT(physicalDevice, pToolCount, pToolProperties);
 
     if (original_pToolProperties != nullptr) {
@@ -1808,9 +2639,23 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumeratePhysicalDevices(VkInstance instance, uin
             return result;
         }
 
+        // Read and parse each list of configuration files at most once, rather than once per physical device, and not at all if
+        // the profile cache holds the configuration of every physical device it applies to.
+        struct BoundProfile {
+            std::unique_ptr<const ProfileCache> cache;
+            std::shared_ptr<const DevsimProfile> profile;
+        };
+        const ProfileMap profile_map;
+        std::unordered_map<std::string, BoundProfile> bound_profiles;
+        std::unique_ptr<ProfileWatcher> watcher(hotReload.num > 0 ? new ProfileWatcher(instance) : nullptr);
+
         // For each physical device, create and populate a PDD instance.
-        for (const auto &physical_device : physical_devices) {
+        for (uint32_t index = 0; index < physical_devices.size(); ++index) {
+            const VkPhysicalDevice physical_device = physical_devices[index];
             PhysicalDeviceData &pdd = PhysicalDeviceData::Create(physical_device, instance);
+            if (memoryBudget.num > 0) {
+                pdd.heap_usage_ = std::make_shared<MemoryHeapUsage>();
+            }
 
             EnumerateAll<VkExtensionProperties>(&(pdd.device_extensions), [&](uint32_t *count, VkExtensionProperties *results) {
                 return dt->EnumerateDeviceExtensionProperties(physical_device, nullptr, count, results);
@@ -1864,15 +2709,142 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumeratePhysicalDevices(VkInstance instance, uin
 
             DebugPrintf("\tdeviceName \"%s\"\n", pdd.physical_device_properties_.deviceName);
 
-            // Override PDD members with values from configuration file(s).
-            JsonLoader json_loader(pdd);
-            json_loader.LoadFiles();
+            // Override PDD members with values from configuration file(s).  A physical device without any keeps the values of
+            // the Vulkan implementation.
+            const std::string *filename_list = profile_map.Select(index, pdd.physical_device_properties_);
+            if (!filename_list) {
+                DebugPrintf("\tno configuration file, passed through\n");
+                continue;
+            }
+            if (watcher) {
+                watcher->Watch(physical_device, *filename_list, pdd);
+            }
+            BoundProfile &bound = bound_profiles[*filename_list];
+            if (!bound.cache) {
+                bound.cache.reset(new ProfileCache(*filename_list));
+            }
+            const ProfileCache::Key key = bound.cache->MakeKey(pdd);
+            if (!bound.cache->Load(key, &pdd)) {
+                if (!bound.profile) {
+                    bound.profile = (filename_list == &inputFilename.str) ? JsonLoader::ParseFiles()
+                                                                          : JsonLoader::ParseFiles(filename_list->c_str());
+                }
+                JsonLoader json_loader(pdd);
+                json_loader.ApplyProfile(*bound.profile);
+                bound.cache->Store(key, pdd);
+            }
+        }
+        PhysicalDeviceData::Publish();
+        if (watcher && watcher->Start()) {
+            profileWatcher = watcher.release();
         }
         pdd_initialized = true;
     }
     return result;
 }
 
+VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo,
+                                            const VkAllocationCallbacks *pAllocator, VkDevice *pDevice) {
+    DebugPrintf("CreateDevice\n");
+
+    VkLayerDeviceCreateInfo *chain_info = get_chain_info(pCreateInfo, VK_LAYER_LINK_INFO);
+    assert(chain_info->u.pLayerInfo);
+
+    const PhysicalDeviceData::Reader reader;
+    const PhysicalDeviceData *pdd = PhysicalDeviceData::FindPublished(physicalDevice);
+    PFN_vkGetInstanceProcAddr fp_get_instance_proc_addr = chain_info->u.pLayerInfo->pfnNextGetInstanceProcAddr;
+    PFN_vkGetDeviceProcAddr fp_get_device_proc_addr = chain_info->u.pLayerInfo->pfnNextGetDeviceProcAddr;
+    PFN_vkCreateDevice fp_create_device =
+        (PFN_vkCreateDevice)fp_get_instance_proc_addr(pdd ? pdd->instance() : VK_NULL_HANDLE, "vkCreateDevice");
+    if (!fp_create_device) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    chain_info->u.pLayerInfo = chain_info->u.pLayerInfo->pNext;
+    VkResult result = fp_create_device(physicalDevice, pCreateInfo, pAllocator, pDevice);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    // The heap budgets are the sizes of the heaps that the application sees.
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    const bool simulate_heap_budgets = pdd && pdd->heap_usage_;
+    if (simulate_heap_budgets) {
+        GetPhysicalDeviceMemoryProperties(physicalDevice, &memory_properties);
+    }
+
+    std::lock_guard<std::mutex> lock(global_lock);
+    DeviceData &dd = DeviceData::Create(*pDevice, initDeviceTable(*pDevice, fp_get_device_proc_addr));
+    if (simulate_heap_budgets) {
+        dd.SimulateHeapBudgets(pdd->heap_usage_, memory_properties);
+    }
+    DeviceData::Publish();
+    return result;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator) {
+    DebugPrintf("DestroyDevice\n");
+
+    if (device) {
+        std::lock_guard<std::mutex> lock(global_lock);
+        const dispatch_key key = get_dispatch_key(device);
+        DeviceData::FindPublished(device)->dispatch_table()->DestroyDevice(device, pAllocator);
+        DeviceData::Destroy(device);
+        DeviceData::Publish();
+        destroy_device_dispatch_table(key);
+    }
+}
+
+// Only intercepted when heap budgets are simulated.
+VKAPI_ATTR VkResult VKAPI_CALL AllocateMemory(VkDevice device, const VkMemoryAllocateInfo *pAllocateInfo,
+                                              const VkAllocationCallbacks *pAllocator, VkDeviceMemory *pMemory) {
+    DeviceData *dd = DeviceData::FindPublished(device);
+    const uint32_t memory_type_index = pAllocateInfo->memoryTypeIndex;
+    const VkDeviceSize size = pAllocateInfo->allocationSize;
+    if (!dd->ReserveMemory(memory_type_index, size)) {
+        DebugPrintf("vkAllocateMemory of %" PRIu64 " bytes of memory type %u exceeds the heap budget\n", size, memory_type_index);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    VkResult result = dd->dispatch_table()->AllocateMemory(device, pAllocateInfo, pAllocator, pMemory);
+    if (result == VK_SUCCESS) {
+        dd->AddMemory(*pMemory, memory_type_index, size);
+    } else {
+        dd->UnreserveMemory(memory_type_index, size);
+    }
+    return result;
+}
+
+// Only intercepted when heap budgets are simulated.  The allocation is forgotten before it is freed, as its handle may be reused
+// by an allocation on another thread as soon as it is.
+VKAPI_ATTR void VKAPI_CALL FreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *pAllocator) {
+    DeviceData *dd = DeviceData::FindPublished(device);
+    dd->ReleaseMemory(memory);
+    dd->dispatch_table()->FreeMemory(device, memory, pAllocator);
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetDeviceProcAddr(VkDevice device, const char *pName) {
+#define GET_PROC_ADDR(func) \
+    if (strcmp("vk" #func, pName) == 0) return reinterpret_cast<PFN_vkVoidFunction>(func);
+    GET_PROC_ADDR(GetDeviceProcAddr);
+    GET_PROC_ADDR(DestroyDevice);
+    if (memoryBudget.num > 0) {
+        GET_PROC_ADDR(AllocateMemory);
+        GET_PROC_ADDR(FreeMemory);
+    }
+#undef GET_PROC_ADDR
+
+    if (!device) {
+        return nullptr;
+    }
+
+    const DeviceData *dd = DeviceData::FindPublished(device);
+    if (!dd || !dd->dispatch_table()->GetDeviceProcAddr) {
+        return nullptr;
+    }
+    return dd->dispatch_table()->GetDeviceProcAddr(device, pName);
+}
+
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance instance, const char *pName) {
 // Apply the DRY principle, see https://en.wikipedia.org/wiki/Don%27t_repeat_yourself
 #define GET_PROC_ADDR(func) \
@@ -1884,6 +2856,8 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance instance
     GET_PROC_ADDR(EnumerateDeviceExtensionProperties);
     GET_PROC_ADDR(EnumeratePhysicalDevices);
     GET_PROC_ADDR(DestroyInstance);
+    GET_PROC_ADDR(CreateDevice);
+    GET_PROC_ADDR(GetDeviceProcAddr);
     GET_PROC_ADDR(GetPhysicalDeviceProperties);
     GET_PROC_ADDR(GetPhysicalDeviceProperties2);
     GET_PROC_ADDR(GetPhysicalDeviceProperties2KHR);
@@ -1891,6 +2865,7 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance instance
     GET_PROC_ADDR(GetPhysicalDeviceFeatures2);
     GET_PROC_ADDR(GetPhysicalDeviceFeatures2KHR);
     GET_PROC_ADDR(GetPhysicalDeviceMemoryProperties);
+    GET_PROC_ADDR(GetPhysicalDeviceMemoryProperties2);
     GET_PROC_ADDR(GetPhysicalDeviceMemoryProperties2KHR);
     GET_PROC_ADDR(GetPhysicalDeviceQueueFamilyProperties);
     GET_PROC_ADDR(GetPhysicalDeviceQueueFamilyProperties2KHR);
@@ -1921,6 +2896,10 @@ VK_LAYER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddr(V
     return GetInstanceProcAddr(instance, pName);
 }
 
+VK_LAYER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddr(VkDevice device, const char *pName) {
+    return GetDeviceProcAddr(device, pName);
+}
+
 VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkCreateInstance(const VkInstanceCreateInfo *pCreateInfo,
                                                                 const VkAllocationCallbacks *pAllocator, VkInstance *pInstance) {
     return CreateInstance(pCreateInfo, pAllocator, pInstance);
@@ -1955,7 +2934,7 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
 
     if (pVersionStruct->loaderLayerInterfaceVersion >= 2) {
         pVersionStruct->pfnGetInstanceProcAddr = vkGetInstanceProcAddr;
-        pVersionStruct->pfnGetDeviceProcAddr = nullptr;
+        pVersionStruct->pfnGetDeviceProcAddr = vkGetDeviceProcAddr;
         pVersionStruct->pfnGetPhysicalDeviceProcAddr = nullptr;
     }
 
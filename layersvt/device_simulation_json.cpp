@@ -0,0 +1,1171 @@
+/*
+ * Copyright (C) 2015-2021 Valve Corporation
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "device_simulation_json.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <locale>
+#include <sstream>
+#include <type_traits>
+
+namespace devsim {
+
+namespace {
+
+// Tables of the fields of the structures in the DevSim schema ///////////////////////////////////////////////////////////////////
+
+enum class MemberKind : uint8_t {
+    kValue,        // a single value or a string
+    kArray,        // an array of count values
+    kObject,       // a nested structure
+    kObjectArray,  // an array of up to count structures, whose length is stored in the field at count_offset
+};
+
+struct MemberTable;
+
+struct Member {
+    const char *name;
+    MemberKind kind;
+    ValueType type;
+    Warn warn;
+    uint32_t offset;
+    uint32_t size;   // of a value or a string, or of an element of an array
+    uint32_t count;  // of the elements of an array
+    const char *count_name;
+    uint32_t count_offset;
+    const MemberTable *table;  // of a nested structure, or of the elements of an array of structures
+};
+
+struct MemberTable {
+    const Member *members;
+    size_t count;
+};
+
+template <typename T>
+constexpr ValueType ValueTypeOf() {
+    return std::is_enum<T>::value             ? ValueType::kInt32
+           : std::is_floating_point<T>::value ? ValueType::kFloat
+           : std::is_signed<T>::value         ? ValueType::kInt32
+           : sizeof(T) == 1                   ? ValueType::kUint8
+           : sizeof(T) == 8                   ? ValueType::kUint64
+                                              : ValueType::kUint32;
+}
+
+constexpr uint32_t SizeOf(ValueType type) {
+    return type == ValueType::kUint8 ? 1 : type == ValueType::kUint64 ? 8 : 4;
+}
+
+template <typename T>
+Member MakeValue(const char *name, size_t offset, Warn warn = Warn::kNone) {
+    static_assert(sizeof(T) == SizeOf(ValueTypeOf<T>()), "unsupported field type");
+    return Member{name, MemberKind::kValue, ValueTypeOf<T>(), warn, static_cast<uint32_t>(offset),
+                  sizeof(T), 1, nullptr, 0, nullptr};
+}
+
+template <typename A>
+Member MakeArray(const char *name, size_t offset) {
+    typedef typename std::remove_extent<A>::type T;
+    static_assert(sizeof(T) == SizeOf(ValueTypeOf<T>()), "unsupported field type");
+    return Member{name, MemberKind::kArray, ValueTypeOf<T>(), Warn::kNone, static_cast<uint32_t>(offset),
+                  sizeof(T), std::extent<A>::value, nullptr, 0, nullptr};
+}
+
+template <typename A>
+Member MakeString(const char *name, size_t offset) {
+    return Member{name, MemberKind::kValue, ValueType::kString, Warn::kNone, static_cast<uint32_t>(offset),
+                  sizeof(A), 1, nullptr, 0, nullptr};
+}
+
+template <typename T>
+Member MakeObject(const char *name, size_t offset, const MemberTable &table) {
+    return Member{name, MemberKind::kObject, ValueType::kUint8, Warn::kNone, static_cast<uint32_t>(offset),
+                  sizeof(T), 1, nullptr, 0, &table};
+}
+
+template <typename A>
+Member MakeObjectArray(const char *name, size_t offset, const char *count_name, size_t count_offset, const MemberTable &table) {
+    typedef typename std::remove_extent<A>::type T;
+    return Member{name, MemberKind::kObjectArray, ValueType::kUint8, Warn::kNone, static_cast<uint32_t>(offset),
+                  sizeof(T), std::extent<A>::value, count_name, static_cast<uint32_t>(count_offset), &table};
+}
+
+// The tables are generated from the field names, with offsetof() and the types of the fields, by these macros.  Each table is
+// in the order of the fields of its structure, which is the order in which their values are applied.
+#define VALUE(name) MakeValue<decltype(S::name)>(#name, offsetof(S, name))
+#define VALUE_WARN(name, warn) MakeValue<decltype(S::name)>(#name, offsetof(S, name), warn)
+#define ARRAY(name) MakeArray<decltype(S::name)>(#name, offsetof(S, name))
+#define STRING(name) MakeString<decltype(S::name)>(#name, offsetof(S, name))
+#define OBJECT(name, table) MakeObject<decltype(S::name)>(#name, offsetof(S, name), table)
+#define OBJECT_ARRAY(name, count_name, table) \
+    MakeObjectArray<decltype(S::name)>(#name, offsetof(S, name), #count_name, offsetof(S, count_name), table)
+#define TABLE(members) MemberTable{members, sizeof(members) / sizeof(members[0])}
+
+const MemberTable &LimitsTable() {
+    typedef VkPhysicalDeviceLimits S;
+    static const Member members[] = {
+        VALUE(maxImageDimension1D),
+        VALUE(maxImageDimension2D),
+        VALUE(maxImageDimension3D),
+        VALUE(maxImageDimensionCube),
+        VALUE(maxImageArrayLayers),
+        VALUE(maxTexelBufferElements),
+        VALUE(maxUniformBufferRange),
+        VALUE(maxStorageBufferRange),
+        VALUE(maxPushConstantsSize),
+        VALUE(maxMemoryAllocationCount),
+        VALUE(maxSamplerAllocationCount),
+        VALUE(bufferImageGranularity),
+        VALUE(sparseAddressSpaceSize),
+        VALUE_WARN(maxBoundDescriptorSets, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageDescriptorSamplers, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageDescriptorUniformBuffers, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageDescriptorStorageBuffers, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageDescriptorSampledImages, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageDescriptorStorageImages, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageDescriptorInputAttachments, Warn::kIfGreater),
+        VALUE_WARN(maxPerStageResources, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetSamplers, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetUniformBuffers, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetUniformBuffersDynamic, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetStorageBuffers, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetStorageBuffersDynamic, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetSampledImages, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetStorageImages, Warn::kIfGreater),
+        VALUE_WARN(maxDescriptorSetInputAttachments, Warn::kIfGreater),
+        VALUE(maxVertexInputAttributes),
+        VALUE(maxVertexInputBindings),
+        VALUE(maxVertexInputAttributeOffset),
+        VALUE(maxVertexInputBindingStride),
+        VALUE(maxVertexOutputComponents),
+        VALUE(maxTessellationGenerationLevel),
+        VALUE(maxTessellationPatchSize),
+        VALUE(maxTessellationControlPerVertexInputComponents),
+        VALUE(maxTessellationControlPerVertexOutputComponents),
+        VALUE(maxTessellationControlPerPatchOutputComponents),
+        VALUE(maxTessellationControlTotalOutputComponents),
+        VALUE(maxTessellationEvaluationInputComponents),
+        VALUE(maxTessellationEvaluationOutputComponents),
+        VALUE(maxGeometryShaderInvocations),
+        VALUE(maxGeometryInputComponents),
+        VALUE(maxGeometryOutputComponents),
+        VALUE(maxGeometryOutputVertices),
+        VALUE(maxGeometryTotalOutputComponents),
+        VALUE(maxFragmentInputComponents),
+        VALUE(maxFragmentOutputAttachments),
+        VALUE(maxFragmentDualSrcAttachments),
+        VALUE(maxFragmentCombinedOutputResources),
+        VALUE(maxComputeSharedMemorySize),
+        ARRAY(maxComputeWorkGroupCount),
+        VALUE(maxComputeWorkGroupInvocations),
+        ARRAY(maxComputeWorkGroupSize),
+        VALUE(subPixelPrecisionBits),
+        VALUE(subTexelPrecisionBits),
+        VALUE(mipmapPrecisionBits),
+        VALUE(maxDrawIndexedIndexValue),
+        VALUE(maxDrawIndirectCount),
+        VALUE(maxSamplerLodBias),
+        VALUE(maxSamplerAnisotropy),
+        VALUE(maxViewports),
+        ARRAY(maxViewportDimensions),
+        ARRAY(viewportBoundsRange),
+        VALUE(viewportSubPixelBits),
+        VALUE(minMemoryMapAlignment),
+        VALUE(minTexelBufferOffsetAlignment),
+        VALUE(minUniformBufferOffsetAlignment),
+        VALUE(minStorageBufferOffsetAlignment),
+        VALUE(minTexelOffset),
+        VALUE(maxTexelOffset),
+        VALUE(minTexelGatherOffset),
+        VALUE(maxTexelGatherOffset),
+        VALUE(minInterpolationOffset),
+        VALUE(maxInterpolationOffset),
+        VALUE(subPixelInterpolationOffsetBits),
+        VALUE(maxFramebufferWidth),
+        VALUE(maxFramebufferHeight),
+        VALUE(maxFramebufferLayers),
+        VALUE(framebufferColorSampleCounts),
+        VALUE(framebufferDepthSampleCounts),
+        VALUE(framebufferStencilSampleCounts),
+        VALUE(framebufferNoAttachmentsSampleCounts),
+        VALUE(maxColorAttachments),
+        VALUE(sampledImageColorSampleCounts),
+        VALUE(sampledImageIntegerSampleCounts),
+        VALUE(sampledImageDepthSampleCounts),
+        VALUE(sampledImageStencilSampleCounts),
+        VALUE(storageImageSampleCounts),
+        VALUE(maxSampleMaskWords),
+        VALUE(timestampComputeAndGraphics),
+        VALUE(timestampPeriod),
+        VALUE(maxClipDistances),
+        VALUE(maxCullDistances),
+        VALUE(maxCombinedClipAndCullDistances),
+        VALUE(discreteQueuePriorities),
+        ARRAY(pointSizeRange),
+        ARRAY(lineWidthRange),
+        VALUE(pointSizeGranularity),
+        VALUE(lineWidthGranularity),
+        VALUE(strictLines),
+        VALUE(standardSampleLocations),
+        VALUE(optimalBufferCopyOffsetAlignment),
+        VALUE(optimalBufferCopyRowPitchAlignment),
+        VALUE(nonCoherentAtomSize),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &SparsePropertiesTable() {
+    typedef VkPhysicalDeviceSparseProperties S;
+    static const Member members[] = {
+        VALUE(residencyStandard2DBlockShape),
+        VALUE(residencyStandard2DMultisampleBlockShape),
+        VALUE(residencyStandard3DBlockShape),
+        VALUE(residencyAlignedMipSize),
+        VALUE(residencyNonResidentStrict),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &PropertiesTable() {
+    typedef VkPhysicalDeviceProperties S;
+    static const Member members[] = {
+        VALUE(apiVersion),
+        VALUE(driverVersion),
+        VALUE(vendorID),
+        VALUE(deviceID),
+        VALUE(deviceType),
+        STRING(deviceName),
+        ARRAY(pipelineCacheUUID),
+        OBJECT(limits, LimitsTable()),
+        OBJECT(sparseProperties, SparsePropertiesTable()),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &FeaturesTable() {
+    typedef VkPhysicalDeviceFeatures S;
+    static const Member members[] = {
+        VALUE(robustBufferAccess),
+        VALUE(fullDrawIndexUint32),
+        VALUE(imageCubeArray),
+        VALUE(independentBlend),
+        VALUE(geometryShader),
+        VALUE(tessellationShader),
+        VALUE(sampleRateShading),
+        VALUE(dualSrcBlend),
+        VALUE(logicOp),
+        VALUE(multiDrawIndirect),
+        VALUE(drawIndirectFirstInstance),
+        VALUE(depthClamp),
+        VALUE(depthBiasClamp),
+        VALUE(fillModeNonSolid),
+        VALUE(depthBounds),
+        VALUE(wideLines),
+        VALUE(largePoints),
+        VALUE(alphaToOne),
+        VALUE(multiViewport),
+        VALUE(samplerAnisotropy),
+        VALUE(textureCompressionETC2),
+        VALUE(textureCompressionASTC_LDR),
+        VALUE(textureCompressionBC),
+        VALUE(occlusionQueryPrecise),
+        VALUE(pipelineStatisticsQuery),
+        VALUE(vertexPipelineStoresAndAtomics),
+        VALUE(fragmentStoresAndAtomics),
+        VALUE(shaderTessellationAndGeometryPointSize),
+        VALUE(shaderImageGatherExtended),
+        VALUE(shaderStorageImageExtendedFormats),
+        VALUE(shaderStorageImageMultisample),
+        VALUE(shaderStorageImageReadWithoutFormat),
+        VALUE(shaderStorageImageWriteWithoutFormat),
+        VALUE(shaderUniformBufferArrayDynamicIndexing),
+        VALUE(shaderSampledImageArrayDynamicIndexing),
+        VALUE(shaderStorageBufferArrayDynamicIndexing),
+        VALUE(shaderStorageImageArrayDynamicIndexing),
+        VALUE(shaderClipDistance),
+        VALUE(shaderCullDistance),
+        VALUE(shaderFloat64),
+        VALUE(shaderInt64),
+        VALUE(shaderInt16),
+        VALUE(shaderResourceResidency),
+        VALUE(shaderResourceMinLod),
+        VALUE(sparseBinding),
+        VALUE(sparseResidencyBuffer),
+        VALUE(sparseResidencyImage2D),
+        VALUE(sparseResidencyImage3D),
+        VALUE(sparseResidency2Samples),
+        VALUE(sparseResidency4Samples),
+        VALUE(sparseResidency8Samples),
+        VALUE(sparseResidency16Samples),
+        VALUE(sparseResidencyAliased),
+        VALUE(variableMultisampleRate),
+        VALUE(inheritedQueries),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &MemoryTypeTable() {
+    typedef VkMemoryType S;
+    static const Member members[] = {
+        VALUE(propertyFlags),
+        VALUE(heapIndex),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &MemoryHeapTable() {
+    typedef VkMemoryHeap S;
+    static const Member members[] = {
+        VALUE_WARN(size, Warn::kIfGreater),
+        VALUE(flags),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &MemoryPropertiesTable() {
+    typedef VkPhysicalDeviceMemoryProperties S;
+    static const Member members[] = {
+        OBJECT_ARRAY(memoryTypes, memoryTypeCount, MemoryTypeTable()),
+        OBJECT_ARRAY(memoryHeaps, memoryHeapCount, MemoryHeapTable()),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &PortabilitySubsetPropertiesTable() {
+    typedef VkPhysicalDevicePortabilitySubsetPropertiesKHR S;
+    static const Member members[] = {
+        VALUE_WARN(minVertexInputBindingStrideAlignment, Warn::kIfLesser),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &PortabilitySubsetFeaturesTable() {
+    typedef VkPhysicalDevicePortabilitySubsetFeaturesKHR S;
+    static const Member members[] = {
+        VALUE_WARN(constantAlphaColorBlendFactors, Warn::kIfGreater),
+        VALUE_WARN(events, Warn::kIfGreater),
+        VALUE_WARN(imageViewFormatReinterpretation, Warn::kIfGreater),
+        VALUE_WARN(imageViewFormatSwizzle, Warn::kIfGreater),
+        VALUE_WARN(imageView2DOn3DImage, Warn::kIfGreater),
+        VALUE_WARN(multisampleArrayImage, Warn::kIfGreater),
+        VALUE_WARN(mutableComparisonSamplers, Warn::kIfGreater),
+        VALUE_WARN(pointPolygons, Warn::kIfGreater),
+        VALUE_WARN(samplerMipLodBias, Warn::kIfGreater),
+        VALUE_WARN(separateStencilMaskRef, Warn::kIfGreater),
+        VALUE_WARN(shaderSampleRateInterpolationFunctions, Warn::kIfGreater),
+        VALUE_WARN(tessellationIsolines, Warn::kIfGreater),
+        VALUE_WARN(tessellationPointMode, Warn::kIfGreater),
+        VALUE_WARN(triangleFans, Warn::kIfGreater),
+        VALUE_WARN(vertexAttributeAccessBeyondStride, Warn::kIfGreater),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &Extent3DTable() {
+    typedef VkExtent3D S;
+    static const Member members[] = {
+        VALUE(width),
+        VALUE(height),
+        VALUE(depth),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &QueueFamilyPropertiesTable() {
+    typedef VkQueueFamilyProperties S;
+    static const Member members[] = {
+        VALUE(queueFlags),
+        VALUE(queueCount),
+        VALUE(timestampValidBits),
+        OBJECT(minImageTransferGranularity, Extent3DTable()),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &FormatPropertiesTable() {
+    typedef DevsimFormatProperties S;
+    static const Member members[] = {
+        VALUE(formatID),
+        VALUE(linearTilingFeatures),
+        VALUE(optimalTilingFeatures),
+        VALUE(bufferFeatures),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &LayerPropertiesTable() {
+    typedef VkLayerProperties S;
+    static const Member members[] = {
+        STRING(layerName),
+        VALUE(specVersion),
+        VALUE(implementationVersion),
+        STRING(description),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+const MemberTable &ExtensionPropertiesTable() {
+    typedef VkExtensionProperties S;
+    static const Member members[] = {
+        STRING(extensionName),
+        VALUE(specVersion),
+    };
+    static const MemberTable table = TABLE(members);
+    return table;
+}
+
+#undef VALUE
+#undef VALUE_WARN
+#undef ARRAY
+#undef STRING
+#undef OBJECT
+#undef OBJECT_ARRAY
+#undef TABLE
+
+// Find the member named key.  Files usually list the fields in the order of the table, so the search starts after the member
+// found last, at *hint.
+const Member *FindMember(const MemberTable &table, const std::string &key, size_t *hint) {
+    for (size_t i = 0; i < table.count; ++i) {
+        const size_t index = (*hint + i) % table.count;
+        if (key == table.members[index].name) {
+            *hint = index + 1;
+            return &table.members[index];
+        }
+    }
+    return nullptr;
+}
+
+// Numbers ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Number {
+    bool is_integer;  // written without a fraction or an exponent, and small enough for magnitude
+    bool negative;
+    uint64_t magnitude;
+    double real;
+};
+
+bool IsIntegral(const Number &number) {
+    double integral_part;
+    return number.is_integer || modf(number.real, &integral_part) == 0.0;
+}
+
+// The conversions accept the numbers that jsoncpp's isInt(), isUInt() and isUInt64() accept: integers, written as such or not,
+// in the range of the type.
+bool ToInt32(const Number &number, int32_t *value) {
+    if (number.is_integer) {
+        if (number.magnitude > (number.negative ? 2147483648u : 2147483647u)) {
+            return false;
+        }
+        *value = static_cast<int32_t>(number.negative ? -static_cast<int64_t>(number.magnitude)
+                                                      : static_cast<int64_t>(number.magnitude));
+        return true;
+    }
+    if (number.real < -2147483648.0 || number.real > 2147483647.0 || !IsIntegral(number)) {
+        return false;
+    }
+    *value = static_cast<int32_t>(number.real);
+    return true;
+}
+
+bool ToUint64(const Number &number, uint64_t *value) {
+    if (number.is_integer) {
+        if (number.negative && number.magnitude != 0) {
+            return false;
+        }
+        *value = number.magnitude;
+        return true;
+    }
+    if (number.real < 0.0 || number.real >= 18446744073709551616.0 || !IsIntegral(number)) {
+        return false;
+    }
+    *value = static_cast<uint64_t>(number.real);
+    return true;
+}
+
+bool ToUint32(const Number &number, uint32_t *value) {
+    uint64_t value64 = 0;
+    if (!ToUint64(number, &value64) || value64 > UINT32_MAX) {
+        return false;
+    }
+    *value = static_cast<uint32_t>(value64);
+    return true;
+}
+
+float ToFloat(const Number &number) {
+    if (number.is_integer) {
+        return number.negative ? static_cast<float>(-static_cast<int64_t>(number.magnitude))
+                               : static_cast<float>(number.magnitude);
+    }
+    return static_cast<float>(number.real);
+}
+
+// Store number at dest as a value of type, and return whether it has a value of that type.
+bool StoreNumber(const Number &number, ValueType type, char *dest) {
+    switch (type) {
+        case ValueType::kUint8: {
+            uint32_t value = 0;
+            if (!ToUint32(number, &value) || value > UINT8_MAX) {
+                return false;
+            }
+            *reinterpret_cast<uint8_t *>(dest) = static_cast<uint8_t>(value);
+            return true;
+        }
+        case ValueType::kInt32: {
+            int32_t value = 0;
+            if (!ToInt32(number, &value)) {
+                return false;
+            }
+            memcpy(dest, &value, sizeof(value));
+            return true;
+        }
+        case ValueType::kUint32: {
+            uint32_t value = 0;
+            if (!ToUint32(number, &value)) {
+                return false;
+            }
+            memcpy(dest, &value, sizeof(value));
+            return true;
+        }
+        case ValueType::kUint64: {
+            uint64_t value = 0;
+            if (!ToUint64(number, &value)) {
+                return false;
+            }
+            memcpy(dest, &value, sizeof(value));
+            return true;
+        }
+        case ValueType::kFloat: {
+            const float value = ToFloat(number);
+            memcpy(dest, &value, sizeof(value));
+            return true;
+        }
+        case ValueType::kString:
+        default:
+            return false;
+    }
+}
+
+// Reader ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Reads a document with a recursive descent over the JSON grammar, tokenizing the text as it goes.  Values that have no member
+// in the tables are skipped without being decoded.
+class Reader {
+   public:
+    Reader(const char *text, size_t size) : begin_(text), position_(text), end_(text + size) {}
+
+    bool Read(Document *document);
+
+    // Where and why reading failed.
+    std::string error() const;
+
+   private:
+    static const int kMaxDepth = 1000;
+
+    bool Fail(const char *message);
+
+    // Skip whitespace and comments, and return the next character, or '\0' at the end of the text.
+    char Peek();
+    // Consume c if it is the next character.
+    bool Accept(char c);
+    bool Expect(char c);
+
+    bool ReadString(std::string *value);
+    bool ReadNumber(Number *number);
+    bool ReadLiteral(const char *literal);
+    bool SkipValue();
+
+    // Call read_member(key) for each member of an object, which must read or skip the value of the member.
+    template <typename F>
+    bool ReadMembers(F read_member);
+
+    // Read a value of the type of a field to dest, and set *stored if it has that type.  Other values are skipped.
+    bool ReadValue(ValueType type, uint32_t size, char *dest, bool *stored);
+    bool ReadObject(const MemberTable &table, char *base, uint32_t base_offset, std::vector<Assignment> *assignments);
+    bool ReadMember(const Member &member, char *base, uint32_t base_offset, std::vector<Assignment> *assignments);
+
+    template <typename T>
+    bool ReadStruct(const MemberTable &table, PartialStruct<T> *dest);
+    template <typename T>
+    bool ReadVector(const MemberTable &table, bool *has_dest, std::vector<T> *dest);
+
+    const char *const begin_;
+    const char *position_;
+    const char *const end_;
+    int depth_ = 0;
+    const char *error_ = nullptr;
+    const char *error_position_ = nullptr;
+    std::string key_;
+    std::string string_;
+};
+
+bool Reader::Fail(const char *message) {
+    if (!error_) {
+        error_ = message;
+        error_position_ = position_;
+    }
+    return false;
+}
+
+std::string Reader::error() const {
+    int line = 1;
+    int column = 1;
+    for (const char *c = begin_; c < error_position_; ++c) {
+        if (*c == '\n') {
+            ++line;
+            column = 1;
+        } else {
+            ++column;
+        }
+    }
+    std::ostringstream stream;
+    stream << "line " << line << ", column " << column << ": " << (error_ ? error_ : "no error");
+    return stream.str();
+}
+
+char Reader::Peek() {
+    while (position_ < end_) {
+        const char c = *position_;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            ++position_;
+        } else if (c == '/' && end_ - position_ >= 2 && position_[1] == '/') {
+            while (position_ < end_ && *position_ != '\n') {
+                ++position_;
+            }
+        } else if (c == '/' && end_ - position_ >= 2 && position_[1] == '*') {
+            const char *comment = position_;
+            position_ += 2;
+            while (end_ - position_ >= 2 && !(position_[0] == '*' && position_[1] == '/')) {
+                ++position_;
+            }
+            if (end_ - position_ < 2) {
+                position_ = comment;
+                Fail("unterminated comment");
+                return '\0';
+            }
+            position_ += 2;
+        } else {
+            return c;
+        }
+    }
+    return '\0';
+}
+
+bool Reader::Accept(char c) {
+    if (Peek() == c) {
+        ++position_;
+        return true;
+    }
+    return false;
+}
+
+bool Reader::Expect(char c) {
+    if (Accept(c)) {
+        return true;
+    }
+    static const char *const kMessages[] = {"expected '{'", "expected '}'", "expected '['", "expected ']'",
+                                            "expected ':'", "expected ','", "expected '\"'"};
+    const char *const kChars = "{}[]:,\"";
+    return Fail(kMessages[strchr(kChars, c) - kChars]);
+}
+
+// Append the UTF-8 encoding of code_point to value.
+void AppendUtf8(uint32_t code_point, std::string *value) {
+    if (code_point < 0x80) {
+        value->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        value->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        value->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        value->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        value->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        value->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        value->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        value->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        value->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        value->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+bool Reader::ReadString(std::string *value) {
+    if (!Expect('"')) {
+        return false;
+    }
+    value->clear();
+    while (true) {
+        // Copy the characters up to the next quote or escape at once.
+        const char *run = position_;
+        while (position_ < end_ && *position_ != '"' && *position_ != '\\') {
+            ++position_;
+        }
+        value->append(run, position_);
+        if (position_ == end_) {
+            return Fail("unterminated string");
+        }
+        if (*position_++ == '"') {
+            return true;
+        }
+
+        if (position_ == end_) {
+            return Fail("unterminated string");
+        }
+        const char escape = *position_++;
+        switch (escape) {
+            case '"':
+            case '\\':
+            case '/':
+                value->push_back(escape);
+                break;
+            case 'b':
+                value->push_back('\b');
+                break;
+            case 'f':
+                value->push_back('\f');
+                break;
+            case 'n':
+                value->push_back('\n');
+                break;
+            case 'r':
+                value->push_back('\r');
+                break;
+            case 't':
+                value->push_back('\t');
+                break;
+            case 'u': {
+                uint32_t code_point = 0;
+                for (int surrogate = 0; surrogate < 2; ++surrogate) {
+                    if (end_ - position_ < 4) {
+                        return Fail("bad unicode escape sequence");
+                    }
+                    uint32_t unit = 0;
+                    for (int i = 0; i < 4; ++i) {
+                        const char c = *position_++;
+                        unit <<= 4;
+                        if (c >= '0' && c <= '9') {
+                            unit |= c - '0';
+                        } else if (c >= 'a' && c <= 'f') {
+                            unit |= c - 'a' + 10;
+                        } else if (c >= 'A' && c <= 'F') {
+                            unit |= c - 'A' + 10;
+                        } else {
+                            return Fail("bad unicode escape sequence");
+                        }
+                    }
+                    if (surrogate == 0) {
+                        code_point = unit;
+                        if (unit < 0xD800 || unit > 0xDBFF) {
+                            break;
+                        }
+                        // A high surrogate must be followed by the escape of a low one.
+                        if (end_ - position_ < 2 || position_[0] != '\\' || position_[1] != 'u') {
+                            return Fail("bad unicode surrogate pair");
+                        }
+                        position_ += 2;
+                    } else {
+                        if (unit < 0xDC00 || unit > 0xDFFF) {
+                            return Fail("bad unicode surrogate pair");
+                        }
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (unit - 0xDC00);
+                    }
+                }
+                AppendUtf8(code_point, value);
+                break;
+            }
+            default:
+                --position_;
+                return Fail("bad escape sequence");
+        }
+    }
+}
+
+bool Reader::ReadNumber(Number *number) {
+    const char *start = position_;
+    number->negative = position_ < end_ && *position_ == '-';
+    if (number->negative) {
+        ++position_;
+    }
+    const char *digits = position_;
+    number->magnitude = 0;
+    bool overflow = false;
+    while (position_ < end_ && *position_ >= '0' && *position_ <= '9') {
+        const uint64_t digit = static_cast<uint64_t>(*position_ - '0');
+        overflow = overflow || number->magnitude > (UINT64_MAX - digit) / 10;
+        number->magnitude = number->magnitude * 10 + digit;
+        ++position_;
+    }
+    if (position_ == digits) {
+        position_ = start;
+        return Fail("bad number");
+    }
+
+    bool is_integer = !overflow;
+    if (position_ < end_ && *position_ == '.') {
+        is_integer = false;
+        ++position_;
+        const char *fraction = position_;
+        while (position_ < end_ && *position_ >= '0' && *position_ <= '9') {
+            ++position_;
+        }
+        if (position_ == fraction) {
+            return Fail("bad number");
+        }
+    }
+    if (position_ < end_ && (*position_ == 'e' || *position_ == 'E')) {
+        is_integer = false;
+        ++position_;
+        if (position_ < end_ && (*position_ == '+' || *position_ == '-')) {
+            ++position_;
+        }
+        const char *exponent = position_;
+        while (position_ < end_ && *position_ >= '0' && *position_ <= '9') {
+            ++position_;
+        }
+        if (position_ == exponent) {
+            return Fail("bad number");
+        }
+    }
+
+    number->is_integer = is_integer;
+    if (is_integer) {
+        number->real = number->negative ? -static_cast<double>(number->magnitude) : static_cast<double>(number->magnitude);
+    } else {
+        // Decimal numbers are rare in configuration files, so they are converted with a stream, which is independent of the
+        // locale of the application.
+        std::istringstream stream(std::string(start, position_));
+        stream.imbue(std::locale::classic());
+        stream >> number->real;
+        if (stream.fail()) {
+            position_ = start;
+            return Fail("bad number");
+        }
+    }
+    return true;
+}
+
+bool Reader::ReadLiteral(const char *literal) {
+    const size_t length = strlen(literal);
+    if (static_cast<size_t>(end_ - position_) < length || strncmp(position_, literal, length) != 0) {
+        return Fail("unexpected character");
+    }
+    position_ += length;
+    return true;
+}
+
+bool Reader::SkipValue() {
+    switch (Peek()) {
+        case '{':
+            return ReadMembers([this](const std::string &) { return SkipValue(); });
+        case '[': {
+            if (++depth_ > kMaxDepth) {
+                return Fail("too deeply nested");
+            }
+            ++position_;
+            if (!Accept(']')) {
+                do {
+                    if (!SkipValue()) {
+                        return false;
+                    }
+                } while (Accept(','));
+                if (!Expect(']')) {
+                    return false;
+                }
+            }
+            --depth_;
+            return true;
+        }
+        case '"':
+            return ReadString(&string_);
+        case 't':
+            return ReadLiteral("true");
+        case 'f':
+            return ReadLiteral("false");
+        case 'n':
+            return ReadLiteral("null");
+        case '\0':
+            return Fail(error_ ? error_ : "unexpected end of text");
+        default: {
+            Number number;
+            return ReadNumber(&number);
+        }
+    }
+}
+
+template <typename F>
+bool Reader::ReadMembers(F read_member) {
+    if (++depth_ > kMaxDepth) {
+        return Fail("too deeply nested");
+    }
+    if (!Expect('{')) {
+        return false;
+    }
+    if (!Accept('}')) {
+        do {
+            if (Peek() != '"') {
+                return Fail("expected a member name");
+            }
+            if (!ReadString(&key_) || !Expect(':') || !read_member(key_)) {
+                return false;
+            }
+        } while (Accept(','));
+        if (!Expect('}')) {
+            return false;
+        }
+    }
+    --depth_;
+    return true;
+}
+
+bool Reader::ReadValue(ValueType type, uint32_t size, char *dest, bool *stored) {
+    *stored = false;
+    const char c = Peek();
+    if (type == ValueType::kString) {
+        if (c != '"') {
+            return SkipValue();
+        }
+        if (!ReadString(&string_)) {
+            return false;
+        }
+        // Strings are truncated to the size of their array.
+        const size_t length = std::min(string_.size(), static_cast<size_t>(size - 1));
+        memset(dest, 0, size);
+        memcpy(dest, string_.data(), length);
+        *stored = true;
+        return true;
+    }
+
+    if (c != '-' && (c < '0' || c > '9')) {
+        return SkipValue();
+    }
+    Number number;
+    if (!ReadNumber(&number)) {
+        return false;
+    }
+    *stored = StoreNumber(number, type, dest);
+    return true;
+}
+
+bool Reader::ReadObject(const MemberTable &table, char *base, uint32_t base_offset, std::vector<Assignment> *assignments) {
+    size_t hint = 0;
+    return ReadMembers([&](const std::string &key) {
+        const Member *member = FindMember(table, key, &hint);
+        return member ? ReadMember(*member, base, base_offset, assignments) : SkipValue();
+    });
+}
+
+bool Reader::ReadMember(const Member &member, char *base, uint32_t base_offset, std::vector<Assignment> *assignments) {
+    const uint32_t offset = base_offset + member.offset;
+    switch (member.kind) {
+        case MemberKind::kValue: {
+            bool stored = false;
+            if (!ReadValue(member.type, member.size, base + member.offset, &stored)) {
+                return false;
+            }
+            if (stored && assignments) {
+                assignments->push_back({member.name, offset, member.size, member.type, member.warn});
+            }
+            return true;
+        }
+
+        case MemberKind::kArray: {
+            if (Peek() != '[') {
+                return SkipValue();
+            }
+            ++position_;
+            if (Accept(']')) {
+                return true;
+            }
+            uint32_t index = 0;
+            do {
+                if (index >= member.count) {
+                    if (!SkipValue()) {
+                        return false;
+                    }
+                    continue;
+                }
+                bool stored = false;
+                if (!ReadValue(member.type, member.size, base + member.offset + index * member.size, &stored)) {
+                    return false;
+                }
+                if (stored && assignments) {
+                    assignments->push_back({member.name, offset + index * member.size, member.size, member.type, member.warn});
+                }
+                ++index;
+            } while (Accept(','));
+            return Expect(']');
+        }
+
+        case MemberKind::kObject:
+            if (Peek() != '{') {
+                return SkipValue();
+            }
+            return ReadObject(*member.table, base + member.offset, offset, assignments);
+
+        case MemberKind::kObjectArray: {
+            if (Peek() != '[') {
+                return SkipValue();
+            }
+            ++position_;
+            // The length of the array replaces the count of the structure, even if some elements are not objects.
+            uint32_t count = 0;
+            if (!Accept(']')) {
+                do {
+                    if (count < member.count && Peek() == '{') {
+                        if (!ReadObject(*member.table, base + member.offset + count * member.size, offset + count * member.size,
+                                        assignments)) {
+                            return false;
+                        }
+                    } else if (!SkipValue()) {
+                        return false;
+                    }
+                    count = std::min(count + 1, member.count);
+                } while (Accept(','));
+                if (!Expect(']')) {
+                    return false;
+                }
+            }
+            memcpy(base + member.count_offset, &count, sizeof(count));
+            if (assignments) {
+                assignments->push_back(
+                    {member.count_name, base_offset + member.count_offset, sizeof(count), ValueType::kUint32, Warn::kNone});
+            }
+            return true;
+        }
+
+        default:
+            return SkipValue();
+    }
+}
+
+template <typename T>
+bool Reader::ReadStruct(const MemberTable &table, PartialStruct<T> *dest) {
+    if (Peek() != '{') {
+        return SkipValue();
+    }
+    dest->present = true;
+    if (!ReadObject(table, reinterpret_cast<char *>(&dest->values), 0, &dest->assignments)) {
+        return false;
+    }
+
+    // Apply the fields in the order of the structure, and a field that the file sets twice only once, with its last value.
+    std::vector<Assignment> &assignments = dest->assignments;
+    std::stable_sort(assignments.begin(), assignments.end(),
+                     [](const Assignment &a, const Assignment &b) { return a.offset < b.offset; });
+    std::vector<Assignment> unique;
+    unique.reserve(assignments.size());
+    for (size_t i = 0; i < assignments.size(); ++i) {
+        if (i + 1 == assignments.size() || assignments[i + 1].offset != assignments[i].offset) {
+            unique.push_back(assignments[i]);
+        }
+    }
+    assignments.swap(unique);
+    return true;
+}
+
+template <typename T>
+bool Reader::ReadVector(const MemberTable &table, bool *has_dest, std::vector<T> *dest) {
+    if (Peek() != '[') {
+        return SkipValue();
+    }
+    ++position_;
+    *has_dest = true;
+    dest->clear();
+    if (Accept(']')) {
+        return true;
+    }
+    do {
+        // Elements that are not objects are kept, with all their fields cleared.
+        T element = {};
+        if (Peek() == '{') {
+            if (!ReadObject(table, reinterpret_cast<char *>(&element), 0, nullptr)) {
+                return false;
+            }
+        } else if (!SkipValue()) {
+            return false;
+        }
+        dest->push_back(element);
+    } while (Accept(','));
+    return Expect(']');
+}
+
+bool Reader::Read(Document *document) {
+    // Skip a UTF-8 byte order mark.
+    if (end_ - position_ >= 3 && memcmp(position_, "\xEF\xBB\xBF", 3) == 0) {
+        position_ += 3;
+    }
+    if (Peek() != '{') {
+        return Fail(error_ ? error_ : "the document root is not an object");
+    }
+
+    return ReadMembers([&](const std::string &key) {
+        if (key == "$schema") {
+            if (Peek() != '"') {
+                document->has_schema = false;
+                return SkipValue();
+            }
+            document->has_schema = true;
+            return ReadString(&document->schema);
+        } else if (key == "VkPhysicalDeviceProperties") {
+            return ReadStruct(PropertiesTable(), &document->properties);
+        } else if (key == "VkPhysicalDeviceFeatures") {
+            return ReadStruct(FeaturesTable(), &document->features);
+        } else if (key == "VkPhysicalDeviceMemoryProperties") {
+            return ReadStruct(MemoryPropertiesTable(), &document->memory_properties);
+        } else if (key == "VkPhysicalDevicePortabilitySubsetPropertiesKHR") {
+            return ReadStruct(PortabilitySubsetPropertiesTable(), &document->portability_subset_properties);
+        } else if (key == "VkPhysicalDevicePortabilitySubsetFeaturesKHR") {
+            return ReadStruct(PortabilitySubsetFeaturesTable(), &document->portability_subset_features);
+        } else if (key == "ArrayOfVkQueueFamilyProperties") {
+            return ReadVector(QueueFamilyPropertiesTable(), &document->has_queue_family_properties,
+                              &document->queue_family_properties);
+        } else if (key == "ArrayOfVkFormatProperties") {
+            return ReadVector(FormatPropertiesTable(), &document->has_format_properties, &document->format_properties);
+        } else if (key == "ArrayOfVkLayerProperties") {
+            return ReadVector(LayerPropertiesTable(), &document->has_layer_properties, &document->layer_properties);
+        } else if (key == "ArrayOfVkExtensionProperties") {
+            return ReadVector(ExtensionPropertiesTable(), &document->has_extension_properties, &document->extension_properties);
+        }
+        return SkipValue();
+    });
+}
+
+}  // namespace
+
+bool ReadDocument(const char *text, size_t size, Document *document, std::string *error) {
+    Reader reader(text, size);
+    if (!reader.Read(document)) {
+        *error = reader.error();
+        return false;
+    }
+    return true;
+}
+
+}  // namespace devsim
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2015-2021 Valve Corporation
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * layersvt/device_simulation_json.h - Streaming reader of DevSim JSON configuration files.
+ * The text of a file is tokenized in a single pass, without building a document tree.  Each value the DevSim schema defines is
+ * stored straight into the Vulkan structure it belongs to, at the offset that a table of the fields of that structure gives for
+ * its name; other values are skipped.
+ *
+ * Some values of a file only replace those of the Vulkan implementation, which differ between physical devices, so a file is
+ * read once into a Document, and the structures of a Document record which of their fields the file sets.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "vulkan/vulkan_beta.h"
+
+namespace devsim {
+
+// The types of the fields that configuration files can set.  Enums are read as int32_t.
+enum class ValueType : uint8_t {
+    kUint8,
+    kInt32,
+    kUint32,
+    kUint64,
+    kFloat,
+    kString,  // a char array, always null-terminated
+};
+
+// Whether to warn when a value of a configuration file replaces a lesser or greater value of the Vulkan implementation.
+enum class Warn : uint8_t {
+    kNone,
+    kIfGreater,
+    kIfLesser,
+};
+
+// A field of a structure set by a configuration file.  Fields of nested structures and elements of arrays are assigned
+// separately, at their offsets in the outermost structure.
+struct Assignment {
+    const char *name;  // as in the DevSim schema, without the names of the enclosing structures
+    uint32_t offset;
+    uint32_t size;
+    ValueType type;
+    Warn warn;
+};
+
+// The values that a configuration file sets in a structure, to be copied over those of the Vulkan implementation.
+template <typename T>
+struct PartialStruct {
+    bool present = false;  // whether the file has the structure, even if it sets none of its fields
+    T values = {};
+    std::vector<Assignment> assignments;  // in the order of their offsets, and at most one per field
+};
+
+// This is the JSON representation of VkFormat property data, as defined by the Devsim schema.
+// It will be split to create a VkFormat value and a VkFormatProperties structure after loading from JSON.
+struct DevsimFormatProperties {
+    VkFormat formatID;
+    VkFormatFeatureFlags linearTilingFeatures;
+    VkFormatFeatureFlags optimalTilingFeatures;
+    VkFormatFeatureFlags bufferFeatures;
+};
+
+// The contents of a configuration file.  The arrays of the DevSim schema replace those of the Vulkan implementation as a whole,
+// so they are read as they will be used.
+struct Document {
+    bool has_schema = false;  // whether "$schema" is a string
+    std::string schema;
+
+    PartialStruct<VkPhysicalDeviceProperties> properties;
+    PartialStruct<VkPhysicalDeviceFeatures> features;
+    PartialStruct<VkPhysicalDeviceMemoryProperties> memory_properties;
+    PartialStruct<VkPhysicalDevicePortabilitySubsetPropertiesKHR> portability_subset_properties;
+    PartialStruct<VkPhysicalDevicePortabilitySubsetFeaturesKHR> portability_subset_features;
+
+    bool has_queue_family_properties = false;
+    std::vector<VkQueueFamilyProperties> queue_family_properties;
+    bool has_format_properties = false;
+    std::vector<DevsimFormatProperties> format_properties;
+    bool has_layer_properties = false;
+    std::vector<VkLayerProperties> layer_properties;
+    bool has_extension_properties = false;
+    std::vector<VkExtensionProperties> extension_properties;
+};
+
+// Read the size bytes of text into document.  Returns false, with the line and column of the problem in error, if the text is
+// not a JSON object.  JSON comments are allowed, as jsoncpp allows them.
+bool ReadDocument(const char *text, size_t size, Document *document, std::string *error);
+
+}  // namespace devsim
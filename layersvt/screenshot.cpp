@@ -24,6 +24,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if !defined(_WIN32) && !defined(ANDROID)
+#include <signal.h>
+#endif
 #include <unordered_map>
 #include <iostream>
 #include <algorithm>
@@ -31,6 +36,12 @@
 #include <set>
 #include <vector>
 #include <fstream>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
@@ -41,6 +52,11 @@ using namespace std;
 #include "vk_layer_utils.h"
 
 #include "screenshot_parsing.h"
+#include "screenshot_bands.h"
+#include "screenshot_convert.h"
+#include "screenshot_encode.h"
+#include "screenshot_hash.h"
+#include "screenshot_shm.h"
 
 #ifdef ANDROID
 
@@ -51,16 +67,73 @@ const char *env_var_frames = "debug.vulkan.screenshot";
 const char *env_var_old = env_var_frames;
 const char *env_var_format = "debug.vulkan.screenshot.format";
 const char *env_var_dir = "debug.vulkan.screenshot.dir";
+const char *env_var_pipelined = "debug.vulkan.screenshot.pipelined";
+const char *env_var_format_file = "debug.vulkan.screenshot.format_file";
+const char *env_var_compression_level = "debug.vulkan.screenshot.compression_level";
+const char *env_var_deep_color = "debug.vulkan.screenshot.deep_color";
+const char *env_var_scale = "debug.vulkan.screenshot.scale";
+const char *env_var_region = "debug.vulkan.screenshot.region";
+const char *env_var_hash_file = "debug.vulkan.screenshot.hash_file";
+const char *env_var_hash_tiles = "debug.vulkan.screenshot.hash_tiles";
+const char *env_var_hash_baseline = "debug.vulkan.screenshot.hash_baseline";
+const char *env_var_hash_threshold = "debug.vulkan.screenshot.hash_threshold";
+const char *env_var_sequence_file = "debug.vulkan.screenshot.sequence_file";
+const char *env_var_sequence_frame_rate = "debug.vulkan.screenshot.sequence_frame_rate";
+const char *env_var_threads = "debug.vulkan.screenshot.threads";
+const char *env_var_trigger_file = "debug.vulkan.screenshot.trigger_file";
+const char *env_var_trigger_interval = "debug.vulkan.screenshot.trigger_interval";
+const char *env_var_trigger_frames = "debug.vulkan.screenshot.trigger_frames";
+const char *env_var_trigger_signal = "debug.vulkan.screenshot.trigger_signal";
+const char *env_var_shm_name = "debug.vulkan.screenshot.shm_name";
+const char *env_var_shm_slots = "debug.vulkan.screenshot.shm_slots";
 #else  // Linux or Windows
 const char *env_var_old = "_VK_SCREENSHOT";
 const char *env_var_frames = "VK_SCREENSHOT_FRAMES";
 const char *env_var_format = "VK_SCREENSHOT_FORMAT";
 const char *env_var_dir = "VK_SCREENSHOT_DIR";
+const char *env_var_pipelined = "VK_SCREENSHOT_PIPELINED";
+const char *env_var_format_file = "VK_SCREENSHOT_FORMAT_FILE";
+const char *env_var_compression_level = "VK_SCREENSHOT_COMPRESSION_LEVEL";
+const char *env_var_deep_color = "VK_SCREENSHOT_DEEP_COLOR";
+const char *env_var_scale = "VK_SCREENSHOT_SCALE";
+const char *env_var_region = "VK_SCREENSHOT_REGION";
+const char *env_var_hash_file = "VK_SCREENSHOT_HASH_FILE";
+const char *env_var_hash_tiles = "VK_SCREENSHOT_HASH_TILES";
+const char *env_var_hash_baseline = "VK_SCREENSHOT_HASH_BASELINE";
+const char *env_var_hash_threshold = "VK_SCREENSHOT_HASH_THRESHOLD";
+const char *env_var_sequence_file = "VK_SCREENSHOT_SEQUENCE_FILE";
+const char *env_var_sequence_frame_rate = "VK_SCREENSHOT_SEQUENCE_FRAME_RATE";
+const char *env_var_threads = "VK_SCREENSHOT_THREADS";
+const char *env_var_trigger_file = "VK_SCREENSHOT_TRIGGER_FILE";
+const char *env_var_trigger_interval = "VK_SCREENSHOT_TRIGGER_INTERVAL";
+const char *env_var_trigger_frames = "VK_SCREENSHOT_TRIGGER_FRAMES";
+const char *env_var_trigger_signal = "VK_SCREENSHOT_TRIGGER_SIGNAL";
+const char *env_var_shm_name = "VK_SCREENSHOT_SHM_NAME";
+const char *env_var_shm_slots = "VK_SCREENSHOT_SHM_SLOTS";
 #endif
 
 const char *settings_option_frames = "lunarg_screenshot.frames";
 const char *settings_option_format = "lunarg_screenshot.format";
 const char *settings_option_dir = "lunarg_screenshot.dir";
+const char *settings_option_pipelined = "lunarg_screenshot.pipelined";
+const char *settings_option_format_file = "lunarg_screenshot.format_file";
+const char *settings_option_compression_level = "lunarg_screenshot.compression_level";
+const char *settings_option_deep_color = "lunarg_screenshot.deep_color";
+const char *settings_option_scale = "lunarg_screenshot.scale";
+const char *settings_option_region = "lunarg_screenshot.region";
+const char *settings_option_hash_file = "lunarg_screenshot.hash_file";
+const char *settings_option_hash_tiles = "lunarg_screenshot.hash_tiles";
+const char *settings_option_hash_baseline = "lunarg_screenshot.hash_baseline";
+const char *settings_option_hash_threshold = "lunarg_screenshot.hash_threshold";
+const char *settings_option_sequence_file = "lunarg_screenshot.sequence_file";
+const char *settings_option_sequence_frame_rate = "lunarg_screenshot.sequence_frame_rate";
+const char *settings_option_threads = "lunarg_screenshot.threads";
+const char *settings_option_trigger_file = "lunarg_screenshot.trigger_file";
+const char *settings_option_trigger_interval = "lunarg_screenshot.trigger_interval";
+const char *settings_option_trigger_frames = "lunarg_screenshot.trigger_frames";
+const char *settings_option_trigger_signal = "lunarg_screenshot.trigger_signal";
+const char *settings_option_shm_name = "lunarg_screenshot.shm_name";
+const char *settings_option_shm_slots = "lunarg_screenshot.shm_slots";
 
 #ifdef ANDROID
 
@@ -111,13 +184,64 @@ static inline void local_free_getenv(const char *val) { free((void *)val); }
 
 namespace screenshot {
 
-static int globalLockInitialized = 0;
-static loader_platform_thread_mutex globalLock;
+// Guards the handle maps below.  It is only held to look up or update an
+// entry, never while a capture is recorded or written; the objects in the
+// maps have locks of their own.
+static mutex mapLock;
 
 const char *vk_screenshot_dir = nullptr;
 bool vk_screenshot_dir_used_env_var = false;
 
-bool printFormatWarning = true;
+atomic<bool> printFormatWarning(true);
+
+// When set, captures are written by a worker thread after their copy completes on the GPU
+// instead of being waited for in QueuePresentKHR.
+bool pipelinedCapture = false;
+
+// Number of captures of one swapchain that can be in flight at once.  When
+// all of them are, QueuePresentKHR waits for the oldest one to be written.
+static const size_t captureRingSize = 3;
+
+// Type of the image files written, and the zlib compression level used for PNG.
+screenshot::ImageFileFormat imageFileFormat = screenshot::IMAGE_FILE_FORMAT_PPM;
+int compressionLevel = 1;
+
+// Whether captures of swapchains with more than 8 bits per channel are
+// written as 16-bit PPM or PNG files.  Otherwise, and in the modes and file
+// formats that only take 8 bits per channel, they are tone mapped to 8 bits.
+bool deepColor16Bit = true;
+
+// Region of the swapchain images that is captured, and the percentage of its
+// size that the captures are scaled to on the GPU.  A region with a width of 0
+// covers the whole image.
+VkRect2D captureRegion = {{0, 0}, {0, 0}};
+int captureScale = 100;
+
+atomic<bool> printScaleWarning(true);
+atomic<bool> printQueueWarning(true);
+
+// Frame hash mode.  When a hash file is set, the hash of each captured frame
+// is logged to it instead of writing its image.  The image is still written
+// when at least hashThreshold tiles differ from the baseline, if one is given.
+string hashFileName;
+string hashBaselineFileName;
+uint32_t hashTiles = 0;
+uint32_t hashThreshold = 1;
+
+// Sequence mode.  When a sequence file is set, captured frames are appended to
+// it as a Y4M video, at the given frame rate, instead of writing images.
+string sequenceFileName;
+uint32_t sequenceFrameRate = 30;
+
+// Shared memory mode.  When a shared memory name is set, captured frames are
+// published to a ring of shmSlots frames in shared memory, for another
+// process to read, instead of writing images.
+string shmName;
+uint32_t shmSlots = 4;
+
+// Threads that convert and compress bands of each captured image in
+// parallel.  By default, there is one per core.
+static screenshot::BandPool bandPool(0);
 
 typedef enum colorSpaceFormat {
     UNDEFINED = 0,
@@ -139,35 +263,42 @@ typedef struct {
 } DispatchMapStruct;
 static unordered_map<VkDevice, DispatchMapStruct *> dispatchMap;
 
-// unordered map: associates a swap chain with a device, image extent, format,
-// and list of images
-typedef struct {
-    VkDevice device;
-    VkExtent2D imageExtent;
-    VkFormat format;
-    VkImage *imageList;
-} SwapchainMapStruct;
-static unordered_map<VkSwapchainKHR, SwapchainMapStruct *> swapchainMap;
+class CaptureRing;
+class CaptureBatchPool;
 
-// unordered map: associates an image with a device, image extent, and format
-typedef struct {
+// unordered map: associates a swap chain with a device, image extent, format,
+// and list of images.  The lock of a swapchain is held while it is captured,
+// and guards its images and capture resources.
+struct SwapchainMapStruct {
     VkDevice device;
     VkExtent2D imageExtent;
     VkFormat format;
-} ImageMapStruct;
-static unordered_map<VkImage, ImageMapStruct *> imageMap;
+    mutex lock;
+    vector<VkImage> images;
+    // Signaled by a capture of the image at the same index and waited on by its present.
+    vector<VkSemaphore> captureSemaphores;
+    // Staging resources reused by the captures of this swapchain.
+    CaptureRing *captureRing = nullptr;
+};
+static unordered_map<VkSwapchainKHR, unique_ptr<SwapchainMapStruct>> swapchainMap;
 
 // unordered map: associates a device with per device info -
 //   wsi capability
-//   set of queues created for this device
-//   queue to queueFamilyIndex map
-//   physical device
-typedef struct {
+//   queue to queue family map, guarded by lock
+//   physical device and its instance
+//   command buffers that captures are recorded into
+struct QueueFamilyStruct {
+    uint32_t index;
+    VkQueueFlags flags;
+};
+struct DeviceMapStruct {
     bool wsi_enabled;
-    set<VkQueue> queues;
-    unordered_map<VkQueue, uint32_t> queueIndexMap;
     VkPhysicalDevice physicalDevice;
-} DeviceMapStruct;
+    VkInstance instance;
+    mutex lock;
+    unordered_map<VkQueue, QueueFamilyStruct> queueIndexMap;
+    CaptureBatchPool *captureBatches = nullptr;
+};
 static unordered_map<VkDevice, DeviceMapStruct *> deviceMap;
 
 // unordered map: associates a physical device with an instance
@@ -176,11 +307,30 @@ typedef struct {
 } PhysDeviceMapStruct;
 static unordered_map<VkPhysicalDevice, PhysDeviceMapStruct *> physDeviceMap;
 
+// Guards the frame list, range and capture window.  capturesPending is set
+// while they can still select a frame, so that presents only take frameLock
+// while the layer is capturing; the other presents just count the frame.
+static mutex frameLock;
+static atomic<bool> capturesPending(false);
+static atomic<int> frameCounter(0);
+
+// Runtime triggers.  Creating the trigger file, which is looked for every
+// triggerInterval frames and deleted when found, or receiving SIGUSR1 arms a
+// window of the next triggerFrames frames to capture.  A trigger only sets triggerPending and
+// capturesPending, so that it can be raised from a signal handler; the
+// window is armed by the next present, under frameLock.
+static string triggerFileName;
+static int triggerInterval = 60;
+static int triggerFrames = 1;
+static bool triggerSignal = false;
+static atomic<bool> triggerPending(false);
+static int captureWindowFrames = 0;
+
 // set: list of frames to take screenshots without duplication.
 static set<int> screenshotFrames;
 
 // Flag indicating we have received the frame list
-static bool screenshotFramesReceived = false;
+static atomic<bool> screenshotFramesReceived(false);
 
 // Screenshots will be generated from screenShotFrameRange's startFrame to startFrame+count-1 with skipped Interval in between.
 static FrameRange screenShotFrameRange = {false, 0, SCREEN_SHOT_FRAMES_UNLIMITED, SCREEN_SHOT_FRAMES_INTERVAL_DEFAULT};
@@ -296,6 +446,142 @@ void readScreenShotDir(void) {
 #endif
 }
 
+// Value of a setting, from its environment variable if it is set or else from
+// vk_layer_settings.txt.
+static string getScreenShotOption(const char *settings_option, const char *env_var_name) {
+    string value;
+    const char *option = getLayerOption(settings_option);
+    const char *env_var = local_getenv(env_var_name);
+
+    if (env_var != NULL && strlen(env_var) > 0) {
+        option = env_var;
+    }
+    if (option) value = option;
+
+    if (env_var != NULL) {
+        local_free_getenv(env_var);
+    }
+    return value;
+}
+
+void readScreenShotPipelined(void) {
+    string pipelined = getScreenShotOption(settings_option_pipelined, env_var_pipelined);
+    if (!pipelined.empty()) pipelinedCapture = pipelined == "true" || pipelined == "1";
+}
+
+void readScreenShotFormatFile(void) {
+    string formatFile = getScreenShotOption(settings_option_format_file, env_var_format_file);
+    if (formatFile.empty()) return;
+
+    if (formatFile == "PPM") {
+        imageFileFormat = screenshot::IMAGE_FILE_FORMAT_PPM;
+    } else if (formatFile == "PNG") {
+        imageFileFormat = screenshot::IMAGE_FILE_FORMAT_PNG;
+    } else if (formatFile == "QOI") {
+        imageFileFormat = screenshot::IMAGE_FILE_FORMAT_QOI;
+    } else {
+#ifdef ANDROID
+        __android_log_print(ANDROID_LOG_INFO, "screenshot",
+                            "Selected file format:%s\nIs NOT in the list:\nPPM, PNG, QOI\nPPM will be used instead\n",
+                            formatFile.c_str());
+#else
+        fprintf(stderr, "Selected file format:%s\nIs NOT in the list:\nPPM, PNG, QOI\nPPM will be used instead\n",
+                formatFile.c_str());
+#endif
+    }
+}
+
+void readScreenShotCompressionLevel(void) {
+    string level = getScreenShotOption(settings_option_compression_level, env_var_compression_level);
+    if (!level.empty()) compressionLevel = std::min(std::max(atoi(level.c_str()), 0), 9);
+}
+
+void readScreenShotScale(void) {
+    string scale = getScreenShotOption(settings_option_scale, env_var_scale);
+    if (!scale.empty()) captureScale = std::min(std::max(atoi(scale.c_str()), 1), 100);
+}
+
+void readScreenShotRegion(void) {
+    string region = getScreenShotOption(settings_option_region, env_var_region);
+    if (region.empty()) return;
+
+    int x, y, w, h;
+    if (sscanf(region.c_str(), "%d,%d,%d,%d", &x, &y, &w, &h) == 4 && x >= 0 && y >= 0 && w > 0 && h > 0) {
+        captureRegion = {{x, y}, {static_cast<uint32_t>(w), static_cast<uint32_t>(h)}};
+    } else {
+#ifdef ANDROID
+        __android_log_print(ANDROID_LOG_INFO, "screenshot",
+                            "Region:%s\nIs NOT in the form x,y,width,height\nThe whole image will be captured\n",
+                            region.c_str());
+#else
+        fprintf(stderr, "Region:%s\nIs NOT in the form x,y,width,height\nThe whole image will be captured\n",
+                region.c_str());
+#endif
+    }
+}
+
+void readScreenShotHash(void) {
+    hashFileName = getScreenShotOption(settings_option_hash_file, env_var_hash_file);
+    hashBaselineFileName = getScreenShotOption(settings_option_hash_baseline, env_var_hash_baseline);
+
+    string tiles = getScreenShotOption(settings_option_hash_tiles, env_var_hash_tiles);
+    if (!tiles.empty()) hashTiles = std::min(std::max(atoi(tiles.c_str()), 0), 64);
+
+    string threshold = getScreenShotOption(settings_option_hash_threshold, env_var_hash_threshold);
+    if (!threshold.empty()) hashThreshold = std::max(atoi(threshold.c_str()), 1);
+}
+
+void readScreenShotSequence(void) {
+    sequenceFileName = getScreenShotOption(settings_option_sequence_file, env_var_sequence_file);
+
+    string frameRate = getScreenShotOption(settings_option_sequence_frame_rate, env_var_sequence_frame_rate);
+    if (!frameRate.empty()) sequenceFrameRate = std::min(std::max(atoi(frameRate.c_str()), 1), 1000);
+}
+
+void readScreenShotThreads(void) {
+    string threads = getScreenShotOption(settings_option_threads, env_var_threads);
+    uint32_t const threadCount = threads.empty() ? 0 : static_cast<uint32_t>(std::min(std::max(atoi(threads.c_str()), 0), 256));
+    bandPool.setThreadCount(threadCount);
+}
+
+void readScreenShotTriggers(void) {
+    triggerFileName = getScreenShotOption(settings_option_trigger_file, env_var_trigger_file);
+
+    string interval = getScreenShotOption(settings_option_trigger_interval, env_var_trigger_interval);
+    if (!interval.empty()) triggerInterval = std::max(atoi(interval.c_str()), 1);
+
+    string frames = getScreenShotOption(settings_option_trigger_frames, env_var_trigger_frames);
+    if (!frames.empty()) triggerFrames = std::max(atoi(frames.c_str()), 1);
+
+    string signal = getScreenShotOption(settings_option_trigger_signal, env_var_trigger_signal);
+    triggerSignal = signal == "true" || signal == "1";
+}
+
+void readScreenShotDeepColor(void) {
+    string deepColor = getScreenShotOption(settings_option_deep_color, env_var_deep_color);
+    if (deepColor.empty() || deepColor == "16BIT") {
+        deepColor16Bit = true;
+    } else if (deepColor == "TONEMAP") {
+        deepColor16Bit = false;
+    } else {
+#ifdef ANDROID
+        __android_log_print(ANDROID_LOG_INFO, "screenshot",
+                            "Selected deep color output:%s\nIs NOT in the list:\n16BIT, TONEMAP\n16BIT will be used instead\n",
+                            deepColor.c_str());
+#else
+        fprintf(stderr, "Selected deep color output:%s\nIs NOT in the list:\n16BIT, TONEMAP\n16BIT will be used instead\n",
+                deepColor.c_str());
+#endif
+    }
+}
+
+void readScreenShotShm(void) {
+    shmName = getScreenShotOption(settings_option_shm_name, env_var_shm_name);
+
+    string slots = getScreenShotOption(settings_option_shm_slots, env_var_shm_slots);
+    if (!slots.empty()) shmSlots = std::min(std::max(atoi(slots.c_str()), 1), 64);
+}
+
 // detect if frameNumber reach or beyond the right edge for screenshot in the range.
 // return:
 //       if frameNumber is already the last screenshot frame of the range(mean no another screenshot frame number >frameNumber and
@@ -320,6 +606,7 @@ static bool isEndOfScreenShotFrameRange(int frameNumber, FrameRange *pFrameRange
 
 // Parse comma-separated frame list string into the set
 static void populate_frame_list(const char *vk_screenshot_frames) {
+    lock_guard<mutex> lock(frameLock);
     string spec(vk_screenshot_frames), word;
     size_t start = 0, comma = 0;
 
@@ -352,9 +639,61 @@ static void populate_frame_list(const char *vk_screenshot_frames) {
         }
     }
 
+    capturesPending = !screenshotFrames.empty() || screenShotFrameRange.valid;
     screenshotFramesReceived = true;
 }
 
+static bool triggersEnabled() { return !triggerFileName.empty() || triggerSignal; }
+
+// Whether every requested frame has been captured, in which case the layer
+// no longer needs to track queues and swapchains.
+static bool noScreenshotsPending() { return screenshotFramesReceived && !capturesPending && !triggersEnabled(); }
+
+// Ask the next present to arm a capture window.  It is async-signal-safe.
+static void raiseTrigger() {
+    triggerPending = true;
+    capturesPending = true;
+}
+
+// Look for the trigger file, and delete it to raise a trigger.  Called by
+// presents every triggerInterval frames, without any lock held.
+static void checkTriggerFile() {
+    struct stat info;
+    if (stat(triggerFileName.c_str(), &info) != 0) return;
+    remove(triggerFileName.c_str());
+    raiseTrigger();
+}
+
+#if !defined(_WIN32) && !defined(ANDROID)
+static void onTriggerSignal(int) { raiseTrigger(); }
+#endif
+
+// Decide whether to capture frameNumber, removing it from the frames that
+// remain to be captured.  Called with frameLock held.
+static bool selectScreenShotFrame(int frameNumber) {
+    if (triggerPending.exchange(false)) captureWindowFrames = triggerFrames;
+    bool const inCaptureWindow = captureWindowFrames > 0;
+    if (inCaptureWindow) captureWindowFrames--;
+
+    bool inScreenShotFrameRange = false;
+    auto it = screenshotFrames.find(frameNumber);
+    bool const inScreenShotFrames = (it != screenshotFrames.end());
+    isInScreenShotFrameRange(frameNumber, &screenShotFrameRange, &inScreenShotFrameRange);
+
+    if (inScreenShotFrames) {
+        screenshotFrames.erase(it);
+    }
+    if ((inScreenShotFrames || inScreenShotFrameRange) && screenshotFrames.empty() &&
+        isEndOfScreenShotFrameRange(frameNumber, &screenShotFrameRange)) {
+        screenShotFrameRange.valid = false;
+    }
+    capturesPending = !screenshotFrames.empty() || screenShotFrameRange.valid || captureWindowFrames > 0;
+    // A trigger raised since triggerPending was tested must not be lost by
+    // clearing capturesPending.
+    if (triggerPending) capturesPending = true;
+    return inScreenShotFrames || inScreenShotFrameRange || inCaptureWindow;
+}
+
 void readScreenShotFrames(void) {
     const char *vk_screenshot_frames = getLayerOption(settings_option_frames);
     const char *env_var = local_getenv(env_var_frames);
@@ -380,7 +719,7 @@ void readScreenShotFrames(void) {
     }
 }
 
-static bool memory_type_from_properties(VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t typeBits,
+static bool memory_type_from_properties(const VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t typeBits,
                                         VkFlags requirements_mask, uint32_t *typeIndex) {
     // Search memtypes to find first index with those properties
     for (uint32_t i = 0; i < 32; i++) {
@@ -397,7 +736,33 @@ static bool memory_type_from_properties(VkPhysicalDeviceMemoryProperties *memory
     return false;
 }
 
+// Whether the red and blue channels of an 8-bit format are stored in reverse
+// order.
+static bool formatIsBGR(VkFormat format) {
+    return (format >= VK_FORMAT_B8G8R8_UNORM && format <= VK_FORMAT_B8G8R8_SRGB) ||
+           (format >= VK_FORMAT_B8G8R8A8_UNORM && format <= VK_FORMAT_B8G8R8A8_SRGB);
+}
+
+// The format with the same numeric type and the red and blue channels in RGB
+// order.  Formats that are already RGB are returned unchanged.
+static VkFormat formatAsRGB(VkFormat format) {
+    if (format >= VK_FORMAT_B8G8R8_UNORM && format <= VK_FORMAT_B8G8R8_SRGB)
+        return static_cast<VkFormat>(format - VK_FORMAT_B8G8R8_UNORM + VK_FORMAT_R8G8B8_UNORM);
+    if (format >= VK_FORMAT_B8G8R8A8_UNORM && format <= VK_FORMAT_B8G8R8A8_SRGB)
+        return static_cast<VkFormat>(format - VK_FORMAT_B8G8R8A8_UNORM + VK_FORMAT_R8G8B8A8_UNORM);
+    return format;
+}
+
+// Whether a format has more than 8 bits per channel.  Swapchains of these
+// formats are read back in their own format, so that no precision is lost
+// before they are converted on the CPU.
+static bool formatIsDeepColor(VkFormat format) {
+    return format == VK_FORMAT_A2B10G10R10_UNORM_PACK32 || format == VK_FORMAT_A2R10G10B10_UNORM_PACK32 ||
+           format == VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
 static DispatchMapStruct *get_dispatch_info(VkDevice dev) {
+    lock_guard<mutex> lock(mapLock);
     auto it = dispatchMap.find(dev);
     if (it == dispatchMap.end())
         return NULL;
@@ -406,6 +771,7 @@ static DispatchMapStruct *get_dispatch_info(VkDevice dev) {
 }
 
 static DeviceMapStruct *get_device_info(VkDevice dev) {
+    lock_guard<mutex> lock(mapLock);
     auto it = deviceMap.find(dev);
     if (it == deviceMap.end())
         return NULL;
@@ -413,160 +779,1012 @@ static DeviceMapStruct *get_device_info(VkDevice dev) {
         return it->second;
 }
 
+static SwapchainMapStruct *get_swapchain_info(VkSwapchainKHR swapchain) {
+    lock_guard<mutex> lock(mapLock);
+    auto it = swapchainMap.find(swapchain);
+    if (it == swapchainMap.end())
+        return NULL;
+    else
+        return it->second.get();
+}
+
 static void init_screenshot() {
-    if (!globalLockInitialized) {
-        // TODO/TBD: Need to delete this mutex sometime.  How???  One
-        // suggestion is to call this during vkCreateInstance(), and then we
-        // can clean it up during vkDestroyInstance().  However, that requires
-        // that the layer have per-instance locks.  We need to come back and
-        // address this soon.
-        loader_platform_thread_create_mutex(&globalLock);
-        globalLockInitialized = 1;
-    }
     readScreenShotFormatENV();
     readScreenShotDir();
     readScreenShotFrames();
+    readScreenShotPipelined();
+    readScreenShotFormatFile();
+    readScreenShotCompressionLevel();
+    readScreenShotDeepColor();
+    readScreenShotScale();
+    readScreenShotRegion();
+    readScreenShotHash();
+    readScreenShotSequence();
+    readScreenShotThreads();
+    readScreenShotTriggers();
+    readScreenShotShm();
+
+#if !defined(_WIN32) && !defined(ANDROID)
+    if (triggerSignal) {
+        struct sigaction action = {};
+        action.sa_handler = onTriggerSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, NULL);
+    }
+#endif
 }
 
-VkQueue getQueueForScreenshot(VkDevice device) {
-    // Find a queue that we can use for taking a screenshot
-    VkQueue queue = VK_NULL_HANDLE;
-    uint32_t count;
-    VkBool32 graphicsCapable = VK_FALSE;
-    VkBool32 presentCapable = VK_FALSE;
-    VkLayerInstanceDispatchTable *pInstanceTable;
-    DeviceMapStruct *devMap = get_device_info(device);
-    if (NULL == devMap) {
-        assert(0);
-        return queue;
+// Staging resources for one capture.  They are created by the first capture
+// that uses the slot and reused by the following ones.
+struct CaptureSlot {
+    VkImage image2;
+    VkImage image3;
+    VkDeviceMemory mem2;
+    VkDeviceMemory mem3;
+    // Used instead of the images when the swapchain image is copied as is.
+    VkBuffer buffer;
+    VkDeviceMemory bufferMem;
+    // Persistent mapping and layout of the image or buffer that the CPU reads.
+    const char *ptr;
+    VkSubresourceLayout srLayout;
+    bool coherent;
+    bool inUse;
+};
+
+// A small ring of capture slots for one swapchain, so that continuous capture
+// does not allocate memory and create driver objects on every frame.  All
+// slots are sized for the same extent and format; the ring is replaced when
+// those change.
+class CaptureRing {
+   public:
+    CaptureRing(VkDevice device, VkLayerDispatchTable *pTableDevice, VkExtent2D extent, VkFormat destformat, bool readBuffer,
+                bool need2steps, uint32_t queueFamilyIndex)
+        : device(device),
+          pTableDevice(pTableDevice),
+          extent(extent),
+          destformat(destformat),
+          readBuffer(readBuffer),
+          need2steps(need2steps),
+          queueFamilyIndex(queueFamilyIndex),
+          slots() {}
+
+    // Waits for the captures that still use the slots.
+    ~CaptureRing() {
+        unique_lock<mutex> lock(mtx);
+        slotReleased.wait(lock, [this] { return findInUse() == nullptr; });
+        for (auto &slot : slots) destroySlot(slot);
+    }
+
+    bool matches(VkExtent2D otherExtent, VkFormat otherDestformat, bool otherReadBuffer, bool otherNeed2steps,
+                 uint32_t otherQueueFamilyIndex) const {
+        return extent.width == otherExtent.width && extent.height == otherExtent.height && destformat == otherDestformat &&
+               readBuffer == otherReadBuffer && need2steps == otherNeed2steps && queueFamilyIndex == otherQueueFamilyIndex;
+    }
+
+    // The memory that the CPU reads the capture from.
+    VkDeviceMemory hostMemory(const CaptureSlot &slot) const {
+        if (readBuffer) return slot.bufferMem;
+        return need2steps ? slot.mem3 : slot.mem2;
+    }
+
+    // Take a slot that no pending capture uses, waiting for the oldest
+    // capture to be written if all of them are in use.
+    CaptureSlot *acquire() {
+        unique_lock<mutex> lock(mtx);
+        CaptureSlot *slot = nullptr;
+        slotReleased.wait(lock, [this, &slot] {
+            slot = findFree();
+            return slot != nullptr;
+        });
+        slot->inUse = true;
+        return slot;
     }
 
-    pInstanceTable = instance_dispatch_table(physDeviceMap[devMap->physicalDevice]->instance);
-    assert(pInstanceTable);
-    pInstanceTable->GetPhysicalDeviceQueueFamilyProperties(devMap->physicalDevice, &count, NULL);
+    void release(CaptureSlot *slot) {
+        {
+            lock_guard<mutex> lock(mtx);
+            slot->inUse = false;
+        }
+        slotReleased.notify_all();
+    }
 
-    std::vector<VkQueueFamilyProperties> queueProps(count);
+    // Free the resources of a slot that is not in use by a pending capture.
+    void destroySlot(CaptureSlot &slot) {
+        if (slot.ptr) pTableDevice->UnmapMemory(device, hostMemory(slot));
+        if (slot.bufferMem) pTableDevice->FreeMemory(device, slot.bufferMem, NULL);
+        if (slot.buffer) pTableDevice->DestroyBuffer(device, slot.buffer, NULL);
+        if (slot.mem2) pTableDevice->FreeMemory(device, slot.mem2, NULL);
+        if (slot.image2) pTableDevice->DestroyImage(device, slot.image2, NULL);
+        if (slot.mem3) pTableDevice->FreeMemory(device, slot.mem3, NULL);
+        if (slot.image3) pTableDevice->DestroyImage(device, slot.image3, NULL);
+        bool inUse = slot.inUse;
+        slot = CaptureSlot();
+        slot.inUse = inUse;
+    }
 
-#if defined(__ANDROID__)
-    // On Android, all physical devices and queue families must be capable of presentation with any native window
-    presentCapable = VK_TRUE;
+    VkDevice const device;
+    VkLayerDispatchTable *const pTableDevice;
+    VkExtent2D const extent;
+    VkFormat const destformat;
+    // The swapchain image is copied into a buffer as is, without a blit.
+    bool const readBuffer;
+    bool const need2steps;
+    uint32_t const queueFamilyIndex;
+
+   private:
+    CaptureSlot *findFree() {
+        for (auto &slot : slots) {
+            if (!slot.inUse) return &slot;
+        }
+        return nullptr;
+    }
+
+    CaptureSlot *findInUse() {
+        for (auto &slot : slots) {
+            if (slot.inUse) return &slot;
+        }
+        return nullptr;
+    }
+
+    mutex mtx;
+    condition_variable slotReleased;
+    CaptureSlot slots[captureRingSize];
+};
+
+// A capture whose copy has been submitted to the GPU but whose image file
+// has not been written yet.  Its slot is released when it is destroyed.
+struct PendingCapture {
+    ~PendingCapture() {
+        if (slot) ring->release(slot);
+    }
+
+    string filename;
+    int frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t numChannels;
+    // Format of the read back image: 8-bit RGB or RGBA, or a deep color
+    // format.
+    VkFormat format;
+    bool swapRB;
+    CaptureRing *ring;
+    CaptureSlot *slot;
+};
+
+// The command buffer and fence of one capture submission, which copies the
+// images of every swapchain captured by a present.
+struct CaptureBatch {
+    uint32_t queueFamilyIndex;
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    bool inUse;
+};
+
+// The capture batches of a device.  A batch is taken by the present that
+// records it and released once the captures it copied have been read back,
+// so there are about as many batches as captures in flight.
+class CaptureBatchPool {
+   public:
+    CaptureBatchPool(VkDevice device, DispatchMapStruct *dispMap) : device(device), dispMap(dispMap) {}
+
+    // Called once no capture is in flight.
+    ~CaptureBatchPool() {
+        for (auto &batch : batches) destroyBatch(*batch);
+    }
+
+    // Take a batch that can be submitted to a queue of the family, creating
+    // one if none is free.
+    CaptureBatch *acquire(uint32_t queueFamilyIndex) {
+        lock_guard<mutex> lock(mtx);
+        for (auto &batch : batches) {
+            if (!batch->inUse && batch->queueFamilyIndex == queueFamilyIndex) {
+                batch->inUse = true;
+                return batch.get();
+            }
+        }
+
+        unique_ptr<CaptureBatch> batch(new CaptureBatch());
+        batch->queueFamilyIndex = queueFamilyIndex;
+        if (!createBatch(*batch)) {
+            destroyBatch(*batch);
+            return nullptr;
+        }
+        batch->inUse = true;
+        batches.push_back(std::move(batch));
+        return batches.back().get();
+    }
+
+    void release(CaptureBatch *batch) {
+        lock_guard<mutex> lock(mtx);
+        batch->inUse = false;
+    }
+
+    VkDevice const device;
+    DispatchMapStruct *const dispMap;
+
+   private:
+    bool createBatch(CaptureBatch &batch);
+    void destroyBatch(CaptureBatch &batch);
+
+    mutex mtx;
+    vector<unique_ptr<CaptureBatch>> batches;
+};
+
+// The captures of one present, whose copies have been submitted to the GPU
+// together.  The batch is released when it is destroyed.
+struct PendingPresent {
+    ~PendingPresent() {
+        if (batch) batchPool->release(batch);
+    }
+
+    vector<unique_ptr<PendingCapture>> captures;
+    CaptureBatchPool *batchPool;
+    CaptureBatch *batch;
+};
+
+// An image read back from a capture, converted to packed RGB, that still has
+// to be encoded and written.
+struct EncodeJob {
+    string filename;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bitDepth;  // 8, or 16 for big-endian channels
+    vector<uint8_t> pixels;
+};
+
+static void writeImageFile(EncodeJob &job) {
+    const char *filename = job.filename.c_str();
+    ofstream file(filename, ios::binary);
+    assert(file.is_open());
+
+    if (!file.is_open()) {
+#ifdef ANDROID
+        __android_log_print(ANDROID_LOG_DEBUG, "screenshot",
+                            "Failed to open output file: %s.  Be sure to grant read and write permissions.", filename);
+#else
+        fprintf(stderr, "Failed to open output file:%s,  Be sure to grant read and write permissions\n", filename);
 #endif
+        return;
+    }
+
+    vector<uint8_t> encoded;
+    switch (imageFileFormat) {
+        case screenshot::IMAGE_FILE_FORMAT_PNG:
+            screenshot::encodePNG(job.pixels.data(), job.width, job.height, job.bitDepth, compressionLevel, encoded, &bandPool);
+            break;
+        case screenshot::IMAGE_FILE_FORMAT_QOI:
+            screenshot::encodeQOI(job.pixels.data(), job.width, job.height, encoded, &bandPool);
+            break;
+        default:
+            file << "P6\n";
+            file << job.width << "\n";
+            file << job.height << "\n";
+            file << (job.bitDepth == 16 ? 65535 : 255) << "\n";
+            file.write(reinterpret_cast<const char *>(job.pixels.data()), job.pixels.size());
+            break;
+    }
+    if (!encoded.empty()) file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    file.close();
+}
 
-    if (queueProps.size() > 0) {
-        pInstanceTable->GetPhysicalDeviceQueueFamilyProperties(devMap->physicalDevice, &count, queueProps.data());
-
-        // Iterate over all queues for this device, searching for a queue that is graphics and present capable
-        deviceMap[device]->queues.begin();
-        for (auto it = deviceMap[device]->queues.begin(); it != deviceMap[device]->queues.end(); it++) {
-            queue = *it;
-            graphicsCapable = ((queueProps[deviceMap[device]->queueIndexMap[queue]].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0);
-#if defined(_WIN32)
-            presentCapable =
-                instance_dispatch_table(devMap->physicalDevice)
-                    ->GetPhysicalDeviceWin32PresentationSupportKHR(devMap->physicalDevice, deviceMap[device]->queueIndexMap[queue]);
-#elif not defined(__ANDROID__)
-            // Everthing else not Windows or Android
-            // TODO: Make a function call to get present support from vkGetPhysicalDeviceXlibPresentationSupportKHR,
-            // vkGetPhysicalDeviceXcbPresentationSupportKHR, etc
-            presentCapable = graphicsCapable;
+// The Y4M video of sequence mode.  It is only written by the thread of
+// sequencePool, and is opened at the first frame, whose size it keeps.
+static ofstream sequenceFile;
+static uint32_t sequenceWidth = 0;
+static uint32_t sequenceHeight = 0;
+
+// Append a frame to the sequence file, as 8-bit 4:4:4 YCbCr planes.
+static void writeSequenceFrame(EncodeJob &job) {
+    if (!sequenceFile.is_open()) {
+        sequenceFile.open(sequenceFileName.c_str(), ios::binary | ios::trunc);
+        if (!sequenceFile.is_open()) {
+#ifdef ANDROID
+            __android_log_print(ANDROID_LOG_DEBUG, "screenshot",
+                                "Failed to open output file: %s.  Be sure to grant read and write permissions.",
+                                sequenceFileName.c_str());
+#else
+            fprintf(stderr, "Failed to open output file:%s,  Be sure to grant read and write permissions\n",
+                    sequenceFileName.c_str());
 #endif
-            if (graphicsCapable && presentCapable) break;
+            return;
         }
+        sequenceWidth = job.width;
+        sequenceHeight = job.height;
+        sequenceFile << "YUV4MPEG2 W" << sequenceWidth << " H" << sequenceHeight << " F" << sequenceFrameRate
+                     << ":1 Ip A1:1 C444\n";
     }
-    return queue;
+
+    // The size of a Y4M video cannot change.
+    if (job.width != sequenceWidth || job.height != sequenceHeight) {
+#ifdef ANDROID
+        __android_log_print(ANDROID_LOG_INFO, "screenshot", "Skipping %ux%u frame of %ux%u sequence", job.width, job.height,
+                            sequenceWidth, sequenceHeight);
+#else
+        fprintf(stderr, "screenshot: Skipping %ux%u frame of %ux%u sequence\n", job.width, job.height, sequenceWidth,
+                sequenceHeight);
+#endif
+        return;
+    }
+
+    // The frame is converted into one buffer and written with a single call.
+    static const char frameHeader[] = "FRAME\n";
+    size_t const planeSize = static_cast<size_t>(job.width) * job.height;
+    vector<uint8_t> frame(sizeof(frameHeader) - 1 + 3 * planeSize);
+    memcpy(frame.data(), frameHeader, sizeof(frameHeader) - 1);
+    uint8_t *y = frame.data() + sizeof(frameHeader) - 1;
+    uint8_t *u = y + planeSize;
+    uint8_t *v = u + planeSize;
+    const uint8_t *rgb = job.pixels.data();
+    uint32_t const bandCount = bandPool.getBandCount(job.height, 16);
+    bandPool.run(bandCount, [&](uint32_t band) {
+        uint32_t const endRow = static_cast<uint32_t>(static_cast<uint64_t>(job.height) * (band + 1) / bandCount);
+        for (uint32_t row = static_cast<uint32_t>(static_cast<uint64_t>(job.height) * band / bandCount); row < endRow; row++) {
+            size_t const offset = static_cast<size_t>(row) * job.width;
+            screenshot::convertRowRGBToYUV444(rgb + 3 * offset, y + offset, u + offset, v + offset, job.width);
+        }
+    });
+    sequenceFile.write(reinterpret_cast<const char *>(frame.data()), frame.size());
+    // Hand the frame over right away to a reader at the other end of a pipe.
+    sequenceFile.flush();
 }
 
-// Track allocated resources in writePPM()
-// and clean them up when they go out of scope.
-struct WritePPMCleanupData {
-    VkDevice device;
-    VkLayerDispatchTable *pTableDevice;
-    VkImage image2;
-    VkImage image3;
-    VkDeviceMemory mem2;
-    VkDeviceMemory mem3;
-    bool mem2mapped;
-    bool mem3mapped;
-    VkCommandBuffer commandBuffer;
-    VkCommandPool commandPool;
-    ~WritePPMCleanupData();
+// Encodes and writes images on a pool of threads, so that compressing a
+// capture does not hold up the next ones.  Images may be written out of
+// order, unless the pool has a single thread.
+class EncodePool {
+   public:
+    EncodePool(void (*write)(EncodeJob &), size_t maxThreads) : write(write), maxThreads(maxThreads) {}
+
+    ~EncodePool() {
+        // Joining from a static destructor can deadlock while the library is
+        // being unloaded; stop() is called when the last device is destroyed.
+        for (auto &thread : threads) {
+            if (thread.joinable()) thread.detach();
+        }
+    }
+
+    // Queue an image.  Each queued image holds a full frame, so this waits
+    // while every thread already has a couple of them waiting.
+    void push(unique_ptr<EncodeJob> job) {
+        unique_lock<mutex> lock(mtx);
+        if (threads.empty()) {
+            const size_t count = std::min(static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u)), maxThreads);
+            stopping = false;
+            for (size_t i = 0; i < count; i++) threads.push_back(std::thread(&EncodePool::run, this));
+        }
+        done.wait(lock, [this] { return pending.size() < 2 * threads.size(); });
+        pending.push_back(std::move(job));
+        ready.notify_one();
+    }
+
+    // Wait until every queued image has been written.
+    void drain() {
+        unique_lock<mutex> lock(mtx);
+        done.wait(lock, [this] { return pending.empty() && busy == 0; });
+    }
+
+    // Write the remaining images and stop the threads.
+    void stop() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &thread : threads) {
+            if (thread.joinable()) thread.join();
+        }
+        threads.clear();
+    }
+
+   private:
+    void run() {
+        unique_lock<mutex> lock(mtx);
+        for (;;) {
+            ready.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) break;
+
+            unique_ptr<EncodeJob> job = std::move(pending.front());
+            pending.pop_front();
+            busy++;
+            done.notify_all();
+            lock.unlock();
+
+            write(*job);
+            job.reset();
+
+            lock.lock();
+            busy--;
+            done.notify_all();
+        }
+    }
+
+    void (*const write)(EncodeJob &);
+    size_t const maxThreads;
+    mutex mtx;
+    condition_variable ready;
+    condition_variable done;
+    deque<unique_ptr<EncodeJob>> pending;
+    size_t busy = 0;
+    bool stopping = false;
+    vector<std::thread> threads;
+};
+
+static EncodePool encodePool(writeImageFile, 4);
+
+// Frames of the sequence file are written by a single thread, in the order
+// they were captured.
+static EncodePool sequencePool(writeSequenceFrame, 1);
+
+// The log of the hashes of captured frames, and the hashes of a previous run
+// that they are compared with.
+class FrameHashLog {
+   public:
+    bool enabled() const { return !fileName.empty(); }
+
+    // Set the log file, which is created at the first capture, and load the
+    // baseline if a file is given.
+    void open(const string &logFileName, const string &baselineFileName) {
+        lock_guard<mutex> lock(mtx);
+        if (logFileName != fileName) {
+            if (file.is_open()) file.close();
+            fileName = logFileName;
+        }
+
+        baseline.clear();
+        hasBaseline = false;
+        if (baselineFileName.empty()) return;
+        ifstream baselineFile(baselineFileName.c_str());
+        if (!baselineFile.is_open()) {
+#ifdef ANDROID
+            __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failed to open baseline %s", baselineFileName.c_str());
+#else
+            fprintf(stderr, "screenshot: Failed to open baseline %s\n", baselineFileName.c_str());
+#endif
+            return;
+        }
+        string line;
+        int frameNumber;
+        screenshot::FrameHash hash;
+        while (getline(baselineFile, line)) {
+            if (screenshot::parseFrameHash(line.c_str(), frameNumber, hash)) baseline[frameNumber] = hash;
+        }
+        hasBaseline = true;
+    }
+
+    // Log the hash of a captured frame.  Returns whether its image should
+    // also be written, which is when it differs enough from the baseline.
+    bool record(int frameNumber, const screenshot::FrameHash &hash) {
+        lock_guard<mutex> lock(mtx);
+        if (!file.is_open()) {
+            file.open(fileName.c_str(), ios::out | ios::trunc);
+            if (!file.is_open()) {
+#ifdef ANDROID
+                __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failed to open %s", fileName.c_str());
+#else
+                fprintf(stderr, "screenshot: Failed to open %s\n", fileName.c_str());
+#endif
+            }
+        }
+        // Flushed at every frame so that the log is complete even if the
+        // application does not exit cleanly.
+        file << screenshot::formatFrameHash(frameNumber, hash) << '\n';
+        file.flush();
+
+        if (!hasBaseline) return false;
+        auto it = baseline.find(frameNumber);
+        if (it == baseline.end()) return true;
+        // Frames hashed without tiles count as one tile.
+        uint32_t const tileCount = std::max(static_cast<uint32_t>(hash.tiles.size()), 1u);
+        return screenshot::countChangedTiles(hash, it->second) >= std::min(hashThreshold, tileCount);
+    }
+
+   private:
+    mutex mtx;
+    string fileName;
+    ofstream file;
+    unordered_map<int, screenshot::FrameHash> baseline;
+    bool hasBaseline = false;
+};
+
+static FrameHashLog frameHashLog;
+
+// The conversion of the rows of a capture to packed RGB, with 8 bits per
+// channel or, for deep color captures, 16 bits if bitDepth is 16.
+static screenshot::RowConversion getRowConversion(const PendingCapture &capture, uint32_t bitDepth) {
+    bool const deep16 = bitDepth == 16 && formatIsDeepColor(capture.format);
+    if (capture.format == VK_FORMAT_R16G16B16A16_SFLOAT)
+        return deep16 ? screenshot::ROW_CONVERSION_RGBA16F_TO_RGB16 : screenshot::ROW_CONVERSION_RGBA16F_TO_RGB8;
+    if (formatIsDeepColor(capture.format))
+        return deep16 ? screenshot::ROW_CONVERSION_RGB10A2_TO_RGB16 : screenshot::ROW_CONVERSION_RGB10A2_TO_RGB8;
+    return screenshot::ROW_CONVERSION_RGBA8_TO_RGB8;
+}
+
+// Convert row y of the image read back by a capture to packed RGB at dst.
+static void convertCaptureRow(const PendingCapture &capture, screenshot::RowConversion conversion, uint32_t y, uint8_t *dst) {
+    const CaptureSlot &slot = *capture.slot;
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(slot.ptr + slot.srLayout.offset) + y * slot.srLayout.rowPitch;
+    if (4 == capture.numChannels)
+        screenshot::convertRow(conversion, src, dst, capture.width, capture.swapRB);
+    else
+        screenshot::convertRowRGBToRGB(src, dst, capture.width, capture.swapRB);
+}
+
+// Convert the image read back by a capture to tightly packed RGB rows at
+// rgb, with 8 bits per channel or, for deep color captures, 16 bits if
+// bitDepth is 16.  Bands of rows are converted in parallel.
+static void convertCaptureToRGB(const PendingCapture &capture, uint8_t *rgb, uint32_t bitDepth = 8) {
+    uint32_t const height = capture.height;
+    bool const deep16 = bitDepth == 16 && formatIsDeepColor(capture.format);
+    screenshot::RowConversion const conversion = getRowConversion(capture, bitDepth);
+    size_t const dstPitch = (deep16 ? 6 : 3) * static_cast<size_t>(capture.width);
+
+    uint32_t const bandCount = bandPool.getBandCount(height, 16);
+    bandPool.run(bandCount, [&](uint32_t band) {
+        uint32_t const firstRow = static_cast<uint32_t>(static_cast<uint64_t>(height) * band / bandCount);
+        uint32_t const endRow = static_cast<uint32_t>(static_cast<uint64_t>(height) * (band + 1) / bandCount);
+        for (uint32_t y = firstRow; y < endRow; y++) convertCaptureRow(capture, conversion, y, rgb + dstPitch * y);
+    });
+}
+
+// Hash the image read back by a capture, converting it one row at a time so
+// that no full-frame copy is made.
+static void hashCapture(const PendingCapture &capture, screenshot::FrameHash &hash) {
+    screenshot::RowConversion const conversion = getRowConversion(capture, 8);
+    screenshot::FrameHasher hasher(capture.width, capture.height, hashTiles);
+    vector<uint8_t> row(3 * static_cast<size_t>(capture.width));
+    for (uint32_t y = 0; y < capture.height; y++) {
+        convertCaptureRow(capture, conversion, y, row.data());
+        hasher.addRow(row.data());
+    }
+    hasher.digest(hash);
+}
+
+// The ring of shared memory mode.  It is created at the first frame, with
+// room for frames of its size.
+static mutex shmLock;
+static screenshot::FrameRingWriter frameRing;
+static atomic<bool> printShmWarning(true);
+
+// Convert a capture straight into the next frame of the shared memory ring.
+static void exportCapture(const PendingCapture &capture) {
+    lock_guard<mutex> lock(shmLock);
+    uint32_t const pitch = 3 * capture.width;
+    if (!frameRing.isOpen() &&
+        !frameRing.create(shmName.c_str(), shmSlots, static_cast<uint64_t>(pitch) * capture.height)) {
+        if (printShmWarning.exchange(false)) {
+#ifdef ANDROID
+            __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failed to create shared memory %s", shmName.c_str());
+#else
+            fprintf(stderr, "Screenshot failed to create shared memory %s\n", shmName.c_str());
+#endif
+        }
+        return;
+    }
+
+    // Frames larger than the first one are skipped.
+    uint8_t *pixels =
+        frameRing.beginFrame(capture.frameNumber, capture.width, capture.height, screenshot::FRAME_FORMAT_RGB8, pitch);
+    if (!pixels) return;
+    convertCaptureToRGB(capture, pixels);
+    frameRing.publishFrame();
+}
+
+// Read back a capture whose copy has completed.  PPM files are written right
+// away; other formats are handed to the encoder pool.
+static void writeCapture(PendingCapture &capture) {
+    CaptureRing &ring = *capture.ring;
+    CaptureSlot &slot = *capture.slot;
+
+    // The staging memory is only required to be host visible, so make the
+    // GPU writes visible if it is not host coherent.
+    if (!slot.coherent) {
+        const VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL, ring.hostMemory(slot), 0, VK_WHOLE_SIZE};
+        ring.pTableDevice->InvalidateMappedMemoryRanges(ring.device, 1, &range);
+    }
+
+    // In shared memory mode, the converted image is the only copy made.
+    if (!shmName.empty()) {
+        exportCapture(capture);
+        return;
+    }
+
+    uint32_t const width = capture.width;
+    uint32_t const height = capture.height;
+
+    // Deep color captures keep 16 bits per channel in the files that can
+    // hold them.  Hashes and sequences take 8-bit images.
+    bool const deep16 = deepColor16Bit && formatIsDeepColor(capture.format) && !frameHashLog.enabled() &&
+                        sequenceFileName.empty() && imageFileFormat != screenshot::IMAGE_FILE_FORMAT_QOI;
+
+    // The image is only converted whole when a hashed frame has to be written.
+    if (frameHashLog.enabled()) {
+        screenshot::FrameHash hash;
+        hashCapture(capture, hash);
+        if (!frameHashLog.record(capture.frameNumber, hash)) return;
+    }
+
+    // Convert the whole image to packed RGB first so that it is written with
+    // a single call rather than one call per pixel.  This also frees the slot
+    // before the image is encoded.
+    unique_ptr<EncodeJob> job(new EncodeJob());
+    job->filename = capture.filename;
+    job->width = width;
+    job->height = height;
+    job->bitDepth = deep16 ? 16 : 8;
+    job->pixels.resize((deep16 ? 6 : 3) * static_cast<size_t>(width) * height);
+    convertCaptureToRGB(capture, job->pixels.data(), job->bitDepth);
+
+    if (!sequenceFileName.empty())
+        sequencePool.push(std::move(job));
+    else if (imageFileFormat == screenshot::IMAGE_FILE_FORMAT_PPM)
+        writeImageFile(*job);
+    else
+        encodePool.push(std::move(job));
+}
+
+// Wait for the copies of a present to finish and read back its captures,
+// releasing the slot of each one as soon as it has been read.
+static void writeCaptures(PendingPresent &present) {
+    CaptureBatchPool &batchPool = *present.batchPool;
+    VkLayerDispatchTable *pTableDevice = batchPool.dispMap->device_dispatch_table;
+
+    VkResult err = pTableDevice->WaitForFences(batchPool.device, 1, &present.batch->fence, VK_TRUE, UINT64_MAX);
+    assert(!err);
+    if (VK_SUCCESS != err) return;
+
+    for (auto &capture : present.captures) {
+        writeCapture(*capture);
+        capture.reset();
+    }
+}
+
+// Writes pipelined captures on a separate thread once their copies have
+// completed, so that QueuePresentKHR does not wait for the GPU.  Captures are
+// written in the order they were submitted.
+class CaptureWorker {
+   public:
+    ~CaptureWorker() {
+        // Joining from a static destructor can deadlock while the library is
+        // being unloaded; stop() is called when the last device is destroyed.
+        if (thread.joinable()) thread.detach();
+    }
+
+    // Queue the submitted captures of a present.  The number of captures in
+    // flight is bounded by the capture slots of each swapchain.
+    void push(unique_ptr<PendingPresent> present) {
+        lock_guard<mutex> lock(mtx);
+        pending.push_back(std::move(present));
+        if (!thread.joinable()) {
+            stopping = false;
+            thread = std::thread(&CaptureWorker::run, this);
+        }
+        ready.notify_one();
+    }
+
+    // Wait until every queued capture has been written.
+    void drain() {
+        unique_lock<mutex> lock(mtx);
+        done.wait(lock, [this] { return pending.empty() && !busy; });
+    }
+
+    // Write the remaining captures and stop the thread.
+    void stop() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        ready.notify_one();
+        if (thread.joinable()) thread.join();
+    }
+
+   private:
+    void run() {
+        unique_lock<mutex> lock(mtx);
+        for (;;) {
+            ready.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) break;
+
+            unique_ptr<PendingPresent> present = std::move(pending.front());
+            pending.pop_front();
+            busy = true;
+            lock.unlock();
+
+            writeCaptures(*present);
+            present.reset();
+
+            lock.lock();
+            busy = false;
+            done.notify_all();
+        }
+    }
+
+    mutex mtx;
+    condition_variable ready;
+    condition_variable done;
+    deque<unique_ptr<PendingPresent>> pending;
+    bool busy = false;
+    bool stopping = false;
+    std::thread thread;
 };
 
-WritePPMCleanupData::~WritePPMCleanupData() {
-    if (mem2mapped) pTableDevice->UnmapMemory(device, mem2);
-    if (mem2) pTableDevice->FreeMemory(device, mem2, NULL);
-    if (image2) pTableDevice->DestroyImage(device, image2, NULL);
+static CaptureWorker captureWorker;
+
+// Create the readback buffer of a capture slot and map it.  The rows of the
+// swapchain image are tightly packed in the buffer.
+static bool createCaptureBuffer(CaptureRing &ring, CaptureSlot &slot, VkPhysicalDeviceMemoryProperties const &memoryProperties) {
+    VkDevice device = ring.device;
+    VkLayerDispatchTable *pTableDevice = ring.pTableDevice;
+    VkDeviceSize const rowPitch = static_cast<VkDeviceSize>(ring.extent.width) * FormatElementSize(ring.destformat);
+    VkDeviceSize const size = rowPitch * ring.extent.height;
+    VkResult err;
+
+    VkBufferCreateInfo bufCreateInfo = {};
+    bufCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufCreateInfo.size = size;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    err = pTableDevice->CreateBuffer(device, &bufCreateInfo, NULL, &slot.buffer);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+
+    VkMemoryRequirements memRequirements;
+    pTableDevice->GetBufferMemoryRequirements(device, slot.buffer, &memRequirements);
+    VkMemoryAllocateInfo memAllocInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL, memRequirements.size, 0};
+    // The CPU reads every byte of the buffer, so prefer cached memory.
+    bool pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
+                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                            &memAllocInfo.memoryTypeIndex) ||
+                memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                            &memAllocInfo.memoryTypeIndex);
+    assert(pass);
+    if (!pass) return false;
+    err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &slot.bufferMem);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+    err = pTableDevice->BindBufferMemory(device, slot.buffer, slot.bufferMem, 0);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+    slot.coherent =
+        (memoryProperties.memoryTypes[memAllocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    slot.srLayout.offset = 0;
+    slot.srLayout.size = size;
+    slot.srLayout.rowPitch = rowPitch;
+    slot.srLayout.arrayPitch = size;
+    slot.srLayout.depthPitch = size;
+    err = pTableDevice->MapMemory(device, slot.bufferMem, 0, VK_WHOLE_SIZE, 0, (void **)&slot.ptr);
+    assert(!err);
+    if (VK_SUCCESS != err) {
+        slot.ptr = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Create the staging images of a capture slot and map the image that the CPU
+// reads.
+static bool createCaptureImages(CaptureRing &ring, CaptureSlot &slot, VkPhysicalDeviceMemoryProperties const &memoryProperties) {
+    VkDevice device = ring.device;
+    VkLayerDispatchTable *pTableDevice = ring.pTableDevice;
+    bool const need2steps = ring.need2steps;
+    VkResult err;
+    bool pass;
+
+    // Set up the image creation info for both the blit and copy images, in case
+    // both are needed.
+    VkImageCreateInfo imgCreateInfo2 = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        NULL,
+        0,
+        VK_IMAGE_TYPE_2D,
+        ring.destformat,
+        {ring.extent.width, ring.extent.height, 1},
+        1,
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_LINEAR,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        NULL,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VkImageCreateInfo imgCreateInfo3 = imgCreateInfo2;
+
+    // If we need both images, set up image2 to be read/write and tiled.
+    if (need2steps) {
+        imgCreateInfo2.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imgCreateInfo2.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    VkMemoryAllocateInfo memAllocInfo = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL,
+        0,  // allocationSize, queried later
+        0   // memoryTypeIndex, queried later
+    };
+    VkMemoryRequirements memRequirements;
+
+    // Create image2 and allocate its memory.  It could be the intermediate or
+    // final image.
+    err = pTableDevice->CreateImage(device, &imgCreateInfo2, NULL, &slot.image2);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+    pTableDevice->GetImageMemoryRequirements(device, slot.image2, &memRequirements);
+    memAllocInfo.allocationSize = memRequirements.size;
+    pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
+                                       need2steps ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                       &memAllocInfo.memoryTypeIndex);
+    assert(pass);
+    err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &slot.mem2);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+    err = pTableDevice->BindImageMemory(device, slot.image2, slot.mem2, 0);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+
+    // Create image3 and allocate its memory, if needed.
+    if (need2steps) {
+        err = pTableDevice->CreateImage(device, &imgCreateInfo3, NULL, &slot.image3);
+        assert(!err);
+        if (VK_SUCCESS != err) return false;
+        pTableDevice->GetImageMemoryRequirements(device, slot.image3, &memRequirements);
+        memAllocInfo.allocationSize = memRequirements.size;
+        pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                           &memAllocInfo.memoryTypeIndex);
+        assert(pass);
+        err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &slot.mem3);
+        assert(!err);
+        if (VK_SUCCESS != err) return false;
+        err = pTableDevice->BindImageMemory(device, slot.image3, slot.mem3, 0);
+        assert(!err);
+        if (VK_SUCCESS != err) return false;
+    }
+    slot.coherent =
+        (memoryProperties.memoryTypes[memAllocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    // Keep the final image mapped for as long as the slot exists.
+    const VkImageSubresource sr = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0};
+    pTableDevice->GetImageSubresourceLayout(device, need2steps ? slot.image3 : slot.image2, &sr, &slot.srLayout);
+    err = pTableDevice->MapMemory(device, need2steps ? slot.mem3 : slot.mem2, 0, VK_WHOLE_SIZE, 0, (void **)&slot.ptr);
+    assert(!err);
+    if (VK_SUCCESS != err) {
+        slot.ptr = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Create the command buffer and fence of a capture batch.  On failure, the
+// objects created so far are left for destroyBatch() to free.
+bool CaptureBatchPool::createBatch(CaptureBatch &batch) {
+    VkLayerDispatchTable *pTableDevice = dispMap->device_dispatch_table;
+    VkResult err;
+
+    // We want to create our own command pool to be sure we can use it from this thread
+    VkCommandPoolCreateInfo cmd_pool_info = {};
+    cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmd_pool_info.pNext = NULL;
+    cmd_pool_info.queueFamilyIndex = batch.queueFamilyIndex;
+    cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    err = pTableDevice->CreateCommandPool(device, &cmd_pool_info, NULL, &batch.commandPool);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+
+    // Set up the command buffer.
+    const VkCommandBufferAllocateInfo allocCommandBufferInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL,
+                                                                batch.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+    err = pTableDevice->AllocateCommandBuffers(device, &allocCommandBufferInfo, &batch.commandBuffer);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
+
+    // Replace any entry left by a destroyed command buffer with the same handle.
+    VkDevice cmdBuf = static_cast<VkDevice>(static_cast<void *>(batch.commandBuffer));
+    {
+        lock_guard<mutex> lock(mapLock);
+        dispatchMap[cmdBuf] = dispMap;
+    }
+
+    // We have just created a dispatchable object, but the dispatch table has
+    // not been placed in the object yet.  When a "normal" application creates
+    // a command buffer, the dispatch table is installed by the top-level api
+    // binding (trampoline.c). But here, we have to do it ourselves.
+    if (!dispMap->pfn_dev_init) {
+        *((const void **)batch.commandBuffer) = *(void **)device;
+    } else {
+        err = dispMap->pfn_dev_init(device, (void *)batch.commandBuffer);
+        assert(!err);
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, NULL, 0};
+    err = pTableDevice->CreateFence(device, &fenceCreateInfo, NULL, &batch.fence);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
 
-    if (mem3mapped) pTableDevice->UnmapMemory(device, mem3);
-    if (mem3) pTableDevice->FreeMemory(device, mem3, NULL);
-    if (image3) pTableDevice->DestroyImage(device, image3, NULL);
+    return true;
+}
 
-    if (commandBuffer) pTableDevice->FreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-    if (commandPool) pTableDevice->DestroyCommandPool(device, commandPool, NULL);
+void CaptureBatchPool::destroyBatch(CaptureBatch &batch) {
+    VkLayerDispatchTable *pTableDevice = dispMap->device_dispatch_table;
+    if (batch.commandBuffer) pTableDevice->FreeCommandBuffers(device, batch.commandPool, 1, &batch.commandBuffer);
+    if (batch.commandPool) pTableDevice->DestroyCommandPool(device, batch.commandPool, NULL);
+    if (batch.fence) pTableDevice->DestroyFence(device, batch.fence, NULL);
 }
 
-// Save an image to a PPM image file.
+// Record the capture of a swapchain image into the command buffer of a
+// present's capture batch.
 //
 // This function issues commands to copy/convert the swapchain image
 // from whatever compatible format the swapchain image uses
 // to a single format (VK_FORMAT_R8G8B8A8_UNORM) so that the converted
 // result can be easily written to a PPM file.
 //
+// It returns true if the copy was recorded, in which case the capture is
+// added to the present's pending captures.  Nothing is recorded otherwise.
+//
 // Error handling: If there is a problem, this function should silently
 // fail without affecting the Present operation going on in the caller.
 // The numerous debug asserts are to catch programming errors and are not
 // expected to assert.  Recovery and clean up are implemented for image memory
 // allocation failures.
 // (TODO) It would be nice to pass any failure info to DebugReport or something.
-static void writePPM(const char *filename, VkImage image1) {
-    VkResult err;
-    bool pass;
-
+//
+// It is called with the lock of the swapchain held.
+static bool recordCapture(const string &filename, int frameNumber, SwapchainMapStruct *swapchainMapElem, uint32_t imageIndex,
+                          const QueueFamilyStruct &queueFamily, VkCommandBuffer commandBuffer, PendingPresent &present) {
     // Bail immediately if we can't find the image.
-    if (imageMap.empty() || imageMap.find(image1) == imageMap.end()) return;
+    if (imageIndex >= swapchainMapElem->images.size()) return false;
+    VkImage image1 = swapchainMapElem->images[imageIndex];
 
     // Collect object info from maps.  This info is generally recorded
     // by the other functions hooked in this layer.
-    VkDevice device = imageMap[image1]->device;
-    VkPhysicalDevice physicalDevice = deviceMap[device]->physicalDevice;
-    VkInstance instance = physDeviceMap[physicalDevice]->instance;
+    VkDevice device = swapchainMapElem->device;
+    DeviceMapStruct *devMap = get_device_info(device);
     DispatchMapStruct *dispMap = get_dispatch_info(device);
-    if (NULL == dispMap) {
+    if (NULL == dispMap || NULL == devMap) {
         assert(0);
-        return;
-    }
-    VkQueue queue = getQueueForScreenshot(device);
-    if (!queue) {
-#ifdef ANDROID
-        __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failure - capable queue not found\n");
-#else
-        fprintf(stderr, "Screenshot could not find a capable queue\n");
-#endif
-        return;
+        return false;
     }
     VkLayerDispatchTable *pTableDevice = dispMap->device_dispatch_table;
-    VkLayerDispatchTable *pTableQueue = get_dispatch_info(static_cast<VkDevice>(static_cast<void *>(queue)))->device_dispatch_table;
+    VkPhysicalDevice physicalDevice = devMap->physicalDevice;
     VkLayerInstanceDispatchTable *pInstanceTable;
-    pInstanceTable = instance_dispatch_table(instance);
+    pInstanceTable = instance_dispatch_table(devMap->instance);
 
     // Gather incoming image info and check image format for compatibility with
     // the target format.
-    // This function supports both 24-bit and 32-bit swapchain images.
-    uint32_t const width = imageMap[image1]->imageExtent.width;
-    uint32_t const height = imageMap[image1]->imageExtent.height;
-    VkFormat const format = imageMap[image1]->format;
+    // This function supports both 24-bit and 32-bit swapchain images, and
+    // the deep color formats of formatIsDeepColor().
+    VkExtent2D const &imageExtent = swapchainMapElem->imageExtent;
+    VkFormat const format = swapchainMapElem->format;
+
+    // The captured region is clipped to the image, and the size of the written
+    // image is scaled from it.
+    VkRect2D region = {{0, 0}, imageExtent};
+    if (captureRegion.extent.width) {
+        uint32_t const x = std::min(static_cast<uint32_t>(captureRegion.offset.x), imageExtent.width - 1);
+        uint32_t const y = std::min(static_cast<uint32_t>(captureRegion.offset.y), imageExtent.height - 1);
+        region.offset = {static_cast<int32_t>(x), static_cast<int32_t>(y)};
+        region.extent.width = std::min(captureRegion.extent.width, imageExtent.width - x);
+        region.extent.height = std::min(captureRegion.extent.height, imageExtent.height - y);
+    }
+    uint32_t width = std::max(region.extent.width * captureScale / 100, 1u);
+    uint32_t height = std::max(region.extent.height * captureScale / 100, 1u);
     uint32_t const numChannels = FormatChannelCount(format);
+    bool const deepColor = formatIsDeepColor(format);
 
-    if ((3 != numChannels) && (4 != numChannels)) {
+    if (!deepColor && (3 != numChannels) && (4 != numChannels)) {
         assert(0);
-        return;
+        return false;
     }
 
-    // Initial dest format is undefined as we will look for one
-    VkFormat destformat = VK_FORMAT_UNDEFINED;
+    // Initial dest format is undefined as we will look for one, unless the
+    // image is read back in its own format.
+    VkFormat destformat = deepColor ? format : VK_FORMAT_UNDEFINED;
 
     // This variable set by readScreenShotFormatENV func during init
-    if (userColorSpaceFormat != UNDEFINED) {
+    if (!deepColor && userColorSpaceFormat != UNDEFINED) {
         switch (userColorSpaceFormat) {
             case UNORM:
                 if (numChannels == 4)
@@ -621,12 +1839,10 @@ static void writePPM(const char *filename, VkImage image1) {
     if (destformat == VK_FORMAT_UNDEFINED) {
         // Here we reserve swapchain color space only as RGBA swizzle will be later.
         //
-        // One Potential optimization here would be: set destination to RGB all the
-        // time instead RGBA. PPM does not support Alpha channel, so we can write
-        // RGB one row by row but RGBA written one pixel at a time.
-        // This requires BLIT operation to get involved but current drivers (mostly)
-        // does not support BLIT operations on 3 Channel rendertargets.
-        // So format conversion gets costly.
+        // The destination keeps the alpha channel even though PPM does not
+        // support it, because current drivers (mostly) do not support BLIT
+        // operations on 3 channel rendertargets.  The alpha channel is
+        // dropped on the CPU when the file is written.
         if (numChannels == 4) {
             if (FormatIsUNorm(format))
                 destformat = VK_FORMAT_R8G8B8A8_UNORM;
@@ -662,7 +1878,7 @@ static void writePPM(const char *filename, VkImage image1) {
 
     // Still could not find the right format then we use UNORM
     if (destformat == VK_FORMAT_UNDEFINED) {
-        if (printFormatWarning) {
+        if (printFormatWarning.exchange(false)) {
 #ifdef ANDROID
             __android_log_print(ANDROID_LOG_INFO, "screenshot",
                                 "Swapchain format is not in the list:\nUNORM, SNORM, USCALED, SSCALED, UINT, SINT, SRGB\n");
@@ -671,7 +1887,6 @@ static void writePPM(const char *filename, VkImage image1) {
                     "Swapchain format is not in the list:\nUNORM, SNORM, USCALED, SSCALED, UINT, SINT, SRGB\n"
                     "UNORM colorspace will be used instead\n");
 #endif
-            printFormatWarning = false;
         }
         if (numChannels == 4)
             destformat = VK_FORMAT_R8G8B8A8_UNORM;
@@ -681,7 +1896,7 @@ static void writePPM(const char *filename, VkImage image1) {
 
     if ((FormatCompatibilityClass(destformat) != FormatCompatibilityClass(format))) {
         assert(0);
-        return;
+        return false;
     }
 
     // General Approach
@@ -714,24 +1929,44 @@ static void writePPM(const char *filename, VkImage image1) {
     // both linear and optimal tiled (swapchain) images.
     // There is therefore no point in looking at the BLIT_SRC properties.
     //
-    // There is also the optimization where the incoming and target formats are
-    // the same.  In this case, just do a COPY.
+    // There is also the optimization where the incoming and target formats
+    // only differ by the order of the red and blue channels, if at all, and
+    // the capture is not scaled.  In this case, no image is needed: the
+    // swapchain image is copied into a host-visible buffer with tightly packed
+    // rows, and the channels are swapped on the CPU.
+    //
+    // Scaling and cropping are done by the BLIT, so that only the reduced
+    // image is read back and written.
 
     VkFormatProperties targetFormatProps;
     pInstanceTable->GetPhysicalDeviceFormatProperties(physicalDevice, destformat, &targetFormatProps);
+    bool const scaled = width != region.extent.width || height != region.extent.height;
     bool need2steps = false;
-    bool copyOnly = false;
-    if (destformat == format) {
-        copyOnly = true;
+    bool readBuffer = false;
+    if (!scaled && formatAsRGB(format) == destformat) {
+        readBuffer = true;
     } else {
         bool const bltLinear = targetFormatProps.linearTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT ? true : false;
         bool const bltOptimal = targetFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT ? true : false;
         if (!bltLinear && !bltOptimal) {
             // Cannot blit to either target tiling type.  It should be pretty
             // unlikely to have a device that cannot blit to either type.
-            // But punt by just doing a copy and possibly have the wrong
-            // colors.  This should be quite rare.
-            copyOnly = true;
+            // But punt by just doing a copy, and swap the red and blue
+            // channels on the CPU if needed.  This should be quite rare.
+            // The region is still captured, but it cannot be scaled.
+            readBuffer = true;
+            if (scaled) {
+                width = region.extent.width;
+                height = region.extent.height;
+                if (printScaleWarning.exchange(false)) {
+#ifdef ANDROID
+                    __android_log_print(ANDROID_LOG_INFO, "screenshot",
+                                        "Device cannot blit to the capture format\nCaptures will not be scaled\n");
+#else
+                    fprintf(stderr, "Device cannot blit to the capture format\nCaptures will not be scaled\n");
+#endif
+                }
+            }
         } else if (!bltLinear && bltOptimal) {
             // Cannot blit to a linear target but can blt to optimal, so copy
             // after blit is needed.
@@ -740,131 +1975,59 @@ static void writePPM(const char *filename, VkImage image1) {
         // Else bltLinear is available and only 1 step is needed.
     }
 
-    // Put resources that need to be cleaned up in a struct with a destructor
-    // so that things get cleaned up when this function is exited.
-    WritePPMCleanupData data = {};
-    data.device = device;
-    data.pTableDevice = pTableDevice;
-
-    // Set up the image creation info for both the blit and copy images, in case
-    // both are needed.
-    VkImageCreateInfo imgCreateInfo2 = {
-        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        NULL,
-        0,
-        VK_IMAGE_TYPE_2D,
-        destformat,
-        {width, height, 1},
-        1,
-        1,
-        VK_SAMPLE_COUNT_1_BIT,
-        VK_IMAGE_TILING_LINEAR,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-        VK_SHARING_MODE_EXCLUSIVE,
-        0,
-        NULL,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-    };
-    VkImageCreateInfo imgCreateInfo3 = imgCreateInfo2;
-
-    // If we need both images, set up image2 to be read/write and tiled.
-    if (need2steps) {
-        imgCreateInfo2.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imgCreateInfo2.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    // Only the copy into a buffer can be done on a queue without graphics.
+    if (!readBuffer && !(queueFamily.flags & VK_QUEUE_GRAPHICS_BIT)) {
+        if (printQueueWarning.exchange(false)) {
+#ifdef ANDROID
+            __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failure - present queue is not graphics capable\n");
+#else
+            fprintf(stderr, "Screenshot cannot capture a present on a queue that is not graphics capable\n");
+#endif
+        }
+        return false;
     }
-
-    VkMemoryAllocateInfo memAllocInfo = {
-        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL,
-        0,  // allocationSize, queried later
-        0   // memoryTypeIndex, queried later
-    };
-    VkMemoryRequirements memRequirements;
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-
-    // Create image2 and allocate its memory.  It could be the intermediate or
-    // final image.
-    err = pTableDevice->CreateImage(device, &imgCreateInfo2, NULL, &data.image2);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-    pTableDevice->GetImageMemoryRequirements(device, data.image2, &memRequirements);
-    memAllocInfo.allocationSize = memRequirements.size;
-    pInstanceTable->GetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-    pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
-                                       need2steps ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                       &memAllocInfo.memoryTypeIndex);
-    assert(pass);
-    err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &data.mem2);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-    err = pTableQueue->BindImageMemory(device, data.image2, data.mem2, 0);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-
-    // Create image3 and allocate its memory, if needed.
-    if (need2steps) {
-        err = pTableDevice->CreateImage(device, &imgCreateInfo3, NULL, &data.image3);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        pTableDevice->GetImageMemoryRequirements(device, data.image3, &memRequirements);
-        memAllocInfo.allocationSize = memRequirements.size;
-        pInstanceTable->GetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-        pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                           &memAllocInfo.memoryTypeIndex);
-        assert(pass);
-        err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &data.mem3);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        err = pTableQueue->BindImageMemory(device, data.image3, data.mem3, 0);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
+    uint32_t const queueFamilyIndex = queueFamily.index;
+
+    // Reuse the staging resources of the swapchain, setting them up at its
+    // first capture or if they no longer match.
+    CaptureRing *ring = swapchainMapElem->captureRing;
+    if (ring && !ring->matches({width, height}, destformat, readBuffer, need2steps, queueFamilyIndex)) {
+        delete ring;
+        ring = nullptr;
     }
-
-    // We want to create our own command pool to be sure we can use it from this thread
-    VkCommandPoolCreateInfo cmd_pool_info = {};
-    cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    cmd_pool_info.pNext = NULL;
-    auto it = deviceMap[device]->queueIndexMap.find(queue);
-    assert(it != deviceMap[device]->queueIndexMap.end());
-    cmd_pool_info.queueFamilyIndex = it->second;
-    cmd_pool_info.flags = 0;
-
-    err = pTableDevice->CreateCommandPool(device, &cmd_pool_info, NULL, &data.commandPool);
-    assert(!err);
-
-    // Set up the command buffer.
-    const VkCommandBufferAllocateInfo allocCommandBufferInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL,
-                                                                data.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
-    err = pTableDevice->AllocateCommandBuffers(device, &allocCommandBufferInfo, &data.commandBuffer);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-
-    VkDevice cmdBuf = static_cast<VkDevice>(static_cast<void *>(data.commandBuffer));
-    if (deviceMap.find(cmdBuf) != deviceMap.end()) {
-        // Remove element with key cmdBuf from deviceMap so we can replace it
-        deviceMap.erase(cmdBuf);
+    if (!ring) {
+        ring = new CaptureRing(device, pTableDevice, {width, height}, destformat, readBuffer, need2steps, queueFamilyIndex);
+        swapchainMapElem->captureRing = ring;
     }
-    dispatchMap.emplace(cmdBuf, dispMap);
-    VkLayerDispatchTable *pTableCommandBuffer;
-    pTableCommandBuffer = get_dispatch_info(cmdBuf)->device_dispatch_table;
 
-    // We have just created a dispatchable object, but the dispatch table has
-    // not been placed in the object yet.  When a "normal" application creates
-    // a command buffer, the dispatch table is installed by the top-level api
-    // binding (trampoline.c). But here, we have to do it ourselves.
-    if (!dispMap->pfn_dev_init) {
-        *((const void **)data.commandBuffer) = *(void **)device;
-    } else {
-        err = dispMap->pfn_dev_init(device, (void *)data.commandBuffer);
-        assert(!err);
+    // The slot is released when the capture is destroyed, either when this
+    // function is exited early or once the file has been written.
+    unique_ptr<PendingCapture> capture(new PendingCapture());
+    capture->filename = filename;
+    capture->frameNumber = frameNumber;
+    capture->width = width;
+    capture->height = height;
+    capture->numChannels = numChannels;
+    capture->format = destformat;
+    // A copy keeps the byte order of the swapchain format, and so does a blit
+    // of a deep color format.
+    capture->swapRB = deepColor ? format == VK_FORMAT_A2R10G10B10_UNORM_PACK32 : readBuffer && formatIsBGR(format);
+    capture->ring = ring;
+    capture->slot = ring->acquire();
+    CaptureSlot &slot = *capture->slot;
+
+    if (!slot.ptr) {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        pInstanceTable->GetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        if (!(ring->readBuffer ? createCaptureBuffer(*ring, slot, memoryProperties)
+                               : createCaptureImages(*ring, slot, memoryProperties))) {
+            ring->destroySlot(slot);
+            return false;
+        }
     }
 
-    const VkCommandBufferBeginInfo commandBufferBeginInfo = {
-        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        NULL,
-        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-    };
-    err = pTableCommandBuffer->BeginCommandBuffer(data.commandBuffer, &commandBufferBeginInfo);
-    assert(!err);
+    VkLayerDispatchTable *pTableCommandBuffer;
+    pTableCommandBuffer = get_dispatch_info(static_cast<VkDevice>(static_cast<void *>(commandBuffer)))->device_dispatch_table;
 
     // This barrier is used to transition from/to present Layout
     VkImageMemoryBarrier presentMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -879,7 +2042,8 @@ static void writePPM(const char *filename, VkImage image1) {
                                                  {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
 
     // This barrier is used to transition from a newly-created layout to a blt
-    // or copy destination layout.
+    // or copy destination layout.  The previous contents of the staging images
+    // are discarded.
     VkImageMemoryBarrier destMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                                               NULL,
                                               0,
@@ -888,47 +2052,71 @@ static void writePPM(const char *filename, VkImage image1) {
                                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                                               VK_QUEUE_FAMILY_IGNORED,
                                               VK_QUEUE_FAMILY_IGNORED,
-                                              data.image2,
+                                              slot.image2,
                                               {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
 
     // This barrier is used to transition a dest layout to general layout.
     VkImageMemoryBarrier generalMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                                                  NULL,
                                                  VK_ACCESS_TRANSFER_WRITE_BIT,
-                                                 VK_ACCESS_MEMORY_READ_BIT,
+                                                 VK_ACCESS_HOST_READ_BIT,
                                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                                                  VK_IMAGE_LAYOUT_GENERAL,
                                                  VK_QUEUE_FAMILY_IGNORED,
                                                  VK_QUEUE_FAMILY_IGNORED,
-                                                 data.image2,
+                                                 slot.image2,
                                                  {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
 
     VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
     VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
 
     // The source image needs to be transitioned from present to transfer
-    // source.
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, dstStages, 0, 0, NULL, 0,
-                                            NULL, 1, &presentMemoryBarrier);
-
-    // image2 needs to be transitioned from its undefined state to transfer
-    // destination.
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1, &destMemoryBarrier);
+    // source.  The submission waits on the present's semaphores at the
+    // transfer stage, which this barrier chains with.
+    pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
+                                            &presentMemoryBarrier);
 
     const VkImageCopy imageCopyRegion = {
         {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0}, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0}, {width, height, 1}};
 
-    if (copyOnly) {
-        pTableCommandBuffer->CmdCopyImage(data.commandBuffer, image1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data.image2,
-                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
+    if (readBuffer) {
+        // A buffer row length of 0 packs the rows tightly.
+        const VkBufferImageCopy bufferCopyRegion = {0,
+                                                    0,
+                                                    0,
+                                                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                                                    {region.offset.x, region.offset.y, 0},
+                                                    {width, height, 1}};
+        pTableCommandBuffer->CmdCopyImageToBuffer(commandBuffer, image1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1,
+                                                  &bufferCopyRegion);
+
+        // Make the copy visible to the host.
+        const VkBufferMemoryBarrier bufferMemoryBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                                           NULL,
+                                                           VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                           VK_ACCESS_HOST_READ_BIT,
+                                                           VK_QUEUE_FAMILY_IGNORED,
+                                                           VK_QUEUE_FAMILY_IGNORED,
+                                                           slot.buffer,
+                                                           0,
+                                                           VK_WHOLE_SIZE};
+        pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1,
+                                                &bufferMemoryBarrier, 0, NULL);
     } else {
+        // image2 needs to be transitioned from its undefined state to transfer
+        // destination.
+        pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
+                                                &destMemoryBarrier);
+
         VkImageBlit imageBlitRegion = {};
         imageBlitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         imageBlitRegion.srcSubresource.baseArrayLayer = 0;
         imageBlitRegion.srcSubresource.layerCount = 1;
         imageBlitRegion.srcSubresource.mipLevel = 0;
-        imageBlitRegion.srcOffsets[1].x = width;
-        imageBlitRegion.srcOffsets[1].y = height;
+        imageBlitRegion.srcOffsets[0].x = region.offset.x;
+        imageBlitRegion.srcOffsets[0].y = region.offset.y;
+        imageBlitRegion.srcOffsets[1].x = region.offset.x + static_cast<int32_t>(region.extent.width);
+        imageBlitRegion.srcOffsets[1].y = region.offset.y + static_cast<int32_t>(region.extent.height);
         imageBlitRegion.srcOffsets[1].z = 1;
         imageBlitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         imageBlitRegion.dstSubresource.baseArrayLayer = 0;
@@ -938,13 +2126,21 @@ static void writePPM(const char *filename, VkImage image1) {
         imageBlitRegion.dstOffsets[1].y = height;
         imageBlitRegion.dstOffsets[1].z = 1;
 
-        pTableCommandBuffer->CmdBlitImage(data.commandBuffer, image1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data.image2,
-                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlitRegion, VK_FILTER_NEAREST);
+        // Scaled captures are filtered when the swapchain format allows it.
+        VkFilter filter = VK_FILTER_NEAREST;
+        if (scaled) {
+            VkFormatProperties sourceFormatProps;
+            pInstanceTable->GetPhysicalDeviceFormatProperties(physicalDevice, format, &sourceFormatProps);
+            if (sourceFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) filter = VK_FILTER_LINEAR;
+        }
+
+        pTableCommandBuffer->CmdBlitImage(commandBuffer, image1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.image2,
+                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlitRegion, filter);
         if (need2steps) {
             // image 3 needs to be transitioned from its undefined state to a
             // transfer destination.
-            destMemoryBarrier.image = data.image3;
-            pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
+            destMemoryBarrier.image = slot.image3;
+            pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
                                                     &destMemoryBarrier);
 
             // Transition image2 so that it can be read for the upcoming copy to
@@ -953,21 +2149,21 @@ static void writePPM(const char *filename, VkImage image1) {
             destMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
             destMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
             destMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            destMemoryBarrier.image = data.image2;
-            pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
+            destMemoryBarrier.image = slot.image2;
+            pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
                                                     &destMemoryBarrier);
 
             // This step essentially untiles the image.
-            pTableCommandBuffer->CmdCopyImage(data.commandBuffer, data.image2, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data.image3,
+            pTableCommandBuffer->CmdCopyImage(commandBuffer, slot.image2, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.image3,
                                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
-            generalMemoryBarrier.image = data.image3;
+            generalMemoryBarrier.image = slot.image3;
         }
-    }
 
-    // The destination needs to be transitioned from the optimal copy format to
-    // the format we can read with the CPU.
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
-                                            &generalMemoryBarrier);
+        // The destination needs to be transitioned from the optimal copy
+        // format to the format we can read with the CPU.
+        pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 0, NULL, 1,
+                                                &generalMemoryBarrier);
+    }
 
     // Restore the swap chain image layout to what it was before.
     // This may not be strictly needed, but it is generally good to restore
@@ -976,89 +2172,180 @@ static void writePPM(const char *filename, VkImage image1) {
     presentMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
     presentMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
     presentMemoryBarrier.dstAccessMask = 0;
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
+    pTableCommandBuffer->CmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
                                             &presentMemoryBarrier);
 
-    err = pTableCommandBuffer->EndCommandBuffer(data.commandBuffer);
-    assert(!err);
+    present.captures.push_back(std::move(capture));
+    return true;
+}
 
-    VkFence nullFence = {VK_NULL_HANDLE};
-    VkSubmitInfo submitInfo;
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pNext = NULL;
-    submitInfo.waitSemaphoreCount = 0;
-    submitInfo.pWaitSemaphores = NULL;
-    submitInfo.pWaitDstStageMask = NULL;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &data.commandBuffer;
-    submitInfo.signalSemaphoreCount = 0;
-    submitInfo.pSignalSemaphores = NULL;
+// Get the semaphore that a capture of the swapchain image at imageIndex
+// signals for its present, creating it on first use.  Called with the lock
+// of the swapchain held.
+static VkSemaphore getCaptureSemaphore(SwapchainMapStruct *swapchainMapElem, uint32_t imageIndex) {
+    if (swapchainMapElem->captureSemaphores.size() <= imageIndex) {
+        swapchainMapElem->captureSemaphores.resize(imageIndex + 1, VK_NULL_HANDLE);
+    }
+    VkSemaphore &semaphore = swapchainMapElem->captureSemaphores[imageIndex];
+    if (semaphore == VK_NULL_HANDLE) {
+        VkDevice device = swapchainMapElem->device;
+        const VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, NULL, 0};
+        VkResult err = get_dispatch_info(device)->device_dispatch_table->CreateSemaphore(device, &semaphoreCreateInfo, NULL,
+                                                                                          &semaphore);
+        assert(!err);
+        if (VK_SUCCESS != err) semaphore = VK_NULL_HANDLE;
+    }
+    return semaphore;
+}
 
-    err = pTableQueue->QueueSubmit(queue, 1, &submitInfo, nullFence);
-    assert(!err);
+// Capture the swapchain images of a present.  The copies of all of them are
+// recorded into one command buffer and submitted at once, so that capturing
+// several windows costs a single submission.  The submission waits on the
+// semaphores of the present and signals the returned semaphore, which the
+// present must wait on instead.  It is submitted to the queue of the present,
+// which the application synchronizes for the call and which can access the
+// swapchain images without an ownership transfer.  VK_NULL_HANDLE is returned
+// if nothing was
+// submitted.  The files are written once the copies have completed, either
+// right away or by the capture worker in pipelined mode.
+//
+// When the present has several swapchains, the index of each one in it is
+// added to its file name.  In frame hash and sequence modes, which keep one
+// image per frame, only the first swapchain is captured.
+static VkSemaphore captureSwapchains(VkQueue queue, const string &fileBaseName, int frameNumber,
+                                     const VkPresentInfoKHR *pPresentInfo) {
+    VkResult err;
 
-    err = pTableQueue->QueueWaitIdle(queue);
-    assert(!err);
+    uint32_t swapchainCount = pPresentInfo->swapchainCount;
+    if (frameHashLog.enabled() || !sequenceFileName.empty() || !shmName.empty()) swapchainCount = 1;
+    vector<SwapchainMapStruct *> swapchainMapElems(swapchainCount);
+    SwapchainMapStruct *firstMapElem = nullptr;
+    uint32_t firstIndex = 0;
+    for (uint32_t i = 0; i < swapchainCount; i++) {
+        swapchainMapElems[i] = get_swapchain_info(pPresentInfo->pSwapchains[i]);
+        if (!firstMapElem && swapchainMapElems[i]) {
+            firstMapElem = swapchainMapElems[i];
+            firstIndex = i;
+        }
+    }
+    if (!firstMapElem) return VK_NULL_HANDLE;
 
-    err = pTableDevice->DeviceWaitIdle(device);
-    assert(!err);
+    // Collect object info from maps.  All the swapchains of a present belong
+    // to the device of its queue.
+    VkDevice device = firstMapElem->device;
+    DeviceMapStruct *devMap = get_device_info(device);
+    DispatchMapStruct *dispMap = get_dispatch_info(device);
+    if (NULL == dispMap || NULL == devMap) {
+        assert(0);
+        return VK_NULL_HANDLE;
+    }
+    VkLayerDispatchTable *pTableDevice = dispMap->device_dispatch_table;
+    VkLayerDispatchTable *pTableQueue = get_dispatch_info(static_cast<VkDevice>(static_cast<void *>(queue)))->device_dispatch_table;
 
-    // Map the final image so that the CPU can read it.
-    const VkImageSubresource sr = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0};
-    VkSubresourceLayout srLayout;
-    const char *ptr;
-    if (!need2steps) {
-        pTableDevice->GetImageSubresourceLayout(device, data.image2, &sr, &srLayout);
-        err = pTableDevice->MapMemory(device, data.mem2, 0, VK_WHOLE_SIZE, 0, (void **)&ptr);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        data.mem2mapped = true;
-    } else {
-        pTableDevice->GetImageSubresourceLayout(device, data.image3, &sr, &srLayout);
-        err = pTableDevice->MapMemory(device, data.mem3, 0, VK_WHOLE_SIZE, 0, (void **)&ptr);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        data.mem3mapped = true;
+    QueueFamilyStruct queueFamily;
+    {
+        lock_guard<mutex> lock(devMap->lock);
+        auto it = devMap->queueIndexMap.find(queue);
+        if (it == devMap->queueIndexMap.end()) return VK_NULL_HANDLE;
+        queueFamily = it->second;
     }
+    uint32_t const queueFamilyIndex = queueFamily.index;
+
+    // The swapchains stay locked until their captures have been recorded,
+    // and written if the capture is not pipelined.  They are locked in
+    // address order so that presents sharing swapchains cannot deadlock.
+    vector<SwapchainMapStruct *> lockOrder;
+    for (auto swapchainMapElem : swapchainMapElems) {
+        if (swapchainMapElem) lockOrder.push_back(swapchainMapElem);
+    }
+    sort(lockOrder.begin(), lockOrder.end());
+    lockOrder.erase(unique(lockOrder.begin(), lockOrder.end()), lockOrder.end());
+    vector<unique_lock<mutex>> locks;
+    for (auto swapchainMapElem : lockOrder) locks.emplace_back(swapchainMapElem->lock);
+
+    VkSemaphore signalSemaphore = getCaptureSemaphore(firstMapElem, pPresentInfo->pImageIndices[firstIndex]);
+    if (signalSemaphore == VK_NULL_HANDLE) return VK_NULL_HANDLE;
+
+    // The batch is released when the present is destroyed, either when this
+    // function is exited early or once its captures have been read back.
+    unique_ptr<PendingPresent> present(new PendingPresent());
+    present->batchPool = devMap->captureBatches;
+    present->batch = devMap->captureBatches->acquire(queueFamilyIndex);
+    if (!present->batch) return VK_NULL_HANDLE;
+    CaptureBatch &batch = *present->batch;
+
+    // The previous captures that used the batch have completed, so its
+    // command buffer can be recorded again.
+    err = pTableDevice->ResetCommandPool(device, batch.commandPool, 0);
+    assert(!err);
+    if (VK_SUCCESS != err) return VK_NULL_HANDLE;
 
-    // Write the data to a PPM file.
-    ofstream file(filename, ios::binary);
-    assert(file.is_open());
+    VkLayerDispatchTable *pTableCommandBuffer;
+    pTableCommandBuffer = get_dispatch_info(static_cast<VkDevice>(static_cast<void *>(batch.commandBuffer)))->device_dispatch_table;
 
-    if (!file.is_open()) {
+    const VkCommandBufferBeginInfo commandBufferBeginInfo = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        NULL,
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    err = pTableCommandBuffer->BeginCommandBuffer(batch.commandBuffer, &commandBufferBeginInfo);
+    assert(!err);
+
+    const char *extension = screenshot::getImageFileExtension(imageFileFormat);
+    for (uint32_t i = 0; i < swapchainCount; i++) {
+        if (!swapchainMapElems[i]) continue;
+        string fileName = fileBaseName;
+        if (swapchainCount > 1) fileName += "_" + to_string(i);
+        fileName += extension;
+
+        // In frame hash mode, the image is only written if the frame changed,
+        // and in sequence and shared memory modes, no image file is written.
+        if (!frameHashLog.enabled() && sequenceFileName.empty() && shmName.empty()) {
 #ifdef ANDROID
-        __android_log_print(ANDROID_LOG_DEBUG, "screenshot",
-                            "Failed to open output file: %s.  Be sure to grant read and write permissions.", filename);
+            __android_log_print(ANDROID_LOG_INFO, "screenshot", "Screen capture file is: %s", fileName.c_str());
 #else
-        fprintf(stderr, "Failed to open output file:%s,  Be sure to grant read and write permissions\n", filename);
+            printf("Screen Capture file is: %s \n", fileName.c_str());
 #endif
-        return;
+        }
+
+        recordCapture(fileName, frameNumber, swapchainMapElems[i], pPresentInfo->pImageIndices[i], queueFamily, batch.commandBuffer,
+                      *present);
     }
 
-    file << "P6\n";
-    file << width << "\n";
-    file << height << "\n";
-    file << 255 << "\n";
+    err = pTableCommandBuffer->EndCommandBuffer(batch.commandBuffer);
+    assert(!err);
+    if (present->captures.empty()) return VK_NULL_HANDLE;
 
-    ptr += srLayout.offset;
-    if (3 == numChannels) {
-        for (uint32_t y = 0; y < height; y++) {
-            file.write(ptr, 3 * width);
-            ptr += srLayout.rowPitch;
-        }
-    } else if (4 == numChannels) {
-        for (uint32_t y = 0; y < height; y++) {
-            const unsigned int *row = (const unsigned int *)ptr;
-            for (uint32_t x = 0; x < width; x++) {
-                file.write((char *)row, 3);
-                row++;
-            }
-            ptr += srLayout.rowPitch;
-        }
+    err = pTableDevice->ResetFences(device, 1, &batch.fence);
+    assert(!err);
+    if (VK_SUCCESS != err) return VK_NULL_HANDLE;
+
+    // Take over the present's wait semaphores so that the copies start after
+    // the application's rendering, and let the present wait for the copies.
+    // Neither the queue nor the device has to go idle for this.
+    vector<VkPipelineStageFlags> waitStages(pPresentInfo->waitSemaphoreCount, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    VkSubmitInfo submitInfo;
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = NULL;
+    submitInfo.waitSemaphoreCount = pPresentInfo->waitSemaphoreCount;
+    submitInfo.pWaitSemaphores = pPresentInfo->pWaitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+
+    err = pTableQueue->QueueSubmit(queue, 1, &submitInfo, batch.fence);
+    assert(!err);
+    if (VK_SUCCESS != err) return VK_NULL_HANDLE;
+
+    if (pipelinedCapture) {
+        captureWorker.push(std::move(present));
+    } else {
+        writeCaptures(*present);
     }
-    file.close();
 
-    // Clean up handled by ~WritePPMCleanupData()
+    return signalSemaphore;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator,
@@ -1082,6 +2369,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreat
     initInstanceTable(*pInstance, fpGetInstanceProcAddr);
 
     init_screenshot();
+    frameHashLog.open(hashFileName, hashBaselineFileName);
 
     return result;
 }
@@ -1095,6 +2383,7 @@ static void createDeviceRegisterExtensions(const VkDeviceCreateInfo *pCreateInfo
     VkLayerDispatchTable *pDisp = dispMap->device_dispatch_table;
     PFN_vkGetDeviceProcAddr gpa = pDisp->GetDeviceProcAddr;
     pDisp->CreateSwapchainKHR = (PFN_vkCreateSwapchainKHR)gpa(device, "vkCreateSwapchainKHR");
+    pDisp->DestroySwapchainKHR = (PFN_vkDestroySwapchainKHR)gpa(device, "vkDestroySwapchainKHR");
     pDisp->GetSwapchainImagesKHR = (PFN_vkGetSwapchainImagesKHR)gpa(device, "vkGetSwapchainImagesKHR");
     pDisp->AcquireNextImageKHR = (PFN_vkAcquireNextImageKHR)gpa(device, "vkAcquireNextImageKHR");
     pDisp->QueuePresentKHR = (PFN_vkQueuePresentKHR)gpa(device, "vkQueuePresentKHR");
@@ -1111,7 +2400,11 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu, const VkDevice
     assert(chain_info->u.pLayerInfo);
     PFN_vkGetInstanceProcAddr fpGetInstanceProcAddr = chain_info->u.pLayerInfo->pfnNextGetInstanceProcAddr;
     PFN_vkGetDeviceProcAddr fpGetDeviceProcAddr = chain_info->u.pLayerInfo->pfnNextGetDeviceProcAddr;
-    VkInstance instance = physDeviceMap[gpu]->instance;
+    VkInstance instance;
+    {
+        lock_guard<mutex> lock(mapLock);
+        instance = physDeviceMap[gpu]->instance;
+    }
     PFN_vkCreateDevice fpCreateDevice = (PFN_vkCreateDevice)fpGetInstanceProcAddr(instance, "vkCreateDevice");
     if (fpCreateDevice == NULL) {
         return VK_ERROR_INITIALIZATION_FAILED;
@@ -1125,12 +2418,15 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu, const VkDevice
         return result;
     }
 
-    assert(deviceMap.find(*pDevice) == deviceMap.end());
     DeviceMapStruct *deviceMapElem = new DeviceMapStruct;
-    deviceMap[*pDevice] = deviceMapElem;
-    assert(dispatchMap.find(*pDevice) == dispatchMap.end());
     DispatchMapStruct *dispatchMapElem = new DispatchMapStruct;
-    dispatchMap[*pDevice] = dispatchMapElem;
+    {
+        lock_guard<mutex> lock(mapLock);
+        assert(deviceMap.find(*pDevice) == deviceMap.end());
+        deviceMap[*pDevice] = deviceMapElem;
+        assert(dispatchMap.find(*pDevice) == dispatchMap.end());
+        dispatchMap[*pDevice] = dispatchMapElem;
+    }
 
     // Setup device dispatch table
     dispatchMapElem->device_dispatch_table = new VkLayerDispatchTable;
@@ -1139,6 +2435,8 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu, const VkDevice
     createDeviceRegisterExtensions(pCreateInfo, *pDevice);
     // Create a mapping from a device to a physicalDevice
     deviceMapElem->physicalDevice = gpu;
+    deviceMapElem->instance = instance;
+    deviceMapElem->captureBatches = new CaptureBatchPool(*pDevice, dispatchMapElem);
 
     // store the loader callback for initializing created dispatchable objects
     chain_info = get_chain_info(pCreateInfo, VK_LOADER_DATA_CALLBACK);
@@ -1157,6 +2455,7 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumeratePhysicalDevices(VkInstance instance, uin
     VkLayerInstanceDispatchTable *pTable = instance_dispatch_table(instance);
     result = pTable->EnumeratePhysicalDevices(instance, pPhysicalDeviceCount, pPhysicalDevices);
     if (result == VK_SUCCESS && *pPhysicalDeviceCount > 0 && pPhysicalDevices) {
+        lock_guard<mutex> lock(mapLock);
         for (uint32_t i = 0; i < *pPhysicalDeviceCount; i++) {
             // Create a mapping from a physicalDevice to an instance
             if (physDeviceMap[pPhysicalDevices[i]] == NULL) {
@@ -1169,25 +2468,78 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumeratePhysicalDevices(VkInstance instance, uin
     return result;
 }
 
+// Free the capture resources of a swapchain that is no longer tracked.
+static void destroySwapchainState(unique_ptr<SwapchainMapStruct> swapchainMapElem, VkLayerDispatchTable *pDisp) {
+    lock_guard<mutex> lock(swapchainMapElem->lock);
+    // Deleting the staging resources waits for captures still using them.
+    delete swapchainMapElem->captureRing;
+    for (auto semaphore : swapchainMapElem->captureSemaphores) {
+        if (semaphore != VK_NULL_HANDLE) pDisp->DestroySemaphore(swapchainMapElem->device, semaphore, NULL);
+    }
+}
+
 VKAPI_ATTR void VKAPI_CALL DestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator) {
     DispatchMapStruct *dispMap = get_dispatch_info(device);
     DeviceMapStruct *devMap = get_device_info(device);
     assert(dispMap);
     assert(devMap);
     VkLayerDispatchTable *pDisp = dispMap->device_dispatch_table;
+
+    // Pipelined captures still use the device and its dispatch table.
+    captureWorker.drain();
+
+    // Swapchains should have been destroyed already, but free the capture
+    // resources of any that are left.
+    vector<unique_ptr<SwapchainMapStruct>> swapchains;
+    {
+        lock_guard<mutex> lock(mapLock);
+        for (auto it = swapchainMap.begin(); it != swapchainMap.end();) {
+            if (it->second->device == device) {
+                swapchains.push_back(std::move(it->second));
+                it = swapchainMap.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (auto &swapchainMapElem : swapchains) {
+        destroySwapchainState(std::move(swapchainMapElem), pDisp);
+    }
+    delete devMap->captureBatches;
+
     pDisp->DestroyDevice(device, pAllocator);
 
     if (vk_screenshot_dir_used_env_var) {
         local_free_getenv(vk_screenshot_dir);
     }
 
-    loader_platform_thread_lock_mutex(&globalLock);
+    bool lastDevice;
+    {
+        // Remove the device along with its queues and command buffers.
+        lock_guard<mutex> lock(mapLock);
+        for (auto it = dispatchMap.begin(); it != dispatchMap.end();) {
+            if (it->second == dispMap)
+                it = dispatchMap.erase(it);
+            else
+                ++it;
+        }
+        deviceMap.erase(device);
+        lastDevice = deviceMap.empty();
+    }
     delete pDisp;
     delete dispMap;
     delete devMap;
 
-    deviceMap.erase(device);
-    loader_platform_thread_unlock_mutex(&globalLock);
+    if (lastDevice) {
+        captureWorker.stop();
+        encodePool.stop();
+        sequencePool.stop();
+        {
+            lock_guard<mutex> lock(shmLock);
+            frameRing.destroy();
+        }
+        bandPool.stop();
+    }
 }
 
 VKAPI_ATTR void VKAPI_CALL GetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue *pQueue) {
@@ -1196,31 +2548,35 @@ VKAPI_ATTR void VKAPI_CALL GetDeviceQueue(VkDevice device, uint32_t queueFamilyI
     VkLayerDispatchTable *pDisp = dispMap->device_dispatch_table;
     pDisp->GetDeviceQueue(device, queueFamilyIndex, queueIndex, pQueue);
 
+    // queues are dispatchable objects.
+    // Create dispatchMap entry with this queue as its key.  QueuePresentKHR
+    // needs it even when no more screenshots are taken.
+    VkDevice que = static_cast<VkDevice>(static_cast<void *>(*pQueue));
+    {
+        lock_guard<mutex> lock(mapLock);
+        dispatchMap[que] = dispMap;
+    }
+
     // Save the device queue in a map if we are taking screenshots.
-    loader_platform_thread_lock_mutex(&globalLock);
-    if (screenshotFramesReceived && screenshotFrames.empty() && !screenShotFrameRange.valid) {
+    if (noScreenshotsPending()) {
         // No screenshots in the list to take
-        loader_platform_thread_unlock_mutex(&globalLock);
         return;
     }
 
-    // Add this queue to deviceMap[device].queues, and queueFamilyIndex to deviceMap[device].queueIndexMap
-    if (deviceMap.find(device) != deviceMap.end()) {
-        deviceMap[device]->queues.emplace(*pQueue);
-
-        if (deviceMap[device]->queueIndexMap.find(*pQueue) != deviceMap[device]->queueIndexMap.end())
-            deviceMap[device]->queueIndexMap.erase(*pQueue);
-        deviceMap[device]->queueIndexMap.emplace(*pQueue, queueFamilyIndex);
+    // Add the queue family and its capabilities to the device's queueIndexMap,
+    // so that presents do not have to query them.
+    DeviceMapStruct *devMap = get_device_info(device);
+    if (devMap) {
+        uint32_t queueFamilyCount = 0;
+        VkLayerInstanceDispatchTable *pInstanceTable = instance_dispatch_table(devMap->instance);
+        pInstanceTable->GetPhysicalDeviceQueueFamilyProperties(devMap->physicalDevice, &queueFamilyCount, NULL);
+        vector<VkQueueFamilyProperties> queueProps(queueFamilyCount);
+        pInstanceTable->GetPhysicalDeviceQueueFamilyProperties(devMap->physicalDevice, &queueFamilyCount, queueProps.data());
+        VkQueueFlags const flags = queueFamilyIndex < queueFamilyCount ? queueProps[queueFamilyIndex].queueFlags : 0;
+
+        lock_guard<mutex> lock(devMap->lock);
+        devMap->queueIndexMap[*pQueue] = {queueFamilyIndex, flags};
     }
-
-    // queues are dispatchable objects.
-    // Create dispatchMap entry with this queue as its key.
-    // Copy the device dispatch table to the new dispatch table.
-    VkDevice que = static_cast<VkDevice>(static_cast<void *>(*pQueue));
-    if (dispatchMap.find(que) != dispatchMap.end()) dispatchMap.erase(que);
-    dispatchMap.emplace(que, dispMap);
-
-    loader_platform_thread_unlock_mutex(&globalLock);
 }
 
 VKAPI_ATTR void VKAPI_CALL GetDeviceQueue2(VkDevice device, const VkDeviceQueueInfo2 *pQueueInfo, VkQueue *pQueue) {
@@ -1240,32 +2596,22 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(VkDevice device, const VkSwapc
     VkResult result = pDisp->CreateSwapchainKHR(device, &myCreateInfo, pAllocator, pSwapchain);
 
     // Save the swapchain in a map of we are taking screenshots.
-    loader_platform_thread_lock_mutex(&globalLock);
-    if (screenshotFramesReceived && screenshotFrames.empty() && !screenShotFrameRange.valid) {
+    if (noScreenshotsPending()) {
         // No screenshots in the list to take
-        loader_platform_thread_unlock_mutex(&globalLock);
         return result;
     }
 
     if (result == VK_SUCCESS) {
         // Create a mapping for a swapchain to a device, image extent, and
         // format
-        SwapchainMapStruct *swapchainMapElem = new SwapchainMapStruct;
+        unique_ptr<SwapchainMapStruct> swapchainMapElem(new SwapchainMapStruct());
         swapchainMapElem->device = device;
         swapchainMapElem->imageExtent = pCreateInfo->imageExtent;
         swapchainMapElem->format = pCreateInfo->imageFormat;
-        // If there's a (destroyed) swapchain with the same handle, remove it from the swapchainMap
-        if (swapchainMap.find(*pSwapchain) != swapchainMap.end()) {
-            delete swapchainMap[*pSwapchain];
-            swapchainMap.erase(*pSwapchain);
-        }
-        swapchainMap.insert(make_pair(*pSwapchain, swapchainMapElem));
-
-        // Create a mapping for the swapchain object into the dispatch table
-        // TODO is this needed? screenshot_device_table_map.emplace((void
-        // *)pSwapchain, pTable);
+        // If there's a (destroyed) swapchain with the same handle, it is replaced
+        lock_guard<mutex> lock(mapLock);
+        swapchainMap[*pSwapchain] = std::move(swapchainMapElem);
     }
-    loader_platform_thread_unlock_mutex(&globalLock);
 
     return result;
 }
@@ -1277,113 +2623,90 @@ VKAPI_ATTR VkResult VKAPI_CALL GetSwapchainImagesKHR(VkDevice device, VkSwapchai
     VkLayerDispatchTable *pDisp = dispMap->device_dispatch_table;
     VkResult result = pDisp->GetSwapchainImagesKHR(device, swapchain, pCount, pSwapchainImages);
 
-    // Save the swapchain images in a map if we are taking screenshots
-    loader_platform_thread_lock_mutex(&globalLock);
-    if (screenshotFramesReceived && screenshotFrames.empty() && !screenShotFrameRange.valid) {
+    // Save the swapchain images if we are taking screenshots
+    if (noScreenshotsPending()) {
         // No screenshots in the list to take
-        loader_platform_thread_unlock_mutex(&globalLock);
         return result;
     }
 
-    if (result == VK_SUCCESS && pSwapchainImages && !swapchainMap.empty() && swapchainMap.find(swapchain) != swapchainMap.end()) {
-        unsigned i;
-
-        for (i = 0; i < *pCount; i++) {
-            // Create a mapping for an image to a device, image extent, and
-            // format
-            if (imageMap[pSwapchainImages[i]] == NULL) {
-                ImageMapStruct *imageMapElem = new ImageMapStruct;
-                imageMap[pSwapchainImages[i]] = imageMapElem;
-            }
-            imageMap[pSwapchainImages[i]]->device = swapchainMap[swapchain]->device;
-            imageMap[pSwapchainImages[i]]->imageExtent = swapchainMap[swapchain]->imageExtent;
-            imageMap[pSwapchainImages[i]]->format = swapchainMap[swapchain]->format;
-        }
-
-        // Add list of images to swapchain to image map
-        SwapchainMapStruct *swapchainMapElem = swapchainMap[swapchain];
-        if (i >= 1 && swapchainMapElem) {
-            VkImage *imageList = new VkImage[i];
-            swapchainMapElem->imageList = imageList;
-            for (unsigned j = 0; j < i; j++) {
-                swapchainMapElem->imageList[j] = pSwapchainImages[j];
-            }
-        }
+    SwapchainMapStruct *swapchainMapElem = get_swapchain_info(swapchain);
+    if (result == VK_SUCCESS && pSwapchainImages && swapchainMapElem && *pCount >= 1) {
+        // Add list of images to swapchain
+        lock_guard<mutex> lock(swapchainMapElem->lock);
+        swapchainMapElem->images.assign(pSwapchainImages, pSwapchainImages + *pCount);
     }
-    loader_platform_thread_unlock_mutex(&globalLock);
     return result;
 }
 
+VKAPI_ATTR void VKAPI_CALL DestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain, const VkAllocationCallbacks *pAllocator) {
+    DispatchMapStruct *dispMap = get_dispatch_info(device);
+    assert(dispMap);
+    VkLayerDispatchTable *pDisp = dispMap->device_dispatch_table;
+    pDisp->DestroySwapchainKHR(device, swapchain, pAllocator);
+
+    unique_ptr<SwapchainMapStruct> swapchainMapElem;
+    {
+        lock_guard<mutex> lock(mapLock);
+        auto it = swapchainMap.find(swapchain);
+        if (it == swapchainMap.end()) return;
+        swapchainMapElem = std::move(it->second);
+        swapchainMap.erase(it);
+    }
+    destroySwapchainState(std::move(swapchainMapElem), pDisp);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo) {
-    static int frameNumber = 0;
     DispatchMapStruct *dispMap = get_dispatch_info((VkDevice)queue);
     assert(dispMap);
-    loader_platform_thread_lock_mutex(&globalLock);
-
-    if (!screenshotFrames.empty() || screenShotFrameRange.valid) {
-        set<int>::iterator it;
-        bool inScreenShotFrames = false;
-        bool inScreenShotFrameRange = false;
-        it = screenshotFrames.find(frameNumber);
-        inScreenShotFrames = (it != screenshotFrames.end());
-        isInScreenShotFrameRange(frameNumber, &screenShotFrameRange, &inScreenShotFrameRange);
-        if ((inScreenShotFrames) || (inScreenShotFrameRange)) {
-            string fileName;
-
-            if (vk_screenshot_dir == NULL || strlen(vk_screenshot_dir) == 0) {
-                fileName = to_string(frameNumber) + ".ppm";
-            } else {
-                fileName = vk_screenshot_dir;
-                fileName += "/" + to_string(frameNumber) + ".ppm";
-            }
-#ifdef ANDROID
-            __android_log_print(ANDROID_LOG_INFO, "screenshot", "Screen capture file is: %s", fileName.c_str());
-#else
-            printf("Screen Capture file is: %s \n", fileName.c_str());
-#endif
+    VkSemaphore captureSemaphore = VK_NULL_HANDLE;
+
+    // While frames remain to be captured, frame numbers are taken under
+    // frameLock so that they are selected in order.  Otherwise, the present
+    // only loads capturesPending, and looks for the trigger file every
+    // triggerInterval frames before taking the lock.
+    int frameNumber;
+    bool screenShotFrame = false;
+    if (!triggerFileName.empty() && frameCounter % triggerInterval == 0) checkTriggerFile();
+    if (!capturesPending) {
+        frameNumber = frameCounter++;
+    } else {
+        lock_guard<mutex> lock(frameLock);
+        frameNumber = frameCounter++;
+        screenShotFrame = selectScreenShotFrame(frameNumber);
+    }
 
-            VkImage image;
-            VkSwapchainKHR swapchain;
-            // We'll dump only one image: the first
-            // If there are 0 swapchains, skip taking the snapshot
-            if (pPresentInfo && pPresentInfo->swapchainCount > 0) {
-                swapchain = pPresentInfo->pSwapchains[0];
-                image = swapchainMap[swapchain]->imageList[pPresentInfo->pImageIndices[0]];
-                writePPM(fileName.c_str(), image);
-            } else {
+    if (screenShotFrame) {
+        string fileBaseName;
+
+        if (vk_screenshot_dir == NULL || strlen(vk_screenshot_dir) == 0) {
+            fileBaseName = to_string(frameNumber);
+        } else {
+            fileBaseName = vk_screenshot_dir;
+            fileBaseName += "/" + to_string(frameNumber);
+        }
+
+        // If there are 0 swapchains, skip taking the snapshot
+        if (pPresentInfo && pPresentInfo->swapchainCount > 0) {
+            captureSemaphore = captureSwapchains(queue, fileBaseName, frameNumber, pPresentInfo);
+        } else {
 #ifdef ANDROID
-                __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failure - no swapchain specified\n");
+            __android_log_print(ANDROID_LOG_ERROR, "screenshot", "Failure - no swapchain specified\n");
 #else
-                fprintf(stderr, "Screenshot failure - no swapchain specified\n");
+            fprintf(stderr, "Screenshot failure - no swapchain specified\n");
 #endif
-            }
-            if (inScreenShotFrames) {
-                screenshotFrames.erase(it);
-            }
-
-            if (screenshotFrames.empty() && isEndOfScreenShotFrameRange(frameNumber, &screenShotFrameRange)) {
-                // Free all our maps since we are done with them.
-                for (auto swapchainIter = swapchainMap.begin(); swapchainIter != swapchainMap.end(); swapchainIter++) {
-                    SwapchainMapStruct *swapchainMapElem = swapchainIter->second;
-                    delete swapchainMapElem;
-                }
-                for (auto imageIter = imageMap.begin(); imageIter != imageMap.end(); imageIter++) {
-                    ImageMapStruct *imageMapElem = imageIter->second;
-                    delete imageMapElem;
-                }
-                for (auto physDeviceIter = physDeviceMap.begin(); physDeviceIter != physDeviceMap.end(); physDeviceIter++) {
-                    PhysDeviceMapStruct *physDeviceMapElem = physDeviceIter->second;
-                    delete physDeviceMapElem;
-                }
-                swapchainMap.clear();
-                imageMap.clear();
-                physDeviceMap.clear();
-                screenShotFrameRange.valid = false;
-            }
         }
     }
-    frameNumber++;
-    loader_platform_thread_unlock_mutex(&globalLock);
+
+    // The submitted captures have taken over the present's wait semaphores, so
+    // the present waits for the capture instead.
+    VkPresentInfoKHR presentInfo;
+    if (captureSemaphore != VK_NULL_HANDLE) {
+        presentInfo = *pPresentInfo;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &captureSemaphore;
+        pPresentInfo = &presentInfo;
+    }
+
     VkLayerDispatchTable *pDisp = dispMap->device_dispatch_table;
     VkResult result = pDisp->QueuePresentKHR(queue, pPresentInfo);
     return result;
@@ -1545,6 +2868,7 @@ static PFN_vkVoidFunction intercept_khr_swapchain_command(const char *name, VkDe
         PFN_vkVoidFunction proc;
     } khr_swapchain_commands[] = {
         {"vkCreateSwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(CreateSwapchainKHR)},
+        {"vkDestroySwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(DestroySwapchainKHR)},
         {"vkGetSwapchainImagesKHR", reinterpret_cast<PFN_vkVoidFunction>(GetSwapchainImagesKHR)},
         {"vkQueuePresentKHR", reinterpret_cast<PFN_vkVoidFunction>(QueuePresentKHR)},
     };
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "screenshot_bands.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace screenshot {
+
+static uint32_t resolveThreadCount(uint32_t threadCount) {
+    if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    return threadCount;
+}
+
+BandPool::BandPool(uint32_t threadCount) : threadCount(resolveThreadCount(threadCount)) {}
+
+BandPool::~BandPool() {
+    // Joining from a static destructor can deadlock while a library is being
+    // unloaded, so threads that were not stopped are left to exit with the
+    // process.
+    for (auto &thread : threads) {
+        if (thread.joinable()) thread.detach();
+    }
+}
+
+void BandPool::setThreadCount(uint32_t count) {
+    count = resolveThreadCount(count);
+    if (count == threadCount) return;
+    stop();
+    threadCount = count;
+}
+
+void BandPool::stop() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    bandsQueued.notify_all();
+    for (auto &thread : threads) {
+        if (thread.joinable()) thread.join();
+    }
+    threads.clear();
+    stopping = false;
+}
+
+uint32_t BandPool::getBandCount(uint32_t rows, uint32_t minRows) const {
+    if (threadCount <= 1) return 1;
+    // A few bands per thread even out bands that take longer than others.
+    uint32_t const bands = std::min(4 * threadCount, rows / std::max(minRows, 1u));
+    return std::max(bands, 1u);
+}
+
+void BandPool::run(uint32_t bandCount, const function<void(uint32_t)> &process) {
+    if (bandCount <= 1 || threadCount <= 1) {
+        for (uint32_t band = 0; band < bandCount; band++) process(band);
+        return;
+    }
+
+    Job job = {&process, bandCount, 0, 0};
+    unique_lock<mutex> lock(mtx);
+    if (threads.empty()) {
+        for (uint32_t i = 1; i < threadCount; i++) threads.push_back(std::thread(&BandPool::worker, this));
+    }
+    jobs.push_back(&job);
+    bandsQueued.notify_all();
+
+    // Work on this job until its bands have all been taken, then wait for the
+    // other threads to finish theirs.  The job is on the stack, so no thread
+    // may use it once it has finished.
+    Job *taken;
+    uint32_t band;
+    while (job.nextBand < job.bandCount && takeBand(taken, band)) {
+        lock.unlock();
+        (*taken->process)(band);
+        lock.lock();
+        finishBand(taken);
+    }
+    bandFinished.wait(lock, [&job] { return job.finishedBands == job.bandCount; });
+}
+
+bool BandPool::takeBand(Job *&job, uint32_t &band) {
+    if (jobs.empty()) return false;
+    job = jobs.front();
+    band = job->nextBand++;
+    if (job->nextBand == job->bandCount) jobs.pop_front();
+    return true;
+}
+
+void BandPool::finishBand(Job *job) {
+    if (++job->finishedBands == job->bandCount) bandFinished.notify_all();
+}
+
+void BandPool::worker() {
+    unique_lock<mutex> lock(mtx);
+    for (;;) {
+        bandsQueued.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) break;
+
+        Job *job;
+        uint32_t band;
+        if (!takeBand(job, band)) continue;
+        lock.unlock();
+        (*job->process)(band);
+        lock.lock();
+        finishBand(job);
+    }
+}
+
+}  // namespace screenshot
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A pool of threads that processes an image in horizontal bands, so that
+// converting and compressing a large capture scales with the number of cores.
+
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace screenshot {
+
+class BandPool {
+   public:
+    // A pool of threadCount threads, including the threads that call run().
+    // With 0, one thread per core is used.
+    explicit BandPool(uint32_t threadCount = 1);
+    ~BandPool();
+
+    // Use threadCount threads from now on, stopping the current ones if the
+    // number changes, in which case it must not be called while run() is.
+    void setThreadCount(uint32_t threadCount);
+    uint32_t getThreadCount() const { return threadCount; }
+
+    // Stop the threads.  They are started again by the next run().
+    void stop();
+
+    // Number of bands to split rows into: enough to balance the load between
+    // the threads, but none smaller than minRows rows.
+    uint32_t getBandCount(uint32_t rows, uint32_t minRows) const;
+
+    // Call process(band) for every band from 0 to bandCount - 1, and return
+    // once they have all been processed.  The calling thread processes bands
+    // too.  Several threads may call run() at once.
+    void run(uint32_t bandCount, const std::function<void(uint32_t band)> &process);
+
+   private:
+    struct Job {
+        const std::function<void(uint32_t)> *process;
+        uint32_t bandCount;
+        uint32_t nextBand;
+        uint32_t finishedBands;
+    };
+
+    // Take the next band of the oldest job that has bands left, and count a
+    // band of a job as processed.  Both are called with mtx held.
+    bool takeBand(Job *&job, uint32_t &band);
+    void finishBand(Job *job);
+    void worker();
+
+    uint32_t threadCount;
+    std::mutex mtx;
+    std::condition_variable bandsQueued;
+    std::condition_variable bandFinished;
+    std::deque<Job *> jobs;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+}  // namespace screenshot
@@ -0,0 +1,636 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "screenshot_convert.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SCREENSHOT_CONVERT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCREENSHOT_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// The x86 kernels are compiled for their instruction set regardless of the
+// flags the layer is built with, and are only called if the CPU supports it.
+#if defined(SCREENSHOT_CONVERT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SCREENSHOT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SCREENSHOT_TARGET(isa)
+#endif
+
+using namespace std;
+
+namespace screenshot {
+
+static inline uint32_t loadU32(const uint8_t *src) {
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static inline uint16_t loadU16(const uint8_t *src) {
+    uint16_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static inline void storeU16BE(uint8_t *dst, uint32_t value) {
+    dst[0] = static_cast<uint8_t>(value >> 8);
+    dst[1] = static_cast<uint8_t>(value);
+}
+
+// Repeat the bits of a 10-bit channel into 16 bits.
+static inline uint32_t expand10To16(uint32_t value) {
+    value &= 0x3ff;
+    return (value << 6) | (value >> 4);
+}
+
+static void convertRowRGBAToRGBScalar(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const int r = swapRB ? 2 : 0;
+    const int b = swapRB ? 0 : 2;
+    for (uint32_t x = 0; x < width; x++) {
+        dst[0] = src[r];
+        dst[1] = src[1];
+        dst[2] = src[b];
+        src += 4;
+        dst += 3;
+    }
+}
+
+static void convertRowRGB10A2ToRGB8Scalar(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const int r = swapRB ? 22 : 2;
+    const int b = swapRB ? 2 : 22;
+    for (uint32_t x = 0; x < width; x++) {
+        const uint32_t pixel = loadU32(src);
+        dst[0] = static_cast<uint8_t>(pixel >> r);
+        dst[1] = static_cast<uint8_t>(pixel >> 12);
+        dst[2] = static_cast<uint8_t>(pixel >> b);
+        src += 4;
+        dst += 3;
+    }
+}
+
+static void convertRowRGB10A2ToRGB16Scalar(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const int r = swapRB ? 20 : 0;
+    const int b = swapRB ? 0 : 20;
+    for (uint32_t x = 0; x < width; x++) {
+        const uint32_t pixel = loadU32(src);
+        storeU16BE(dst, expand10To16(pixel >> r));
+        storeU16BE(dst + 2, expand10To16(pixel >> 10));
+        storeU16BE(dst + 4, expand10To16(pixel >> b));
+        src += 4;
+        dst += 6;
+    }
+}
+
+// The sRGB transfer function makes the half float conversions costly to
+// compute, but each channel only has 32768 non-negative values, so they are
+// looked up in tables indexed by the bits of the channel.  The tables are
+// built at first use.  Negative values and NaNs give 0, and infinity 1.
+static float halfToFloat(uint32_t half) {
+    const int exponent = static_cast<int>(half >> 10) & 0x1f;
+    const float mantissa = static_cast<float>(half & 0x3ff);
+    if (exponent == 0) return ldexpf(mantissa, -24);
+    return ldexpf(mantissa + 1024.0f, exponent - 25);
+}
+
+static float encodeSRGB(float linear) {
+    return linear <= 0.0031308f ? 12.92f * linear : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+// Values up to the knee are unchanged, and higher ones approach 1 with a
+// continuous slope.
+static float toneMap(float value) {
+    const float knee = 0.8f;
+    if (value <= knee) return value;
+    const float t = (value - knee) / (1.0f - knee);
+    return knee + (1.0f - knee) * t / (1.0f + t);
+}
+
+struct HalfTables {
+    HalfTables() {
+        for (uint32_t half = 0; half < 0x8000; half++) {
+            float clamped = 1.0f;
+            float toneMapped = 1.0f;
+            if ((half & 0x7c00) != 0x7c00) {
+                const float value = halfToFloat(half);
+                clamped = value < 1.0f ? value : 1.0f;
+                toneMapped = toneMap(value);
+            } else if (half & 0x3ff) {
+                clamped = toneMapped = 0.0f;  // NaN
+            }
+            to16[half] = static_cast<uint16_t>(encodeSRGB(clamped) * 65535.0f + 0.5f);
+            to8[half] = static_cast<uint8_t>(encodeSRGB(toneMapped) * 255.0f + 0.5f);
+        }
+    }
+    // The vector kernels gather 4 bytes per entry, which may read up to 3
+    // bytes past the last one.
+    uint16_t to16[0x8000 + 1];
+    uint8_t to8[0x8000 + 3];
+};
+
+static const HalfTables &getHalfTables() {
+    static const HalfTables tables;
+    return tables;
+}
+
+// The result of a negative value is masked to 0 rather than tested, as a
+// branch would be mispredicted on noisy images.
+static inline uint32_t lookUpHalf(const uint8_t *table, uint32_t half) { return table[half & 0x7fff] & ((half >> 15) - 1); }
+static inline uint32_t lookUpHalf(const uint16_t *table, uint32_t half) { return table[half & 0x7fff] & ((half >> 15) - 1); }
+
+static void convertRowRGBA16FToRGB8Scalar(const uint8_t *src, uint8_t *dst, uint32_t width, bool) {
+    const uint8_t *table = getHalfTables().to8;
+    for (uint32_t x = 0; x < width; x++) {
+        for (int c = 0; c < 3; c++) dst[c] = static_cast<uint8_t>(lookUpHalf(table, loadU16(src + 2 * c)));
+        src += 8;
+        dst += 3;
+    }
+}
+
+static void convertRowRGBA16FToRGB16Scalar(const uint8_t *src, uint8_t *dst, uint32_t width, bool) {
+    const uint16_t *table = getHalfTables().to16;
+    for (uint32_t x = 0; x < width; x++) {
+        for (int c = 0; c < 3; c++) storeU16BE(dst + 2 * c, lookUpHalf(table, loadU16(src + 2 * c)));
+        src += 8;
+        dst += 6;
+    }
+}
+
+#if defined(SCREENSHOT_CONVERT_X86)
+
+// Gathers the color bytes of 4 pixels into the low 12 bytes of a register.
+static const int8_t shuffleRGB[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1};
+static const int8_t shuffleBGR[16] = {2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1};
+
+// 16 pixels per iteration: four 12-byte results are merged into three
+// 16-byte stores.
+SCREENSHOT_TARGET("ssse3")
+static void convertRowRGBAToRGBSSSE3(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapRB ? shuffleBGR : shuffleRGB));
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)), shuffle);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)), shuffle);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48)), shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+        src += 64;
+        dst += 48;
+    }
+    convertRowRGBAToRGBScalar(src, dst, width - x, swapRB);
+}
+
+// 8 pixels per iteration: each 128-bit lane is compacted to 12 bytes and the
+// lanes are joined with a cross-lane permute.  The 32-byte store writes 8
+// bytes past the 24 valid ones, which the next iteration overwrites, so the
+// loop stops early enough to stay inside the row.
+SCREENSHOT_TARGET("avx2")
+static void convertRowRGBAToRGBAVX2(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapRB ? shuffleBGR : shuffleRGB));
+    const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle128);
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    uint32_t x = 0;
+    for (; x + 11 <= width; x += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permutevar8x32_epi32(v, permute));
+        src += 32;
+        dst += 24;
+    }
+    convertRowRGBAToRGBSSSE3(src, dst, width - x, swapRB);
+}
+
+// Moves the top 8 bits of the channels of 4 RGB10A2 pixels into RGBA8
+// pixels with an alpha of 0, which are then compacted like RGBA8 ones.
+SCREENSHOT_TARGET("ssse3")
+static inline __m128i packRGB10A2ToRGBA8(__m128i pixels) {
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 2), mask);
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 4), _mm_slli_epi32(mask, 8));
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 6), _mm_slli_epi32(mask, 16));
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+SCREENSHOT_TARGET("avx2")
+static inline __m256i packRGB10A2ToRGBA8(__m256i pixels) {
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(pixels, 2), mask);
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 4), _mm256_slli_epi32(mask, 8));
+    const __m256i b = _mm256_and_si256(_mm256_srli_epi32(pixels, 6), _mm256_slli_epi32(mask, 16));
+    return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+SCREENSHOT_TARGET("ssse3")
+static void convertRowRGB10A2ToRGB8SSSE3(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapRB ? shuffleBGR : shuffleRGB));
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+        a = _mm_shuffle_epi8(packRGB10A2ToRGBA8(a), shuffle);
+        b = _mm_shuffle_epi8(packRGB10A2ToRGBA8(b), shuffle);
+        c = _mm_shuffle_epi8(packRGB10A2ToRGBA8(c), shuffle);
+        d = _mm_shuffle_epi8(packRGB10A2ToRGBA8(d), shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+        src += 64;
+        dst += 48;
+    }
+    convertRowRGB10A2ToRGB8Scalar(src, dst, width - x, swapRB);
+}
+
+// Same as convertRowRGBAToRGBAVX2, including the 8 bytes stored past the
+// converted pixels.
+SCREENSHOT_TARGET("avx2")
+static void convertRowRGB10A2ToRGB8AVX2(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapRB ? shuffleBGR : shuffleRGB));
+    const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle128);
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    uint32_t x = 0;
+    for (; x + 11 <= width; x += 8) {
+        __m256i v = packRGB10A2ToRGBA8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+        v = _mm256_shuffle_epi8(v, shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permutevar8x32_epi32(v, permute));
+        src += 32;
+        dst += 24;
+    }
+    convertRowRGB10A2ToRGB8SSSE3(src, dst, width - x, swapRB);
+}
+
+// Turn two pixels of 16-bit little-endian R, G, B and padding into 12 bytes of
+// big-endian RGB or BGR.
+static const int8_t shuffleRGB16[16] = {1, 0, 3, 2, 5, 4, 9, 8, 11, 10, 13, 12, -1, -1, -1, -1};
+static const int8_t shuffleBGR16[16] = {5, 4, 3, 2, 1, 0, 13, 12, 11, 10, 9, 8, -1, -1, -1, -1};
+
+// Expands the channels of RGB10A2 pixels to 16 bits, and interleaves them so
+// that lo holds the first two pixels of each 128-bit lane and hi the last
+// two, each pixel as R, G, B and 0 in 16-bit lanes.
+SCREENSHOT_TARGET("ssse3")
+static inline void expandRGB10A2ToRGB16(__m128i pixels, __m128i &lo, __m128i &hi) {
+    const __m128i mask = _mm_set1_epi32(0x3ff);
+    __m128i r = _mm_and_si128(pixels, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 10), mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 20), mask);
+    r = _mm_or_si128(_mm_slli_epi32(r, 6), _mm_srli_epi32(r, 4));
+    g = _mm_or_si128(_mm_slli_epi32(g, 6), _mm_srli_epi32(g, 4));
+    b = _mm_or_si128(_mm_slli_epi32(b, 6), _mm_srli_epi32(b, 4));
+    const __m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+    lo = _mm_unpacklo_epi32(rg, b);
+    hi = _mm_unpackhi_epi32(rg, b);
+}
+
+SCREENSHOT_TARGET("avx2")
+static inline void expandRGB10A2ToRGB16(__m256i pixels, __m256i &lo, __m256i &hi) {
+    const __m256i mask = _mm256_set1_epi32(0x3ff);
+    __m256i r = _mm256_and_si256(pixels, mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 10), mask);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(pixels, 20), mask);
+    r = _mm256_or_si256(_mm256_slli_epi32(r, 6), _mm256_srli_epi32(r, 4));
+    g = _mm256_or_si256(_mm256_slli_epi32(g, 6), _mm256_srli_epi32(g, 4));
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 6), _mm256_srli_epi32(b, 4));
+    const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+    lo = _mm256_unpacklo_epi32(rg, b);
+    hi = _mm256_unpackhi_epi32(rg, b);
+}
+
+// 8 pixels per iteration, merged into three 16-byte stores as in
+// convertRowRGBAToRGBSSSE3.
+SCREENSHOT_TARGET("ssse3")
+static void convertRowRGB10A2ToRGB16SSSE3(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapRB ? shuffleBGR16 : shuffleRGB16));
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a, b, c, d;
+        expandRGB10A2ToRGB16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), a, b);
+        expandRGB10A2ToRGB16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)), c, d);
+        a = _mm_shuffle_epi8(a, shuffle);
+        b = _mm_shuffle_epi8(b, shuffle);
+        c = _mm_shuffle_epi8(c, shuffle);
+        d = _mm_shuffle_epi8(d, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+        src += 32;
+        dst += 48;
+    }
+    convertRowRGB10A2ToRGB16Scalar(src, dst, width - x, swapRB);
+}
+
+// 8 pixels per iteration.  The 64-bit quarters of the source are reordered
+// so that the unpacks, which work within 128-bit lanes, leave the first four
+// pixels in lo and the last four in hi.  Each is then compacted to 24 bytes
+// like in convertRowRGBAToRGBAVX2, and the second store overwrites the 8
+// bytes that the first one writes past its pixels.  The second one also
+// writes 8 bytes past the pixels, hence the early end of the loop.
+SCREENSHOT_TARGET("avx2")
+static void convertRowRGB10A2ToRGB16AVX2(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(swapRB ? shuffleBGR16 : shuffleRGB16));
+    const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle128);
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    uint32_t x = 0;
+    for (; x + 10 <= width; x += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        __m256i lo, hi;
+        expandRGB10A2ToRGB16(_mm256_permute4x64_epi64(pixels, 0xd8), lo, hi);
+        lo = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(lo, shuffle), permute);
+        hi = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(hi, shuffle), permute);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 24), hi);
+        src += 32;
+        dst += 48;
+    }
+    convertRowRGB10A2ToRGB16SSSE3(src, dst, width - x, swapRB);
+}
+
+// Looks up 8 half float channels, given as 16-bit lanes, in a table of 8-bit
+// or 16-bit entries, and returns them in 32-bit lanes.
+SCREENSHOT_TARGET("avx2")
+static inline __m256i lookUpHalves(const uint8_t *table, __m128i halves) {
+    const __m256i half = _mm256_cvtepu16_epi32(halves);
+    const __m256i index = _mm256_and_si256(half, _mm256_set1_epi32(0x7fff));
+    const __m256i positive = _mm256_cmpgt_epi32(_mm256_set1_epi32(0x8000), half);
+    const __m256i values = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), index, 1);
+    return _mm256_and_si256(values, _mm256_and_si256(positive, _mm256_set1_epi32(0xff)));
+}
+
+SCREENSHOT_TARGET("avx2")
+static inline __m256i lookUpHalves(const uint16_t *table, __m128i halves) {
+    const __m256i half = _mm256_cvtepu16_epi32(halves);
+    const __m256i index = _mm256_and_si256(half, _mm256_set1_epi32(0x7fff));
+    const __m256i positive = _mm256_cmpgt_epi32(_mm256_set1_epi32(0x8000), half);
+    const __m256i values = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), index, 2);
+    return _mm256_and_si256(values, _mm256_and_si256(positive, _mm256_set1_epi32(0xffff)));
+}
+
+// 8 pixels per iteration, alpha included, with a gather per pair of pixels.
+// The packs work within 128-bit lanes, which leaves the pixels in the order
+// 0, 2, 4, 6, 1, 3, 5, 7 until they are permuted back.  They are then
+// compacted and stored like in convertRowRGBAToRGBAVX2.
+SCREENSHOT_TARGET("avx2")
+static void convertRowRGBA16FToRGB8AVX2(const uint8_t *src, uint8_t *dst, uint32_t width, bool) {
+    const uint8_t *table = getHalfTables().to8;
+    const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffleRGB)));
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    uint32_t x = 0;
+    for (; x + 11 <= width; x += 8) {
+        const __m256i a = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+        const __m256i b = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)));
+        const __m256i c = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)));
+        const __m256i d = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48)));
+        __m256i v = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+        v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, order), shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permutevar8x32_epi32(v, permute));
+        src += 64;
+        dst += 24;
+    }
+    convertRowRGBA16FToRGB8Scalar(src, dst, width - x, false);
+}
+
+// 8 pixels per iteration.  After the pack, the 64-bit quarters hold the
+// pixels 0, 2, 1 and 3, which are reordered to the layout that
+// convertRowRGB10A2ToRGB16AVX2 compacts and stores.
+SCREENSHOT_TARGET("avx2")
+static void convertRowRGBA16FToRGB16AVX2(const uint8_t *src, uint8_t *dst, uint32_t width, bool) {
+    const uint16_t *table = getHalfTables().to16;
+    const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffleRGB16)));
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    uint32_t x = 0;
+    for (; x + 10 <= width; x += 8) {
+        const __m256i a = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+        const __m256i b = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)));
+        const __m256i c = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)));
+        const __m256i d = lookUpHalves(table, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48)));
+        __m256i lo = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+        __m256i hi = _mm256_permute4x64_epi64(_mm256_packus_epi32(c, d), 0xd8);
+        lo = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(lo, shuffle), permute);
+        hi = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(hi, shuffle), permute);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 24), hi);
+        src += 64;
+        dst += 48;
+    }
+    convertRowRGBA16FToRGB16Scalar(src, dst, width - x, false);
+}
+
+static bool cpuSupports(const char *isa) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (strcmp(isa, "ssse3") == 0) return __builtin_cpu_supports("ssse3");
+    if (strcmp(isa, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    return false;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    if (strcmp(isa, "ssse3") == 0) return (info[2] & (1 << 9)) != 0;
+    if (strcmp(isa, "avx2") == 0) {
+        // AVX2 also needs the OS to save the YMM registers.
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (maxLeaf < 7 || !osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+    return false;
+#else
+    return false;
+#endif
+}
+
+#elif defined(SCREENSHOT_CONVERT_NEON)
+
+// 16 pixels per iteration using structured loads and stores.
+static void convertRowRGBAToRGBNEON(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t rgba = vld4q_u8(src);
+        uint8x16x3_t rgb;
+        rgb.val[0] = swapRB ? rgba.val[2] : rgba.val[0];
+        rgb.val[1] = rgba.val[1];
+        rgb.val[2] = swapRB ? rgba.val[0] : rgba.val[2];
+        vst3q_u8(dst, rgb);
+        src += 64;
+        dst += 48;
+    }
+    convertRowRGBAToRGBScalar(src, dst, width - x, swapRB);
+}
+
+// The channel at bit shift of 16 RGB10A2 pixels, keeping its top 8 bits.
+static inline uint8x16_t channelRGB10A2ToU8(const uint32x4_t pixels[4], int shift) {
+    const int32x4_t count = vdupq_n_s32(-shift - 2);
+    const uint16x8_t lo = vcombine_u16(vmovn_u32(vshlq_u32(pixels[0], count)), vmovn_u32(vshlq_u32(pixels[1], count)));
+    const uint16x8_t hi = vcombine_u16(vmovn_u32(vshlq_u32(pixels[2], count)), vmovn_u32(vshlq_u32(pixels[3], count)));
+    return vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+}
+
+// The channel at bit shift of 8 RGB10A2 pixels, expanded to 16 bits and
+// byte swapped to big-endian.
+static inline uint16x8_t channelRGB10A2ToU16BE(const uint32x4_t pixels[2], int shift) {
+    const int32x4_t count = vdupq_n_s32(-shift);
+    uint16x8_t v = vcombine_u16(vmovn_u32(vshlq_u32(pixels[0], count)), vmovn_u32(vshlq_u32(pixels[1], count)));
+    v = vandq_u16(v, vdupq_n_u16(0x3ff));
+    v = vorrq_u16(vshlq_n_u16(v, 6), vshrq_n_u16(v, 4));
+    return vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+}
+
+static void convertRowRGB10A2ToRGB8NEON(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint32x4_t pixels[4];
+        for (int i = 0; i < 4; i++) pixels[i] = vreinterpretq_u32_u8(vld1q_u8(src + 16 * i));
+        uint8x16x3_t rgb;
+        rgb.val[0] = channelRGB10A2ToU8(pixels, swapRB ? 20 : 0);
+        rgb.val[1] = channelRGB10A2ToU8(pixels, 10);
+        rgb.val[2] = channelRGB10A2ToU8(pixels, swapRB ? 0 : 20);
+        vst3q_u8(dst, rgb);
+        src += 64;
+        dst += 48;
+    }
+    convertRowRGB10A2ToRGB8Scalar(src, dst, width - x, swapRB);
+}
+
+static void convertRowRGB10A2ToRGB16NEON(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint32x4_t pixels[2];
+        for (int i = 0; i < 2; i++) pixels[i] = vreinterpretq_u32_u8(vld1q_u8(src + 16 * i));
+        uint16x8x3_t rgb;
+        rgb.val[0] = channelRGB10A2ToU16BE(pixels, swapRB ? 20 : 0);
+        rgb.val[1] = channelRGB10A2ToU16BE(pixels, 10);
+        rgb.val[2] = channelRGB10A2ToU16BE(pixels, swapRB ? 0 : 20);
+        vst3q_u16(reinterpret_cast<uint16_t *>(dst), rgb);
+        src += 32;
+        dst += 48;
+    }
+    convertRowRGB10A2ToRGB16Scalar(src, dst, width - x, swapRB);
+}
+
+#endif
+
+uint32_t getRowConversionSourceSize(RowConversion conversion) {
+    return conversion == ROW_CONVERSION_RGBA16F_TO_RGB8 || conversion == ROW_CONVERSION_RGBA16F_TO_RGB16 ? 8 : 4;
+}
+
+uint32_t getRowConversionDestSize(RowConversion conversion) {
+    return conversion == ROW_CONVERSION_RGB10A2_TO_RGB16 || conversion == ROW_CONVERSION_RGBA16F_TO_RGB16 ? 6 : 3;
+}
+
+vector<RowConverter> getRowConverters(RowConversion conversion) {
+    vector<RowConverter> converters;
+    switch (conversion) {
+        case ROW_CONVERSION_RGBA8_TO_RGB8:
+            converters.push_back({"scalar", convertRowRGBAToRGBScalar});
+#if defined(SCREENSHOT_CONVERT_X86)
+            if (cpuSupports("ssse3")) converters.push_back({"ssse3", convertRowRGBAToRGBSSSE3});
+            if (cpuSupports("ssse3") && cpuSupports("avx2")) converters.push_back({"avx2", convertRowRGBAToRGBAVX2});
+#elif defined(SCREENSHOT_CONVERT_NEON)
+            converters.push_back({"neon", convertRowRGBAToRGBNEON});
+#endif
+            break;
+        case ROW_CONVERSION_RGB10A2_TO_RGB8:
+            converters.push_back({"scalar", convertRowRGB10A2ToRGB8Scalar});
+#if defined(SCREENSHOT_CONVERT_X86)
+            if (cpuSupports("ssse3")) converters.push_back({"ssse3", convertRowRGB10A2ToRGB8SSSE3});
+            if (cpuSupports("ssse3") && cpuSupports("avx2")) converters.push_back({"avx2", convertRowRGB10A2ToRGB8AVX2});
+#elif defined(SCREENSHOT_CONVERT_NEON)
+            converters.push_back({"neon", convertRowRGB10A2ToRGB8NEON});
+#endif
+            break;
+        case ROW_CONVERSION_RGB10A2_TO_RGB16:
+            converters.push_back({"scalar", convertRowRGB10A2ToRGB16Scalar});
+#if defined(SCREENSHOT_CONVERT_X86)
+            if (cpuSupports("ssse3")) converters.push_back({"ssse3", convertRowRGB10A2ToRGB16SSSE3});
+            if (cpuSupports("ssse3") && cpuSupports("avx2")) converters.push_back({"avx2", convertRowRGB10A2ToRGB16AVX2});
+#elif defined(SCREENSHOT_CONVERT_NEON)
+            converters.push_back({"neon", convertRowRGB10A2ToRGB16NEON});
+#endif
+            break;
+        case ROW_CONVERSION_RGBA16F_TO_RGB8:
+            converters.push_back({"table", convertRowRGBA16FToRGB8Scalar});
+#if defined(SCREENSHOT_CONVERT_X86)
+            if (cpuSupports("avx2")) converters.push_back({"avx2", convertRowRGBA16FToRGB8AVX2});
+#endif
+            break;
+        case ROW_CONVERSION_RGBA16F_TO_RGB16:
+            converters.push_back({"table", convertRowRGBA16FToRGB16Scalar});
+#if defined(SCREENSHOT_CONVERT_X86)
+            if (cpuSupports("avx2")) converters.push_back({"avx2", convertRowRGBA16FToRGB16AVX2});
+#endif
+            break;
+        default:
+            break;
+    }
+    return converters;
+}
+
+void convertRow(RowConversion conversion, const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    // The fastest implementation of each conversion, chosen once.
+    struct Fastest {
+        Fastest() {
+            for (int i = 0; i < ROW_CONVERSION_COUNT; i++) {
+                convert[i] = getRowConverters(static_cast<RowConversion>(i)).back().convert;
+            }
+        }
+        PFN_convertRow convert[ROW_CONVERSION_COUNT];
+    };
+    static const Fastest fastest;
+    fastest.convert[conversion](src, dst, width, swapRB);
+}
+
+void convertRowRGBAToRGB(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    convertRow(ROW_CONVERSION_RGBA8_TO_RGB8, src, dst, width, swapRB);
+}
+
+void convertRowRGBToRGB(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB) {
+    if (!swapRB) {
+        memcpy(dst, src, 3 * static_cast<size_t>(width));
+        return;
+    }
+    for (uint32_t x = 0; x < width; x++) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        src += 3;
+        dst += 3;
+    }
+}
+
+void convertRowRGBToYUV444(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, uint32_t width) {
+    // 8-bit fixed point.  The chroma sums are biased by 128 << 8 so that they
+    // stay positive before the shift.
+    for (uint32_t x = 0; x < width; x++) {
+        int const r = src[0], g = src[1], b = src[2];
+        y[x] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[x] = static_cast<uint8_t>((-38 * r - 74 * g + 112 * b + (128 << 8) + 128) >> 8);
+        v[x] = static_cast<uint8_t>((112 * r - 94 * g - 18 * b + (128 << 8) + 128) >> 8);
+        src += 3;
+    }
+}
+
+}  // namespace screenshot
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Pixel conversion of captured images into the layout written to image files.
+// Nothing in here depends on Vulkan, so it can be tested and benchmarked on
+// synthetic buffers.
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace screenshot {
+
+// The conversions of a row of captured pixels into tightly packed RGB pixels,
+// dropping alpha.  16-bit channels are written big-endian, as PPM and PNG
+// files store them.
+enum RowConversion {
+    // 4 bytes per pixel, such as R8G8B8A8_UNORM.
+    ROW_CONVERSION_RGBA8_TO_RGB8,
+    // A2B10G10R10_UNORM_PACK32, keeping the top 8 bits of each channel.
+    ROW_CONVERSION_RGB10A2_TO_RGB8,
+    // A2B10G10R10_UNORM_PACK32, with the 10 bits of each channel repeated
+    // into 16, so that 1023 becomes 65535.
+    ROW_CONVERSION_RGB10A2_TO_RGB16,
+    // R16G16B16A16_SFLOAT holding linear values, tone mapped and encoded with
+    // the sRGB transfer function.  Values up to 0.8 are unchanged, and higher
+    // ones are compressed into the rest of the range.
+    ROW_CONVERSION_RGBA16F_TO_RGB8,
+    // R16G16B16A16_SFLOAT holding linear values, clamped to [0, 1] and encoded
+    // with the sRGB transfer function.
+    ROW_CONVERSION_RGBA16F_TO_RGB16,
+    ROW_CONVERSION_COUNT
+};
+
+// Bytes per pixel read and written by a conversion.
+uint32_t getRowConversionSourceSize(RowConversion conversion);
+uint32_t getRowConversionDestSize(RowConversion conversion);
+
+// Converts a row of width pixels.  If swapRB is set, the first and third
+// channels are exchanged, which turns BGRA into RGB.  It has no effect on the
+// half float conversions.
+typedef void (*PFN_convertRow)(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB);
+
+typedef struct {
+    const char *name;
+    PFN_convertRow convert;
+} RowConverter;
+
+// Convert a row with the fastest implementation of the conversion that the
+// CPU supports.
+void convertRow(RowConversion conversion, const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB);
+
+// Convert a row of 4-byte pixels with the fastest implementation the CPU
+// supports.
+void convertRowRGBAToRGB(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB);
+
+// Copy a row of 3-byte pixels, exchanging the first and third bytes if swapRB
+// is set.
+void convertRowRGBToRGB(const uint8_t *src, uint8_t *dst, uint32_t width, bool swapRB);
+
+// Convert a row of 3-byte RGB pixels to separate rows of Y, Cb and Cr, with
+// the BT.601 limited-range coefficients that Y4M readers assume.
+void convertRowRGBToYUV444(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, uint32_t width);
+
+// All implementations of a conversion that the CPU supports.  The first one
+// is the scalar implementation, which is the reference for the others.
+std::vector<RowConverter> getRowConverters(RowConversion conversion = ROW_CONVERSION_RGBA8_TO_RGB8);
+
+}  // namespace screenshot
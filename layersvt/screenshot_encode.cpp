@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "screenshot_encode.h"
+
+#include <string.h>
+
+#ifdef SCREENSHOT_USE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+namespace screenshot {
+
+const char *getImageFileExtension(ImageFileFormat format) {
+    switch (format) {
+        case IMAGE_FILE_FORMAT_PNG:
+            return ".png";
+        case IMAGE_FILE_FORMAT_QOI:
+            return ".qoi";
+        default:
+            return ".ppm";
+    }
+}
+
+static void appendU32BE(vector<uint8_t> &out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+//=================================== PNG ===================================//
+
+#ifdef SCREENSHOT_USE_ZLIB
+
+static uint32_t updateCRC32(uint32_t crc, const uint8_t *data, size_t size) {
+    return static_cast<uint32_t>(crc32(crc, data, static_cast<uInt>(size)));
+}
+
+#else
+
+static uint32_t updateCRC32(uint32_t crc, const uint8_t *data, size_t size) {
+    // Initialized once, even when several images are encoded at once.
+    struct Table {
+        Table() {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+        uint32_t entries[256];
+    };
+    static const Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t updateAdler32(uint32_t adler, const uint8_t *data, size_t size) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // The sums cannot overflow within this many bytes.
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        while (block-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// The Adler-32 of two pieces of data from their own, as zlib's
+// adler32_combine() computes it.
+static uint32_t combineAdler32(uint32_t adler1, uint32_t adler2, size_t size2) {
+    const uint32_t base = 65521;
+    const uint32_t rem = static_cast<uint32_t>(size2 % base);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum1) % base);
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= (base << 1)) sum2 -= (base << 1);
+    if (sum2 >= base) sum2 -= base;
+    return sum1 | (sum2 << 16);
+}
+
+#endif
+
+static void appendChunk(vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size) {
+    appendU32BE(out, static_cast<uint32_t>(size));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    appendU32BE(out, updateCRC32(0, &out[start], out.size() - start));
+}
+
+// Append data as stored deflate blocks, the last of which ends the stream if
+// last is set.
+static void appendStoredBlocks(const uint8_t *data, size_t size, bool last, vector<uint8_t> &out) {
+    size_t offset = 0;
+    do {
+        const size_t block = size - offset < 65535 ? size - offset : 65535;
+        const bool final = last && offset + block == size;
+        out.push_back(final ? 1 : 0);
+        out.push_back(static_cast<uint8_t>(block));
+        out.push_back(static_cast<uint8_t>(block >> 8));
+        out.push_back(static_cast<uint8_t>(~block));
+        out.push_back(static_cast<uint8_t>(~block >> 8));
+        out.insert(out.end(), data + offset, data + offset + block);
+        offset += block;
+    } while (offset < size);
+}
+
+// Compress a band of filtered rows into raw deflate blocks.  Each band is
+// compressed on its own and ends on a byte boundary, so the blocks of all the
+// bands can be joined into one stream; only the last band ends the stream.
+// Without zlib, the data is stored.
+static void compressBand(const vector<uint8_t> &filtered, int level, bool last, vector<uint8_t> &compressed) {
+#ifdef SCREENSHOT_USE_ZLIB
+    if (level > 0) {
+        z_stream stream = {};
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+            // A sync flush adds an empty stored block to the bound.
+            compressed.resize(deflateBound(&stream, static_cast<uLong>(filtered.size())) + 16);
+            stream.next_in = const_cast<Bytef *>(filtered.data());
+            stream.avail_in = static_cast<uInt>(filtered.size());
+            stream.next_out = compressed.data();
+            stream.avail_out = static_cast<uInt>(compressed.size());
+            const int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+            const bool done = last ? result == Z_STREAM_END : result == Z_OK && stream.avail_in == 0 && stream.avail_out > 0;
+            compressed.resize(stream.total_out);
+            deflateEnd(&stream);
+            if (done) return;
+        }
+        compressed.clear();
+    }
+#endif
+    (void)level;
+    appendStoredBlocks(filtered.data(), filtered.size(), last, compressed);
+}
+
+static uint32_t getAdler32(const vector<uint8_t> &data) {
+#ifdef SCREENSHOT_USE_ZLIB
+    return static_cast<uint32_t>(adler32(1, data.data(), static_cast<uInt>(data.size())));
+#else
+    return updateAdler32(1, data.data(), data.size());
+#endif
+}
+
+void encodePNG(const uint8_t *rgb, uint32_t width, uint32_t height, uint32_t bitDepth, int level, vector<uint8_t> &out,
+               BandPool *pool) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.insert(out.end(), signature, signature + sizeof(signature));
+
+    // RGB, default compression and filtering, not interlaced.
+    vector<uint8_t> header;
+    appendU32BE(header, width);
+    appendU32BE(header, height);
+    const uint8_t format[5] = {static_cast<uint8_t>(bitDepth), 2, 0, 0, 0};
+    header.insert(header.end(), format, format + sizeof(format));
+    appendChunk(out, "IHDR", header.data(), header.size());
+
+    // The rows are filtered and compressed in bands, possibly in parallel.
+    // Each row is stored as the difference with the row above (filter type
+    // Up), which is cheap and compresses rendered frames well.  The row above
+    // the first row of a band is read from the image, so bands do not depend
+    // on each other.  Without compression, filtering would only cost time.
+    // Filters work on bytes, so 16-bit rows are filtered the same way.
+    const size_t stride = 3 * static_cast<size_t>(width) * (bitDepth / 8);
+    const bool filter = level > 0;
+    const uint32_t bandCount = pool ? pool->getBandCount(height, 64) : 1;
+    vector<vector<uint8_t>> compressed(bandCount);
+    vector<uint32_t> adlers(bandCount);
+    vector<size_t> sizes(bandCount);
+    auto processBand = [&](uint32_t band) {
+        const uint32_t firstRow = static_cast<uint32_t>(static_cast<uint64_t>(height) * band / bandCount);
+        const uint32_t endRow = static_cast<uint32_t>(static_cast<uint64_t>(height) * (band + 1) / bandCount);
+        vector<uint8_t> filtered((stride + 1) * (endRow - firstRow));
+        uint8_t *dst = filtered.data();
+        for (uint32_t y = firstRow; y < endRow; y++) {
+            const uint8_t *row = rgb + y * stride;
+            if (filter && y > 0) {
+                const uint8_t *above = row - stride;
+                *dst++ = 2;
+                for (size_t i = 0; i < stride; i++) dst[i] = static_cast<uint8_t>(row[i] - above[i]);
+            } else {
+                *dst++ = 0;
+                memcpy(dst, row, stride);
+            }
+            dst += stride;
+        }
+        adlers[band] = getAdler32(filtered);
+        sizes[band] = filtered.size();
+        compressBand(filtered, level, band + 1 == bandCount, compressed[band]);
+    };
+    if (pool)
+        pool->run(bandCount, processBand);
+    else
+        processBand(0);
+
+    // Join the bands into a zlib stream.  The header only records the level
+    // as a hint to decoders.
+    vector<uint8_t> stream;
+    size_t streamSize = 6;
+    for (const auto &band : compressed) streamSize += band.size();
+    stream.reserve(streamSize);
+    stream.push_back(0x78);
+    stream.push_back(level <= 1 ? 0x01 : level <= 5 ? 0x5e : level == 6 ? 0x9c : 0xda);
+    uint32_t adler = 1;
+    for (uint32_t band = 0; band < bandCount; band++) {
+        stream.insert(stream.end(), compressed[band].begin(), compressed[band].end());
+        vector<uint8_t>().swap(compressed[band]);
+#ifdef SCREENSHOT_USE_ZLIB
+        adler = static_cast<uint32_t>(adler32_combine(adler, adlers[band], static_cast<z_off_t>(sizes[band])));
+#else
+        adler = combineAdler32(adler, adlers[band], sizes[band]);
+#endif
+    }
+    appendU32BE(stream, adler);
+
+    appendChunk(out, "IDAT", stream.data(), stream.size());
+    appendChunk(out, "IEND", nullptr, 0);
+}
+
+//=================================== QOI ===================================//
+
+// See https://qoiformat.org/qoi-specification.pdf.  The pixels are opaque, so
+// the encoder never needs to emit QOI_OP_RGBA.
+static const uint8_t QOI_OP_INDEX = 0x00;
+static const uint8_t QOI_OP_DIFF = 0x40;
+static const uint8_t QOI_OP_LUMA = 0x80;
+static const uint8_t QOI_OP_RUN = 0xc0;
+static const uint8_t QOI_OP_RGB = 0xfe;
+
+static inline int hashQOI(const uint8_t *px) { return (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64; }
+
+// The encoder state at a pixel: the index of recently seen pixels and the
+// length of the run in progress.  The previous pixel is read from the image.
+struct QOIState {
+    uint8_t index[64][3];
+    // The index starts with transparent black, which never matches an
+    // opaque pixel, so index entries that were never written are skipped.
+    bool indexValid[64];
+    uint32_t run;
+};
+
+// A pixel continues a run when it equals the one before it, the first pixel
+// being compared with opaque black.  Other pixels are written to the index.
+static inline bool continuesRun(const uint8_t *rgb, size_t i) {
+    static const uint8_t black[3] = {0, 0, 0};
+    return memcmp(rgb + 3 * i, i > 0 ? rgb + 3 * (i - 1) : black, 3) == 0;
+}
+
+// Summarize how the pixels from begin to end change the encoder state, so
+// that the state at the start of each band can be found without encoding the
+// bands before it.
+struct QOIBandSummary {
+    QOIState written;
+    // Number of pixels at the end of the band that continue a run, and
+    // whether every pixel of the band does.
+    size_t trailingRun;
+    bool allRun;
+};
+
+static void summarizeQOIBand(const uint8_t *rgb, size_t begin, size_t end, QOIBandSummary &summary) {
+    memset(&summary, 0, sizeof(summary));
+    summary.allRun = true;
+    for (size_t i = begin; i < end; i++) {
+        if (continuesRun(rgb, i)) {
+            summary.trailingRun++;
+            continue;
+        }
+        const uint8_t *px = rgb + 3 * i;
+        const int hash = hashQOI(px);
+        memcpy(summary.written.index[hash], px, 3);
+        summary.written.indexValid[hash] = true;
+        summary.trailingRun = 0;
+        summary.allRun = false;
+    }
+}
+
+// Encode the pixels from begin to end, starting from state.  A run that is
+// still in progress at the end of the band is left for the next band.
+static void encodeQOIBand(const uint8_t *rgb, size_t begin, size_t end, size_t count, QOIState &state, vector<uint8_t> &out) {
+    for (size_t i = begin; i < end; i++) {
+        const uint8_t *px = rgb + 3 * i;
+        if (continuesRun(rgb, i)) {
+            state.run++;
+            if (state.run == 62 || i + 1 == count) {
+                out.push_back(static_cast<uint8_t>(QOI_OP_RUN | (state.run - 1)));
+                state.run = 0;
+            }
+            continue;
+        }
+        if (state.run > 0) {
+            out.push_back(static_cast<uint8_t>(QOI_OP_RUN | (state.run - 1)));
+            state.run = 0;
+        }
+
+        const int hash = hashQOI(px);
+        if (state.indexValid[hash] && memcmp(state.index[hash], px, 3) == 0) {
+            out.push_back(static_cast<uint8_t>(QOI_OP_INDEX | hash));
+        } else {
+            memcpy(state.index[hash], px, 3);
+            state.indexValid[hash] = true;
+
+            static const uint8_t black[3] = {0, 0, 0};
+            const uint8_t *prev = i > 0 ? px - 3 : black;
+            const int vr = static_cast<int8_t>(px[0] - prev[0]);
+            const int vg = static_cast<int8_t>(px[1] - prev[1]);
+            const int vb = static_cast<int8_t>(px[2] - prev[2]);
+            const int vgr = vr - vg;
+            const int vgb = vb - vg;
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                out.push_back(static_cast<uint8_t>(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+            } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                out.push_back(static_cast<uint8_t>(QOI_OP_LUMA | (vg + 32)));
+                out.push_back(static_cast<uint8_t>((vgr + 8) << 4 | (vgb + 8)));
+            } else {
+                out.push_back(QOI_OP_RGB);
+                out.insert(out.end(), px, px + 3);
+            }
+        }
+    }
+}
+
+void encodeQOI(const uint8_t *rgb, uint32_t width, uint32_t height, vector<uint8_t> &out, BandPool *pool) {
+    const uint8_t magic[4] = {'q', 'o', 'i', 'f'};
+    out.insert(out.end(), magic, magic + sizeof(magic));
+    appendU32BE(out, width);
+    appendU32BE(out, height);
+    out.push_back(3);  // RGB
+    out.push_back(0);  // sRGB with linear alpha
+
+    // The bands are encoded in parallel, then joined.  The output is the same
+    // as encoding the whole image at once: a first pass finds the pixels that
+    // each band writes to the index and the run it ends with, from which the
+    // state at the start of every band follows.
+    const size_t count = static_cast<size_t>(width) * height;
+    const uint32_t bandCount = pool ? pool->getBandCount(height, 16) : 1;
+    auto bandBegin = [&](uint32_t band) { return count * band / bandCount; };
+
+    vector<QOIBandSummary> summaries(bandCount);
+    if (bandCount > 1) {
+        pool->run(bandCount - 1,
+                  [&](uint32_t band) { summarizeQOIBand(rgb, bandBegin(band), bandBegin(band + 1), summaries[band]); });
+    }
+
+    vector<QOIState> states(bandCount, QOIState());
+    size_t run = 0;
+    for (uint32_t band = 1; band < bandCount; band++) {
+        const QOIBandSummary &summary = summaries[band - 1];
+        states[band] = states[band - 1];
+        for (int hash = 0; hash < 64; hash++) {
+            if (summary.written.indexValid[hash]) {
+                memcpy(states[band].index[hash], summary.written.index[hash], 3);
+                states[band].indexValid[hash] = true;
+            }
+        }
+        // Runs are written every 62 pixels.
+        run = summary.allRun ? run + summary.trailingRun : summary.trailingRun;
+        states[band].run = static_cast<uint32_t>(run % 62);
+    }
+
+    vector<vector<uint8_t>> encoded(bandCount);
+    auto processBand = [&](uint32_t band) {
+        encoded[band].reserve(4 * (bandBegin(band + 1) - bandBegin(band)));
+        encodeQOIBand(rgb, bandBegin(band), bandBegin(band + 1), count, states[band], encoded[band]);
+    };
+    if (pool)
+        pool->run(bandCount, processBand);
+    else
+        processBand(0);
+
+    size_t size = out.size() + 8;
+    for (const auto &band : encoded) size += band.size();
+    out.reserve(size);
+    for (const auto &band : encoded) out.insert(out.end(), band.begin(), band.end());
+
+    const uint8_t padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    out.insert(out.end(), padding, padding + sizeof(padding));
+}
+
+}  // namespace screenshot
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encoders for the compressed image files the screenshot layer can write.
+// They take tightly packed RGB pixels, as produced by screenshot_convert.h.
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "screenshot_bands.h"
+
+namespace screenshot {
+
+enum ImageFileFormat { IMAGE_FILE_FORMAT_PPM, IMAGE_FILE_FORMAT_PNG, IMAGE_FILE_FORMAT_QOI };
+
+// File name extension, including the dot.
+const char *getImageFileExtension(ImageFileFormat format);
+
+// Append a PNG file to out.  bitDepth is 8, or 16 for rows of big-endian
+// 16-bit channels.  level is the zlib compression level, 0 (none) to 9
+// (smallest).  Without zlib, the image data is stored uncompressed.  With a
+// pool, bands of rows are compressed in parallel, each on its own, which
+// makes the file slightly larger.
+void encodePNG(const uint8_t *rgb, uint32_t width, uint32_t height, uint32_t bitDepth, int level, std::vector<uint8_t> &out,
+               BandPool *pool = nullptr);
+
+// Append a QOI file to out.  With a pool, bands of rows are encoded in
+// parallel; the file is the same either way.
+void encodeQOI(const uint8_t *rgb, uint32_t width, uint32_t height, std::vector<uint8_t> &out, BandPool *pool = nullptr);
+
+}  // namespace screenshot
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "screenshot_hash.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+namespace screenshot {
+
+//================================= xxHash64 ================================//
+
+static const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t prime3 = 0x165667B19E3779F9ULL;
+static const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// The hash is defined on little-endian words, whatever the host byte order.
+static inline uint64_t readU64LE(const uint8_t *p) {
+    return static_cast<uint64_t>(p[0]) | static_cast<uint64_t>(p[1]) << 8 | static_cast<uint64_t>(p[2]) << 16 |
+           static_cast<uint64_t>(p[3]) << 24 | static_cast<uint64_t>(p[4]) << 32 | static_cast<uint64_t>(p[5]) << 40 |
+           static_cast<uint64_t>(p[6]) << 48 | static_cast<uint64_t>(p[7]) << 56;
+}
+
+static inline uint32_t readU32LE(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    acc = rotl(acc, 31);
+    return acc * prime1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= xxhRound(0, value);
+    return acc * prime1 + prime4;
+}
+
+// Consume whole 32-byte stripes and return the number of bytes consumed.
+static size_t consumeStripes(uint64_t acc[4], const uint8_t *p, size_t size) {
+    const uint8_t *const start = p;
+    for (; size >= 32; size -= 32, p += 32) {
+        acc[0] = xxhRound(acc[0], readU64LE(p));
+        acc[1] = xxhRound(acc[1], readU64LE(p + 8));
+        acc[2] = xxhRound(acc[2], readU64LE(p + 16));
+        acc[3] = xxhRound(acc[3], readU64LE(p + 24));
+    }
+    return p - start;
+}
+
+XXHash64::XXHash64(uint64_t seed) : buffer(), bufferSize(0), totalSize(0), seed(seed) {
+    acc[0] = seed + prime1 + prime2;
+    acc[1] = seed + prime2;
+    acc[2] = seed;
+    acc[3] = seed - prime1;
+}
+
+void XXHash64::update(const void *data, size_t size) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    totalSize += size;
+
+    if (bufferSize > 0) {
+        size_t const fill = min(size, sizeof(buffer) - bufferSize);
+        memcpy(buffer + bufferSize, p, fill);
+        bufferSize += fill;
+        p += fill;
+        size -= fill;
+        if (bufferSize < sizeof(buffer)) return;
+        consumeStripes(acc, buffer, sizeof(buffer));
+        bufferSize = 0;
+    }
+
+    size_t const consumed = consumeStripes(acc, p, size);
+    memcpy(buffer, p + consumed, size - consumed);
+    bufferSize = size - consumed;
+}
+
+uint64_t XXHash64::digest() const {
+    uint64_t h;
+    if (totalSize >= 32) {
+        h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (int i = 0; i < 4; i++) h = mergeRound(h, acc[i]);
+    } else {
+        h = seed + prime5;
+    }
+    h += totalSize;
+
+    const uint8_t *p = buffer;
+    size_t size = bufferSize;
+    for (; size >= 8; size -= 8, p += 8) {
+        h ^= xxhRound(0, readU64LE(p));
+        h = rotl(h, 27) * prime1 + prime4;
+    }
+    if (size >= 4) {
+        h ^= static_cast<uint64_t>(readU32LE(p)) * prime1;
+        h = rotl(h, 23) * prime2 + prime3;
+        size -= 4;
+        p += 4;
+    }
+    for (; size > 0; size--, p++) {
+        h ^= *p * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxHash64(const void *data, size_t size, uint64_t seed) {
+    XXHash64 hasher(seed);
+    hasher.update(data, size);
+    return hasher.digest();
+}
+
+//================================ Frame hash ===============================//
+
+FrameHasher::FrameHasher(uint32_t width, uint32_t height, uint32_t tilesPerSide)
+    : rowSize(3 * static_cast<size_t>(width)),
+      height(height),
+      tilesPerSide(tilesPerSide),
+      row(0),
+      tiles(static_cast<size_t>(tilesPerSide) * tilesPerSide),
+      columns(tilesPerSide + 1) {
+    for (uint32_t i = 1; i <= tilesPerSide; i++) columns[i] = 3 * (static_cast<size_t>(width) * i / tilesPerSide);
+}
+
+void FrameHasher::addRow(const uint8_t *rgb) {
+    frame.update(rgb, rowSize);
+
+    // Each row is split between the tiles of its row of tiles.
+    if (tilesPerSide > 0) {
+        XXHash64 *tileRow = &tiles[static_cast<size_t>(row) * tilesPerSide / height * tilesPerSide];
+        for (uint32_t i = 0; i < tilesPerSide; i++) tileRow[i].update(rgb + columns[i], columns[i + 1] - columns[i]);
+    }
+    row++;
+}
+
+void FrameHasher::digest(FrameHash &out) const {
+    out.hash = frame.digest();
+    out.tiles.clear();
+    out.tiles.reserve(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++) out.tiles.push_back(tiles[i].digest());
+}
+
+void hashImageRGB(const uint8_t *rgb, uint32_t width, uint32_t height, uint32_t tilesPerSide, FrameHash &out) {
+    size_t const rowSize = 3 * static_cast<size_t>(width);
+    FrameHasher hasher(width, height, tilesPerSide);
+    for (uint32_t y = 0; y < height; y++) hasher.addRow(rgb + rowSize * y);
+    hasher.digest(out);
+}
+
+string formatFrameHash(int frameNumber, const FrameHash &hash) {
+    char text[24];
+    string line = to_string(frameNumber);
+    snprintf(text, sizeof(text), ",%016" PRIx64, hash.hash);
+    line += text;
+    for (size_t i = 0; i < hash.tiles.size(); i++) {
+        snprintf(text, sizeof(text), ",%016" PRIx64, hash.tiles[i]);
+        line += text;
+    }
+    return line;
+}
+
+bool parseFrameHash(const char *line, int &frameNumber, FrameHash &hash) {
+    char *end;
+    long frame = strtol(line, &end, 10);
+    if (end == line || *end != ',' || frame < 0) return false;
+    frameNumber = static_cast<int>(frame);
+
+    const char *p = end + 1;
+    hash.hash = strtoull(p, &end, 16);
+    if (end == p) return false;
+    hash.tiles.clear();
+    while (*end == ',') {
+        p = end + 1;
+        uint64_t tile = strtoull(p, &end, 16);
+        if (end == p) return false;
+        hash.tiles.push_back(tile);
+    }
+    return *end == '\0' || *end == '\r' || *end == '\n';
+}
+
+uint32_t countChangedTiles(const FrameHash &a, const FrameHash &b) {
+    if (a.tiles.empty() || a.tiles.size() != b.tiles.size()) return a.hash != b.hash ? 1 : 0;
+    uint32_t changed = 0;
+    for (size_t i = 0; i < a.tiles.size(); i++) changed += a.tiles[i] != b.tiles[i];
+    return changed;
+}
+
+}  // namespace screenshot
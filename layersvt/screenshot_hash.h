@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Hashes of captured frames, used to tell whether a frame changed without
+// writing its image.  They take tightly packed 8-bit RGB pixels, as produced
+// by screenshot_convert.h.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace screenshot {
+
+// Streaming xxHash64.  Feeding the data in any number of pieces gives the same
+// hash as hashing it at once.
+class XXHash64 {
+   public:
+    explicit XXHash64(uint64_t seed = 0);
+    void update(const void *data, size_t size);
+    uint64_t digest() const;
+
+   private:
+    uint64_t acc[4];
+    uint8_t buffer[32];
+    size_t bufferSize;
+    uint64_t totalSize;
+    uint64_t seed;
+};
+
+uint64_t xxHash64(const void *data, size_t size, uint64_t seed = 0);
+
+// Hash of a whole frame, and of each of its tiles in row-major order.
+struct FrameHash {
+    uint64_t hash;
+    std::vector<uint64_t> tiles;
+};
+
+// Hashes an image given one row at a time, from the top, so that it does not
+// have to be held whole.  The hashes are those of hashImageRGB().
+class FrameHasher {
+   public:
+    FrameHasher(uint32_t width, uint32_t height, uint32_t tilesPerSide);
+    void addRow(const uint8_t *rgb);
+    void digest(FrameHash &out) const;
+
+   private:
+    size_t rowSize;
+    uint32_t height;
+    uint32_t tilesPerSide;
+    uint32_t row;
+    XXHash64 frame;
+    std::vector<XXHash64> tiles;
+    std::vector<size_t> columns;
+};
+
+// Hash an image, and when tilesPerSide is not 0, each tile of a
+// tilesPerSide x tilesPerSide grid laid over it.  The hashes do not depend on
+// the width of the rows in memory.
+void hashImageRGB(const uint8_t *rgb, uint32_t width, uint32_t height, uint32_t tilesPerSide, FrameHash &out);
+
+// A line of a frame hash log: "frame,hash" followed by ",tile" for each tile,
+// with the hashes in hexadecimal.  The line has no newline.
+std::string formatFrameHash(int frameNumber, const FrameHash &hash);
+
+// Parse a line written by formatFrameHash().  Returns false for lines that are
+// not frame hashes, such as comments.
+bool parseFrameHash(const char *line, int &frameNumber, FrameHash &hash);
+
+// Number of tiles whose hashes differ, or 1 when the frames were not hashed
+// with the same tiles and only the frame hashes differ.
+uint32_t countChangedTiles(const FrameHash &a, const FrameHash &b);
+
+}  // namespace screenshot
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "screenshot_shm.h"
+
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define SCREENSHOT_USE_SHM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace screenshot {
+
+static_assert(sizeof(FrameSlotHeader) <= FRAME_SLOT_PIXELS_OFFSET, "The slot header overlaps the pixels");
+static_assert(sizeof(atomic<uint64_t>) == sizeof(uint64_t) && sizeof(atomic<uint32_t>) == sizeof(uint32_t),
+              "The atomics of the ring must have the size of the integers other processes see");
+
+static uint64_t alignSize(uint64_t size) { return (size + 63) & ~static_cast<uint64_t>(63); }
+
+static uint32_t getBytesPerPixel(FrameFormat format) { return format == FRAME_FORMAT_RGB8 ? 3 : 0; }
+
+//=============================== Writer =================================//
+
+bool FrameRingWriter::create(const char *ringName, uint32_t slotCount, uint64_t frameCapacity) {
+    destroy();
+#ifdef SCREENSHOT_USE_SHM
+    if (slotCount == 0) slotCount = 1;
+    uint64_t const headerSize = alignSize(sizeof(FrameRingHeader));
+    uint64_t const slotSize = FRAME_SLOT_PIXELS_OFFSET + alignSize(frameCapacity);
+    uint64_t const size = headerSize + slotSize * slotCount;
+    if (size != static_cast<size_t>(size)) return false;
+
+    // Replace a ring that a previous process did not remove, rather than
+    // sharing it with a reader that still has it mapped.
+    shm_unlink(ringName);
+    int fd = shm_open(ringName, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        mapping = mmap(NULL, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(ringName);
+        return false;
+    }
+
+    // The object is filled with zeros, so the slots and the frame count
+    // start at 0.  The magic number is written last, for readers that open
+    // the ring while it is being set up.
+    header = static_cast<FrameRingHeader *>(mapping);
+    header->version = FRAME_RING_VERSION;
+    header->slotCount = slotCount;
+    header->headerSize = static_cast<uint32_t>(headerSize);
+    header->slotSize = slotSize;
+    header->frameCapacity = frameCapacity;
+    atomic_thread_fence(memory_order_release);
+    header->magic = FRAME_RING_MAGIC;
+
+    name = ringName;
+    mappingSize = static_cast<size_t>(size);
+    return true;
+#else
+    (void)ringName;
+    (void)slotCount;
+    (void)frameCapacity;
+    return false;
+#endif
+}
+
+void FrameRingWriter::destroy() {
+#ifdef SCREENSHOT_USE_SHM
+    if (!header) return;
+    munmap(header, mappingSize);
+    shm_unlink(name.c_str());
+    header = nullptr;
+    slot = nullptr;
+#endif
+}
+
+uint8_t *FrameRingWriter::beginFrame(int32_t frameNumber, uint32_t width, uint32_t height, FrameFormat format, uint32_t pitch) {
+    if (!header) return nullptr;
+    if (static_cast<uint64_t>(pitch) < static_cast<uint64_t>(getBytesPerPixel(format)) * width ||
+        static_cast<uint64_t>(pitch) * height > header->frameCapacity) {
+        return nullptr;
+    }
+
+    uint64_t const index = header->frameCount.load(memory_order_relaxed);
+    uint8_t *base = reinterpret_cast<uint8_t *>(header) + header->headerSize + (index % header->slotCount) * header->slotSize;
+    slot = reinterpret_cast<FrameSlotHeader *>(base);
+
+    // Make the sequence number odd before anything in the slot changes.
+    slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->format = format;
+    slot->index = index;
+    slot->frameNumber = frameNumber;
+    slot->width = width;
+    slot->height = height;
+    slot->pitch = pitch;
+    return base + FRAME_SLOT_PIXELS_OFFSET;
+}
+
+void FrameRingWriter::publishFrame() {
+    if (!slot) return;
+    slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_release);
+    header->frameCount.store(slot->index + 1, memory_order_release);
+    slot = nullptr;
+}
+
+//=============================== Reader =================================//
+
+bool FrameRingReader::open(const char *name) {
+    close();
+#ifdef SCREENSHOT_USE_SHM
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<uint64_t>(info.st_size) >= sizeof(FrameRingHeader)) {
+        mapping = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    header = static_cast<const FrameRingHeader *>(mapping);
+    mappingSize = static_cast<size_t>(info.st_size);
+    bool const valid = header->magic == FRAME_RING_MAGIC && header->version == FRAME_RING_VERSION && header->slotCount > 0 &&
+                       header->slotSize >= FRAME_SLOT_PIXELS_OFFSET + header->frameCapacity &&
+                       header->headerSize + header->slotSize * header->slotCount <= mappingSize;
+    atomic_thread_fence(memory_order_acquire);
+    if (!valid) close();
+    return valid;
+#else
+    (void)name;
+    return false;
+#endif
+}
+
+void FrameRingReader::close() {
+#ifdef SCREENSHOT_USE_SHM
+    if (!header) return;
+    munmap(const_cast<FrameRingHeader *>(header), mappingSize);
+    header = nullptr;
+#endif
+}
+
+FrameReadResult FrameRingReader::read(uint64_t index, FrameInfo &info, vector<uint8_t> &pixels) const {
+    if (index >= getFrameCount()) return FRAME_NOT_READY;
+
+    const uint8_t *base =
+        reinterpret_cast<const uint8_t *>(header) + header->headerSize + (index % header->slotCount) * header->slotSize;
+    const FrameSlotHeader *slot = reinterpret_cast<const FrameSlotHeader *>(base);
+
+    // The frame has been published, so a slot that is being written or that
+    // changes while it is copied holds a later frame.
+    uint32_t const sequence = slot->sequence.load(memory_order_acquire);
+    if (sequence & 1) return FRAME_OVERWRITTEN;
+
+    info.index = slot->index;
+    info.frameNumber = slot->frameNumber;
+    info.width = slot->width;
+    info.height = slot->height;
+    info.format = slot->format;
+    info.pitch = slot->pitch;
+    uint64_t const size = static_cast<uint64_t>(info.pitch) * info.height;
+    if (info.index == index && size <= header->frameCapacity) {
+        pixels.resize(static_cast<size_t>(size));
+        memcpy(pixels.data(), base + FRAME_SLOT_PIXELS_OFFSET, pixels.size());
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (slot->sequence.load(memory_order_relaxed) != sequence || info.index != index) return FRAME_OVERWRITTEN;
+    return FRAME_READ;
+}
+
+}  // namespace screenshot
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A ring of captured frames in POSIX shared memory, through which another
+// process can read the frames without going through files.  Nothing in here
+// depends on Vulkan, so readers only need this header and screenshot_shm.cpp.
+//
+// The shared memory object starts with a FrameRingHeader, followed by
+// slotCount slots of slotSize bytes.  Each slot is a FrameSlotHeader followed
+// by the rows of a frame.  Frames are numbered from 0 in the order they are
+// published, and frame i is stored in slot i % slotCount, so the writer
+// overwrites the oldest frame once the ring is full.
+//
+// Each slot is guarded by a sequence lock: its sequence number is odd while
+// the writer updates the slot and is increased to the next even number once
+// the frame is complete.  A reader copies the slot and then checks that the
+// sequence number was even and did not change in the meantime.  Otherwise
+// the writer reused the slot for a later frame, and the copy is discarded.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace screenshot {
+
+static const uint32_t FRAME_RING_MAGIC = 0x53534b56;  // "VKSS"
+static const uint32_t FRAME_RING_VERSION = 1;
+
+// Offset of the first row of a frame in its slot.
+static const uint32_t FRAME_SLOT_PIXELS_OFFSET = 64;
+
+// Layout of the pixels of a frame.
+enum FrameFormat {
+    FRAME_FORMAT_RGB8 = 1,  // 3 bytes per pixel, red first
+};
+
+struct FrameRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t headerSize;     // offset of the first slot
+    uint64_t slotSize;       // including the slot header
+    uint64_t frameCapacity;  // largest frame, in bytes
+    // Number of frames published so far.
+    std::atomic<uint64_t> frameCount;
+};
+
+struct FrameSlotHeader {
+    std::atomic<uint32_t> sequence;
+    uint32_t format;
+    uint64_t index;  // position of the frame in the order of publication
+    int32_t frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;  // bytes from a row to the next
+};
+
+// Information about a frame, as copied out of its slot.
+struct FrameInfo {
+    uint64_t index;
+    int32_t frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t pitch;
+};
+
+// Creates the ring and publishes frames into it.  It is not thread-safe.
+class FrameRingWriter {
+   public:
+    FrameRingWriter() = default;
+    ~FrameRingWriter() { destroy(); }
+
+    // Create the shared memory object name, replacing any left by a previous
+    // process, with slotCount slots for frames of up to frameCapacity bytes.
+    // Returns false if shared memory is not available on the platform.
+    bool create(const char *name, uint32_t slotCount, uint64_t frameCapacity);
+
+    // Unmap and remove the shared memory object.  Readers that mapped it
+    // keep their mapping.
+    void destroy();
+
+    bool isOpen() const { return header != nullptr; }
+
+    // Start writing the next frame into its slot, and return where its first
+    // row goes, or nullptr if the frame does not fit.  The frame becomes
+    // visible to readers once publishFrame() is called.
+    uint8_t *beginFrame(int32_t frameNumber, uint32_t width, uint32_t height, FrameFormat format, uint32_t pitch);
+    void publishFrame();
+
+   private:
+    FrameRingWriter(const FrameRingWriter &) = delete;
+    FrameRingWriter &operator=(const FrameRingWriter &) = delete;
+
+    std::string name;
+    FrameRingHeader *header = nullptr;
+    size_t mappingSize = 0;
+    FrameSlotHeader *slot = nullptr;
+};
+
+enum FrameReadResult {
+    FRAME_READ,         // the frame was copied
+    FRAME_NOT_READY,    // the frame has not been published yet
+    FRAME_OVERWRITTEN,  // the writer has already reused the slot of the frame
+};
+
+// Maps an existing ring read-only and copies frames out of it.  It is the
+// reference implementation of the protocol for other readers.
+class FrameRingReader {
+   public:
+    FrameRingReader() = default;
+    ~FrameRingReader() { close(); }
+
+    // Map the ring created by a writer under name.  Returns false if it does
+    // not exist or is not a ring this reader understands.
+    bool open(const char *name);
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+    uint32_t getSlotCount() const { return header->slotCount; }
+
+    // Number of frames published so far; the latest one is getFrameCount() - 1.
+    uint64_t getFrameCount() const { return header->frameCount.load(std::memory_order_acquire); }
+
+    // Copy frame index out of its slot, with its rows packed to
+    // info.pitch bytes.
+    FrameReadResult read(uint64_t index, FrameInfo &info, std::vector<uint8_t> &pixels) const;
+
+   private:
+    FrameRingReader(const FrameRingReader &) = delete;
+    FrameRingReader &operator=(const FrameRingReader &) = delete;
+
+    const FrameRingHeader *header = nullptr;
+    size_t mappingSize = 0;
+};
+
+}  // namespace screenshot
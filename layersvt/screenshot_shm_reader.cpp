@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2015-2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reference reader of the shared memory ring that the screenshot layer
+// writes captured frames to when lunarg_screenshot.shm_name is set.  It
+// follows the frames as they are published, prints a line for each one and
+// can write them as PPM files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "screenshot_shm.h"
+
+static void printUsage(const char *argv0) {
+    printf(
+        "Usage: %s <name> [options]\n"
+        "Reads the frames that the screenshot layer publishes to the shared memory ring <name>.\n"
+        "Options:\n"
+        "  --dir <dir>     also write each frame to <dir>/<frame>.ppm\n"
+        "  --frames <n>    exit after reading n frames\n",
+        argv0);
+}
+
+static bool writePPM(const std::string &filename, const screenshot::FrameInfo &info, const std::vector<uint8_t> &pixels) {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) return false;
+    fprintf(file, "P6\n%u %u\n255\n", info.width, info.height);
+    for (uint32_t y = 0; y < info.height; y++) fwrite(&pixels[static_cast<size_t>(info.pitch) * y], 3, info.width, file);
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+    const char *name = nullptr;
+    const char *dir = nullptr;
+    uint64_t frames = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-' && !name) {
+            name = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (!name) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The ring is created at the first frame the layer captures.
+    screenshot::FrameRingReader reader;
+    while (!reader.open(name)) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    screenshot::FrameInfo info;
+    std::vector<uint8_t> pixels;
+    uint64_t next = 0;
+    uint64_t received = 0;
+    uint64_t skipped = 0;
+    while (frames == 0 || received < frames) {
+        uint64_t const count = reader.getFrameCount();
+        if (next == count) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        // Frames older than the ring holds are gone.
+        if (count - next > reader.getSlotCount()) {
+            skipped += count - reader.getSlotCount() - next;
+            next = count - reader.getSlotCount();
+        }
+
+        screenshot::FrameReadResult const result = reader.read(next++, info, pixels);
+        if (result == screenshot::FRAME_OVERWRITTEN) {
+            skipped++;
+            continue;
+        }
+        received++;
+        printf("frame %d, %ux%u, %llu skipped\n", info.frameNumber, info.width, info.height,
+               static_cast<unsigned long long>(skipped));
+        if (dir && info.format == screenshot::FRAME_FORMAT_RGB8 &&
+            !writePPM(std::string(dir) + "/" + std::to_string(info.frameNumber) + ".ppm", info, pixels)) {
+            fprintf(stderr, "Could not write frame %d\n", info.frameNumber);
+            return 1;
+        }
+    }
+    return 0;
+}
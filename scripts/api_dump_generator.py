@@ -148,14 +148,7 @@ inline void dump_head_{funcName}(ApiDumpInstance& dump_inst, {funcTypedParams})
 {{
     dump_inst.outputMutex()->lock();
 
-    if (pNameInfo->pObjectName)
-    {{
-        dump_inst.object_name_map.insert(std::make_pair<uint64_t, std::string>((uint64_t &&)pNameInfo->object, pNameInfo->pObjectName));
-    }}
-    else
-    {{
-        dump_inst.object_name_map.erase(pNameInfo->object);
-    }}
+    dump_inst.object_name_map.set(pNameInfo->object, pNameInfo->pObjectName);
 
     if (dump_inst.shouldDumpOutput()) {{
         switch(dump_inst.settings().format())
@@ -203,14 +196,7 @@ inline void dump_body_{funcName}(ApiDumpInstance& dump_inst, {funcReturn} result
 inline void dump_head_{funcName}(ApiDumpInstance& dump_inst, {funcTypedParams})
 {{
     dump_inst.outputMutex()->lock();
-    if (pNameInfo->pObjectName)
-    {{
-        dump_inst.object_name_map.insert(std::make_pair<uint64_t, std::string>((uint64_t &&)pNameInfo->objectHandle, pNameInfo->pObjectName));
-    }}
-    else
-    {{
-        dump_inst.object_name_map.erase(pNameInfo->objectHandle);
-    }}
+    dump_inst.object_name_map.set(pNameInfo->objectHandle, pNameInfo->pObjectName);
     if (dump_inst.shouldDumpOutput()) {{
         switch(dump_inst.settings().format())
         {{
@@ -286,6 +272,7 @@ VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 @foreach function where('{funcName}' == 'vkDestroyInstance')
 VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 {{
+    {funcNameCleanupCode}
     dump_head_{funcName}(ApiDumpInstance::current(), {funcNamedParams});
     // Destroy the dispatch table
     dispatch_key key = get_dispatch_key({funcDispatchParam});
@@ -328,6 +315,7 @@ VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 @foreach function where('{funcName}' == 'vkDestroyDevice')
 VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 {{
+    {funcNameCleanupCode}
     dump_head_{funcName}(ApiDumpInstance::current(), {funcNamedParams});
 
     // Destroy the dispatch table
@@ -411,10 +399,11 @@ VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 @foreach function where('{funcDispatchType}' == 'instance' and '{funcReturn}' == 'void' and '{funcName}' not in ['vkCreateInstance', 'vkDestroyInstance', 'vkCreateDevice', 'vkGetInstanceProcAddr', 'vkEnumerateDeviceExtensionProperties', 'vkEnumerateDeviceLayerProperties'])
 VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 {{
+    {funcNameCleanupCode}
     dump_head_{funcName}(ApiDumpInstance::current(), {funcNamedParams});
     instance_dispatch_table({funcDispatchParam})->{funcShortName}({funcNamedParams});
     {funcStateTrackingCode}
-    dump_body_{funcName}(ApiDumpInstance::current(), {funcNamedParams});    
+    dump_body_{funcName}(ApiDumpInstance::current(), {funcNamedParams});
 }}
 @end function
 
@@ -423,6 +412,7 @@ VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 @foreach function where('{funcDispatchType}' == 'device' and '{funcReturn}' != 'void' and '{funcName}' not in ['vkDestroyDevice', 'vkEnumerateInstanceExtensionProperties', 'vkEnumerateInstanceLayerProperties', 'vkQueuePresentKHR', 'vkGetDeviceProcAddr'])
 VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 {{
+    {funcNameCleanupCode}
     dump_head_{funcName}(ApiDumpInstance::current(), {funcNamedParams});
     {funcReturn} result = device_dispatch_table({funcDispatchParam})->{funcShortName}({funcNamedParams});
     {funcStateTrackingCode}
@@ -434,6 +424,7 @@ VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 @foreach function where('{funcDispatchType}' == 'device' and '{funcReturn}' == 'void' and '{funcName}' not in ['vkDestroyDevice', 'vkEnumerateInstanceExtensionProperties', 'vkEnumerateInstanceLayerProperties', 'vkGetDeviceProcAddr'])
 VK_LAYER_EXPORT VKAPI_ATTR {funcReturn} VKAPI_CALL {funcName}({funcTypedParams})
 {{
+    {funcNameCleanupCode}
     dump_head_{funcName}(ApiDumpInstance::current(), {funcNamedParams});
     device_dispatch_table({funcDispatchParam})->{funcShortName}({funcNamedParams});
     {funcStateTrackingCode}
@@ -672,9 +663,9 @@ inline std::ostream& dump_text_{hdlName}(const {hdlName} object, const ApiDumpSe
     if(settings.showAddress()) {{
         settings.stream() << object;
 
-        std::unordered_map<uint64_t, std::string>::const_iterator it = ApiDumpInstance::current().object_name_map.find((uint64_t) object);
-        if (it != ApiDumpInstance::current().object_name_map.end()) {{
-            settings.stream() << " [" << it->second << "]";
+        std::shared_ptr<const std::string> name = ApiDumpInstance::current().object_name_map.find((uint64_t) object);
+        if (name) {{
+            settings.stream() << " [" << *name << "]";
         }}
     }} else {{
         settings.stream() << "address";
@@ -1106,9 +1097,9 @@ inline std::ostream& dump_html_{hdlName}(const {hdlName} object, const ApiDumpSe
     if(settings.showAddress()) {{
         settings.stream() << object;
 
-        std::unordered_map<uint64_t, std::string>::const_iterator it = ApiDumpInstance::current().object_name_map.find((uint64_t) object);
-        if (it != ApiDumpInstance::current().object_name_map.end()) {{
-            settings.stream() << "</div><div class='val'>[" << it->second << "]";
+        std::shared_ptr<const std::string> name = ApiDumpInstance::current().object_name_map.find((uint64_t) object);
+        if (name) {{
+            settings.stream() << "</div><div class='val'>[" << *name << "]";
         }}
     }} else {{
         settings.stream() << "address";
@@ -1848,14 +1839,48 @@ TRACKED_STATE = {
             'ApiDumpInstance::current().addCmdBuffers(\n' +
                 'device,\n' +
                 'pAllocateInfo->commandPool,\n' +
-                'std::vector<VkCommandBuffer>(pCommandBuffers, pCommandBuffers + pAllocateInfo->commandBufferCount),\n' +
+                'pCommandBuffers,\n' +
+                'pAllocateInfo->commandBufferCount,\n' +
                 'pAllocateInfo->level\n'
             ');',
-    'vkDestroyCommandPool':
-        'ApiDumpInstance::current().eraseCmdBufferPool(device, commandPool);'
+    'vkFreeCommandBuffers':
+        'ApiDumpInstance::current().eraseCmdBuffers(device, commandPool, pCommandBuffers, commandBufferCount);'
     ,
+    'vkAllocateDescriptorSets':
+        'if(result == VK_SUCCESS)\n' +
+            'ApiDumpInstance::current().addDescriptorSets(\n' +
+                'device,\n' +
+                'pAllocateInfo->descriptorPool,\n' +
+                'pDescriptorSets,\n' +
+                'pAllocateInfo->descriptorSetCount\n'
+            ');',
+    'vkFreeDescriptorSets':
+        'ApiDumpInstance::current().eraseDescriptorSets(device, descriptorPool, pDescriptorSets, descriptorSetCount);'
+    ,
+}
+
+# Handles destroyed by a call have their debug names taken out of the name map before the call goes down
+# the chain, because the driver may hand the same handle values out again as soon as it returns. The call
+# is still dumped with those names, from released_names. Calls named vkDestroy* (and vkFreeMemory) get
+# this automatically for their last non-allocator parameter, so only calls that free arrays of handles,
+# or the handles allocated from a pool, need to be listed here.
+NAME_CLEANUP = {
     'vkFreeCommandBuffers':
-        'ApiDumpInstance::current().eraseCmdBuffers(device, commandPool, std::vector<VkCommandBuffer>(pCommandBuffers, pCommandBuffers + commandBufferCount));'
+        'for (uint32_t i = 0; pCommandBuffers != NULL && i < commandBufferCount; ++i)\n' +
+            'released_names.release((uint64_t)pCommandBuffers[i]);'
+    ,
+    'vkFreeDescriptorSets':
+        'for (uint32_t i = 0; pDescriptorSets != NULL && i < descriptorSetCount; ++i)\n' +
+            'released_names.release((uint64_t)pDescriptorSets[i]);'
+    ,
+    'vkDestroyCommandPool':
+        'ApiDumpInstance::current().eraseCmdBufferPool(device, commandPool, released_names);'
+    ,
+    'vkResetDescriptorPool':
+        'ApiDumpInstance::current().resetDescriptorPool(device, descriptorPool, released_names);'
+    ,
+    'vkDestroyDescriptorPool':
+        'ApiDumpInstance::current().eraseDescriptorPool(device, descriptorPool, released_names);'
     ,
 }
 
@@ -2672,6 +2697,18 @@ class VulkanFunction:
         if self.name in TRACKED_STATE:
             self.stateTrackingCode = TRACKED_STATE[self.name]
 
+        nameCleanup = []
+        if self.name.startswith('vkDestroy') or self.name == 'vkFreeMemory':
+            destroyed = [param for param in self.parameters if param.name != 'pAllocator'][-1]
+            if destroyed.pointerLevels == 0:
+                nameCleanup.append('released_names.release((uint64_t){});'.format(destroyed.name))
+        if self.name in NAME_CLEANUP:
+            nameCleanup.append(NAME_CLEANUP[self.name])
+        self.nameCleanupCode = ''
+        if nameCleanup:
+            self.nameCleanupCode = '\n'.join(
+                ['ReleasedObjectNames released_names(ApiDumpInstance::current().object_name_map);'] + nameCleanup)
+
         self.safeToPrint = True
         for param in self.parameters:
             if param.pointerLevels == 1 and param.type.find("const") == -1:
@@ -2688,6 +2725,7 @@ class VulkanFunction:
             'funcDispatchParam': self.parameters[0].name,
             'funcDispatchType' : self.dispatchType, 
             'funcStateTrackingCode': self.stateTrackingCode,
+            'funcNameCleanupCode': self.nameCleanupCode,
             'funcSafeToPrint': self.safeToPrint,
         }
 
@@ -0,0 +1,595 @@
+/* Copyright (c) 2021 The Khronos Group Inc.
+ * Copyright (c) 2021 Valve Corporation
+ * Copyright (c) 2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the per-call cost of the api_dump layer without a GPU or ICD.
+ *
+ * The layer library is loaded the same way the loader would load it, and its vkCreateInstance and
+ * vkCreateDevice are handed a stub "next layer" whose entrypoints do nothing. A synthetic frame loop
+ * (descriptor updates, a render pass full of vkCmd* calls, submit and present) is then replayed through
+ * the layer from 1..N threads, and the time per call and the rate at which the layer writes its output
+ * are reported.
+ *
+ * One process measures one output format and flush setting, because the layer reads its settings once.
+ * apidump_benchmark.sh runs every combination.
+ */
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vulkan/vk_layer.h"
+#include "vulkan/vulkan.h"
+
+//============================= Stub downstream =============================//
+
+// Dispatchable objects start with the loader's dispatch pointer, which layers use as the key for their
+// dispatch tables. Children of an instance or device share their parent's key.
+struct StubDispatchable {
+    void *loader_data;
+};
+
+static int stub_instance_key;
+static int stub_device_key;
+static StubDispatchable stub_physical_device = {&stub_instance_key};
+
+template <typename T>
+static T FakeHandle(uint64_t value) {
+    return (T)(uintptr_t)value;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubCreateInstance(const VkInstanceCreateInfo *, const VkAllocationCallbacks *,
+                                                         VkInstance *pInstance) {
+    *pInstance = reinterpret_cast<VkInstance>(new StubDispatchable{&stub_instance_key});
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL StubDestroyInstance(VkInstance instance, const VkAllocationCallbacks *) {
+    delete reinterpret_cast<StubDispatchable *>(instance);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubEnumeratePhysicalDevices(VkInstance, uint32_t *pPhysicalDeviceCount,
+                                                                   VkPhysicalDevice *pPhysicalDevices) {
+    if (pPhysicalDevices != nullptr && *pPhysicalDeviceCount > 0) {
+        pPhysicalDevices[0] = reinterpret_cast<VkPhysicalDevice>(&stub_physical_device);
+    }
+    *pPhysicalDeviceCount = 1;
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubCreateDevice(VkPhysicalDevice, const VkDeviceCreateInfo *, const VkAllocationCallbacks *,
+                                                       VkDevice *pDevice) {
+    *pDevice = reinterpret_cast<VkDevice>(new StubDispatchable{&stub_device_key});
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL StubDestroyDevice(VkDevice device, const VkAllocationCallbacks *) {
+    delete reinterpret_cast<StubDispatchable *>(device);
+}
+
+// Queues are only requested from the main thread. A deque keeps their addresses stable as it grows.
+static VKAPI_ATTR void VKAPI_CALL StubGetDeviceQueue(VkDevice, uint32_t, uint32_t queueIndex, VkQueue *pQueue) {
+    static std::deque<StubDispatchable> queues;
+    while (queues.size() <= queueIndex) queues.push_back(StubDispatchable{&stub_device_key});
+    *pQueue = reinterpret_cast<VkQueue>(&queues[queueIndex]);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubCreateCommandPool(VkDevice, const VkCommandPoolCreateInfo *,
+                                                            const VkAllocationCallbacks *, VkCommandPool *pCommandPool) {
+    static std::atomic<uint64_t> next_pool(0x1000);
+    *pCommandPool = FakeHandle<VkCommandPool>(next_pool++);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL StubDestroyCommandPool(VkDevice, VkCommandPool, const VkAllocationCallbacks *) {}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubAllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo *pAllocateInfo,
+                                                                 VkCommandBuffer *pCommandBuffers) {
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        pCommandBuffers[i] = reinterpret_cast<VkCommandBuffer>(new StubDispatchable{&stub_device_key});
+    }
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL StubFreeCommandBuffers(VkDevice, VkCommandPool, uint32_t commandBufferCount,
+                                                         const VkCommandBuffer *pCommandBuffers) {
+    for (uint32_t i = 0; i < commandBufferCount; ++i) {
+        delete reinterpret_cast<StubDispatchable *>(pCommandBuffers[i]);
+    }
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubAcquireNextImageKHR(VkDevice, VkSwapchainKHR, uint64_t, VkSemaphore, VkFence,
+                                                              uint32_t *pImageIndex) {
+    *pImageIndex = 0;
+    return VK_SUCCESS;
+}
+
+// Everything else the frame loop calls has nothing to return, so one do-nothing body per signature suffices.
+static VKAPI_ATTR VkResult VKAPI_CALL StubWaitForFences(VkDevice, uint32_t, const VkFence *, VkBool32, uint64_t) {
+    return VK_SUCCESS;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL StubResetFences(VkDevice, uint32_t, const VkFence *) { return VK_SUCCESS; }
+static VKAPI_ATTR VkResult VKAPI_CALL StubResetCommandPool(VkDevice, VkCommandPool, VkCommandPoolResetFlags) {
+    return VK_SUCCESS;
+}
+static VKAPI_ATTR void VKAPI_CALL StubUpdateDescriptorSets(VkDevice, uint32_t, const VkWriteDescriptorSet *, uint32_t,
+                                                           const VkCopyDescriptorSet *) {}
+static VKAPI_ATTR VkResult VKAPI_CALL StubBeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo *) {
+    return VK_SUCCESS;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL StubEndCommandBuffer(VkCommandBuffer) { return VK_SUCCESS; }
+static VKAPI_ATTR void VKAPI_CALL StubCmdPipelineBarrier(VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags,
+                                                         VkDependencyFlags, uint32_t, const VkMemoryBarrier *, uint32_t,
+                                                         const VkBufferMemoryBarrier *, uint32_t, const VkImageMemoryBarrier *) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdBeginRenderPass(VkCommandBuffer, const VkRenderPassBeginInfo *, VkSubpassContents) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdEndRenderPass(VkCommandBuffer) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdSetViewport(VkCommandBuffer, uint32_t, uint32_t, const VkViewport *) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdSetScissor(VkCommandBuffer, uint32_t, uint32_t, const VkRect2D *) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t,
+                                                            uint32_t, const VkDescriptorSet *, uint32_t, const uint32_t *) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdPushConstants(VkCommandBuffer, VkPipelineLayout, VkShaderStageFlags, uint32_t, uint32_t,
+                                                       const void *) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdBindVertexBuffers(VkCommandBuffer, uint32_t, uint32_t, const VkBuffer *,
+                                                           const VkDeviceSize *) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdBindIndexBuffer(VkCommandBuffer, VkBuffer, VkDeviceSize, VkIndexType) {}
+static VKAPI_ATTR void VKAPI_CALL StubCmdDrawIndexed(VkCommandBuffer, uint32_t, uint32_t, uint32_t, int32_t, uint32_t) {}
+static VKAPI_ATTR VkResult VKAPI_CALL StubQueueSubmit(VkQueue, uint32_t, const VkSubmitInfo *, VkFence) { return VK_SUCCESS; }
+static VKAPI_ATTR VkResult VKAPI_CALL StubQueuePresentKHR(VkQueue, const VkPresentInfoKHR *) { return VK_SUCCESS; }
+
+static VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL StubGetDeviceProcAddr(VkDevice, const char *pName);
+
+static VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL StubGetInstanceProcAddr(VkInstance, const char *pName) {
+    struct StubEntrypoint {
+        const char *name;
+        PFN_vkVoidFunction function;
+    };
+#define STUB_ENTRYPOINT(name) \
+    { "vk" #name, reinterpret_cast<PFN_vkVoidFunction>(Stub##name) }
+    static const StubEntrypoint entrypoints[] = {
+        STUB_ENTRYPOINT(GetInstanceProcAddr),  STUB_ENTRYPOINT(GetDeviceProcAddr),        STUB_ENTRYPOINT(CreateInstance),
+        STUB_ENTRYPOINT(DestroyInstance),      STUB_ENTRYPOINT(EnumeratePhysicalDevices), STUB_ENTRYPOINT(CreateDevice),
+        STUB_ENTRYPOINT(DestroyDevice),        STUB_ENTRYPOINT(GetDeviceQueue),           STUB_ENTRYPOINT(CreateCommandPool),
+        STUB_ENTRYPOINT(DestroyCommandPool),   STUB_ENTRYPOINT(AllocateCommandBuffers),   STUB_ENTRYPOINT(FreeCommandBuffers),
+        STUB_ENTRYPOINT(AcquireNextImageKHR),  STUB_ENTRYPOINT(WaitForFences),            STUB_ENTRYPOINT(ResetFences),
+        STUB_ENTRYPOINT(ResetCommandPool),     STUB_ENTRYPOINT(UpdateDescriptorSets),     STUB_ENTRYPOINT(BeginCommandBuffer),
+        STUB_ENTRYPOINT(EndCommandBuffer),     STUB_ENTRYPOINT(CmdPipelineBarrier),       STUB_ENTRYPOINT(CmdBeginRenderPass),
+        STUB_ENTRYPOINT(CmdEndRenderPass),     STUB_ENTRYPOINT(CmdSetViewport),           STUB_ENTRYPOINT(CmdSetScissor),
+        STUB_ENTRYPOINT(CmdBindPipeline),      STUB_ENTRYPOINT(CmdBindDescriptorSets),    STUB_ENTRYPOINT(CmdPushConstants),
+        STUB_ENTRYPOINT(CmdBindVertexBuffers), STUB_ENTRYPOINT(CmdBindIndexBuffer),       STUB_ENTRYPOINT(CmdDrawIndexed),
+        STUB_ENTRYPOINT(QueueSubmit),          STUB_ENTRYPOINT(QueuePresentKHR),
+    };
+#undef STUB_ENTRYPOINT
+
+    for (const auto &entrypoint : entrypoints) {
+        if (strcmp(pName, entrypoint.name) == 0) return entrypoint.function;
+    }
+    return nullptr;
+}
+
+static VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL StubGetDeviceProcAddr(VkDevice, const char *pName) {
+    return StubGetInstanceProcAddr(VK_NULL_HANDLE, pName);
+}
+
+//=============================== Frame loop ================================//
+
+// Entrypoints of the layer under test.
+struct LayerFunctions {
+    PFN_vkGetInstanceProcAddr GetInstanceProcAddr;
+    PFN_vkGetDeviceProcAddr GetDeviceProcAddr;
+    PFN_vkCreateInstance CreateInstance;
+    PFN_vkDestroyInstance DestroyInstance;
+    PFN_vkEnumeratePhysicalDevices EnumeratePhysicalDevices;
+    PFN_vkCreateDevice CreateDevice;
+    PFN_vkDestroyDevice DestroyDevice;
+    PFN_vkGetDeviceQueue GetDeviceQueue;
+    PFN_vkCreateCommandPool CreateCommandPool;
+    PFN_vkDestroyCommandPool DestroyCommandPool;
+    PFN_vkAllocateCommandBuffers AllocateCommandBuffers;
+    PFN_vkFreeCommandBuffers FreeCommandBuffers;
+    PFN_vkAcquireNextImageKHR AcquireNextImageKHR;
+    PFN_vkWaitForFences WaitForFences;
+    PFN_vkResetFences ResetFences;
+    PFN_vkResetCommandPool ResetCommandPool;
+    PFN_vkUpdateDescriptorSets UpdateDescriptorSets;
+    PFN_vkBeginCommandBuffer BeginCommandBuffer;
+    PFN_vkEndCommandBuffer EndCommandBuffer;
+    PFN_vkCmdPipelineBarrier CmdPipelineBarrier;
+    PFN_vkCmdBeginRenderPass CmdBeginRenderPass;
+    PFN_vkCmdEndRenderPass CmdEndRenderPass;
+    PFN_vkCmdSetViewport CmdSetViewport;
+    PFN_vkCmdSetScissor CmdSetScissor;
+    PFN_vkCmdBindPipeline CmdBindPipeline;
+    PFN_vkCmdBindDescriptorSets CmdBindDescriptorSets;
+    PFN_vkCmdPushConstants CmdPushConstants;
+    PFN_vkCmdBindVertexBuffers CmdBindVertexBuffers;
+    PFN_vkCmdBindIndexBuffer CmdBindIndexBuffer;
+    PFN_vkCmdDrawIndexed CmdDrawIndexed;
+    PFN_vkQueueSubmit QueueSubmit;
+    PFN_vkQueuePresentKHR QueuePresentKHR;
+};
+
+// Each thread renders to its own swapchain and submits to its own queue, so that the call stream is valid:
+// queues, swapchains, fences and the descriptor sets being updated are all externally synchronized.
+struct ThreadContext {
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    uint64_t handle_base;  // added to the fake handles of the objects only this thread uses
+};
+
+static const uint32_t DESCRIPTOR_WRITES_PER_FRAME = 8;
+
+// Records and presents one frame. Returns the number of Vulkan calls made.
+static uint64_t RunFrame(const LayerFunctions &vk, const ThreadContext &ctx, uint32_t draws_per_frame) {
+    const VkSwapchainKHR swapchain = FakeHandle<VkSwapchainKHR>(ctx.handle_base + 0x5000);
+    const VkSemaphore acquire_semaphore = FakeHandle<VkSemaphore>(ctx.handle_base + 0x5100);
+    const VkSemaphore render_semaphore = FakeHandle<VkSemaphore>(ctx.handle_base + 0x5101);
+    const VkFence fence = FakeHandle<VkFence>(ctx.handle_base + 0x5200);
+    const VkImage image = FakeHandle<VkImage>(ctx.handle_base + 0x5300);
+    const VkRenderPass render_pass = FakeHandle<VkRenderPass>(0x5400);
+    const VkFramebuffer framebuffer = FakeHandle<VkFramebuffer>(0x5500);
+    const VkPipelineLayout pipeline_layout = FakeHandle<VkPipelineLayout>(0x5600);
+    const VkBuffer buffer = FakeHandle<VkBuffer>(0x5700);
+    const VkImageView image_view = FakeHandle<VkImageView>(0x5800);
+    const VkSampler sampler = FakeHandle<VkSampler>(0x5900);
+    uint64_t calls = 0;
+
+    uint32_t image_index = 0;
+    vk.AcquireNextImageKHR(ctx.device, swapchain, UINT64_MAX, acquire_semaphore, VK_NULL_HANDLE, &image_index);
+    vk.WaitForFences(ctx.device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vk.ResetFences(ctx.device, 1, &fence);
+    vk.ResetCommandPool(ctx.device, ctx.command_pool, 0);
+    calls += 4;
+
+    VkDescriptorBufferInfo buffer_info = {buffer, 0, 256};
+    VkDescriptorImageInfo image_info = {sampler, image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet writes[DESCRIPTOR_WRITES_PER_FRAME] = {};
+    for (uint32_t i = 0; i < DESCRIPTOR_WRITES_PER_FRAME; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = FakeHandle<VkDescriptorSet>(ctx.handle_base + 0x6000 + i / 2);
+        writes[i].dstBinding = i % 2;
+        writes[i].descriptorCount = 1;
+        if (i % 2 == 0) {
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writes[i].pBufferInfo = &buffer_info;
+        } else {
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[i].pImageInfo = &image_info;
+        }
+    }
+    vk.UpdateDescriptorSets(ctx.device, DESCRIPTOR_WRITES_PER_FRAME, writes, 0, nullptr);
+    calls += 1;
+
+    VkCommandBufferBeginInfo begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr,
+                                           VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr};
+    vk.BeginCommandBuffer(ctx.command_buffer, &begin_info);
+
+    VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vk.CmdPipelineBarrier(ctx.command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                          0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkClearValue clear_value = {};
+    VkRenderPassBeginInfo render_pass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    render_pass_info.renderPass = render_pass;
+    render_pass_info.framebuffer = framebuffer;
+    render_pass_info.renderArea = {{0, 0}, {1920, 1080}};
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_value;
+    vk.CmdBeginRenderPass(ctx.command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = {0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f};
+    VkRect2D scissor = {{0, 0}, {1920, 1080}};
+    vk.CmdSetViewport(ctx.command_buffer, 0, 1, &viewport);
+    vk.CmdSetScissor(ctx.command_buffer, 0, 1, &scissor);
+    calls += 5;
+
+    for (uint32_t draw = 0; draw < draws_per_frame; ++draw) {
+        const VkDescriptorSet descriptor_set = FakeHandle<VkDescriptorSet>(ctx.handle_base + 0x6000 + draw % 4);
+        const VkDeviceSize vertex_offset = draw * 4096;
+        const float push_constants[4] = {1.0f, 0.5f, 0.25f, static_cast<float>(draw)};
+        vk.CmdBindPipeline(ctx.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, FakeHandle<VkPipeline>(0x7000 + draw % 8));
+        vk.CmdBindDescriptorSets(ctx.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0,
+                                 nullptr);
+        vk.CmdPushConstants(ctx.command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants),
+                            push_constants);
+        vk.CmdBindVertexBuffers(ctx.command_buffer, 0, 1, &buffer, &vertex_offset);
+        vk.CmdBindIndexBuffer(ctx.command_buffer, buffer, 0, VK_INDEX_TYPE_UINT16);
+        vk.CmdDrawIndexed(ctx.command_buffer, 3 * 256, 1, 0, 0, 0);
+        calls += 6;
+    }
+
+    vk.CmdEndRenderPass(ctx.command_buffer);
+    vk.EndCommandBuffer(ctx.command_buffer);
+
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &acquire_semaphore;
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &ctx.command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &render_semaphore;
+    vk.QueueSubmit(ctx.queue, 1, &submit_info, fence);
+
+    VkPresentInfoKHR present_info = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &render_semaphore;
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &swapchain;
+    present_info.pImageIndices = &image_index;
+    vk.QueuePresentKHR(ctx.queue, &present_info);
+    calls += 4;
+
+    return calls;
+}
+
+//================================== Main ===================================//
+
+struct Options {
+    std::string layer_path;
+    std::string format = "text";
+    std::string flush = "true";
+    std::string output = "apidump_benchmark.out";
+    uint32_t threads = 1;
+    uint32_t frames = 200;
+    uint32_t draws_per_frame = 64;
+    double max_ns_per_call = 0.0;
+};
+
+static void PrintUsage(const char *argv0) {
+    printf(
+        "Usage: %s --layer <libVkLayer_api_dump.so> [options]\n"
+        "  --format text|html|json   Output format to measure (default text)\n"
+        "  --flush true|false        Value of lunarg_api_dump.flush (default true)\n"
+        "  --output <file>           File the layer writes to (default apidump_benchmark.out)\n"
+        "  --threads <N>             Measure 1..N recording threads (default 1)\n"
+        "  --frames <N>              Frames recorded per thread (default 200)\n"
+        "  --draws <N>               Draws recorded per frame (default 64)\n"
+        "  --max-ns-per-call <ns>    Exit with failure if any run is slower than this\n",
+        argv0);
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char *value = argv[++i];
+        if (arg == "--layer") {
+            options.layer_path = value;
+        } else if (arg == "--format") {
+            options.format = value;
+        } else if (arg == "--flush") {
+            options.flush = value;
+        } else if (arg == "--output") {
+            options.output = value;
+        } else if (arg == "--threads") {
+            options.threads = static_cast<uint32_t>(std::max(1, atoi(value)));
+        } else if (arg == "--frames") {
+            options.frames = static_cast<uint32_t>(std::max(1, atoi(value)));
+        } else if (arg == "--draws") {
+            options.draws_per_frame = static_cast<uint32_t>(std::max(0, atoi(value)));
+        } else if (arg == "--max-ns-per-call") {
+            options.max_ns_per_call = atof(value);
+        } else {
+            return false;
+        }
+    }
+    return !options.layer_path.empty();
+}
+
+// The layer reads vk_layer_settings.txt once, at its first call. Point it at a settings file that selects
+// the configuration under test, and clear the environment overrides that would take precedence.
+static bool ConfigureLayer(const Options &options) {
+    const std::string settings_path = options.output + ".settings.txt";
+    std::ofstream settings(settings_path);
+    if (!settings) return false;
+    settings << "lunarg_api_dump.output_format = " << options.format << "\n"
+             << "lunarg_api_dump.flush = " << options.flush << "\n"
+             << "lunarg_api_dump.file = true\n"
+             << "lunarg_api_dump.log_filename = " << options.output << "\n"
+             << "lunarg_api_dump.detailed = true\n"
+             << "lunarg_api_dump.no_addr = false\n";
+    settings.close();
+
+    setenv("VK_LAYER_SETTINGS_PATH", settings_path.c_str(), 1);
+    const char *overrides[] = {"VK_APIDUMP_LOG_FILENAME", "VK_APIDUMP_OUTPUT_FORMAT", "VK_APIDUMP_DETAILED",
+                               "VK_APIDUMP_NO_ADDR",      "VK_APIDUMP_FLUSH",         "VK_APIDUMP_OUTPUT_RANGE"};
+    for (const char *name : overrides) unsetenv(name);
+    return true;
+}
+
+static uint64_t FileSize(const std::string &path) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) return 0;
+    return static_cast<uint64_t>(file_stat.st_size);
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (!ConfigureLayer(options)) {
+        fprintf(stderr, "Unable to write layer settings next to %s\n", options.output.c_str());
+        return 1;
+    }
+
+    void *layer = dlopen(options.layer_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (layer == nullptr) {
+        fprintf(stderr, "Unable to load %s: %s\n", options.layer_path.c_str(), dlerror());
+        return 1;
+    }
+
+    LayerFunctions vk = {};
+    vk.GetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(dlsym(layer, "vkGetInstanceProcAddr"));
+    vk.GetDeviceProcAddr = reinterpret_cast<PFN_vkGetDeviceProcAddr>(dlsym(layer, "vkGetDeviceProcAddr"));
+    vk.CreateInstance = reinterpret_cast<PFN_vkCreateInstance>(dlsym(layer, "vkCreateInstance"));
+    if (vk.GetInstanceProcAddr == nullptr || vk.GetDeviceProcAddr == nullptr || vk.CreateInstance == nullptr) {
+        fprintf(stderr, "%s does not export the layer entrypoints\n", options.layer_path.c_str());
+        return 1;
+    }
+
+    // Create the instance and device the same way the loader does, with the stub as the next link.
+    VkLayerInstanceLink instance_link = {};
+    instance_link.pfnNextGetInstanceProcAddr = StubGetInstanceProcAddr;
+    instance_link.pfnNextGetPhysicalDeviceProcAddr = nullptr;
+    VkLayerInstanceCreateInfo instance_chain = {};
+    instance_chain.sType = VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO;
+    instance_chain.function = VK_LAYER_LINK_INFO;
+    instance_chain.u.pLayerInfo = &instance_link;
+    VkApplicationInfo app_info = {VK_STRUCTURE_TYPE_APPLICATION_INFO, nullptr, "apidump_benchmark", 1, "none", 0,
+                                  VK_API_VERSION_1_1};
+    VkInstanceCreateInfo instance_info = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, &instance_chain, 0, &app_info};
+    VkInstance instance = VK_NULL_HANDLE;
+    if (vk.CreateInstance(&instance_info, nullptr, &instance) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateInstance failed\n");
+        return 1;
+    }
+
+#define LOAD_INSTANCE_FUNCTION(name) vk.name = reinterpret_cast<PFN_vk##name>(vk.GetInstanceProcAddr(instance, "vk" #name))
+    LOAD_INSTANCE_FUNCTION(DestroyInstance);
+    LOAD_INSTANCE_FUNCTION(EnumeratePhysicalDevices);
+    LOAD_INSTANCE_FUNCTION(CreateDevice);
+#undef LOAD_INSTANCE_FUNCTION
+
+    uint32_t physical_device_count = 1;
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    vk.EnumeratePhysicalDevices(instance, &physical_device_count, &physical_device);
+
+    VkLayerDeviceLink device_link = {};
+    device_link.pfnNextGetInstanceProcAddr = StubGetInstanceProcAddr;
+    device_link.pfnNextGetDeviceProcAddr = StubGetDeviceProcAddr;
+    VkLayerDeviceCreateInfo device_chain = {};
+    device_chain.sType = VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO;
+    device_chain.function = VK_LAYER_LINK_INFO;
+    device_chain.u.pLayerInfo = &device_link;
+    const std::vector<float> queue_priorities(options.threads, 1.0f);
+    VkDeviceQueueCreateInfo queue_info = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, nullptr, 0, 0, options.threads,
+                                          queue_priorities.data()};
+    VkDeviceCreateInfo device_info = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO, &device_chain, 0, 1, &queue_info};
+    VkDevice device = VK_NULL_HANDLE;
+    if (vk.CreateDevice(physical_device, &device_info, nullptr, &device) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateDevice failed\n");
+        return 1;
+    }
+
+#define LOAD_DEVICE_FUNCTION(name) vk.name = reinterpret_cast<PFN_vk##name>(vk.GetDeviceProcAddr(device, "vk" #name))
+    LOAD_DEVICE_FUNCTION(DestroyDevice);
+    LOAD_DEVICE_FUNCTION(GetDeviceQueue);
+    LOAD_DEVICE_FUNCTION(CreateCommandPool);
+    LOAD_DEVICE_FUNCTION(DestroyCommandPool);
+    LOAD_DEVICE_FUNCTION(AllocateCommandBuffers);
+    LOAD_DEVICE_FUNCTION(FreeCommandBuffers);
+    LOAD_DEVICE_FUNCTION(AcquireNextImageKHR);
+    LOAD_DEVICE_FUNCTION(WaitForFences);
+    LOAD_DEVICE_FUNCTION(ResetFences);
+    LOAD_DEVICE_FUNCTION(ResetCommandPool);
+    LOAD_DEVICE_FUNCTION(UpdateDescriptorSets);
+    LOAD_DEVICE_FUNCTION(BeginCommandBuffer);
+    LOAD_DEVICE_FUNCTION(EndCommandBuffer);
+    LOAD_DEVICE_FUNCTION(CmdPipelineBarrier);
+    LOAD_DEVICE_FUNCTION(CmdBeginRenderPass);
+    LOAD_DEVICE_FUNCTION(CmdEndRenderPass);
+    LOAD_DEVICE_FUNCTION(CmdSetViewport);
+    LOAD_DEVICE_FUNCTION(CmdSetScissor);
+    LOAD_DEVICE_FUNCTION(CmdBindPipeline);
+    LOAD_DEVICE_FUNCTION(CmdBindDescriptorSets);
+    LOAD_DEVICE_FUNCTION(CmdPushConstants);
+    LOAD_DEVICE_FUNCTION(CmdBindVertexBuffers);
+    LOAD_DEVICE_FUNCTION(CmdBindIndexBuffer);
+    LOAD_DEVICE_FUNCTION(CmdDrawIndexed);
+    LOAD_DEVICE_FUNCTION(QueueSubmit);
+    LOAD_DEVICE_FUNCTION(QueuePresentKHR);
+#undef LOAD_DEVICE_FUNCTION
+
+    std::vector<ThreadContext> contexts(options.threads);
+    for (uint32_t t = 0; t < options.threads; ++t) {
+        ThreadContext &ctx = contexts[t];
+        ctx.device = device;
+        ctx.handle_base = static_cast<uint64_t>(t) << 16;
+        vk.GetDeviceQueue(device, 0, t, &ctx.queue);
+        VkCommandPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr, 0, 0};
+        vk.CreateCommandPool(device, &pool_info, nullptr, &ctx.command_pool);
+        VkCommandBufferAllocateInfo allocate_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, ctx.command_pool,
+                                                     VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+        vk.AllocateCommandBuffers(device, &allocate_info, &ctx.command_buffer);
+    }
+
+    bool within_budget = true;
+    printf("%-6s %-6s %8s %12s %10s %10s\n", "format", "flush", "threads", "calls", "ns/call", "MB/s");
+    for (uint32_t thread_count = 1; thread_count <= options.threads; ++thread_count) {
+        std::atomic<uint64_t> total_calls(0);
+        const uint64_t size_before = FileSize(options.output);
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t]() {
+                uint64_t calls = 0;
+                for (uint32_t frame = 0; frame < options.frames; ++frame) {
+                    calls += RunFrame(vk, contexts[t], options.draws_per_frame);
+                }
+                total_calls += calls;
+            });
+        }
+        for (auto &thread : threads) thread.join();
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const uint64_t bytes = FileSize(options.output) - size_before;
+        const double ns_per_call = elapsed.count() * 1e9 / static_cast<double>(total_calls.load());
+        const double mb_per_second = static_cast<double>(bytes) / 1e6 / elapsed.count();
+        printf("%-6s %-6s %8u %12llu %10.1f %10.1f\n", options.format.c_str(), options.flush.c_str(), thread_count,
+               static_cast<unsigned long long>(total_calls.load()), ns_per_call, mb_per_second);
+
+        if (options.max_ns_per_call > 0.0 && ns_per_call > options.max_ns_per_call) within_budget = false;
+    }
+
+    for (auto &ctx : contexts) {
+        vk.FreeCommandBuffers(device, ctx.command_pool, 1, &ctx.command_buffer);
+        vk.DestroyCommandPool(device, ctx.command_pool, nullptr);
+    }
+    vk.DestroyDevice(device, nullptr);
+    vk.DestroyInstance(instance, nullptr);
+
+    if (!within_budget) {
+        fprintf(stderr, "Per-call overhead exceeded %.1f ns\n", options.max_ns_per_call);
+        return 1;
+    }
+    return 0;
+}
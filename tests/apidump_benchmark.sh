@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# apidump_benchmark.sh
+# This script measures the per-call overhead of the api_dump layer for every output format and
+# flush setting. It runs apidump_benchmark, which drives the layer with a stub driver underneath,
+# so no GPU or ICD is needed. The layer library defaults to the one in this build tree and can be
+# given with -l or --layer. The number of recording threads can be given with -n or --threads.
+# If --max-ns-per-call is given, the script fails when any run is slower than that.
+
+# Track unrecognized arguments.
+UNRECOGNIZED=()
+THREADS=4
+MAX_NS_PER_CALL=0
+
+# Parse the command-line arguments.
+while [[ $# -gt 0 ]]
+do
+   KEY="$1"
+   case $KEY in
+      -l|--layer)
+      LAYER="$2"
+      shift
+      shift
+      ;;
+      -n|--threads)
+      THREADS="$2"
+      shift
+      shift
+      ;;
+      --max-ns-per-call)
+      MAX_NS_PER_CALL="$2"
+      shift
+      shift
+      ;;
+      *)
+      UNRECOGNIZED+=("$1")
+      shift
+      ;;
+   esac
+done
+
+# Reject unrecognized arguments.
+if [[ ${#UNRECOGNIZED[@]} -ne 0 ]]; then
+   echo "ERROR: $0:$LINENO"
+   echo "Unrecognized command-line arguments: ${UNRECOGNIZED[*]}"
+   exit 1
+fi
+
+if [ -t 1 ] ; then
+    RED='\033[0;31m'
+    GREEN='\033[0;32m'
+    NC='\033[0m' # No Color
+else
+    RED=''
+    GREEN=''
+    NC=''
+fi
+
+pushd $(dirname "${BASH_SOURCE[0]}") > /dev/null
+
+if [ -z ${LAYER+x} ]; then
+   LAYER="$(pwd)/../layersvt/libVkLayer_api_dump.so"
+fi
+
+printf "$GREEN[ RUN      ]$NC $0\n"
+
+RESULT=0
+for FORMAT in text html json
+do
+    for FLUSH in true false
+    do
+        ./apidump_benchmark --layer "$LAYER" --format $FORMAT --flush $FLUSH --threads $THREADS \
+            --output apidump_benchmark.tmp --max-ns-per-call $MAX_NS_PER_CALL
+        if [ $? -ne 0 ]; then
+            RESULT=1
+        fi
+        rm -f apidump_benchmark.tmp apidump_benchmark.tmp.settings.txt
+    done
+done
+
+if [ $RESULT -eq 0 ]; then
+    printf "$GREEN[  PASSED  ]$NC $0\n"
+else
+    printf "$RED[  FAILED  ]$NC $0\n"
+fi
+
+popd > /dev/null
+
+exit $RESULT
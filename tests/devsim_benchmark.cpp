@@ -0,0 +1,204 @@
+/* Copyright (c) 2021 The Khronos Group Inc.
+ * Copyright (c) 2021 Valve Corporation
+ * Copyright (c) 2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks and times the streaming reader of the device simulation layer on DevSim configuration
+ * files given on the command line.
+ *
+ * Each file is read with devsim::ReadDocument(), and when jsoncpp is available also parsed into a
+ * jsoncpp document, which is what the layer used to do. The values of both are compared for the
+ * device name, API version and the lengths of the arrays, then both are timed. The jsoncpp time
+ * includes a walk over the document that visits every value, as the layer looked up every field
+ * of the document by name.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "device_simulation_json.h"
+
+#ifdef DEVSIM_BENCHMARK_JSONCPP
+#include <json/json.h>
+#endif
+
+struct Options {
+    uint32_t iterations = 200;
+    std::vector<std::string> filenames;
+};
+
+static void PrintUsage(const char *argv0) {
+    printf(
+        "Usage: %s [options] <file>...\n"
+        "  --iterations <N>   Times each file is read (default 200)\n",
+        argv0);
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--iterations") {
+            if (i + 1 >= argc) return false;
+            options.iterations = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return false;
+        } else {
+            options.filenames.push_back(arg);
+        }
+    }
+    return !options.filenames.empty();
+}
+
+static bool ReadFile(const std::string &filename, std::string &text) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+#ifdef DEVSIM_BENCHMARK_JSONCPP
+// Visits every value of a document and returns how many there are.
+static size_t WalkValue(const Json::Value &value) {
+    size_t count = 1;
+    if (value.isObject()) {
+        for (const auto &name : value.getMemberNames()) count += WalkValue(value[name]);
+    } else if (value.isArray()) {
+        for (Json::ArrayIndex i = 0; i < value.size(); ++i) count += WalkValue(value[i]);
+    }
+    return count;
+}
+
+static int ArrayLength(const Json::Value &root, const char *name) {
+    const Json::Value &value = root[name];
+    return value.isArray() ? static_cast<int>(value.size()) : -1;
+}
+
+// Compares the values that both readers give for a few members of the document.
+static bool CheckDocument(const std::string &filename, const devsim::Document &document, const Json::Value &root) {
+    bool passed = true;
+    const Json::Value &properties = root["VkPhysicalDeviceProperties"];
+    if (properties.isObject() && properties["deviceName"].isString() &&
+        properties["deviceName"].asString().compare(0, VK_MAX_PHYSICAL_DEVICE_NAME_SIZE - 1,
+                                                    document.properties.values.deviceName) != 0) {
+        fprintf(stderr, "%s: deviceName \"%s\" instead of \"%s\"\n", filename.c_str(), document.properties.values.deviceName,
+                properties["deviceName"].asCString());
+        passed = false;
+    }
+    if (properties.isObject() && properties["apiVersion"].isUInt() &&
+        properties["apiVersion"].asUInt() != document.properties.values.apiVersion) {
+        fprintf(stderr, "%s: apiVersion %u instead of %u\n", filename.c_str(), document.properties.values.apiVersion,
+                properties["apiVersion"].asUInt());
+        passed = false;
+    }
+
+    const struct {
+        const char *name;
+        bool present;
+        size_t length;
+    } arrays[] = {
+        {"ArrayOfVkQueueFamilyProperties", document.has_queue_family_properties, document.queue_family_properties.size()},
+        {"ArrayOfVkFormatProperties", document.has_format_properties, document.format_properties.size()},
+        {"ArrayOfVkLayerProperties", document.has_layer_properties, document.layer_properties.size()},
+        {"ArrayOfVkExtensionProperties", document.has_extension_properties, document.extension_properties.size()},
+    };
+    for (const auto &array : arrays) {
+        const int expected = ArrayLength(root, array.name);
+        const int actual = array.present ? static_cast<int>(array.length) : -1;
+        if (actual != expected) {
+            fprintf(stderr, "%s: %s has %d elements instead of %d\n", filename.c_str(), array.name, actual, expected);
+            passed = false;
+        }
+    }
+    return passed;
+}
+#endif
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    bool passed = true;
+    printf("Reading DevSim files, %u iterations\n", options.iterations);
+    printf("  %-40s %8s %12s %12s %8s\n", "file", "KiB", "ms streaming", "ms jsoncpp", "speedup");
+    for (const auto &filename : options.filenames) {
+        std::string text;
+        if (!ReadFile(filename, text)) {
+            fprintf(stderr, "%s: could not be read\n", filename.c_str());
+            passed = false;
+            continue;
+        }
+
+        devsim::Document document;
+        std::string error;
+        if (!devsim::ReadDocument(text.data(), text.size(), &document, &error) || !document.has_schema) {
+            fprintf(stderr, "%s: %s\n", filename.c_str(), error.empty() ? "no $schema" : error.c_str());
+            passed = false;
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < options.iterations; ++i) {
+            devsim::Document timed;
+            devsim::ReadDocument(text.data(), text.size(), &timed, &error);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const double streaming_ms = 1e3 * elapsed.count() / options.iterations;
+
+        double jsoncpp_ms = 0.0;
+#ifdef DEVSIM_BENCHMARK_JSONCPP
+        Json::Reader reader;
+        Json::Value root;
+        if (!reader.parse(text, root, false) || !CheckDocument(filename, document, root)) {
+            fprintf(stderr, "%s: differs from jsoncpp\n", filename.c_str());
+            passed = false;
+            continue;
+        }
+
+        size_t values = 0;
+        const auto jsoncpp_start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < options.iterations; ++i) {
+            Json::Value timed;
+            reader.parse(text, timed, false);
+            values += WalkValue(timed);
+        }
+        const std::chrono::duration<double> jsoncpp_elapsed = std::chrono::steady_clock::now() - jsoncpp_start;
+        jsoncpp_ms = 1e3 * jsoncpp_elapsed.count() / options.iterations;
+        if (values == 0) passed = false;
+#endif
+
+        std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+        if (name.size() > 40) name = name.substr(0, 37) + "...";
+        if (jsoncpp_ms > 0.0) {
+            printf("  %-40s %8.1f %12.3f %12.3f %7.1fx\n", name.c_str(), text.size() / 1024.0, streaming_ms, jsoncpp_ms,
+                   jsoncpp_ms / streaming_ms);
+        } else {
+            printf("  %-40s %8.1f %12.3f %12s %8s\n", name.c_str(), text.size() / 1024.0, streaming_ms, "-", "-");
+        }
+    }
+
+    printf(passed ? "PASSED\n" : "FAILED\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,549 @@
+/* Copyright (c) 2021 The Khronos Group Inc.
+ * Copyright (c) 2021 Valve Corporation
+ * Copyright (c) 2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks and times the pixel conversions and image encoders of the screenshot layer, on synthetic
+ * buffers so that no GPU is needed.
+ *
+ * Every row converter the CPU supports, for 8-bit, 10-bit and half float captures, is first
+ * compared with the scalar one over a range of row widths, so that the vector loops and their tails
+ * are both covered, then each one converts a synthetic 4K image repeatedly and its throughput is
+ * reported. The scalar converters are also checked against known values.
+ *
+ * The PNG and QOI encoders are checked by decoding their output, including 16-bit PNG files, then timed on a synthetic image
+ * with smooth gradients and flat areas, which compresses roughly like a rendered frame. Each is
+ * timed on one thread and with bands of the image encoded on a pool of threads.
+ *
+ * The frame hashes are checked against the reference xxHash64 values and for tile changes, then
+ * timed on the same image.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "screenshot_convert.h"
+#include "screenshot_encode.h"
+#include "screenshot_hash.h"
+
+#ifdef SCREENSHOT_USE_ZLIB
+#include <zlib.h>
+#endif
+
+struct Options {
+    uint32_t width = 3840;
+    uint32_t height = 2160;
+    uint32_t iterations = 20;
+    int level = 1;
+    uint32_t threads = 0;
+};
+
+static void PrintUsage(const char *argv0) {
+    printf(
+        "Usage: %s [options]\n"
+        "  --width <N>        Width of the timed image (default 3840)\n"
+        "  --height <N>       Height of the timed image (default 2160)\n"
+        "  --iterations <N>   Times each converter or encoder processes the image (default 20)\n"
+        "  --level <N>        PNG compression level (default 1)\n"
+        "  --threads <N>      Threads that encode bands of the image in parallel (default: one per core)\n",
+        argv0);
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char *value = argv[++i];
+        if (arg == "--width") {
+            options.width = static_cast<uint32_t>(std::max(1, atoi(value)));
+        } else if (arg == "--height") {
+            options.height = static_cast<uint32_t>(std::max(1, atoi(value)));
+        } else if (arg == "--iterations") {
+            options.iterations = static_cast<uint32_t>(std::max(1, atoi(value)));
+        } else if (arg == "--level") {
+            options.level = std::min(std::max(atoi(value), 0), 9);
+        } else if (arg == "--threads") {
+            options.threads = static_cast<uint32_t>(std::max(0, atoi(value)));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void FillSynthetic(std::vector<uint8_t> &buffer) {
+    uint32_t state = 0x12345678u;
+    for (uint8_t &byte : buffer) {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(state >> 24);
+    }
+}
+
+static const char *const conversionNames[screenshot::ROW_CONVERSION_COUNT] = {
+    "RGBA8 to RGB8", "RGB10A2 to RGB8", "RGB10A2 to RGB16", "RGBA16F to RGB8", "RGBA16F to RGB16"};
+
+// Compare a converter with the reference for every width up to a few vector
+// iterations, with the source and destination at unaligned offsets.  Guard
+// bytes after the destination catch writes past the end of the row.
+static bool CheckConverter(screenshot::RowConversion conversion, const screenshot::RowConverter &converter,
+                           const screenshot::RowConverter &reference) {
+    const uint32_t max_width = 131;
+    const size_t guard = 64;
+    const size_t src_size = screenshot::getRowConversionSourceSize(conversion);
+    const size_t dst_size = screenshot::getRowConversionDestSize(conversion);
+    std::vector<uint8_t> src(src_size * max_width + 1);
+    FillSynthetic(src);
+    for (int swap = 0; swap < 2; ++swap) {
+        for (uint32_t width = 0; width <= max_width; ++width) {
+            std::vector<uint8_t> expected(dst_size * max_width + guard + 1, 0xcd);
+            std::vector<uint8_t> actual(dst_size * max_width + guard + 1, 0xcd);
+            reference.convert(src.data() + 1, expected.data() + 1, width, swap != 0);
+            converter.convert(src.data() + 1, actual.data() + 1, width, swap != 0);
+            if (expected != actual) {
+                fprintf(stderr, "%s %s differs from %s for width %u%s\n", conversionNames[conversion], converter.name,
+                        reference.name, width, swap ? " with red and blue swapped" : "");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Converts single pixels with the scalar converters and compares them with
+// values computed by hand.
+static bool CheckConversionValues() {
+    static const struct {
+        screenshot::RowConversion conversion;
+        uint8_t src[8];
+        bool swap;
+        uint8_t expected[6];
+    } cases[] = {
+        // R = 1023, G = 512, B = 3, A = 3.
+        {screenshot::ROW_CONVERSION_RGB10A2_TO_RGB8, {0xff, 0x03, 0x38, 0xc0}, false, {255, 128, 0}},
+        {screenshot::ROW_CONVERSION_RGB10A2_TO_RGB8, {0xff, 0x03, 0x38, 0xc0}, true, {0, 128, 255}},
+        {screenshot::ROW_CONVERSION_RGB10A2_TO_RGB16, {0xff, 0x03, 0x38, 0xc0}, false, {0xff, 0xff, 0x80, 0x20, 0x00, 0xc0}},
+        {screenshot::ROW_CONVERSION_RGB10A2_TO_RGB16, {0xff, 0x03, 0x38, 0xc0}, true, {0x00, 0xc0, 0x80, 0x20, 0xff, 0xff}},
+        // 1.0, 0.5 and 0.0, which encode to sRGB 1.0, 0.735 and 0.0.
+        {screenshot::ROW_CONVERSION_RGBA16F_TO_RGB16, {0x00, 0x3c, 0x00, 0x38, 0x00, 0x00, 0x00, 0x3c}, false,
+         {0xff, 0xff, 0xbc, 0x40, 0x00, 0x00}},
+        // Values up to 0.8 are not tone mapped, 1.0 is.
+        {screenshot::ROW_CONVERSION_RGBA16F_TO_RGB8, {0x00, 0x3c, 0x00, 0x38, 0x00, 0x00, 0x00, 0x3c}, false, {243, 188, 0}},
+        // 2.0 is clamped to 1.0, -1.0 and NaN are 0 and infinity is 1.0.
+        {screenshot::ROW_CONVERSION_RGBA16F_TO_RGB16, {0x00, 0x40, 0x00, 0xbc, 0x01, 0x7e, 0x00, 0x3c}, false,
+         {0xff, 0xff, 0x00, 0x00, 0x00, 0x00}},
+        {screenshot::ROW_CONVERSION_RGBA16F_TO_RGB8, {0x00, 0x7c, 0x00, 0xbc, 0x01, 0x7e, 0x00, 0x3c}, false, {255, 0, 0}},
+    };
+    bool passed = true;
+    for (const auto &test : cases) {
+        uint8_t actual[6] = {};
+        screenshot::getRowConverters(test.conversion).front().convert(test.src, actual, 1, test.swap);
+        if (memcmp(actual, test.expected, screenshot::getRowConversionDestSize(test.conversion)) != 0) {
+            fprintf(stderr, "%s does not convert a pixel to the expected value\n", conversionNames[test.conversion]);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+static uint32_t ReadU32BE(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+// Decodes the PNG files the layer writes: 8-bit or 16-bit RGB, with rows filtered with None or Up.
+static bool DecodePNG(const std::vector<uint8_t> &file, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgb) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (file.size() < 8 || memcmp(file.data(), signature, 8) != 0) return false;
+    std::vector<uint8_t> compressed;
+    uint32_t bytes_per_channel = 1;
+    size_t offset = 8;
+    bool ended = false;
+    while (!ended && offset + 12 <= file.size()) {
+        const uint32_t length = ReadU32BE(&file[offset]);
+        const std::string type(reinterpret_cast<const char *>(&file[offset + 4]), 4);
+        const uint8_t *data = &file[offset + 8];
+        if (offset + 12 + length > file.size()) return false;
+        if (type == "IHDR") {
+            width = ReadU32BE(data);
+            height = ReadU32BE(data + 4);
+            if ((data[8] != 8 && data[8] != 16) || data[9] != 2) return false;
+            bytes_per_channel = data[8] / 8;
+        } else if (type == "IDAT") {
+            compressed.insert(compressed.end(), data, data + length);
+        } else if (type == "IEND") {
+            ended = true;
+        }
+        offset += 12 + length;
+    }
+    if (!ended) return false;
+
+    const size_t stride = 3 * static_cast<size_t>(width) * bytes_per_channel;
+    std::vector<uint8_t> filtered((stride + 1) * height);
+#ifdef SCREENSHOT_USE_ZLIB
+    uLongf size = static_cast<uLongf>(filtered.size());
+    if (uncompress(filtered.data(), &size, compressed.data(), static_cast<uLong>(compressed.size())) != Z_OK ||
+        size != filtered.size()) {
+        return false;
+    }
+#else
+    // Without zlib the layer only writes stored blocks.
+    size_t in = 2, out = 0;
+    for (;;) {
+        if (in + 5 > compressed.size()) return false;
+        const bool last = (compressed[in] & 1) != 0;
+        const size_t length = compressed[in + 1] | compressed[in + 2] << 8;
+        in += 5;
+        if (out + length > filtered.size() || in + length > compressed.size()) return false;
+        memcpy(&filtered[out], &compressed[in], length);
+        in += length;
+        out += length;
+        if (last) break;
+    }
+    if (out != filtered.size()) return false;
+#endif
+
+    rgb.resize(stride * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t filter = filtered[y * (stride + 1)];
+        const uint8_t *src = &filtered[y * (stride + 1) + 1];
+        uint8_t *row = &rgb[y * stride];
+        for (size_t i = 0; i < stride; ++i) {
+            if (filter == 0) {
+                row[i] = src[i];
+            } else if (filter == 2) {
+                row[i] = static_cast<uint8_t>(src[i] + (y > 0 ? row[i - stride] : 0));
+            } else {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Decodes QOI files following the specification, independently of the encoder.
+static bool DecodeQOI(const std::vector<uint8_t> &file, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgb) {
+    if (file.size() < 22 || memcmp(file.data(), "qoif", 4) != 0) return false;
+    width = ReadU32BE(&file[4]);
+    height = ReadU32BE(&file[8]);
+    const size_t count = static_cast<size_t>(width) * height;
+    rgb.clear();
+    rgb.reserve(3 * count);
+
+    uint8_t index[64][4] = {};
+    uint8_t px[4] = {0, 0, 0, 255};
+    size_t in = 14;
+    const size_t end = file.size() - 8;
+    while (rgb.size() < 3 * count) {
+        if (in >= end) return false;
+        const uint8_t op = file[in++];
+        int run = 1;
+        if (op == 0xfe) {
+            memcpy(px, &file[in], 3);
+            in += 3;
+        } else if (op == 0xff) {
+            memcpy(px, &file[in], 4);
+            in += 4;
+        } else if ((op & 0xc0) == 0x00) {
+            memcpy(px, index[op], 4);
+        } else if ((op & 0xc0) == 0x40) {
+            px[0] += ((op >> 4) & 3) - 2;
+            px[1] += ((op >> 2) & 3) - 2;
+            px[2] += (op & 3) - 2;
+        } else if ((op & 0xc0) == 0x80) {
+            const int vg = (op & 0x3f) - 32;
+            const uint8_t next = file[in++];
+            px[0] += vg - 8 + ((next >> 4) & 0x0f);
+            px[1] += vg;
+            px[2] += vg - 8 + (next & 0x0f);
+        } else {
+            run = (op & 0x3f) + 1;
+        }
+        memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+        for (int i = 0; i < run; ++i) rgb.insert(rgb.end(), px, px + 3);
+    }
+    static const uint8_t padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    return rgb.size() == 3 * count && in == end && memcmp(&file[end], padding, 8) == 0;
+}
+
+// An image with gradients, flat areas, repeated colors and some noise, so
+// that every encoder operation is used.
+static void FillFrame(std::vector<uint8_t> &rgb, uint32_t width, uint32_t height) {
+    uint32_t state = 0x9e3779b9u;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t *px = &rgb[3 * (static_cast<size_t>(y) * width + x)];
+            state = state * 1664525u + 1013904223u;
+            if (y < height / 4) {
+                px[0] = px[1] = px[2] = 40;
+            } else if (x < width / 2) {
+                px[0] = static_cast<uint8_t>(x * 255 / width);
+                px[1] = static_cast<uint8_t>(y * 255 / height);
+                px[2] = static_cast<uint8_t>((x + y) / 8 % 2 ? 200 : 30);
+            } else {
+                const uint8_t noise = static_cast<uint8_t>(state >> 28);
+                px[0] = static_cast<uint8_t>(x / 3 + noise);
+                px[1] = static_cast<uint8_t>(px[0] / 2 + noise * 3);
+                px[2] = static_cast<uint8_t>(state >> 24);
+            }
+        }
+    }
+}
+
+typedef bool (*DecodeFunction)(const std::vector<uint8_t> &, uint32_t &, uint32_t &, std::vector<uint8_t> &);
+
+static void Encode(screenshot::ImageFileFormat format, const std::vector<uint8_t> &rgb, uint32_t width, uint32_t height,
+                   int level, screenshot::BandPool *pool, std::vector<uint8_t> &encoded) {
+    encoded.clear();
+    if (format == screenshot::IMAGE_FILE_FORMAT_PNG)
+        screenshot::encodePNG(rgb.data(), width, height, 8, level, encoded, pool);
+    else
+        screenshot::encodeQOI(rgb.data(), width, height, encoded, pool);
+}
+
+// Encode images with and without bands, and decode them.  The tall images are
+// split into several bands, and the flat ones have runs that cross bands.  QOI
+// files must be the same whether they are encoded in bands or not.
+static bool CheckEncoder(const char *name, screenshot::ImageFileFormat format, DecodeFunction decode, int level,
+                         screenshot::BandPool &pool) {
+    static const struct {
+        uint32_t width;
+        uint32_t height;
+        int fill;  // -1 for FillFrame, or the value of every byte
+    } images[] = {{1, 1, -1}, {7, 3, -1}, {64, 64, -1}, {333, 17, -1}, {1000, 70, -1},
+                  {200, 300, -1}, {31, 500, 0}, {31, 500, 77}};
+    for (const auto &image : images) {
+        std::vector<uint8_t> rgb(3 * image.width * image.height);
+        if (image.fill < 0)
+            FillFrame(rgb, image.width, image.height);
+        else
+            std::fill(rgb.begin(), rgb.end(), static_cast<uint8_t>(image.fill));
+        std::vector<uint8_t> serial, banded;
+        Encode(format, rgb, image.width, image.height, level, nullptr, serial);
+        Encode(format, rgb, image.width, image.height, level, &pool, banded);
+        for (const std::vector<uint8_t> *encoded : {&serial, &banded}) {
+            uint32_t width = 0, height = 0;
+            std::vector<uint8_t> decoded;
+            if (!decode(*encoded, width, height, decoded) || width != image.width || height != image.height || decoded != rgb) {
+                fprintf(stderr, "%s%s does not decode to the original %ux%u image\n", name,
+                        encoded == &banded ? " in bands" : "", image.width, image.height);
+                return false;
+            }
+        }
+        if (format == screenshot::IMAGE_FILE_FORMAT_QOI && banded != serial) {
+            fprintf(stderr, "%s in bands differs from the serial encoding of the %ux%u image\n", name, image.width,
+                    image.height);
+            return false;
+        }
+    }
+    return true;
+}
+
+// 16-bit PNG files hold the big-endian rows of the RGB16 conversions as they are.
+static bool CheckPNG16(int level, screenshot::BandPool &pool) {
+    const uint32_t width = 123, height = 200;
+    std::vector<uint8_t> rgb(6 * width * height);
+    FillSynthetic(rgb);
+    for (screenshot::BandPool *encodePool : {static_cast<screenshot::BandPool *>(nullptr), &pool}) {
+        std::vector<uint8_t> encoded, decoded;
+        screenshot::encodePNG(rgb.data(), width, height, 16, level, encoded, encodePool);
+        uint32_t decoded_width = 0, decoded_height = 0;
+        if (encoded.size() < 25 || encoded[24] != 16 || !DecodePNG(encoded, decoded_width, decoded_height, decoded) ||
+            decoded_width != width || decoded_height != height || decoded != rgb) {
+            fprintf(stderr, "16-bit PNG%s does not decode to the original %ux%u image\n", encodePool ? " in bands" : "", width,
+                    height);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool CheckYUV() {
+    // White, black, red, green and blue, and their BT.601 limited-range values.
+    static const uint8_t rgb[] = {255, 255, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255};
+    static const uint8_t expected[3][5] = {{235, 16, 82, 144, 41}, {128, 128, 90, 54, 240}, {128, 128, 240, 34, 110}};
+    uint8_t yuv[3][5];
+    screenshot::convertRowRGBToYUV444(rgb, yuv[0], yuv[1], yuv[2], 5);
+    if (memcmp(yuv, expected, sizeof(yuv)) != 0) {
+        fprintf(stderr, "RGB to YUV 4:4:4 does not match the BT.601 values\n");
+        return false;
+    }
+    return true;
+}
+
+static bool CheckHash() {
+    // Reference values of the xxHash64 specification, with a seed of 0.
+    static const struct {
+        const char *text;
+        uint64_t hash;
+    } references[] = {{"", 0xef46db3751d8e999ULL},
+                      {"abc", 0x44bc2cf5ad770999ULL},
+                      {"Nobody inspects the spammish repetition", 0xfbcea83c8a378bf1ULL}};
+    bool passed = true;
+    for (const auto &reference : references) {
+        if (screenshot::xxHash64(reference.text, strlen(reference.text)) != reference.hash) {
+            fprintf(stderr, "xxHash64 of \"%s\" does not match the reference\n", reference.text);
+            passed = false;
+        }
+    }
+
+    // Hashing in pieces of every size up to two stripes gives the same hash.
+    std::vector<uint8_t> data(1000);
+    FillSynthetic(data);
+    const uint64_t expected = screenshot::xxHash64(data.data(), data.size());
+    for (size_t piece = 1; piece <= 64; ++piece) {
+        screenshot::XXHash64 hasher;
+        for (size_t offset = 0; offset < data.size(); offset += piece) {
+            hasher.update(&data[offset], std::min(piece, data.size() - offset));
+        }
+        if (hasher.digest() != expected) {
+            fprintf(stderr, "xxHash64 in pieces of %zu bytes does not match\n", piece);
+            passed = false;
+        }
+    }
+
+    // Changing one pixel changes the frame hash and exactly one tile hash, and the
+    // log line reads back as written.
+    const uint32_t width = 333, height = 17, tiles = 4;
+    std::vector<uint8_t> rgb(3 * width * height);
+    FillFrame(rgb, width, height);
+    screenshot::FrameHash before, after, parsed;
+    screenshot::hashImageRGB(rgb.data(), width, height, tiles, before);
+    // The frame is hashed a row at a time, with the hash of the whole image.
+    if (before.hash != screenshot::xxHash64(rgb.data(), rgb.size())) {
+        fprintf(stderr, "Frame hash does not match the hash of the image\n");
+        passed = false;
+    }
+    rgb[3 * (10 * width + 200) + 1] ^= 1;
+    screenshot::hashImageRGB(rgb.data(), width, height, tiles, after);
+    if (before.tiles.size() != tiles * tiles || before.hash == after.hash ||
+        screenshot::countChangedTiles(before, after) != 1) {
+        fprintf(stderr, "Frame hash tiles do not track a changed pixel\n");
+        passed = false;
+    }
+    int frameNumber = -1;
+    if (!screenshot::parseFrameHash(screenshot::formatFrameHash(42, after).c_str(), frameNumber, parsed) ||
+        frameNumber != 42 || screenshot::countChangedTiles(after, parsed) != 0 || parsed.hash != after.hash) {
+        fprintf(stderr, "Frame hash log line does not read back\n");
+        passed = false;
+    }
+    return passed;
+}
+
+static double TimeConverter(screenshot::RowConversion conversion, const screenshot::RowConverter &converter,
+                            const Options &options, const std::vector<uint8_t> &src, std::vector<uint8_t> &dst) {
+    const size_t src_stride = screenshot::getRowConversionSourceSize(conversion) * static_cast<size_t>(options.width);
+    const size_t dst_stride = screenshot::getRowConversionDestSize(conversion) * static_cast<size_t>(options.width);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < options.iterations; ++i) {
+        const uint8_t *row = src.data();
+        uint8_t *out = dst.data();
+        for (uint32_t y = 0; y < options.height; ++y) {
+            converter.convert(row, out, options.width, (i & 1) != 0);
+            row += src_stride;
+            out += dst_stride;
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    bool passed = CheckConversionValues();
+    const size_t pixels = static_cast<size_t>(options.width) * options.height;
+    for (int i = 0; i < screenshot::ROW_CONVERSION_COUNT; ++i) {
+        const screenshot::RowConversion conversion = static_cast<screenshot::RowConversion>(i);
+        const std::vector<screenshot::RowConverter> converters = screenshot::getRowConverters(conversion);
+        for (const screenshot::RowConverter &converter : converters) {
+            passed = CheckConverter(conversion, converter, converters.front()) && passed;
+        }
+
+        std::vector<uint8_t> src(screenshot::getRowConversionSourceSize(conversion) * pixels);
+        std::vector<uint8_t> dst(screenshot::getRowConversionDestSize(conversion) * pixels);
+        FillSynthetic(src);
+        printf("%s, %ux%u, %u iterations\n", conversionNames[conversion], options.width, options.height, options.iterations);
+        for (const screenshot::RowConverter &converter : converters) {
+            const double seconds = TimeConverter(conversion, converter, options, src, dst);
+            const double megapixels = static_cast<double>(pixels) * options.iterations / 1e6;
+            printf("  %-8s %8.2f ms/image %10.1f Mpixel/s\n", converter.name, 1e3 * seconds / options.iterations,
+                   megapixels / seconds);
+        }
+    }
+
+    passed = CheckYUV() && passed;
+    // The checks use several threads even on a single core, so that bands are
+    // always covered.
+    screenshot::BandPool checkPool(4);
+    passed = CheckEncoder("PNG", screenshot::IMAGE_FILE_FORMAT_PNG, DecodePNG, 0, checkPool) && passed;
+    passed = CheckEncoder("PNG", screenshot::IMAGE_FILE_FORMAT_PNG, DecodePNG, options.level, checkPool) && passed;
+    passed = CheckEncoder("QOI", screenshot::IMAGE_FILE_FORMAT_QOI, DecodeQOI, 0, checkPool) && passed;
+    passed = CheckPNG16(options.level, checkPool) && passed;
+    checkPool.stop();
+
+    std::vector<uint8_t> frame(3 * pixels);
+    FillFrame(frame, options.width, options.height);
+    screenshot::BandPool pool(options.threads);
+    printf("Encoding, %ux%u, %u iterations\n", options.width, options.height, options.iterations);
+    printf("  %-8s %8s %8s %10s %10s\n", "format", "threads", "ms/image", "Mpixel/s", "ratio");
+    for (int format = screenshot::IMAGE_FILE_FORMAT_PNG; format <= screenshot::IMAGE_FILE_FORMAT_QOI; ++format) {
+        for (screenshot::BandPool *encodePool : {static_cast<screenshot::BandPool *>(nullptr), &pool}) {
+            std::vector<uint8_t> encoded;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < options.iterations; ++i) {
+                Encode(static_cast<screenshot::ImageFileFormat>(format), frame, options.width, options.height, options.level,
+                       encodePool, encoded);
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            const double seconds = elapsed.count();
+            const double megapixels = static_cast<double>(pixels) * options.iterations / 1e6;
+            printf("  %-8s %8u %8.2f %10.1f %10.3f\n", format == screenshot::IMAGE_FILE_FORMAT_PNG ? "png" : "qoi",
+                   encodePool ? encodePool->getThreadCount() : 1, 1e3 * seconds / options.iterations, megapixels / seconds,
+                   static_cast<double>(encoded.size()) / frame.size());
+        }
+    }
+    pool.stop();
+
+    passed = CheckHash() && passed;
+
+    printf("Hashing, %ux%u, %u iterations\n", options.width, options.height, options.iterations);
+    printf("  %-8s %8s %10s\n", "tiles", "ms/image", "Mpixel/s");
+    for (uint32_t tiles : {0u, 8u}) {
+        screenshot::FrameHash hash;
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < options.iterations; ++i) {
+            screenshot::hashImageRGB(frame.data(), options.width, options.height, tiles, hash);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const double seconds = elapsed.count();
+        const double megapixels = static_cast<double>(pixels) * options.iterations / 1e6;
+        printf("  %-8u %8.2f %10.1f\n", tiles, 1e3 * seconds / options.iterations, megapixels / seconds);
+    }
+
+    if (!passed) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
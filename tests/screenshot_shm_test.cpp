@@ -0,0 +1,178 @@
+/* Copyright (c) 2021 The Khronos Group Inc.
+ * Copyright (c) 2021 Valve Corporation
+ * Copyright (c) 2021 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the shared memory ring that the screenshot layer exports frames through, with synthetic
+ * frames so that no GPU is needed.
+ *
+ * A few frames are first written and read back one at a time, to check the frame headers, the
+ * pixels, and that frames the writer has lapped are reported as overwritten. Then a writer thread
+ * publishes frames as fast as it can while the reader follows them, and every frame the reader
+ * gets must hold the pixels of a single frame: a torn frame means the sequence lock failed.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "screenshot_shm.h"
+
+// Every byte of a frame depends on its frame number, so that a frame mixing
+// the rows of two frames is detected.
+static uint8_t PixelValue(int32_t frameNumber, size_t offset) { return static_cast<uint8_t>(frameNumber * 31 + offset / 7); }
+
+static bool WriteFrame(screenshot::FrameRingWriter &writer, int32_t frameNumber, uint32_t width, uint32_t height) {
+    uint32_t const pitch = 3 * width;
+    uint8_t *pixels = writer.beginFrame(frameNumber, width, height, screenshot::FRAME_FORMAT_RGB8, pitch);
+    if (!pixels) return false;
+    for (size_t i = 0; i < static_cast<size_t>(pitch) * height; i++) pixels[i] = PixelValue(frameNumber, i);
+    writer.publishFrame();
+    return true;
+}
+
+static bool CheckFrame(const screenshot::FrameInfo &info, const std::vector<uint8_t> &pixels, uint32_t width, uint32_t height) {
+    if (info.width != width || info.height != height || info.pitch != 3 * width ||
+        info.format != screenshot::FRAME_FORMAT_RGB8 || pixels.size() != static_cast<size_t>(info.pitch) * height) {
+        return false;
+    }
+    for (size_t i = 0; i < pixels.size(); i++) {
+        if (pixels[i] != PixelValue(info.frameNumber, i)) return false;
+    }
+    return true;
+}
+
+static bool CheckSequential(const char *name) {
+    const uint32_t width = 64, height = 48, slots = 3;
+    screenshot::FrameRingWriter writer;
+    if (!writer.create(name, slots, 3 * width * height)) {
+        printf("FAILED: could not create the ring %s\n", name);
+        return false;
+    }
+    screenshot::FrameRingReader reader;
+    if (!reader.open(name) || reader.getSlotCount() != slots || reader.getFrameCount() != 0) {
+        printf("FAILED: could not open the ring %s\n", name);
+        return false;
+    }
+
+    bool passed = true;
+    screenshot::FrameInfo info;
+    std::vector<uint8_t> pixels;
+    if (reader.read(0, info, pixels) != screenshot::FRAME_NOT_READY) {
+        printf("FAILED: a frame was read from an empty ring\n");
+        passed = false;
+    }
+    if (WriteFrame(writer, 100, width + 1, height)) {
+        printf("FAILED: a frame larger than the ring was written\n");
+        passed = false;
+    }
+
+    // Frames 0 and 1 are lapped by frames 3 and 4.
+    for (int32_t i = 0; i < 5; i++) WriteFrame(writer, 10 + i, width, height - i);
+    if (reader.getFrameCount() != 5) {
+        printf("FAILED: %llu frames published instead of 5\n", static_cast<unsigned long long>(reader.getFrameCount()));
+        passed = false;
+    }
+    for (uint64_t index = 0; index < 6; index++) {
+        screenshot::FrameReadResult const expected =
+            index < 2 ? screenshot::FRAME_OVERWRITTEN : index < 5 ? screenshot::FRAME_READ : screenshot::FRAME_NOT_READY;
+        screenshot::FrameReadResult const result = reader.read(index, info, pixels);
+        if (result != expected) {
+            printf("FAILED: frame %llu read with result %d instead of %d\n", static_cast<unsigned long long>(index), result,
+                   expected);
+            passed = false;
+        } else if (result == screenshot::FRAME_READ &&
+                   (info.index != index || info.frameNumber != static_cast<int32_t>(10 + index) ||
+                    !CheckFrame(info, pixels, width, height - static_cast<uint32_t>(index)))) {
+            printf("FAILED: frame %llu does not match what was written\n", static_cast<unsigned long long>(index));
+            passed = false;
+        }
+    }
+
+    // Destroying the ring removes its name, but not the reader's mapping.
+    writer.destroy();
+    if (reader.read(4, info, pixels) != screenshot::FRAME_READ) {
+        printf("FAILED: the ring was unmapped from the reader\n");
+        passed = false;
+    }
+    screenshot::FrameRingReader removed;
+    if (removed.open(name)) {
+        printf("FAILED: the ring %s was not removed\n", name);
+        passed = false;
+    }
+    return passed;
+}
+
+static bool CheckConcurrent(const char *name) {
+    const uint32_t width = 256, height = 128, slots = 2;
+    const int32_t frameCount = 2000;
+    screenshot::FrameRingWriter writer;
+    screenshot::FrameRingReader reader;
+    if (!writer.create(name, slots, 3 * width * height) || !reader.open(name)) {
+        printf("FAILED: could not create the ring %s\n", name);
+        return false;
+    }
+
+    std::atomic<bool> done(false);
+    std::thread writerThread([&] {
+        for (int32_t i = 0; i < frameCount; i++) WriteFrame(writer, i, width, height);
+        done = true;
+    });
+
+    screenshot::FrameInfo info;
+    std::vector<uint8_t> pixels;
+    uint64_t next = 0, read = 0, overwritten = 0, torn = 0;
+    while (next < static_cast<uint64_t>(frameCount)) {
+        bool const finished = done;
+        uint64_t const count = reader.getFrameCount();
+        if (next == count) {
+            if (finished && reader.getFrameCount() == count) break;
+            std::this_thread::yield();
+            continue;
+        }
+        screenshot::FrameReadResult const result = reader.read(next, info, pixels);
+        if (result == screenshot::FRAME_READ) {
+            read++;
+            if (info.index != next || !CheckFrame(info, pixels, width, height)) torn++;
+        } else {
+            overwritten++;
+        }
+        next++;
+    }
+    writerThread.join();
+
+    printf("Shared memory ring, %u slots, %d frames: %llu read, %llu overwritten\n", slots, frameCount,
+           static_cast<unsigned long long>(read), static_cast<unsigned long long>(overwritten));
+    if (torn != 0 || read + overwritten != static_cast<uint64_t>(frameCount)) {
+        printf("FAILED: %llu torn frames, %llu frames accounted for\n", static_cast<unsigned long long>(torn),
+               static_cast<unsigned long long>(read + overwritten));
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    const std::string name = "/vkscreenshot_test_" + std::to_string(getpid());
+    bool passed = CheckSequential(name.c_str());
+    passed = CheckConcurrent(name.c_str()) && passed;
+    printf(passed ? "PASSED\n" : "FAILED\n");
+    return passed ? 0 : 1;
+}
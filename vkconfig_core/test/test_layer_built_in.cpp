@@ -302,7 +302,7 @@ TEST(test_layer_built_in, layer_latest_api_dump) {
 TEST(test_layer_built_in, layer_latest_device_simulation) {
     Layer layer;
     EXPECT_TRUE(layer.Load(":/layers/latest/VK_LAYER_LUNARG_device_simulation.json", LAYER_TYPE_EXPLICIT));
-    EXPECT_EQ(6, layer.settings.Size());
+    EXPECT_EQ(10, layer.settings.Size());
     EXPECT_EQ(3, layer.presets.size());
 }
 
@@ -323,6 +323,6 @@ TEST(test_layer_built_in, layer_latest_monitor) {
 TEST(test_layer_built_in, layer_latest_screenshot) {
     Layer layer;
     EXPECT_TRUE(layer.Load(":/layers/latest/VK_LAYER_LUNARG_screenshot.json", LAYER_TYPE_EXPLICIT));
-    EXPECT_EQ(3, layer.settings.Size());
+    EXPECT_EQ(22, layer.settings.Size());
     EXPECT_EQ(0, layer.presets.size());
 }